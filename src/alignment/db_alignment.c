@@ -33,10 +33,12 @@ static size_t db_alignment_from_read(dBAlignment *aln, const read_t *r,
   size_t contig_start, contig_end = 0, search_start = 0;
   const size_t kmer_size = db_graph->kmer_size;
 
-  BinaryKmer bkmer, tmp_key;
+  BinaryKmer bkmer, bkmers[HASH_BATCH_SIZE];
+  RollHasher roller;
+  RollHash rhash = {.fw = 0, .rc = 0}, rhashes[HASH_BATCH_SIZE];
+  dBNode found[HASH_BATCH_SIZE];
   Nucleotide nuc;
-  hkey_t node;
-  size_t i, offset, nxtbse;
+  size_t i, j, m, offset, nxtbse;
 
   dBNodeBuffer *nodes = &aln->nodes;
   Int32Buffer *rpos = &aln->rpos;
@@ -47,6 +49,8 @@ static size_t db_alignment_from_read(dBAlignment *aln, const read_t *r,
   db_node_buf_capacity(nodes, n + r->seq.end);
   int32_buf_capacity(rpos, n + r->seq.end);
 
+  if(BINARY_KMER_ROLL_HASH) roll_hash_init(&roller, kmer_size, NUM_BKMER_WORDS);
+
   while((contig_start = seq_contig_start(r, search_start, kmer_size,
                                          qcutoff, hp_cutoff)) < r->seq.end)
   {
@@ -58,21 +62,34 @@ static size_t db_alignment_from_read(dBAlignment *aln, const read_t *r,
 
     bkmer = binary_kmer_from_str(contig, kmer_size);
     bkmer = binary_kmer_right_shift_one_base(bkmer);
+    if(BINARY_KMER_ROLL_HASH) rhash = binary_kmer_roll_hash(bkmer, kmer_size);
 
-    for(offset=contig_start, nxtbse=kmer_size-1; nxtbse < contig_len; nxtbse++,offset++)
+    // Look up kmers in batches so hash table buckets can be prefetched
+    for(offset=contig_start, nxtbse=kmer_size-1; nxtbse < contig_len; offset+=m)
     {
-      nuc = dna_char_to_nuc(contig[nxtbse]);
-      bkmer = binary_kmer_left_shift_add(bkmer, kmer_size, nuc);
-      tmp_key = binary_kmer_get_key(bkmer, kmer_size);
-      node = hash_table_find(&db_graph->ht, tmp_key);
+      for(m = 0; m < HASH_BATCH_SIZE && nxtbse < contig_len; m++, nxtbse++) {
+        nuc = dna_char_to_nuc(contig[nxtbse]);
+        if(BINARY_KMER_ROLL_HASH) {
+          roll_hash_shift(&roller, &rhash,
+                          binary_kmer_first_nuc(bkmer, kmer_size), nuc);
+          rhashes[m] = rhash;
+        }
+        bkmer = binary_kmer_left_shift_add(bkmer, kmer_size, nuc);
+        bkmers[m] = bkmer;
+      }
+
+      db_graph_find_nodes(db_graph, bkmers,
+                          BINARY_KMER_ROLL_HASH ? rhashes : NULL, m, found);
 
-      if(node != HASH_NOT_FOUND &&
-         (colour == -1 || db_node_has_col(db_graph, node, colour)))
+      for(j = 0; j < m; j++)
       {
-        nodes->b[n].key = node;
-        nodes->b[n].orient = bkmer_get_orientation(bkmer, tmp_key);
-        rpos->b[n] = offset;
-        n++;
+        if(found[j].key != HASH_NOT_FOUND &&
+           (colour == -1 || db_node_has_col(db_graph, found[j].key, colour)))
+        {
+          nodes->b[n] = found[j];
+          rpos->b[n] = offset + j;
+          n++;
+        }
       }
     }
   }
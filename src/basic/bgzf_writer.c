@@ -0,0 +1,131 @@
+#include "global.h"
+#include "bgzf_writer.h"
+#include "file_util.h"
+
+// Block header: gzip magic, deflate, FEXTRA flag, no mtime, unknown OS, then a
+// 6 byte extra field 'BC' holding the block size minus one
+#define BGZF_HDR_LEN 18
+#define BGZF_FTR_LEN 8 // CRC32 and input size
+
+static const uint8_t bgzf_hdr[BGZF_HDR_LEN-2]
+  = {0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0};
+
+// Empty block marking the end of a file
+static const uint8_t bgzf_eof[28]
+  = {0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0,
+     0x1b, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+static inline void bgzf_put_u16(uint8_t *ptr, uint16_t x)
+{
+  ptr[0] = x & 0xff; ptr[1] = x >> 8;
+}
+
+static inline void bgzf_put_u32(uint8_t *ptr, uint32_t x)
+{
+  bgzf_put_u16(ptr, x & 0xffff); bgzf_put_u16(ptr+2, x >> 16);
+}
+
+void bgzf_writer_open(BgzfWriter *wtr, const char *path)
+{
+  wtr->fh = futil_fopen_create(path, "w");
+  wtr->path = path;
+  if(pthread_mutex_init(&wtr->lock, NULL) != 0) die("Mutex init failed");
+}
+
+void bgzf_writer_close(BgzfWriter *wtr)
+{
+  if(fwrite(bgzf_eof, 1, sizeof(bgzf_eof), wtr->fh) != sizeof(bgzf_eof))
+    die("Cannot write to file: %s", futil_outpath_str(wtr->path));
+  futil_fclose(wtr->fh);
+  pthread_mutex_destroy(&wtr->lock);
+  memset(wtr, 0, sizeof(BgzfWriter));
+}
+
+void bgzf_compressor_alloc(BgzfCompressor *cmp)
+{
+  memset(cmp, 0, sizeof(BgzfCompressor));
+  // Raw deflate (negative window bits): we write the gzip wrapper ourselves
+  if(deflateInit2(&cmp->strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8,
+                  Z_DEFAULT_STRATEGY) != Z_OK) {
+    die("Cannot initialise zlib: %s", cmp->strm.msg ? cmp->strm.msg : "");
+  }
+  cmp->size = 4 * BGZF_MAX_BLOCK_SIZE;
+  cmp->b = ctx_malloc(cmp->size);
+}
+
+void bgzf_compressor_dealloc(BgzfCompressor *cmp)
+{
+  deflateEnd(&cmp->strm);
+  ctx_free(cmp->b);
+  memset(cmp, 0, sizeof(BgzfCompressor));
+}
+
+// Compress up to BGZF_BLOCK_SIZE bytes into a block appended to cmp->b
+// Returns number of bytes of input used
+static size_t bgzf_compress_block(BgzfCompressor *cmp,
+                                  const uint8_t *in, size_t len)
+{
+  z_stream *strm = &cmp->strm;
+  uint8_t *out;
+  size_t bsize;
+  int ret;
+
+  if(cmp->len + BGZF_MAX_BLOCK_SIZE > cmp->size) {
+    cmp->size = 2 * (cmp->len + BGZF_MAX_BLOCK_SIZE);
+    cmp->b = ctx_realloc(cmp->b, cmp->size);
+  }
+
+  out = cmp->b + cmp->len;
+  len = MIN2(len, BGZF_BLOCK_SIZE);
+
+  // Input that doesn't compress may not fit in a block: retry with less
+  while(1) {
+    deflateReset(strm);
+    strm->next_in = (Bytef*)in;
+    strm->avail_in = len;
+    strm->next_out = out + BGZF_HDR_LEN;
+    strm->avail_out = BGZF_MAX_BLOCK_SIZE - BGZF_HDR_LEN - BGZF_FTR_LEN;
+    ret = deflate(strm, Z_FINISH);
+    if(ret == Z_STREAM_END) break;
+    if(ret != Z_OK && ret != Z_BUF_ERROR)
+      die("zlib deflate failed [%i]: %s", ret, strm->msg ? strm->msg : "");
+    ctx_assert(len > 1024);
+    len -= 1024;
+  }
+
+  bsize = BGZF_HDR_LEN + strm->total_out + BGZF_FTR_LEN;
+  memcpy(out, bgzf_hdr, sizeof(bgzf_hdr));
+  bgzf_put_u16(out + BGZF_HDR_LEN - 2, bsize - 1);
+  bgzf_put_u32(out + bsize - 8, crc32(crc32(0L, NULL, 0), in, len));
+  bgzf_put_u32(out + bsize - 4, len);
+
+  cmp->len += bsize;
+  return len;
+}
+
+void bgzf_write(BgzfWriter *wtr, BgzfCompressor *cmp,
+                const void *buf, size_t len)
+{
+  const uint8_t *in = (const uint8_t*)buf;
+  size_t n;
+
+  // Compress without holding the lock
+  for(cmp->len = 0; len > 0; in += n, len -= n)
+    n = bgzf_compress_block(cmp, in, len);
+
+  if(cmp->len == 0) return;
+
+  pthread_mutex_lock(&wtr->lock);
+  n = fwrite(cmp->b, 1, cmp->len, wtr->fh);
+  pthread_mutex_unlock(&wtr->lock);
+
+  if(n != cmp->len)
+    die("Cannot write to file: %s", futil_outpath_str(wtr->path));
+  cmp->len = 0;
+}
+
+void bgzf_write_strbuf(BgzfWriter *wtr, BgzfCompressor *cmp, StrBuf *sbuf)
+{
+  bgzf_write(wtr, cmp, sbuf->b, sbuf->end);
+  strbuf_reset(sbuf);
+}
@@ -0,0 +1,59 @@
+#ifndef BGZF_WRITER_H_
+#define BGZF_WRITER_H_
+
+//
+// Multithreaded gzip output as independent blocks (BGZF)
+//
+// Output is a series of gzip members, each compressed from at most
+// BGZF_BLOCK_SIZE bytes and recording its own size in a header field, as in
+// BGZF (see the SAM/BAM spec). Concatenated gzip members are a valid gzip file,
+// so output is read as before with zlib or gunzip, and blocks can be found
+// without decompressing. Each thread compresses its own output with a
+// BgzfCompressor; the writer lock is only held to append finished blocks.
+//
+// Record order is not deterministic with more than one thread: the blocks from
+// each bgzf_write() call are contiguous and in order, but calls from different
+// threads are appended in the order they finish compressing. Callers that need
+// a fixed order must sort their output, or write it from a single thread.
+//
+
+#include <zlib.h>
+#include <pthread.h>
+#include "string_buffer/string_buffer.h"
+
+#define BGZF_BLOCK_SIZE 0xff00 // max bytes of input per block
+#define BGZF_MAX_BLOCK_SIZE 0x10000 // max bytes of a compressed block
+
+typedef struct
+{
+  FILE *fh;
+  const char *path;
+  pthread_mutex_t lock;
+} BgzfWriter;
+
+typedef struct
+{
+  z_stream strm;
+  uint8_t *b; // compressed blocks waiting to be written
+  size_t len, size;
+} BgzfCompressor;
+
+// Create and open `path` for writing, "-" for STDOUT
+void bgzf_writer_open(BgzfWriter *wtr, const char *path);
+
+// Write the empty block that marks the end of a BGZF file, then close
+void bgzf_writer_close(BgzfWriter *wtr);
+
+void bgzf_compressor_alloc(BgzfCompressor *cmp);
+void bgzf_compressor_dealloc(BgzfCompressor *cmp);
+
+// Compress `len` bytes of `buf` into blocks, then append them to the file.
+// Threadsafe as long as each thread uses its own compressor. `buf` is never
+// split by output from other threads, but see above on ordering between them.
+void bgzf_write(BgzfWriter *wtr, BgzfCompressor *cmp,
+                const void *buf, size_t len);
+
+// Write a string buffer with bgzf_write() then reset it
+void bgzf_write_strbuf(BgzfWriter *wtr, BgzfCompressor *cmp, StrBuf *sbuf);
+
+#endif /* BGZF_WRITER_H_ */
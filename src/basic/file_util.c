@@ -308,24 +308,29 @@ bool futil_path_has_extension(const char *path, const char *ext)
 FILE** futil_create_tmp_files(size_t num_tmp_files)
 {
   size_t i;
+  FILE **tmp_files = ctx_malloc(num_tmp_files * sizeof(FILE*));
+  for(i = 0; i < num_tmp_files; i++) tmp_files[i] = futil_create_tmp_file(NULL);
+  return tmp_files;
+}
+
+// Temporary file is opened "w+" and unlinked immediately
+FILE* futil_create_tmp_file(const char *dir)
+{
   StrBuf tmppath;
   strbuf_alloc(&tmppath, 1024);
-  FILE **tmp_files = ctx_malloc(num_tmp_files * sizeof(FILE*));
+  strbuf_sprintf(&tmppath, "%s/cortex.tmp.XXXXXX", dir ? dir : "/tmp");
 
-  int r = rand() & ((1<<20)-1);
+  int fd = mkstemp(tmppath.b);
+  if(fd < 0)
+    die("Cannot write temporary file: %s [%s]", tmppath.b, strerror(errno));
+  unlink(tmppath.b); // Immediately unlink to hide temp file
 
-  for(i = 0; i < num_tmp_files; i++)
-  {
-    strbuf_reset(&tmppath);
-    strbuf_sprintf(&tmppath, "/tmp/cortex.tmp.%i.%zu", r, i);
-    if((tmp_files[i] = fopen(tmppath.b, "r+")) == NULL) {
-      die("Cannot write temporary file: %s [%s]", tmppath.b, strerror(errno));
-    }
-    unlink(tmppath.b); // Immediately unlink to hide temp file
-  }
-  strbuf_dealloc(&tmppath);
+  FILE *fh = fdopen(fd, "w+");
+  if(fh == NULL)
+    die("Cannot open temporary file: %s [%s]", tmppath.b, strerror(errno));
 
-  return tmp_files;
+  strbuf_dealloc(&tmppath);
+  return fh;
 }
 
 // Merge temporary files, closes tmp files
@@ -120,6 +120,10 @@ bool futil_path_has_extension(const char *path, const char *ext);
 //   ctx_free(tmp_files);
 FILE** futil_create_tmp_files(size_t num_tmp_files);
 
+// Create a temporary file in directory `dir` (/tmp if NULL), opened for
+// reading and writing. The file is unlinked so it is removed once closed.
+FILE* futil_create_tmp_file(const char *dir);
+
 // Merge temporary files, closes tmp files
 void futil_merge_tmp_files(FILE **tmp_files, size_t num_files, FILE *fout);
 
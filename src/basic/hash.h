@@ -17,7 +17,11 @@
 #else
   // Use Bob Jenkin's lookup3
   #include "misc/lookup3.h"
-  #define HASH_NAME_STR "Lookup3"
+  #if defined(USE_ROLL_HASH)
+    #define HASH_NAME_STR "Lookup3,RollHash"
+  #else
+    #define HASH_NAME_STR "Lookup3"
+  #endif
   #define ctx_hash32(src,n,rehash) lk3_hashlittle((src), (n), (rehash))
 
 static inline uint64_t ctx_hash64(void *ptr, size_t n, uint64_t init)
@@ -107,6 +107,7 @@ int ctx_breakpoints(int argc, char **argv)
 
   // Defaults
   if(nthreads == 0) nthreads = DEFAULT_NTHREADS;
+  alloc_large_set_nthreads(nthreads);
   if(min_ref_flank == 0) min_ref_flank = DEFAULT_MIN_REF_NKMERS;
   if(max_ref_flank == 0) max_ref_flank = DEFAULT_MAX_REF_NKMERS;
 
@@ -186,7 +187,8 @@ int ctx_breakpoints(int argc, char **argv)
   //
   // Open output file
   //
-  gzFile gzout = futil_gzopen_create(output_file != NULL ? output_file : "-", "w");
+  BgzfWriter brkout;
+  bgzf_writer_open(&brkout, output_file != NULL ? output_file : "-");
 
   //
   // Set up memory
@@ -205,6 +207,7 @@ int ctx_breakpoints(int argc, char **argv)
   // Load graphs
   //
   GraphLoadingPrefs gprefs = graph_loading_prefs(&db_graph);
+  gprefs.nthreads = nthreads;
   gprefs.empty_colours = true;
 
   for(i = 0; i < num_gfiles; i++) {
@@ -221,7 +224,11 @@ int ctx_breakpoints(int argc, char **argv)
 
   // Load link files
   for(i = 0; i < gpfiles.len; i++)
-    gpath_reader_load(&gpfiles.b[i], true, &db_graph);
+    gpath_reader_load(&gpfiles.b[i], GPATH_DIE_MISSING_KMERS, nthreads,
+                      &db_graph);
+
+  // Links are now read only
+  gpath_store_compact(&db_graph.gpstore);
 
   // Get array of sequence file paths
   size_t num_seq_paths = sfilebuf.len;
@@ -251,7 +258,7 @@ int ctx_breakpoints(int argc, char **argv)
 
   // Call breakpoints. Put reference in last colour
   breakpoints_call(nthreads, ncols-1,
-                   gzout, output_file,
+                   &brkout, output_file,
                    rbuf.b, rbuf.len,
                    seq_paths, num_seq_paths,
                    load_ref_edges, min_ref_flank, max_ref_flank,
@@ -259,7 +266,7 @@ int ctx_breakpoints(int argc, char **argv)
                    &db_graph);
 
   // Finished: do clean up
-  gzclose(gzout);
+  bgzf_writer_close(&brkout);
   ctx_free(hdrs);
 
   // Close input files
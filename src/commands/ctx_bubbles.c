@@ -113,6 +113,7 @@ int ctx_bubbles(int argc, char **argv)
   // Defaults for unset values
   if(out_path == NULL) out_path = "-";
   if(nthreads == 0) nthreads = DEFAULT_NTHREADS;
+  alloc_large_set_nthreads(nthreads);
   if(max_allele_len == 0) max_allele_len = DEFAULT_MAX_ALLELE;
   if(max_flank_len == 0) max_flank_len = DEFAULT_MAX_FLANK;
 
@@ -155,9 +156,12 @@ int ctx_bubbles(int argc, char **argv)
   // edges(1bytes) + kmer_paths(8bytes) + in_colour(1bit/col) +
   // visitedfw/rv(2bits/thread)
 
+  // Keep edges and colour bits of a node together (see db_graph.h)
+  int node_recs = ncols <= DBG_NODE_RECORDS_MAX_COLS ? DBG_ALLOC_NODE_RECORDS : 0;
+
   bits_per_kmer = sizeof(BinaryKmer)*8 + sizeof(Edges)*8 +
                   (gpfiles.len > 0 ? sizeof(GPath*)*8 : 0) +
-                  ncols + 2*nthreads;
+                  (node_recs ? 8 : ncols) + 2*nthreads;
 
   kmers_in_hash = cmd_get_kmers_in_hash(memargs.mem_to_use,
                                         memargs.mem_to_use_set,
@@ -189,12 +193,13 @@ int ctx_bubbles(int argc, char **argv)
   //
   // Open output file
   //
-  gzFile gzout = futil_gzopen_create(out_path, "w");
+  BgzfWriter bubout;
+  bgzf_writer_open(&bubout, out_path);
 
   // Allocate memory
   dBGraph db_graph;
   db_graph_alloc(&db_graph, gfiles[0].hdr.kmer_size, ncols, 1, kmers_in_hash,
-                 DBG_ALLOC_EDGES | DBG_ALLOC_NODE_IN_COL);
+                 DBG_ALLOC_EDGES | DBG_ALLOC_NODE_IN_COL | node_recs);
 
   // Paths
   gpath_reader_alloc_gpstore(gpfiles.b, gpfiles.len, path_mem, false, &db_graph);
@@ -203,6 +208,7 @@ int ctx_bubbles(int argc, char **argv)
   // Load graphs
   //
   GraphLoadingPrefs gprefs = graph_loading_prefs(&db_graph);
+  gprefs.nthreads = nthreads;
   gprefs.empty_colours = true;
 
   for(i = 0; i < num_gfiles; i++) {
@@ -216,7 +222,11 @@ int ctx_bubbles(int argc, char **argv)
 
   // Load link files
   for(i = 0; i < gpfiles.len; i++)
-    gpath_reader_load(&gpfiles.b[i], GPATH_DIE_MISSING_KMERS, &db_graph);
+    gpath_reader_load(&gpfiles.b[i], GPATH_DIE_MISSING_KMERS, nthreads,
+                      &db_graph);
+
+  // Links are now read only
+  gpath_store_compact(&db_graph.gpstore);
 
   // Create array of cJSON** from input files
   cJSON **hdrs = ctx_malloc(gpfiles.len * sizeof(cJSON*));
@@ -230,12 +240,12 @@ int ctx_bubbles(int argc, char **argv)
                                    .remove_serial_bubbles = remove_serial_bubbles};
 
   invoke_bubble_caller(nthreads, &call_prefs,
-                       gzout, out_path,
+                       &bubout, out_path,
                        hdrs, gpfiles.len,
                        &db_graph);
 
   status("  saved to: %s\n", out_path);
-  gzclose(gzout);
+  bgzf_writer_close(&bubout);
   ctx_free(hdrs);
 
   // Close input link files
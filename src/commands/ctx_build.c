@@ -7,6 +7,8 @@
 #include "graphs_load.h"
 #include "graph_writer.h"
 #include "build_graph.h"
+#include "build_graph_parts.h"
+#include "graph_image.h"
 
 #include "seq_file/seq_file.h"
 
@@ -39,6 +41,16 @@ const char build_usage[] =
 "                           graphs will be merged, not intersected. Treated as\n"
 "                           single colour graphs.\n"
 "  -S, --sort               Output a graph file ordered by kmer\n"
+"  -X, --image <out.cti>    Also save a graph image for fast loading (mmap)\n"
+"  -c, --min-count <N>      Only add kmers seen at least <N> times (2-"QUOTE_VALUE(KMER_BLOOM_MAX_COUNT)")\n"
+"  -B, --bloom-mem <mem>    Memory for counting kmers with --min-count, taken\n"
+"                           from --memory [default: 1/4 of --memory]\n"
+"  -D, --partitions <P>     Build out-of-core in <P> partitions (implies --sort)\n"
+"  -T, --tmp <dir>          Directory for temporary files [default: output dir]\n"
+"  -e, --estimate <N>       Sample <N> bases of input to estimate the number of\n"
+"                           kmers and size the hash table [default: 1G, 0: off]\n"
+"  -G, --no-grow            Exit if the hash table fills instead of growing it\n"
+"  -C, --small-covgs        Store coverages in 8 bits, larger counts in a table\n"
 "\n"
 "  Note: Argument must come before input file\n"
 "  PCR duplicate removal works by ignoring read (pairs) if (both) reads\n"
@@ -47,6 +59,22 @@ const char build_usage[] =
 "  Consecutive sequence options are loaded into the same colour.\n"
 "  --graph argument can have colours specifed e.g. in.ctx:0,6-8 will load\n"
 "  samples 0,6,7,8.  Graphs are loaded into new colours.\n"
+"  --min-count counts kmers in a Bloom filter before adding them to the graph,\n"
+"  so kmers from sequencing errors don't need space in the hash table. Counts\n"
+"  are approximate and pooled across samples. Edges seen before a kmer reaches\n"
+"  <N> are not added. Cannot be used with --remove-pcr or --intersect.\n"
+"  --partitions splits reads into partitions on disk by minimizer, then builds\n"
+"  each partition in turn, so the hash table only needs to hold about 1/<P> of\n"
+"  the kmers. Cannot be used with --remove-pcr, --intersect, --graph, --image\n"
+"  or --min-count.\n"
+"  Unless -n is given, the number of distinct kmers in sequence input is\n"
+"  estimated with a HyperLogLog sketch of the first bases of each file, to\n"
+"  avoid allocating more memory than needed.\n"
+"  If the hash table fills while loading sequence it is doubled in size, which\n"
+"  may use more than --memory (old and new tables exist while growing).\n"
+"  --small-covgs saves 3 bytes per kmer per colour when most coverages are\n"
+"  under 255. Counts of 255 or more take ~20 bytes each, not included in\n"
+"  --memory. Cannot be used with --intersect or --image.\n"
 "  See `"CMD" join` to combine .ctx files\n"
 "\n";
 
@@ -73,6 +101,14 @@ static struct option longopts[] =
   {"keep-pcr",     no_argument,       NULL, 'P'},
   {"graph",        required_argument, NULL, 'g'},
   {"intersect",    required_argument, NULL, 'I'},
+  {"image",        required_argument, NULL, 'X'},
+  {"min-count",    required_argument, NULL, 'c'},
+  {"bloom-mem",    required_argument, NULL, 'B'},
+  {"partitions",   required_argument, NULL, 'D'},
+  {"tmp",          required_argument, NULL, 'T'},
+  {"estimate",     required_argument, NULL, 'e'},
+  {"no-grow",      no_argument,       NULL, 'G'},
+  {"small-covgs",  no_argument,       NULL, 'C'},
   {NULL, 0, NULL, 0}
 };
 
@@ -91,11 +127,29 @@ static SampleNameBuffer snamebuf;
 static size_t nthreads = 0;
 static struct MemArgs memargs = MEM_ARGS_INIT;
 
-static char *out_path = NULL;
+static char *out_path = NULL, *image_path = NULL;
 static size_t output_colours = 0, kmer_size = 0;
 
 static bool sort_kmers = false;
 
+// Only add kmers seen min_count times (if > 1), counted in a Bloom filter
+static size_t min_count = 0, bloom_mem = 0;
+
+// Build out-of-core in nparts partitions (if > 1)
+static size_t nparts = 0;
+static const char *tmp_dir = NULL;
+
+// Bases to sample from input to estimate the number of kmers
+#define DEFAULT_EST_BASES (1UL<<30)
+static size_t est_bases = DEFAULT_EST_BASES;
+static bool est_bases_set = false;
+
+// Double the hash table when it fills instead of exiting
+static bool grow_table = true;
+
+// Store coverages in 8 bit counters
+static bool small_covgs = false;
+
 static void add_task(BuildGraphTask *task)
 {
   uint8_t fq_offset = task->files.fq_offset, fq_cutoff = task->prefs.fq_cutoff;
@@ -164,6 +218,18 @@ static void parse_args(int argc, char **argv)
         sample_named = true;
         break;
       case 'S': cmd_check(!sort_kmers,cmd); sort_kmers = true; break;
+      case 'X': cmd_check(!image_path,cmd); image_path = optarg; break;
+      case 'c': cmd_check(!min_count,cmd); min_count = cmd_uint32_nonzero(cmd, optarg); break;
+      case 'B': cmd_check(!bloom_mem,cmd); bloom_mem = cmd_parse_arg_mem(cmd, optarg); break;
+      case 'D': cmd_check(!nparts,cmd); nparts = cmd_uint32_nonzero(cmd, optarg); break;
+      case 'T': cmd_check(!tmp_dir,cmd); tmp_dir = optarg; break;
+      case 'G': cmd_check(grow_table,cmd); grow_table = false; break;
+      case 'C': cmd_check(!small_covgs,cmd); small_covgs = true; break;
+      case 'e':
+        cmd_check(!est_bases_set,cmd);
+        est_bases = cmd_parse_arg_mem(cmd, optarg);
+        est_bases_set = true;
+        break;
       case '1':
       case '2':
       case 'i':
@@ -212,6 +278,7 @@ static void parse_args(int argc, char **argv)
 
   // Defaults
   if(!nthreads) nthreads = DEFAULT_NTHREADS;
+  alloc_large_set_nthreads(nthreads);
 
   // Check that optind+1 == argc
   if(optind+1 > argc)
@@ -228,6 +295,19 @@ static void parse_args(int argc, char **argv)
 
   if(!kmer_size) die("kmer size not set with -k <K>");
 
+  if(min_count > KMER_BLOOM_MAX_COUNT)
+    cmd_print_usage("--min-count must be <= %i", KMER_BLOOM_MAX_COUNT);
+  if(bloom_mem && min_count < 2)
+    cmd_print_usage("--bloom-mem requires --min-count <N> with N > 1");
+
+  if(nparts > BUILD_PARTS_MAX)
+    cmd_print_usage("--partitions must be <= %i", BUILD_PARTS_MAX);
+  if(tmp_dir && nparts < 2)
+    cmd_print_usage("--tmp requires --partitions <P> with P > 1");
+
+  if(small_covgs && image_path)
+    cmd_print_usage("Cannot use --small-covgs and --image");
+
   // Check kmer size in graphs to load
   size_t i;
   for(i = 0; i < gfilebuf.len; i++) {
@@ -282,10 +362,20 @@ int ctx_build(int argc, char **argv)
     }
   }
 
-  for(t = 0; t < ntasks; t++) {
-    size_t nkmers = asyncio_input_nkmers(&tasks[t].files);
-    if(nkmers == SIZE_MAX) { max_kmers = nkmers; break; }
-    max_kmers += nkmers;
+  // Estimate number of kmers in sequence input unless -n was given
+  size_t seq_kmers = SIZE_MAX;
+  if(ntasks > 0 && est_bases > 0 && !memargs.num_kmers_set && gisecbuf.len == 0)
+    seq_kmers = build_graph_estimate_nkmers(tasks, ntasks, kmer_size,
+                                            est_bases, nthreads);
+
+  if(seq_kmers != SIZE_MAX) max_kmers += seq_kmers;
+  else {
+    // Guess from file sizes
+    for(t = 0; t < ntasks; t++) {
+      size_t nkmers = asyncio_input_nkmers(&tasks[t].files);
+      if(nkmers == SIZE_MAX) { max_kmers = nkmers; break; }
+      max_kmers += nkmers;
+    }
   }
 
   // Check if we are intersecting with graphs
@@ -293,6 +383,8 @@ int ctx_build(int argc, char **argv)
   {
     if(remove_pcr_used)
       cmd_print_usage("Cannot use --remove-pcr and --intersect");
+    if(small_covgs)
+      cmd_print_usage("Cannot use --small-covgs and --intersect");
 
     for(t = 0; t < ntasks; t++)
       tasks[t].prefs.must_exist_in_graph = true;
@@ -302,37 +394,74 @@ int ctx_build(int argc, char **argv)
       max_kmers += gisecbuf.b[i].num_of_kmers;
   }
 
+  // Count kmers in a Bloom filter and only add them once seen min_count times
+  bool use_bloom = (min_count > 1);
+  if(use_bloom)
+  {
+    if(remove_pcr_used)
+      cmd_print_usage("Cannot use --min-count and --remove-pcr");
+    if(gisecbuf.len > 0)
+      cmd_print_usage("Cannot use --min-count and --intersect");
+    if(!bloom_mem) bloom_mem = memargs.mem_to_use / 4;
+    if(bloom_mem >= memargs.mem_to_use)
+      cmd_print_usage("--bloom-mem must be less than --memory");
+  }
+  else bloom_mem = 0;
+
+  // Build partitions one at a time, output is always sorted
+  bool use_parts = (nparts > 1);
+  if(use_parts)
+  {
+    if(remove_pcr_used)
+      cmd_print_usage("Cannot use --partitions and --remove-pcr");
+    if(gisecbuf.len > 0)
+      cmd_print_usage("Cannot use --partitions and --intersect");
+    if(gfilebuf.len > 0)
+      cmd_print_usage("Cannot use --partitions and --graph");
+    if(image_path)
+      cmd_print_usage("Cannot use --partitions and --image");
+    if(use_bloom)
+      cmd_print_usage("Cannot use --partitions and --min-count");
+    sort_kmers = true;
+    // Allow for uneven partitions
+    if(max_kmers != SIZE_MAX) max_kmers = (max_kmers * 2) / nparts;
+  }
+
   //
   // Decide on memory
   //
   size_t bits_per_kmer, kmers_in_hash, graph_mem;
 
   // remove_pcr_dups requires a fw and rv bit per kmer
+  size_t covg_bytes = small_covgs ? sizeof(uint8_t) : sizeof(Covg);
   bits_per_kmer = sizeof(BinaryKmer)*8 +
-                  (sizeof(Covg) + sizeof(Edges)) * 8 * output_colours +
+                  (covg_bytes + sizeof(Edges)) * 8 * output_colours +
                   (gisecbuf.len > 0 ? sizeof(Edges)*8 : 0) +
                   (remove_pcr_used ? 2 : 0) +
                   (sort_kmers ? sizeof(hkey_t)*8 : 0);
 
-  kmers_in_hash = cmd_get_kmers_in_hash(memargs.mem_to_use,
+  kmers_in_hash = cmd_get_kmers_in_hash(memargs.mem_to_use - bloom_mem,
                                         memargs.mem_to_use_set,
                                         memargs.num_kmers,
                                         memargs.num_kmers_set,
                                         bits_per_kmer, 0, max_kmers,
                                         true, &graph_mem);
 
-  cmd_check_mem_limit(memargs.mem_to_use, graph_mem);
+  cmd_check_mem_limit(memargs.mem_to_use, graph_mem + bloom_mem);
 
   //
   // Check output path
   //
   futil_create_output(out_path);
+  futil_create_output(image_path);
 
   status("Writing %zu colour graph to %s\n", output_colours, futil_outpath_str(out_path));
 
   // Create db_graph
   dBGraph db_graph;
-  int alloc_flags = DBG_ALLOC_EDGES | DBG_ALLOC_COVGS | DBG_ALLOC_BKTLOCKS |
+  // No bucket locks: reads are added with lock-free inserts
+  int alloc_flags = DBG_ALLOC_EDGES | DBG_ALLOC_COVGS |
+                    (small_covgs ? DBG_ALLOC_SMALL_COVGS : 0) |
                     (remove_pcr_used ? DBG_ALLOC_READSTRT : 0);
 
   db_graph_alloc(&db_graph, kmer_size, output_colours, output_colours,
@@ -344,10 +473,30 @@ int ctx_build(int argc, char **argv)
 
   hash_table_print_stats(&db_graph.ht);
 
+  KmerBloom bloom;
+  if(use_bloom) {
+    kmer_bloom_alloc(&bloom, bloom_mem, min_count);
+    for(t = 0; t < ntasks; t++) tasks[t].prefs.bloom = &bloom;
+  }
+
+  BuildGraphParts parts;
+  StrBuf tmp_dir_buf;
+  strbuf_alloc(&tmp_dir_buf, 256);
+  if(use_parts) {
+    // Temporary files go next to the output by default
+    if(tmp_dir == NULL) {
+      if(strcmp(out_path, "-") == 0) strbuf_set(&tmp_dir_buf, "/tmp");
+      else futil_get_strbuf_of_dir_path(out_path, &tmp_dir_buf);
+      tmp_dir = tmp_dir_buf.b;
+    }
+    build_graph_parts_alloc(&parts, nparts, kmer_size, tmp_dir);
+  }
+
   // Load intersection graphs
   if(gisecbuf.len > 0)
   {
     GraphLoadingPrefs gprefs = graph_loading_prefs(&db_graph);
+    gprefs.nthreads = nthreads;
     Covg *tmp_covgs = NULL;
     SWAP(db_graph.col_covgs, tmp_covgs);
     SWAP(db_graph.col_edges, isec_edges); db_graph.num_edge_cols = 1;
@@ -366,6 +515,7 @@ int ctx_build(int argc, char **argv)
   if(gfilebuf.len > 0)
   {
     GraphLoadingPrefs gprefs = graph_loading_prefs(&db_graph);
+    gprefs.nthreads = nthreads;
     gprefs.must_exist_in_graph = (gisecbuf.len > 0);
     gprefs.must_exist_in_edges = isec_edges;
 
@@ -383,6 +533,11 @@ int ctx_build(int argc, char **argv)
 
   size_t start, end, num_load, colour, prev_colour = 0;
 
+  // Grow the hash table if it fills while loading sequence. No kmers are added
+  // when intersecting
+  if(grow_table && gisecbuf.len == 0)
+    db_graph_set_growable(&db_graph, nthreads);
+
   // If we are using PCR duplicate removal,
   // it's best to load one colour at a time
   for(start = 0; start < ntasks; start = end, prev_colour = colour)
@@ -392,7 +547,8 @@ int ctx_build(int argc, char **argv)
     if(remove_pcr_used)
     {
       if(colour != prev_colour)
-        memset(db_graph.readstrt, 0, roundup_bits2bytes(db_graph.ht.capacity)*2);
+        util_memset_mt(db_graph.readstrt, 0,
+                       roundup_bits2bytes(db_graph.ht.capacity)*2, nthreads);
 
       end = start+1;
       while(end < ntasks && end-start < MAX_IO_THREADS &&
@@ -403,9 +559,15 @@ int ctx_build(int argc, char **argv)
     }
 
     num_load = end-start;
-    build_graph(&db_graph, tasks+start, num_load, nthreads);
+    if(use_parts)
+      build_graph_parts_load(&parts, &db_graph, tasks+start, num_load, nthreads);
+    else
+      build_graph(&db_graph, tasks+start, num_load, nthreads);
   }
 
+  // Partitions are built in the same hash table, so it may still grow
+  if(!use_parts) db_graph_set_growable(&db_graph, 0);
+
   // Remove kmers with no coverage
   if(gisecbuf.len > 0) {
     db_graph_remove_no_covg_kmers(&db_graph, nthreads);
@@ -415,21 +577,48 @@ int ctx_build(int argc, char **argv)
   // Print stats for hash table
   hash_table_print_stats(&db_graph.ht);
 
+  if(small_covgs && !use_parts) {
+    char novf_str[50];
+    ulong_to_str(covg_ovf_size(&db_graph.covg_ovf), novf_str);
+    status("[covgs] %s coverages too large for 8 bits", novf_str);
+  }
+
   // Print stats per input file
   for(i = 0; i < ntasks; i++) {
     build_graph_task_print_stats(&tasks[i]);
     build_graph_task_destroy(&tasks[i]);
   }
 
-  status("Dumping graph...\n");
-  graph_writer_save_mkhdr(out_path, &db_graph, sort_kmers, output_colours);
+  if(use_parts)
+  {
+    // Header is taken before the graph is emptied to build each partition
+    FileFilter fltr;
+    memset(&fltr, 0, sizeof(fltr));
+    file_filter_create_direct(&fltr, db_graph.num_of_cols, output_colours);
+    GraphFileHeader *hdr = graph_writer_mkhdr(&db_graph, &fltr, output_colours);
+
+    build_graph_parts_save(&parts, &db_graph, hdr, nthreads, out_path);
+    db_graph_set_growable(&db_graph, 0);
+    build_graph_parts_dealloc(&parts);
+
+    graph_header_free(hdr);
+    file_filter_close(&fltr);
+  }
+  else {
+    status("Dumping graph...\n");
+    graph_writer_save_mkhdr(out_path, &db_graph, sort_kmers, output_colours);
+  }
+
+  if(image_path) graph_image_save(image_path, &db_graph, NULL);
 
   build_graph_task_buf_dealloc(&gtaskbuf);
   gfile_buf_dealloc(&gfilebuf);
   gfile_buf_dealloc(&gisecbuf);
   sample_name_buf_dealloc(&snamebuf);
+  strbuf_dealloc(&tmp_dir_buf);
 
   ctx_free(isec_edges);
+  if(use_bloom) kmer_bloom_dealloc(&bloom);
   db_graph_dealloc(&db_graph);
 
   return EXIT_SUCCESS;
@@ -6,6 +6,7 @@
 #include "graph_info.h"
 #include "graphs_load.h"
 #include "graph_writer.h"
+#include "graph_image.h"
 #include "clean_graph.h"
 #include "db_unitig.h" // for saving length histogram
 
@@ -25,6 +26,7 @@ const char clean_usage[] =
 "  -t, --threads <T>        Number of threads to use [default: "QUOTE_VALUE(DEFAULT_NTHREADS)"]\n"
 "  -N, --ncols <N>          Number of graph colours to use\n"
 "  -S, --sort               Output a graph file ordered by kmer\n"
+"  -X, --image <out.cti>    Also save a graph image for fast loading (mmap)\n"
 "\n"
 "  Cleaning:\n"
 "  -T[L], --tips[=L]        Clip tips shorter than <L> kmers [default: auto]\n"
@@ -53,6 +55,7 @@ static struct option longopts[] =
   {"threads",      required_argument, NULL, 't'},
   {"ncols",        required_argument, NULL, 'N'},
   {"sort",         no_argument,       NULL, 'S'},
+  {"image",        required_argument, NULL, 'X'},
 // command specific
   {"tips",         optional_argument, NULL, 'T'},
   {"unitigs",      optional_argument, NULL, 'U'},
@@ -134,7 +137,7 @@ int ctx_clean(int argc, char **argv)
 {
   size_t nthreads = 0;
   struct MemArgs memargs = MEM_ARGS_INIT;
-  const char *out_ctx_path = NULL;
+  const char *out_ctx_path = NULL, *image_path = NULL;
   bool sort_kmers = false;
   int min_keep_tip = -1, unitig_min = -1; // <0 => default, 0 => noclean
   bool unitig_cleaning = false, tip_cleaning = false;
@@ -174,6 +177,7 @@ int ctx_clean(int argc, char **argv)
         tip_cleaning = true;
         break;
       case 'S': cmd_check(!sort_kmers,cmd); sort_kmers = true; break;
+      case 'X': cmd_check(!image_path,cmd); image_path = optarg; break;
       case 'U':
         cmd_check(unitig_min<0, cmd);
         unitig_min = (optarg != NULL ? (int)cmd_uint32(cmd, optarg) : -1);
@@ -193,6 +197,7 @@ int ctx_clean(int argc, char **argv)
   }
 
   if(nthreads == 0) nthreads = DEFAULT_NTHREADS;
+  alloc_large_set_nthreads(nthreads);
 
   if(optind >= argc) cmd_print_usage("Please give input graph files");
 
@@ -211,6 +216,9 @@ int ctx_clean(int argc, char **argv)
     // warn("No cleaning being done: you did not specify --out <out.ctx>");
   }
 
+  if(image_path != NULL && out_ctx_path == NULL)
+    cmd_print_usage("--image <out.cti> requires --out <out.ctx>");
+
   if(!doing_cleaning && (covg_after_path || len_after_path)) {
     warn("You gave --len-after <out> / --covg-after <out> without "
          "any cleaning (set -U, --unitigs or -t, --tips)");
@@ -322,10 +330,17 @@ int ctx_clean(int argc, char **argv)
 
   cmd_check_mem_limit(memargs.mem_to_use, graph_mem);
 
+  // Graph image is a dump of the hash table, so needs all colours in memory
+  if(image_path != NULL && !all_colours_loaded) {
+    cmd_print_usage("Not enough memory to load all %zu colours for --image",
+                    file_ncols);
+  }
+
   //
   // Check output files are writable
   //
   futil_create_output(out_ctx_path);
+  futil_create_output(image_path);
 
   // Does nothing if arg is NULL
   futil_create_output(covg_before_path);
@@ -347,6 +362,7 @@ int ctx_clean(int argc, char **argv)
 
   // Load graph into a single colour
   GraphLoadingPrefs gprefs = graph_loading_prefs(&db_graph);
+  gprefs.nthreads = nthreads;
 
   // Construct cleaned graph header
   GraphFileHeader outhdr;
@@ -455,7 +471,10 @@ int ctx_clean(int argc, char **argv)
     graph_writer_merge(out_ctx_path, gfiles, num_gfiles,
                        true, all_colours_loaded,
                        edges_union, &outhdr,
-                       sort_kmers, &db_graph);
+                       sort_kmers, nthreads, &db_graph);
+
+    if(image_path != NULL)
+      graph_image_save(image_path, &db_graph, &outhdr);
   }
 
   ctx_check(hash_table_nkmers(&db_graph.ht) == hash_table_count_kmers(&db_graph.ht));
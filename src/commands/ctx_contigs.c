@@ -151,6 +151,7 @@ int ctx_contigs(int argc, char **argv)
 
   // Defaults
   if(nthreads == 0) nthreads = DEFAULT_NTHREADS;
+  alloc_large_set_nthreads(nthreads);
 
   if(!seed_buf.len && !contig_limit && sample_with_replacement) {
     cmd_print_usage("Please specify one or more of: "
@@ -195,9 +196,12 @@ int ctx_contigs(int argc, char **argv)
   //
   size_t bits_per_kmer, kmers_in_hash, graph_mem, path_mem, total_mem;
 
+  // Keep edges and colour bits of a node together (see db_graph.h)
+  int node_recs = ncols <= DBG_NODE_RECORDS_MAX_COLS ? DBG_ALLOC_NODE_RECORDS : 0;
+
   // 1 bit needed per kmer if we need to keep track of kmer usage
   bits_per_kmer = sizeof(BinaryKmer)*8 + sizeof(Edges)*8 + sizeof(GPath*)*8 +
-                  ncols + !sample_with_replacement;
+                  (node_recs ? 8 : ncols) + !sample_with_replacement;
 
   kmers_in_hash = cmd_get_kmers_in_hash(memargs.mem_to_use,
                                         memargs.mem_to_use_set,
@@ -252,7 +256,7 @@ int ctx_contigs(int argc, char **argv)
   // Allocate
   dBGraph db_graph;
   db_graph_alloc(&db_graph, gfiles[0].hdr.kmer_size, ncols, 1, kmers_in_hash,
-                 DBG_ALLOC_EDGES | DBG_ALLOC_NODE_IN_COL);
+                 DBG_ALLOC_EDGES | DBG_ALLOC_NODE_IN_COL | node_recs);
 
   // Paths
   gpath_reader_alloc_gpstore(gpfiles.b, gpfiles.len, path_mem,
@@ -265,6 +269,7 @@ int ctx_contigs(int argc, char **argv)
 
   // Load graph
   GraphLoadingPrefs gprefs = graph_loading_prefs(&db_graph);
+  gprefs.nthreads = nthreads;
   gprefs.empty_colours = true;
 
   for(i = 0; i < num_gfiles; i++) {
@@ -278,11 +283,15 @@ int ctx_contigs(int argc, char **argv)
 
   // Load link files
   for(i = 0; i < gpfiles.len; i++) {
-    gpath_reader_load(&gpfiles.b[i], GPATH_DIE_MISSING_KMERS, &db_graph);
+    gpath_reader_load(&gpfiles.b[i], GPATH_DIE_MISSING_KMERS, nthreads,
+                      &db_graph);
     gpath_reader_close(&gpfiles.b[i]);
   }
   gpfile_buf_dealloc(&gpfiles);
 
+  // Links are now read only
+  gpath_store_compact(&db_graph.gpstore);
+
   AssembleContigStats assem_stats;
   assemble_contigs_stats_init(&assem_stats);
 
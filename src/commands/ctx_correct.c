@@ -194,6 +194,7 @@ int ctx_correct(int argc, char **argv)
   // Load Graph and link files
   //
   GraphLoadingPrefs gprefs = graph_loading_prefs(&db_graph);
+  gprefs.nthreads = args.nthreads;
   gprefs.empty_colours = true;
 
   // Load graph, print stats, close file
@@ -203,10 +204,14 @@ int ctx_correct(int argc, char **argv)
 
   // Load link files
   for(i = 0; i < gpfiles->len; i++) {
-    gpath_reader_load(&gpfiles->b[i], GPATH_DIE_MISSING_KMERS, &db_graph);
+    gpath_reader_load(&gpfiles->b[i], GPATH_DIE_MISSING_KMERS, args.nthreads,
+                      &db_graph);
     gpath_reader_close(&gpfiles->b[i]);
   }
 
+  // Links are now read only
+  gpath_store_compact(&db_graph.gpstore);
+
   //
   // Run alignment
   //
@@ -59,6 +59,26 @@ static bool dist_matrix_thread(hkey_t hkey, size_t threadid, void *arg)
   return false; // keep iterating
 }
 
+// With colour classes, count each distinct set of colours once, weighted by
+// the number of kmers that have it
+static void dist_matrix_classes(const ColourClasses *cc, uint64_t *matrix)
+{
+  const size_t ncols = cc->ncols;
+  uint32_t *cols = ctx_calloc(ncols, sizeof(uint32_t));
+  size_t cls, i, j, n;
+  uint64_t nkmers;
+
+  for(cls = 0; cls < cc->nclasses; cls++) {
+    if((nkmers = cc->class_nkmers[cls]) == 0) continue;
+    n = colour_classes_get_cols(cc, cls, cols);
+    for(i = 0; i < n; i++)
+      for(j = i; j < n; j++)
+        matrix[ncols*cols[i]+cols[j]] += nkmers;
+  }
+
+  ctx_free(cols);
+}
+
 int ctx_dist_matrix(int argc, char **argv)
 {
   size_t nthreads = 0;
@@ -95,6 +115,7 @@ int ctx_dist_matrix(int argc, char **argv)
 
   // Defaults
   if(!nthreads) nthreads = DEFAULT_NTHREADS;
+  alloc_large_set_nthreads(nthreads);
 
   if(optind >= argc) cmd_print_usage("Require input graph files (.ctx)");
 
@@ -123,6 +144,9 @@ int ctx_dist_matrix(int argc, char **argv)
 
   bits_per_kmer = sizeof(BinaryKmer)*8 + ncols; // kmer + in colour
 
+  // colour class ids are built from the colour bits once loaded
+  if(ncols >= DBG_COL_CLASSES_MIN_COLS) bits_per_kmer += sizeof(uint32_t)*8;
+
   kmers_in_hash = cmd_get_kmers_in_hash(memargs.mem_to_use,
                                         memargs.mem_to_use_set,
                                         memargs.num_kmers,
@@ -155,6 +179,7 @@ int ctx_dist_matrix(int argc, char **argv)
   // Load graphs
   //
   GraphLoadingPrefs gprefs = graph_loading_prefs(&db_graph);
+  gprefs.nthreads = nthreads;
   gprefs.empty_colours = true;
 
   for(i = 0; i < num_gfiles; i++) {
@@ -167,9 +192,18 @@ int ctx_dist_matrix(int argc, char **argv)
   hash_table_print_stats(&db_graph.ht);
 
   // Generate matrix
-  status("[dist_matrix] Generating matrix between %zu colours with %zu thread%s",
-         ncols, nthreads, util_plural_str(nthreads));
-  hash_table_iterate(&db_graph.ht, nthreads, dist_matrix_thread, &workers);
+  if(db_graph_compress_colours(&db_graph))
+  {
+    status("[dist_matrix] Generating matrix between %zu colours from %zu "
+           "colour classes", ncols, db_graph.col_classes.nclasses);
+    dist_matrix_classes(&db_graph.col_classes, matrices[0]);
+  }
+  else
+  {
+    status("[dist_matrix] Generating matrix between %zu colours with %zu thread%s",
+           ncols, nthreads, util_plural_str(nthreads));
+    hash_table_iterate(&db_graph.ht, nthreads, dist_matrix_thread, &workers);
+  }
 
   // Merge matrices
   for(i = 1; i < nthreads; i++)
@@ -366,6 +366,7 @@ int ctx_exp_abc(int argc, char **argv)
 
   // Defaults
   if(nthreads == 0) nthreads = DEFAULT_NTHREADS;
+  alloc_large_set_nthreads(nthreads);
   if(num_repeats == 0) num_repeats = DEFAULT_NUM_REPEATS;
   if(max_AB_dist == 0) max_AB_dist = DEFAULT_MAX_AB_DIST;
 
@@ -444,11 +445,15 @@ int ctx_exp_abc(int argc, char **argv)
 
   // Load link files
   for(i = 0; i < gpfiles.len; i++) {
-    gpath_reader_load(&gpfiles.b[i], GPATH_DIE_MISSING_KMERS, &db_graph);
+    gpath_reader_load(&gpfiles.b[i], GPATH_DIE_MISSING_KMERS, nthreads,
+                      &db_graph);
     gpath_reader_close(&gpfiles.b[i]);
   }
   gpfile_buf_dealloc(&gpfiles);
 
+  // Links are now read only
+  gpath_store_compact(&db_graph.gpstore);
+
   status("\n");
   status("Test 1: Priming region A->B (n: %zu max_AB_dist: %zu)",
          num_repeats, max_AB_dist);
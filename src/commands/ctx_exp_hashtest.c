@@ -3,6 +3,19 @@
 #include "util.h"
 #include "db_graph.h"
 #include "binary_kmer.h"
+#include "build_graph.h"
+#include "covg_buffer.h"
+#include "gpath_hash.h"
+#include "gpath_batch.h"
+
+#include <sys/time.h> // gettimeofday()
+
+#ifdef __linux__
+  #include <linux/perf_event.h>
+  #include <sys/syscall.h>
+  #include <sys/ioctl.h>
+  #include <unistd.h>
+#endif
 
 const char exp_hashtest_usage[] =
 "usage: "CMD" hashtest [options] <num_ops>\n"
@@ -15,6 +28,19 @@ const char exp_hashtest_usage[] =
 "  -t, --threads <T> Number of threads to use [default: "QUOTE_VALUE(DEFAULT_NTHREADS)"]\n"
 "  -k, --kmer <K>    Kmer size must be odd ("QUOTE_VALUE(MAX_KMER_SIZE)" >= k >= "QUOTE_VALUE(MIN_KMER_SIZE)")\n"
 "  -F, --func-only   Only use the hash function, do not store kmers\n"
+"  -L, --locks       Use bucket locks instead of lock-free inserts\n"
+"  -S, --scaling     Time 1,2,4,..,T threads with bucket locks and lock-free\n"
+"  -P, --probe       Report lookups/sec per bucket occupancy for each bucket\n"
+"                    probe (scalar, SSE4.2, AVX2) and the tagged layout.\n"
+"                    <num_ops> lookups per test.\n"
+"  -T, --tags        Use the tagged hash table layout: bucket size and 8 bit\n"
+"                    kmer tags in one cache line per bucket\n"
+"  -C, --covg        Build <num_ops> bases of repetitive and random sequence\n"
+"                    with and without per-thread coverage buffers. Reports\n"
+"                    cache misses and cycles from perf counters (Linux).\n"
+"  -G, --links       Add <num_ops> links to the link hash used by `"CMD" thread`\n"
+"                    with 1,2,4,..,T threads, with and without per-thread\n"
+"                    batches, from repetitive and random sequence.\n"
 "\n";
 
 static struct option longopts[] =
@@ -27,12 +53,21 @@ static struct option longopts[] =
 // command specific
   {"kmer",         required_argument, NULL, 'k'},
   {"func-only",    no_argument,       NULL, 'F'},
+  {"locks",        no_argument,       NULL, 'L'},
+  {"scaling",      no_argument,       NULL, 'S'},
+  {"probe",        no_argument,       NULL, 'P'},
+  {"tags",         no_argument,       NULL, 'T'},
+  {"covg",         no_argument,       NULL, 'C'},
+  {"links",        no_argument,       NULL, 'G'},
   {NULL, 0, NULL, 0}
 };
 
+enum HashLoopType { HASH_LOOP_FUNC, HASH_LOOP_SINGLE,
+                    HASH_LOOP_LOCKS, HASH_LOOP_CAS };
+
 struct HashLoopJob {
   dBGraph *db_graph;
-  bool single_threaded;
+  enum HashLoopType type;
   size_t start, end;
   size_t hash; // return value
 };
@@ -47,32 +82,478 @@ static inline void hash_loop(void *arg, size_t threadid)
   bool found;
   uint32_t hash = 0;
 
-  if(j.db_graph && j.single_threaded) {
-    for(i = j.start; i < j.end; i++) {
-      bkmer.b[0] = i;
-      hash_table_find_or_insert(&j.db_graph->ht, bkmer, &found);
+  switch(j.type) {
+    case HASH_LOOP_SINGLE:
+      for(i = j.start; i < j.end; i++) {
+        bkmer.b[0] = i;
+        hash_table_find_or_insert(&j.db_graph->ht, bkmer, &found);
+      }
+      break;
+    case HASH_LOOP_LOCKS:
+      for(i = j.start; i < j.end; i++) {
+        bkmer.b[0] = i;
+        hash_table_find_or_insert_mt(&j.db_graph->ht, bkmer, &found,
+                                     j.db_graph->bktlocks);
+      }
+      break;
+    case HASH_LOOP_CAS:
+      for(i = j.start; i < j.end; i++) {
+        bkmer.b[0] = i;
+        hash_table_find_or_insert_cas(&j.db_graph->ht, bkmer, &found);
+      }
+      break;
+    case HASH_LOOP_FUNC:
+      for(i = j.start; i < j.end; i++) {
+        bkmer.b[0] = i;
+        hash ^= binary_kmer_hash(bkmer, 0);
+      }
+      break;
+  }
+
+  jptr->hash = hash;
+}
+
+static double get_seconds()
+{
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return now.tv_sec + now.tv_usec / 1e6;
+}
+
+// Run num_ops operations with nthreads, returns seconds taken
+static double hash_loop_run(dBGraph *db_graph, enum HashLoopType type,
+                            size_t num_ops, size_t nthreads, size_t *hash)
+{
+  struct HashLoopJob jobs[nthreads];
+  size_t i;
+  double start_time;
+
+  for(i = 0; i < nthreads; i++) {
+    size_t start = i * (num_ops / nthreads);
+    size_t end = (i+1 == nthreads ? num_ops : start + (num_ops / nthreads));
+    jobs[i] = (struct HashLoopJob){.db_graph = db_graph, .type = type,
+                                   .start = start, .end = end, .hash = 0};
+  }
+
+  start_time = get_seconds();
+  util_run_threads(jobs, nthreads, sizeof(jobs[0]), nthreads, hash_loop);
+
+  for(i = 0; i < nthreads; i++) *hash += jobs[i].hash;
+  return get_seconds() - start_time;
+}
+
+// Insert num_ops kmers with 1,2,4,...,max_threads threads, using bucket locks
+// and then lock-free inserts. Prints ops/sec and speedup over a single thread.
+static void hash_loop_scaling(dBGraph *db_graph, size_t num_ops,
+                              size_t max_threads, size_t *hash)
+{
+  size_t t;
+  double locks_secs, cas_secs, locks1 = 0, cas1 = 0;
+  char locks_str[50], cas_str[50];
+  HashTable *ht = &db_graph->ht;
+
+  status("[scaling] threads  locks (ops/sec, speedup)  lock-free (ops/sec, speedup)");
+
+  for(t = 1; ; t = MIN2(t*2, max_threads))
+  {
+    hash_table_empty(ht, t);
+    memset(db_graph->bktlocks, 0, roundup_bits2bytes(ht->num_of_buckets));
+    locks_secs = hash_loop_run(db_graph, HASH_LOOP_LOCKS, num_ops, t, hash);
+
+    hash_table_empty(ht, t);
+    cas_secs = hash_loop_run(db_graph, HASH_LOOP_CAS, num_ops, t, hash);
+
+    if(t == 1) { locks1 = locks_secs; cas1 = cas_secs; }
+
+    num_to_str(num_ops / locks_secs, 2, locks_str);
+    num_to_str(num_ops / cas_secs, 2, cas_str);
+    status("[scaling] %7zu  %10s %6.2fx        %10s %6.2fx", t,
+           locks_str, locks1 / locks_secs, cas_str, cas1 / cas_secs);
+
+    if(t == max_threads) break;
+  }
+}
+
+//
+// Hardware counters
+//
+
+enum PerfCounter { PERF_CACHE_MISSES, PERF_CYCLES, PERF_NCOUNTERS };
+
+// Open hardware counters for this process and threads it starts. fds are -1
+// where counters are not available (e.g. not Linux or perf_event_paranoid)
+static void perf_counters_open(int *fds)
+{
+  size_t i;
+  for(i = 0; i < PERF_NCOUNTERS; i++) fds[i] = -1;
+#ifdef __linux__
+  const uint64_t configs[] = {PERF_COUNT_HW_CACHE_MISSES,
+                              PERF_COUNT_HW_CPU_CYCLES};
+  struct perf_event_attr attr;
+  for(i = 0; i < PERF_NCOUNTERS; i++) {
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = configs[i];
+    attr.disabled = 1;
+    attr.inherit = 1; // count threads created after this
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if(fds[i] >= 0) ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+  }
+#endif
+}
+
+// Close counters, setting counts[i] to UINT64_MAX if not available
+static void perf_counters_close(int *fds, uint64_t *counts)
+{
+  size_t i;
+  for(i = 0; i < PERF_NCOUNTERS; i++) {
+    counts[i] = UINT64_MAX;
+#ifdef __linux__
+    if(fds[i] >= 0) {
+      ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+      if(read(fds[i], &counts[i], sizeof(uint64_t)) != sizeof(uint64_t))
+        counts[i] = UINT64_MAX;
+      close(fds[i]);
     }
-  } else if(j.db_graph) {
-    for(i = j.start; i < j.end; i++) {
-      bkmer.b[0] = i;
-      hash_table_find_or_insert_mt(&j.db_graph->ht, bkmer, &found,
-                                   j.db_graph->bktlocks);
+#endif
+  }
+}
+
+static void perf_count_str(uint64_t count, char *str)
+{
+  if(count == UINT64_MAX) strcpy(str, "n/a");
+  else num_to_str(count, 2, str);
+}
+
+// Time num_ops lookups of half present, half absent kmers
+static void hash_probe_run(const HashTable *ht, size_t nkmers, size_t num_ops,
+                           const char *name, double occupancy, size_t *hash)
+{
+  BinaryKmer bkmer = BINARY_KMER_ZERO_MACRO;
+  int fds[PERF_NCOUNTERS];
+  uint64_t counts[PERF_NCOUNTERS];
+  double start_time, secs;
+  char rate_str[50], misses_str[50];
+  size_t i;
+
+  perf_counters_open(fds);
+  start_time = get_seconds();
+  for(i = 0; i < num_ops; i++) {
+    bkmer.b[0] = (i & 1) ? (i * 2654435761UL) % nkmers : nkmers + i;
+    *hash += hash_table_find(ht, bkmer);
+  }
+  secs = get_seconds() - start_time;
+  perf_counters_close(fds, counts);
+
+  num_to_str(num_ops / secs, 2, rate_str);
+  if(counts[PERF_CACHE_MISSES] == UINT64_MAX) strcpy(misses_str, "n/a");
+  else sprintf(misses_str, "%.2f", (double)counts[PERF_CACHE_MISSES]/num_ops);
+
+  status("[probe] %8.0f%%  %12.2f  %6s  %11s  %s", occupancy * 100,
+         (double)nkmers / ht->num_of_buckets, name, rate_str, misses_str);
+}
+
+// Fill the table to increasing occupancy, at each step time num_ops lookups
+// (half present, half absent kmers) with each bucket probe the CPU supports.
+// The same kmers are also added to a table with the tagged layout.
+static void hash_probe_bench(HashTable *ht, size_t num_ops, size_t *hash)
+{
+  const double occupancy[] = {0.1, 0.25, 0.5, 0.75, 0.9};
+  const HashTableProbe probes[] = {HT_PROBE_SCALAR, HT_PROBE_SSE42, HT_PROBE_AVX2};
+  const size_t nocc = sizeof(occupancy)/sizeof(occupancy[0]);
+  const size_t nprobes = sizeof(probes)/sizeof(probes[0]);
+  HashTableProbe init_probe = hash_table_get_probe();
+  HashTableLayout init_layout = hash_table_get_layout();
+  BinaryKmer bkmer = BINARY_KMER_ZERO_MACRO;
+  size_t o, p, nkmers = 0, target;
+  HashTable tagged;
+  bool found;
+
+  hash_table_set_layout(HT_LAYOUT_TAGS);
+  hash_table_alloc(&tagged, ht->capacity);
+  hash_table_set_layout(init_layout);
+  ctx_assert(tagged.capacity == ht->capacity);
+
+  status("[probe] occupancy  kmers/bucket   probe  lookups/sec  misses/op");
+
+  for(o = 0; o < nocc; o++)
+  {
+    target = occupancy[o] * ht->capacity;
+    for(; nkmers < target; nkmers++) {
+      bkmer.b[0] = nkmers;
+      hash_table_find_or_insert(ht, bkmer, &found);
+      hash_table_find_or_insert(&tagged, bkmer, &found);
     }
-  } else {
-    for(i = j.start; i < j.end; i++) {
-      bkmer.b[0] = i;
-      hash ^= binary_kmer_hash(bkmer, 0);
+    if(nkmers == 0) continue;
+
+    for(p = 0; p < nprobes; p++)
+    {
+      if(!hash_table_probe_supported(probes[p])) continue;
+      hash_table_set_probe(probes[p]);
+      hash_probe_run(ht, nkmers, num_ops, hash_table_probe_str(probes[p]),
+                     occupancy[o], hash);
     }
+
+    hash_probe_run(&tagged, nkmers, num_ops, "tags", occupancy[o], hash);
   }
 
-  jptr->hash = hash;
+  hash_table_set_probe(init_probe);
+  hash_table_dealloc(&tagged);
+}
+
+//
+// Coverage buffer benchmark
+//
+
+enum CovgBufMode { COVG_BUF_NONE, COVG_BUF_PER_READ, COVG_BUF_KEEP };
+
+struct CovgLoopJob {
+  dBGraph *db_graph;
+  const char *seq;
+  size_t len;
+  enum CovgBufMode mode;
+  CovgBuffer *covgbuf; // private to this thread
+};
+
+static void covg_loop(void *arg, size_t threadid)
+{
+  (void)threadid;
+  struct CovgLoopJob *job = (struct CovgLoopJob*)arg;
+  dBGraph *db_graph = job->db_graph;
+  const size_t readlen = 100, step = readlen - db_graph->kmer_size + 1;
+  size_t i;
+
+  // Load as overlapping 100bp reads
+  for(i = 0; i + readlen <= job->len; i += step) {
+    if(job->mode == COVG_BUF_NONE) {
+      build_graph_from_str_mt(db_graph, 0, job->seq+i, readlen, false);
+    } else {
+      build_graph_from_str_buf_mt(db_graph, 0, job->seq+i, readlen,
+                                  job->covgbuf);
+      // Flushing after every read only sums updates within a read
+      if(job->mode == COVG_BUF_PER_READ) covg_buffer_flush(job->covgbuf);
+    }
+  }
+}
+
+struct CovgBufs {
+  CovgBuffer *bufs;
+  size_t n;
+};
+
+static void covg_bufs_flush(void *arg)
+{
+  struct CovgBufs *cb = (struct CovgBufs*)arg;
+  size_t i;
+  for(i = 0; i < cb->n; i++) covg_buffer_flush(&cb->bufs[i]);
+}
+
+// Sum of coverage over all kmers, to check buffered updates are not lost
+static void covg_loop_sum(hkey_t hkey, const dBGraph *db_graph, uint64_t *sum)
+{
+  *sum += db_node_get_covg(db_graph, hkey, 0) +
+          db_node_get_edges(db_graph, hkey, 0);
+}
+
+// Build a graph from `len` bases of each input with nthreads threads, first
+// updating coverage directly, then via per-thread buffers flushed after every
+// read, then via buffers kept across reads. The table can grow, as in `ctx
+// build`, so buffers are flushed by the grow hook. The repetitive input is
+// copies of a 171bp unit (as in alpha satellite DNA) with 1% mutations so all
+// threads update the same few hundred kmers.
+static void covg_buffer_bench(dBGraph *db_graph, size_t len, size_t nthreads,
+                              size_t *hash)
+{
+  const size_t unitlen = 171;
+  char *seq = ctx_malloc(len+1), unit[unitlen];
+  struct CovgLoopJob jobs[nthreads];
+  CovgBuffer bufs[nthreads];
+  struct CovgBufs covgbufs = {.bufs = bufs, .n = nthreads};
+  size_t i, input, mode, per_thread = len / nthreads;
+  const char *mode_strs[] = {"no", "read", "yes"};
+  int fds[PERF_NCOUNTERS];
+  uint64_t counts[PERF_NCOUNTERS], sum;
+  char rate_str[50], misses_str[50], cycles_str[50];
+  double start_time, secs;
+
+  for(i = 0; i < nthreads; i++) covg_buffer_alloc(&bufs[i], db_graph);
+  db_graph_set_growable(db_graph, nthreads);
+  db_graph_set_grow_flush(db_graph, covg_bufs_flush, &covgbufs);
+
+  status("[covg] input      buffer  bases/sec  cache-misses  cycles  checksum");
+
+  for(input = 0; input < 2; input++)
+  {
+    if(input == 0) {
+      for(i = 0; i < unitlen; i++) unit[i] = "ACGT"[rand() & 3];
+      for(i = 0; i < len; i++) {
+        seq[i] = (rand() % 100 == 0) ? "ACGT"[rand() & 3] : unit[i % unitlen];
+      }
+    } else {
+      for(i = 0; i < len; i++) seq[i] = "ACGT"[rand() & 3];
+    }
+
+    for(mode = COVG_BUF_NONE; mode <= COVG_BUF_KEEP; mode++)
+    {
+      db_graph_reset(db_graph, nthreads);
+
+      for(i = 0; i < nthreads; i++) {
+        jobs[i] = (struct CovgLoopJob){.db_graph = db_graph,
+                                       .seq = seq + i * per_thread,
+                                       .len = per_thread,
+                                       .mode = mode, .covgbuf = &bufs[i]};
+      }
+
+      perf_counters_open(fds);
+      start_time = get_seconds();
+      util_run_threads(jobs, nthreads, sizeof(jobs[0]), nthreads, covg_loop);
+      covg_bufs_flush(&covgbufs);
+      secs = get_seconds() - start_time;
+      perf_counters_close(fds, counts);
+
+      sum = 0;
+      HASH_ITERATE(&db_graph->ht, covg_loop_sum, db_graph, &sum);
+      *hash += sum;
+
+      num_to_str(len / secs, 2, rate_str);
+      perf_count_str(counts[PERF_CACHE_MISSES], misses_str);
+      perf_count_str(counts[PERF_CYCLES], cycles_str);
+      status("[covg] %-10s %-6s  %9s  %12s  %6s  %zu",
+             input == 0 ? "repeat" : "random", mode_strs[mode],
+             rate_str, misses_str, cycles_str, (size_t)sum);
+    }
+  }
+
+  db_graph_set_grow_flush(db_graph, NULL, NULL);
+  db_graph_set_growable(db_graph, 0);
+  for(i = 0; i < nthreads; i++) covg_buffer_dealloc(&bufs[i]);
+  ctx_free(seq);
+}
+
+//
+// Link hash benchmark
+//
+
+#define LINKS_PER_READ 16
+
+struct LinkLoopJob {
+  GPathHash *gphash;
+  size_t start, end; // reads to add
+  size_t nlinks; // links in genome
+  bool use_batch;
+};
+
+// Each read gives LINKS_PER_READ consecutive links from a circular genome of
+// `nlinks` links. Link k is on kmer k and has 1-8 junctions.
+static void link_loop(void *arg, size_t threadid)
+{
+  (void)threadid;
+  struct LinkLoopJob *job = (struct LinkLoopJob*)arg;
+  GPathBatch batch;
+  size_t r, i, k;
+  uint64_t h;
+  uint8_t seq[2];
+  bool found;
+
+  if(job->use_batch) gpath_batch_alloc(&batch, job->gphash);
+
+  for(r = job->start; r < job->end; r++)
+  {
+    for(i = 0; i < LINKS_PER_READ; i++)
+    {
+      k = (r * 2654435761UL + i) % job->nlinks;
+      h = (k + 1) * 0x9E3779B97F4A7C15UL;
+      seq[0] = h >> 56;
+      seq[1] = h >> 48;
+      GPathNew newgpath = {.seq = seq, .colset = NULL, .nseen = NULL,
+                           .num_juncs = 1 + (h >> 40) % 8,
+                           .orient = (h >> 39) & 1};
+      if(job->use_batch)
+        gpath_batch_add(&batch, k, newgpath, 0);
+      else
+        gpath_hash_find_or_insert_mt(job->gphash, k, newgpath, &found);
+    }
+  }
+
+  if(job->use_batch) {
+    gpath_batch_flush(&batch);
+    gpath_batch_dealloc(&batch);
+  }
+}
+
+// Add num_ops links with 1,2,4,...,max_threads threads, directly to the link
+// hash and via per-thread batches. The repetitive input has 1024 distinct
+// links so every thread adds the same links, the random input has num_ops.
+// Prints links/sec, speedup over a single thread and number of paths stored.
+static void link_hash_bench(size_t num_ops, size_t max_threads, size_t *hash)
+{
+  const size_t nreads = MAX2(num_ops / LINKS_PER_READ, 1);
+  const size_t nlinks[2] = {1024, nreads * LINKS_PER_READ};
+  size_t t, i, input, batched, per_thread;
+  double start_time, secs, base_secs[2][2] = {{0,0},{0,0}};
+  char rate_str[50];
+  GPathStore gpstore;
+  GPathHash gphash;
+
+  // Up to 2 bytes of junctions per link
+  size_t store_mem = gpath_store_mem(nlinks[1], false) +
+                     nlinks[1] * (sizeof(GPath) + 8) + ONE_MEGABYTE;
+  gpath_store_alloc(&gpstore, 1, nlinks[1], nlinks[1], store_mem, true, false);
+  gpath_hash_alloc(&gphash, &gpstore, nlinks[1] * sizeof(GPEntry) * 2);
+
+  status("[links] threads  input   batch  links/sec  speedup  paths");
+
+  for(t = 1; ; t = MIN2(t*2, max_threads))
+  {
+    struct LinkLoopJob jobs[t];
+    per_thread = nreads / t;
+
+    for(input = 0; input < 2; input++)
+    {
+      for(batched = 0; batched < 2; batched++)
+      {
+        gpath_store_reset(&gpstore);
+        gpath_hash_reset(&gphash);
+
+        for(i = 0; i < t; i++) {
+          jobs[i] = (struct LinkLoopJob){
+            .gphash = &gphash, .nlinks = nlinks[input], .use_batch = batched,
+            .start = i * per_thread,
+            .end = (i+1 == t ? nreads : (i+1) * per_thread)};
+        }
+
+        start_time = get_seconds();
+        util_run_threads(jobs, t, sizeof(jobs[0]), t, link_loop);
+        secs = get_seconds() - start_time;
+
+        if(t == 1) base_secs[input][batched] = secs;
+        *hash += gpstore.num_paths;
+
+        num_to_str(nreads * LINKS_PER_READ / secs, 2, rate_str);
+        status("[links] %7zu  %-6s  %-5s  %9s  %6.2fx  %zu", t,
+               input == 0 ? "repeat" : "random", batched ? "yes" : "no",
+               rate_str, base_secs[input][batched] / secs,
+               (size_t)gpstore.num_paths);
+      }
+    }
+
+    if(t == max_threads) break;
+  }
+
+  gpath_hash_print_stats(&gphash);
+  gpath_hash_dealloc(&gphash);
+  gpath_store_dealloc(&gpstore);
 }
 
 int ctx_exp_hashtest(int argc, char **argv)
 {
   size_t nthreads = 0, kmer_size = 0;
   struct MemArgs memargs = MEM_ARGS_INIT;
-  bool store_kmers = true;
+  bool store_kmers = true, use_locks = false, scaling = false, probe = false;
+  bool covg_bench = false, tags = false, links_bench = false;
 
   // Arg parsing
   char cmd[100], shortopts[100];
@@ -89,6 +570,12 @@ int ctx_exp_hashtest(int argc, char **argv)
       case 'n': cmd_mem_args_set_nkmers(&memargs, optarg); break;
       case 'k': cmd_check(!kmer_size,cmd); kmer_size = cmd_uint32_nonzero(cmd, optarg); break;
       case 'F': cmd_check(store_kmers,cmd); store_kmers = false; break;
+      case 'L': cmd_check(!use_locks,cmd); use_locks = true; break;
+      case 'S': cmd_check(!scaling,cmd); scaling = true; break;
+      case 'P': cmd_check(!probe,cmd); probe = true; break;
+      case 'T': cmd_check(!tags,cmd); tags = true; break;
+      case 'C': cmd_check(!covg_bench,cmd); covg_bench = true; break;
+      case 'G': cmd_check(!links_bench,cmd); links_bench = true; break;
       case ':': /* BADARG */
       case '?': /* BADCH getopt_long has already printed error */
         // cmd_print_usage(NULL);
@@ -99,6 +586,23 @@ int ctx_exp_hashtest(int argc, char **argv)
 
   bool single_threaded = false;
   if(nthreads == 0) { single_threaded = true; nthreads = 1; }
+  alloc_large_set_nthreads(nthreads);
+
+  if(scaling && (single_threaded || !store_kmers))
+    cmd_print_usage("--scaling requires --threads > 0 and cannot use --func-only");
+  if(use_locks && (single_threaded || !store_kmers))
+    cmd_print_usage("--locks requires --threads > 0 and cannot use --func-only");
+  if(probe && (scaling || use_locks || !store_kmers))
+    cmd_print_usage("--probe cannot be used with --scaling, --locks, --func-only");
+  if(covg_bench && (probe || scaling || use_locks || !store_kmers))
+    cmd_print_usage("--covg cannot be used with other tests or --func-only");
+  if(links_bench && (covg_bench || probe || scaling || use_locks || tags ||
+                     single_threaded || !store_kmers)) {
+    cmd_print_usage("--links requires --threads > 0 and cannot be used with "
+                    "other tests, --tags or --func-only");
+  }
+  if(tags && (probe || !store_kmers))
+    cmd_print_usage("--tags cannot be used with --probe or --func-only");
 
   if(!kmer_size) die("kmer size not set with -k <K>");
   if(kmer_size < MIN_KMER_SIZE || kmer_size > MAX_KMER_SIZE)
@@ -110,7 +614,7 @@ int ctx_exp_hashtest(int argc, char **argv)
 
   if(optind+1 != argc) cmd_print_usage(NULL);
 
-  size_t i, num_ops;
+  size_t num_ops;
   if(!parse_entire_size(argv[optind], &num_ops))
     cmd_print_usage("Invalid <num_ops>");
 
@@ -118,6 +622,14 @@ int ctx_exp_hashtest(int argc, char **argv)
   size_t kmers_in_hash = 0, graph_mem = 0, bits_per_kmer = sizeof(BinaryKmer)*8;
   dBGraph db_graph;
 
+  if(covg_bench) bits_per_kmer += (sizeof(Covg) + sizeof(Edges)) * 8;
+  if(probe) bits_per_kmer += sizeof(BinaryKmer)*8; // second (tagged) table
+
+  if(tags) hash_table_set_layout(HT_LAYOUT_TAGS);
+
+  // Link benchmark allocates its own link store and hash
+  if(links_bench) store_kmers = false;
+
   if(store_kmers)
   {
     // Min and max number of kmers both `num_ops`, since each iterations adds a
@@ -132,28 +644,43 @@ int ctx_exp_hashtest(int argc, char **argv)
 
     cmd_check_mem_limit(memargs.mem_to_use, graph_mem);
 
-    db_graph_alloc(&db_graph, kmer_size, 1, 0, kmers_in_hash, DBG_ALLOC_BKTLOCKS);
+    db_graph_alloc(&db_graph, kmer_size, 1, covg_bench ? 1 : 0, kmers_in_hash,
+                   (use_locks || scaling ? DBG_ALLOC_BKTLOCKS : 0) |
+                   (covg_bench ? DBG_ALLOC_EDGES | DBG_ALLOC_COVGS : 0));
     hash_table_print_stats(&db_graph.ht);
   }
 
-  status("[threads] using %zu thread%s (%s-threaded code)",
+  enum HashLoopType type = !store_kmers ? HASH_LOOP_FUNC
+                           : (single_threaded ? HASH_LOOP_SINGLE
+                              : (use_locks ? HASH_LOOP_LOCKS : HASH_LOOP_CAS));
+
+  status("[threads] using %zu thread%s (%s-threaded code%s)",
          nthreads, util_plural_str(nthreads),
-         single_threaded ? "single" : "multi");
+         single_threaded ? "single" : "multi",
+         type == HASH_LOOP_LOCKS ? ", bucket locks" :
+           (type == HASH_LOOP_CAS ? ", lock-free" : ""));
 
-  struct HashLoopJob jobs[nthreads];
   size_t hash = 0;
+  char ops_str[50];
 
-  for(i = 0; i < nthreads; i++) {
-    size_t start = i * (num_ops / nthreads);
-    size_t end = (i+1 == nthreads ? num_ops : start + (num_ops / nthreads));
-    jobs[i] = (struct HashLoopJob){.db_graph = store_kmers ? &db_graph : NULL,
-                                   .single_threaded = single_threaded,
-                                   .start = start, .end = end, .hash = 0};
+  if(links_bench) {
+    link_hash_bench(num_ops, nthreads, &hash);
+  }
+  else if(probe) {
+    hash_probe_bench(&db_graph.ht, num_ops, &hash);
+  }
+  else if(covg_bench) {
+    covg_buffer_bench(&db_graph, num_ops, nthreads, &hash);
+  }
+  else if(scaling) {
+    hash_loop_scaling(&db_graph, num_ops, nthreads, &hash);
+  }
+  else {
+    double secs = hash_loop_run(store_kmers ? &db_graph : NULL, type,
+                                num_ops, nthreads, &hash);
+    num_to_str(num_ops / secs, 2, ops_str);
+    status("[time] %.2f seconds, %s ops/sec", secs, ops_str);
   }
-
-  util_run_threads(jobs, nthreads, sizeof(jobs[0]), nthreads, hash_loop);
-
-  for(i = 0; i < nthreads; i++) hash += jobs[i].hash;
 
   if(store_kmers) {
     hash_table_print_stats(&db_graph.ht);
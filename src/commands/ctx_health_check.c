@@ -83,6 +83,7 @@ int ctx_health_check(int argc, char **argv)
   }
 
   if(nthreads == 0) nthreads = DEFAULT_NTHREADS;
+  alloc_large_set_nthreads(nthreads);
 
   if(optind+1 != argc)
     cmd_print_usage("Too %s arguments", optind == argc ? "few" : "many");
@@ -144,16 +145,21 @@ int ctx_health_check(int argc, char **argv)
   gpath_reader_alloc_gpstore(gpfiles.b, gpfiles.len, path_mem, false, &db_graph);
 
   GraphLoadingPrefs gprefs = graph_loading_prefs(&db_graph);
+  gprefs.nthreads = nthreads;
   gprefs.empty_colours = true;
 
   graph_load(&gfile, gprefs, NULL);
 
   // Load link files
   for(i = 0; i < gpfiles.len; i++) {
-    gpath_reader_load(&gpfiles.b[i], GPATH_DIE_MISSING_KMERS, &db_graph);
+    gpath_reader_load(&gpfiles.b[i], GPATH_DIE_MISSING_KMERS, nthreads,
+                      &db_graph);
     gpath_reader_close(&gpfiles.b[i]);
   }
 
+  // Links are now read only
+  gpath_store_compact(&db_graph.gpstore);
+
   if(do_edge_check)
     db_graph_healthcheck(&db_graph);
 
@@ -85,6 +85,9 @@ int ctx_index(int argc, char **argv)
   if(!file_filter_from_direct(&gfile.fltr))
     die("Cannot open graph file with a filter ('in.ctx:blah' syntax)");
 
+  if(gfile.hdr.version >= CTX_GRAPH_FILEFORMAT_BLOCKED)
+    die("v7 graph files already contain a block index: %s", ctx_path);
+
   // Open output file
   FILE *fout = out_path ? futil_fopen_create(out_path, "w") : stdout;
 
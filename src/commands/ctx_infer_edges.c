@@ -183,6 +183,8 @@ int ctx_infer_edges(int argc, char **argv)
     }
   }
 
+  alloc_large_set_nthreads(num_of_threads);
+
   // Default to adding all edges
   if(!add_pop_edges && !add_all_edges) add_all_edges = true;
 
@@ -222,6 +224,13 @@ int ctx_infer_edges(int argc, char **argv)
   if(!file_filter_from_direct(&file.fltr))
     cmd_print_usage("Inferedges with filter not implemented - sorry");
 
+  // Compressed v7 graphs cannot be edited in place, output is written as v6
+  if(file.hdr.version >= CTX_GRAPH_FILEFORMAT_BLOCKED) {
+    if(editing_file)
+      cmd_print_usage("Cannot edit a v7 graph in place, please pass --out");
+    file.hdr.version = CTX_GRAPH_FILEFORMAT;
+  }
+
   FILE *fout = NULL;
 
   // Editing input file or writing a new file
@@ -28,12 +28,18 @@ const char join_usage[] =
 "  -o, --out <out.ctx>     Output file [required]\n"
 "  -m, --memory <mem>      Memory to use\n"
 "  -n, --nkmers <kmers>    Number of hash table entries (e.g. 1G ~ 1 billion)\n"
+"  -t, --threads <T>       Number of threads to use [default: "QUOTE_VALUE(DEFAULT_NTHREADS)"]\n"
 //
 "  -N, --ncols <c>         How many colours to load at once [default: 1]\n"
 "  -i, --intersect <a.ctx> Only load the kmers that are in graph A.ctx. Can be\n"
 "                          specified multiple times. <a.ctx> is NOT merged into\n"
 "                          the output file.\n"
 "  -S, --sort              Output sorted graph file\n"
+"  -s, --sorted            Input graphs are sorted (see `"CMD" sort`): merge them\n"
+"                          as streams without loading into memory. Default if\n"
+"                          all inputs are compressed (.ctx v7).\n"
+"  -Z, --compress          Write compressed graph (.ctx v7) [requires --sorted]\n"
+"  -B, --block-kmers <N>   Kmers per compressed block [default: "QUOTE_VALUE(GRAPH_BLOCK_KMERS)"]\n"
 "\n"
 "  Files can be specified with specific colours: samples.ctx:2,3\n"
 "  Offset specifies where to load the first colour: 3:samples.ctx\n"
@@ -47,10 +53,14 @@ static struct option longopts[] =
   {"force",        no_argument,       NULL, 'f'},
   {"memory",       required_argument, NULL, 'm'},
   {"nkmers",       required_argument, NULL, 'n'},
+  {"threads",      required_argument, NULL, 't'},
 // command specific
   {"ncols",        required_argument, NULL, 'N'},
   {"intersect",    required_argument, NULL, 'i'},
   {"sort",         no_argument,       NULL, 'S'},
+  {"sorted",       no_argument,       NULL, 's'},
+  {"compress",     no_argument,       NULL, 'Z'},
+  {"block-kmers",  required_argument, NULL, 'B'},
   {NULL, 0, NULL, 0}
 };
 
@@ -65,8 +75,8 @@ int ctx_join(int argc, char **argv)
 {
   struct MemArgs memargs = MEM_ARGS_INIT;
   const char *out_path = NULL;
-  size_t use_ncols = 0;
-  bool sort_kmers = false;
+  size_t use_ncols = 0, nthreads = 0, block_kmers = 0;
+  bool sort_kmers = false, inputs_sorted = false, compress = false;
 
   GraphFileReader tmp_gfile;
   GraphFileBuffer isec_gfiles_buf;
@@ -86,6 +96,7 @@ int ctx_join(int argc, char **argv)
       case 'f': cmd_check(!futil_get_force(), cmd); futil_set_force(true); break;
       case 'm': cmd_mem_args_set_memory(&memargs, optarg); break;
       case 'n': cmd_mem_args_set_nkmers(&memargs, optarg); break;
+      case 't': cmd_check(!nthreads, cmd); nthreads = cmd_uint32_nonzero(cmd, optarg); break;
       case 'N': cmd_check(!use_ncols, cmd); use_ncols = cmd_uint32_nonzero(cmd, optarg); break;
       case 'i':
         graph_file_reset(&tmp_gfile);
@@ -96,6 +107,9 @@ int ctx_join(int argc, char **argv)
         gfile_buf_push(&isec_gfiles_buf, &tmp_gfile, 1);
         break;
       case 'S': cmd_check(!sort_kmers,cmd); sort_kmers = true; break;
+      case 's': cmd_check(!inputs_sorted,cmd); inputs_sorted = true; break;
+      case 'Z': cmd_check(!compress, cmd); compress = true; break;
+      case 'B': cmd_check(!block_kmers, cmd); block_kmers = cmd_uint32_nonzero(cmd, optarg); break;
       case ':': /* BADARG */
       case '?': /* BADCH getopt_long has already printed error */
         // cmd_print_usage(NULL);
@@ -104,11 +118,20 @@ int ctx_join(int argc, char **argv)
     }
   }
 
+  // Defaults
+  if(nthreads == 0) nthreads = DEFAULT_NTHREADS;
+  alloc_large_set_nthreads(nthreads);
+
   GraphFileReader *igfiles = isec_gfiles_buf.b;
   size_t num_igfiles = isec_gfiles_buf.len;
 
   if(!out_path) cmd_print_usage("--out <out.ctx> required");
 
+  if(block_kmers && !compress)
+    cmd_print_usage("--block-kmers requires --compress");
+  if(block_kmers > (1U<<24))
+    cmd_print_usage("--block-kmers too big (max 2^24)");
+
   if(optind >= argc)
     cmd_print_usage("Please specify at least one input graph file");
 
@@ -123,6 +146,7 @@ int ctx_join(int argc, char **argv)
   // Check all binaries are valid binaries with matching kmer size
   size_t i;
   size_t ctx_max_cols = 0;
+  bool all_blocked = true;
   uint64_t min_intersect_num_kmers = 0, ctx_max_kmers = 0, ctx_sum_kmers = 0;
 
   for(i = 0; i < num_gfiles; i++)
@@ -137,6 +161,7 @@ int ctx_join(int argc, char **argv)
     ctx_max_cols = MAX2(ctx_max_cols, file_filter_into_ncols(&gfiles[i].fltr));
     ctx_max_kmers = MAX2(ctx_max_kmers, graph_file_nkmers(&gfiles[i]));
     ctx_sum_kmers += graph_file_nkmers(&gfiles[i]);
+    all_blocked &= (gfiles[i].hdr.version >= CTX_GRAPH_FILEFORMAT_BLOCKED);
   }
 
   // Probe intersection graph files
@@ -160,6 +185,16 @@ int ctx_join(int argc, char **argv)
 
   bool take_intersect = (num_igfiles > 0);
 
+  if(inputs_sorted && take_intersect)
+    cmd_print_usage("--sorted cannot be used with --intersect");
+
+  // Compressed graphs (v7) are always sorted
+  if(all_blocked && !take_intersect) inputs_sorted = true;
+
+  // Compressed output is only written by merging sorted inputs
+  if(compress && !inputs_sorted)
+    cmd_print_usage("--compress requires sorted inputs (--sorted)");
+
   // If we are taking an intersection,
   // all kmers intersection kmers will need to be loaded
   if(take_intersect)
@@ -188,7 +223,7 @@ int ctx_join(int argc, char **argv)
   status("Output %zu cols; from %zu files; intersecting %zu graphs; ",
          ctx_max_cols, num_gfiles, num_igfiles);
 
-  if(num_gfiles == 1 && num_igfiles == 0)
+  if(num_gfiles == 1 && num_igfiles == 0 && !compress)
   {
     // Loading only one file with no intersection files
     // Don't need to store a graph in memory, can filter as stream
@@ -208,6 +243,20 @@ int ctx_join(int argc, char **argv)
     return EXIT_SUCCESS;
   }
 
+  if(inputs_sorted)
+  {
+    // Inputs are sorted: merge kmers from all files as streams, so we don't
+    // need to store anything in memory
+    graph_writer_merge_sorted_mkhdr(out_path, gfiles, num_gfiles,
+                                    compress, block_kmers);
+
+    for(i = 0; i < num_gfiles; i++) graph_file_close(&gfiles[i]);
+    gfile_buf_dealloc(&isec_gfiles_buf);
+    ctx_free(gfiles);
+
+    return EXIT_SUCCESS;
+  }
+
   //
   // Decide on memory
   //
@@ -268,6 +317,7 @@ int ctx_join(int argc, char **argv)
   {
     GraphLoadingPrefs gprefs = graph_loading_prefs(&db_graph);
     gprefs.boolean_covgs = true; // covg++ only
+    gprefs.nthreads = nthreads;
 
     for(i = 0; i < num_igfiles; i++)
     {
@@ -309,7 +359,8 @@ int ctx_join(int argc, char **argv)
 
   graph_writer_merge_mkhdr(out_path, gfiles, num_gfiles,
                           kmers_loaded, colours_loaded, intersect_edges,
-                          intsct_gname_ptr, sort_kmers, &db_graph);
+                          intsct_gname_ptr, sort_kmers, nthreads,
+                          &db_graph);
 
   if(take_intersect)
     db_graph.col_edges -= db_graph.ht.capacity;
@@ -24,6 +24,7 @@ const char pjoin_usage[] =
 "  -g, --graph <in.ctx>   Get number of hash table entries from graph file\n"
 "  -c, --outcols <C>      How many 'colours' should the output file have\n"
 "  -r, --noredundant      Remove redundant paths\n"
+"  -b, --binary           Save links in binary format (faster to load)\n"
 "\n"
 "  Files can be specified with specific colours: samples.ctp:2,3\n"
 "  Offset specifies where to load the first colour: 3:samples.ctp\n"
@@ -42,6 +43,7 @@ static struct option longopts[] =
   {"graph",        required_argument, NULL, 'g'},
   {"outcols",      required_argument, NULL, 'c'},
   {"noredundant",  required_argument, NULL, 'r'},
+  {"binary",       no_argument,       NULL, 'b'},
   {NULL, 0, NULL, 0}
 };
 
@@ -49,7 +51,7 @@ int ctx_pjoin(int argc, char **argv)
 {
   size_t nthreads = 0;
   struct MemArgs memargs = MEM_ARGS_INIT;
-  bool noredundant = false;
+  bool noredundant = false, binary = false;
   size_t output_ncols = 0;
   char *graph_file = NULL;
   const char *out_ctp_path = NULL;
@@ -76,6 +78,7 @@ int ctx_pjoin(int argc, char **argv)
       case 'g': cmd_check(!graph_file,cmd); graph_file = optarg; break;
       case 'c': cmd_check(!output_ncols, cmd); output_ncols = cmd_uint32_nonzero(cmd, optarg); break;
       case 'r': cmd_check(!noredundant,cmd); noredundant = true; break;
+      case 'b': cmd_check(!binary,cmd); binary = true; break;
       case ':': /* BADARG */
       case '?': /* BADCH getopt_long has already printed error */
         // cmd_print_usage(NULL);
@@ -86,6 +89,7 @@ int ctx_pjoin(int argc, char **argv)
 
   // Defaults for unset values
   if(nthreads == 0) nthreads = DEFAULT_NTHREADS;
+  alloc_large_set_nthreads(nthreads);
 
   if(out_ctp_path == NULL) cmd_print_usage("--out <out.ctp.gz> required");
   if(optind >= argc) cmd_print_usage("Please specify at least one input file");
@@ -185,7 +189,8 @@ int ctx_pjoin(int argc, char **argv)
   cmd_check_mem_limit(memargs.mem_to_use, total_mem);
 
   // Open output file
-  gzFile gzout = futil_gzopen_create(out_ctp_path, "w");
+  BgzfWriter ctpout;
+  bgzf_writer_open(&ctpout, out_ctp_path);
 
   // Set up graph and PathStore
   size_t kmer_size = gpath_reader_get_kmer_size(&pfiles[0]);
@@ -217,7 +222,7 @@ int ctx_pjoin(int argc, char **argv)
 
   // Load link files
   for(i = 0; i < num_pfiles; i++)
-    gpath_reader_load(&pfiles[i], GPATH_ADD_MISSING_KMERS, &db_graph);
+    gpath_reader_load(&pfiles[i], GPATH_ADD_MISSING_KMERS, nthreads, &db_graph);
 
   status("Got %zu path bytes", (size_t)db_graph.gpstore.path_bytes);
 
@@ -227,7 +232,7 @@ int ctx_pjoin(int argc, char **argv)
   for(i = 0; i < num_pfiles; i++) hdrs[i] = pfiles[i].json;
 
   // Write output file
-  gpath_save(gzout, out_ctp_path, output_threads, false,
+  gpath_save(&ctpout, out_ctp_path, output_threads, false, binary,
              NULL, NULL, hdrs, num_pfiles,
              contig_histgrms, output_ncols,
              &db_graph);
@@ -237,7 +242,7 @@ int ctx_pjoin(int argc, char **argv)
 
   ctx_free(contig_histgrms);
 
-  gzclose(gzout);
+  bgzf_writer_close(&ctpout);
   ctx_free(hdrs);
 
   // Close ctp files
@@ -85,6 +85,7 @@ int ctx_pop_bubbles(int argc, char **argv)
   // Defaults for unset values
   if(out_path == NULL) out_path = "-";
   if(nthreads == 0) nthreads = DEFAULT_NTHREADS;
+  alloc_large_set_nthreads(nthreads);
 
   if(optind >= argc) cmd_print_usage("Require input graph files (.ctx)");
 
@@ -148,6 +149,7 @@ int ctx_pop_bubbles(int argc, char **argv)
   // Load graphs
   //
   GraphLoadingPrefs gprefs = graph_loading_prefs(&db_graph);
+  gprefs.nthreads = nthreads;
   gprefs.empty_colours = true;
 
   for(i = 0; i < num_gfiles; i++) {
@@ -12,15 +12,16 @@
 const char pview_usage[] =
 "usage: "CMD" pview [options] [-p <in.ctp>] <in.ctx> [in2.ctx ...]\n"
 "\n"
-"  View cortex link files (.ctp).\n"
+"  View cortex link files (.ctp), or convert them to the binary format.\n"
 "\n"
 "  -h, --help             This help message\n"
 "  -q, --quiet            Silence status output normally printed to STDERR\n"
-// "  -f, --force            Overwrite output files\n"
-// "  -o, --out <out.txt>    Output file [required]\n"
+"  -f, --force            Overwrite output files\n"
+"  -o, --out <out.txt>    Output file [default: STDOUT]\n"
 "  -m, --memory <mem>     Memory to use\n"
 "  -n, --nkmers <kmers>   Number of hash table entries (e.g. 1G ~ 1 billion)\n"
 "  -p, --paths <in.ctp>   Load link file (can specify multiple times)\n"
+"  -b, --binary           Write links in binary format (gzipped)\n"
 // "  -H, --header-only      Only print the header (no paths)\n"
 // "  -P, --paths-only       Only print the paths (no header)\n"
 "\n";
@@ -38,6 +39,7 @@ static struct option longopts[] =
 // command specific
   {"header-only",  no_argument,       NULL, 'H'},
   {"paths-only",   no_argument,       NULL, 'P'},
+  {"binary",       no_argument,       NULL, 'b'},
   {NULL, 0, NULL, 0}
 };
 
@@ -52,7 +54,18 @@ static int _print_paths(hkey_t hkey,
   return 0; // 0 => keep iterating
 }
 
-static cJSON* _get_header(GPathFileBuffer *gpfiles, const dBGraph *db_graph)
+static int _write_bin_paths(hkey_t hkey,
+                            StrBuf *sbuf, GPathSubset *subset,
+                            BgzfWriter *out, BgzfCompressor *cmp,
+                            const dBGraph *db_graph)
+{
+  gpath_save_bin_sbuf(hkey, sbuf, subset, db_graph);
+  if(sbuf->end > DEFAULT_IO_BUFSIZE) bgzf_write_strbuf(out, cmp, sbuf);
+  return 0; // 0 => keep iterating
+}
+
+static cJSON* _get_header(GPathFileBuffer *gpfiles, bool binary,
+                          const dBGraph *db_graph)
 {
   // Load contig hist distribution
   size_t i;
@@ -77,7 +90,7 @@ static cJSON* _get_header(GPathFileBuffer *gpfiles, const dBGraph *db_graph)
   for(i = 0; i < gpfiles->len; i++) hdrs[i] = gpfiles->b[i].json;
   cJSON *jsonhdr = gpath_save_mkhdr("STDOUT", NULL, NULL, hdrs, gpfiles->len,
                                     contig_histgrms, db_graph->num_of_cols,
-                                    db_graph);
+                                    binary, db_graph);
 
   for(i = 0; i < db_graph->num_of_cols; i++)
     zsize_buf_dealloc(&contig_histgrms[i]);
@@ -91,7 +104,7 @@ int ctx_pview(int argc, char **argv)
 {
   struct MemArgs memargs = MEM_ARGS_INIT;
   const char *out_path = NULL;
-  bool header_only = false, paths_only = false;
+  bool header_only = false, paths_only = false, binary = false;
 
   GPathReader tmp_gpfile;
   GPathFileBuffer gpfiles;
@@ -122,6 +135,7 @@ int ctx_pview(int argc, char **argv)
         break;
       case 'H': cmd_check(!header_only, cmd); header_only = true; break;
       case 'P': cmd_check(!paths_only,  cmd); paths_only  = true; break;
+      case 'b': cmd_check(!binary, cmd); binary = true; break;
       case ':': /* BADARG */
       case '?': /* BADCH getopt_long has already printed error */
         // cmd_print_usage(NULL);
@@ -137,6 +151,8 @@ int ctx_pview(int argc, char **argv)
   if(gpfiles.len == 0) cmd_print_usage("Please give input link files");
 
   if(header_only && paths_only) cmd_print_usage("Cannot use both -H and -P");
+  if(binary && (header_only || paths_only))
+    cmd_print_usage("Cannot use -H or -P with --binary");
 
   // Use remaining args as graph files
   char **gfile_paths = argv + optind;
@@ -183,7 +199,10 @@ int ctx_pview(int argc, char **argv)
   //
   // Open output file
   //
-  FILE *fout = futil_fopen_create(out_path, "w");
+  FILE *fout = NULL;
+  BgzfWriter binout;
+  if(binary) bgzf_writer_open(&binout, out_path);
+  else fout = futil_fopen_create(out_path, "w");
 
   //
   // Allocate memory
@@ -212,17 +231,47 @@ int ctx_pview(int argc, char **argv)
 
   // Load link files
   for(i = 0; i < gpfiles.len; i++)
-    gpath_reader_load(&gpfiles.b[i], GPATH_DIE_MISSING_KMERS, &db_graph);
+    gpath_reader_load(&gpfiles.b[i], GPATH_DIE_MISSING_KMERS, DEFAULT_NTHREADS,
+                      &db_graph);
+
+  // Links are now read only
+  gpath_store_compact(&db_graph.gpstore);
+
+  if(binary)
+  {
+    StrBuf sbuf;
+    BgzfCompressor cmp;
+    GPathSubset subset;
+
+    strbuf_alloc(&sbuf, 2 * DEFAULT_IO_BUFSIZE);
+    bgzf_compressor_alloc(&cmp);
+    gpath_subset_alloc(&subset);
+    gpath_subset_init(&subset, &db_graph.gpstore.gpset);
+
+    cJSON *jsonhdr = _get_header(&gpfiles, true, &db_graph);
+    json_hdr_sprint(jsonhdr, &sbuf);
+    cJSON_Delete(jsonhdr);
+
+    HASH_ITERATE(&db_graph.ht, _write_bin_paths,
+                 &sbuf, &subset, &binout, &cmp, &db_graph);
+
+    bgzf_write_strbuf(&binout, &cmp, &sbuf);
+    bgzf_writer_close(&binout);
+
+    strbuf_dealloc(&sbuf);
+    bgzf_compressor_dealloc(&cmp);
+    gpath_subset_dealloc(&subset);
+  }
 
   // Generate merged header
-  if(!paths_only) {
-    cJSON *jsonhdr = _get_header(&gpfiles, &db_graph);
+  if(!binary && !paths_only) {
+    cJSON *jsonhdr = _get_header(&gpfiles, false, &db_graph);
     json_hdr_fprint(jsonhdr, fout);
     fputs(ctp_explanation_comment, fout);
     cJSON_Delete(jsonhdr);
   }
 
-  if(!header_only)
+  if(!binary && !header_only)
   {
     // Print paths
     StrBuf sbuf;
@@ -246,7 +295,7 @@ int ctx_pview(int argc, char **argv)
     gpath_subset_dealloc(&subset);
   }
 
-  if(fout != stdout) fclose(fout);
+  if(fout != NULL && fout != stdout) fclose(fout);
 
   // Close input link files
   for(i = 0; i < gpfiles.len; i++)
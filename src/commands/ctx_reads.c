@@ -137,6 +137,7 @@ static void parse_args(int argc, char **argv)
 
   // Defaults
   if(!nthreads) nthreads = DEFAULT_NTHREADS;
+  alloc_large_set_nthreads(nthreads);
 
   if(inputs.len == 0)
     cmd_print_usage("Please specify at least one sequence file (-1, -2 or -i)");
@@ -285,6 +286,7 @@ int ctx_reads(int argc, char **argv)
 
   // Load graphs
   GraphLoadingPrefs gprefs = graph_loading_prefs(&db_graph);
+  gprefs.nthreads = nthreads;
   gprefs.empty_colours = true;
 
   for(i = 0; i < num_gfiles; i++) {
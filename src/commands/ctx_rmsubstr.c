@@ -146,6 +146,7 @@ int ctx_rmsubstr(int argc, char **argv)
 
   // Defaults
   if(!nthreads) nthreads = DEFAULT_NTHREADS;
+  alloc_large_set_nthreads(nthreads);
   if(!kmer_size) kmer_size = DEFAULT_KMER;
 
   if(!(kmer_size&1)) cmd_print_usage("Kmer size must be odd");
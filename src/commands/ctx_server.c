@@ -4,6 +4,7 @@
 #include "file_util.h"
 #include "db_graph.h"
 #include "graphs_load.h"
+#include "graph_image.h"
 #include "gpath_reader.h"
 #include "gpath_checks.h"
 #include "graph_search.h"
@@ -11,6 +12,7 @@
 
 const char server_usage[] =
 "usage: "CMD" server [options] <in.ctx> [in2.ctx ...]\n"
+"       "CMD" server [options] <in.cti>\n"
 "\n"
 "  Interactively query the graph. Responds to STDOUT with JSON.\n"
 "  Commands are:\n"
@@ -26,7 +28,11 @@ const char server_usage[] =
 "  -S, --single-line     Reponses on a single line\n"
 "  -C, --coverages       Load coverages for kmers+links\n"
 "  -E, --edges           Load per sample edges\n"
-"  -D, --disk            Read from disk (one graph only, must be sorted)\n"
+"  -D, --disk            Read from disk (one graph only, sorted or v7 from `sort -Z`)\n"
+"\n"
+"  A graph image (.cti, see `"CMD" build --image`) is mapped into memory rather\n"
+"  than loaded, and shared between servers using the same image. Images\n"
+"  cannot be used with --paths or --disk.\n"
 "\n";
 
 static struct option longopts[] =
@@ -121,16 +127,17 @@ static inline void kmer_response(StrBuf *resp, ServerQuery q, bool pretty,
   size_t nlinks;
   const GPath *gpath = gpath_store_safe_fetch(&db_graph->gpstore, q.node.key);
   const GPathSet *gpset = &db_graph->gpstore.gpset;
-  for(nlinks = 0; gpath != NULL; gpath = gpath->next, nlinks++)
+  for(nlinks = 0; gpath != NULL; gpath = gpath_get_next(gpset, gpath))
   {
-    if(nlinks) strbuf_append_str(resp, pretty ? ",\n            " : ", ");
+    if(nlinks++) strbuf_append_str(resp, pretty ? ",\n            " : ", ");
     strbuf_append_str(resp, "{\"forward\": ");
     strbuf_append_str(resp, gpath->orient == FORWARD ? "true" : "false");
     strbuf_append_str(resp, ", \"juncs\": \"");
 
     // Print link sequence
+    const uint8_t *seq = gpath_get_seq(gpset, gpath);
     for(i = 0; i < gpath->num_juncs; i++)
-      strbuf_append_char(resp, dna_nuc_to_char(binary_seq_get(gpath->seq, i)));
+      strbuf_append_char(resp, dna_nuc_to_char(binary_seq_get(seq, i)));
 
     // Print link colours
     // counts may be null if user did not specify -C,--coverages
@@ -139,7 +146,7 @@ static inline void kmer_response(StrBuf *resp, ServerQuery q, bool pretty,
     for(i = 0; i < db_graph->num_of_cols; i++) {
       if(i) strbuf_append_char(resp, ',');
       size_t count = counts ? counts[i]
-                            : gpath_has_colour(gpath, gpset->ncols, i);
+                            : gpath_has_colour(gpset, gpath, i);
       strbuf_append_ulong(resp, count);
     }
     strbuf_append_str(resp, "]}");
@@ -154,8 +161,15 @@ static inline void query_fetch_from_graph(ServerQuery *q, const dBGraph *db_grap
   for(i = 0; i < q->ncols; i++)
     q->covgs[i] = db_graph->col_covgs ? db_node_get_covg(db_graph, q->node.key, i)
                                       : db_node_has_col(db_graph, q->node.key, i);
-  for(i = 0; i < q->nedges; i++)
-    q->edges[i] = db_node_get_edges(db_graph, q->node.key, i);
+  // Graph images always have coverages and per sample edges
+  if(q->binary_covgs && db_graph->col_covgs)
+    for(i = 0; i < q->ncols; i++)
+      q->covgs[i] = (q->covgs[i] > 0);
+  if(q->nedges == 1)
+    q->edges[0] = db_node_get_edges_union(db_graph, q->node.key);
+  else
+    for(i = 0; i < q->nedges; i++)
+      q->edges[i] = db_node_get_edges(db_graph, q->node.key, i);
 }
 
 static inline void query_fetch_from_disk(ServerQuery *q)
@@ -335,114 +349,140 @@ int ctx_server(int argc, char **argv)
 
   ctx_assert(num_gfiles > 0);
 
-  GraphFileReader *gfiles = ctx_calloc(num_gfiles, sizeof(GraphFileReader));
-  size_t i, ncols;
-  size_t ctx_max_kmers = 0, ctx_sum_kmers = 0;
-  size_t ctp_max_kmers = 0, ctp_sum_kmers = 0;
-
-  ncols = graph_files_open(graph_paths, gfiles, num_gfiles,
-                           &ctx_max_kmers, &ctx_sum_kmers);
-
-  gpath_reader_count_kmers(gpfiles.b, gpfiles.len, &ctp_max_kmers, &ctp_sum_kmers);
-
-  // Check graph + paths are compatible
-  graphs_gpaths_compatible(gfiles, num_gfiles, gpfiles.b, gpfiles.len, -1);
-
-  if(use_disk && num_gfiles > 1)
-    cmd_print_usage("Can only use --disk with one sorted graph file");
+  // A graph image is mapped rather than loaded
+  bool use_image = (num_gfiles == 1 && graph_image_is_image(graph_paths[0]));
 
-  //
-  // Decide on memory
-  //
-  size_t bits_per_kmer, kmers_in_hash, graph_mem = 0, path_mem = 0;
+  if(use_image && (use_disk || gpfiles.len > 0))
+    cmd_print_usage("Cannot use --disk or --paths with a graph image (.cti)");
 
-  // edges(1bytes) + kmer_paths(8bytes) + in_colour(1bit/col) +
+  dBGraph db_graph;
+  GraphFileReader *gfiles = NULL;
+  GraphFileSearch *disk = NULL;
+  size_t i, ctx_max_kmers = 0;
 
-  if(use_disk && gpfiles.len == 0)
+  if(use_image)
   {
-    kmers_in_hash = cmd_get_kmers_in_hash(memargs.mem_to_use,
-                                          memargs.mem_to_use_set,
-                                          memargs.num_kmers,
-                                          memargs.num_kmers_set,
-                                          0, 0, 0, false, &graph_mem);
+    graph_image_load(graph_paths[0], &db_graph);
+
+    if(per_col_edges && db_graph.num_edge_cols < db_graph.num_of_cols)
+      die("Graph image does not have per sample edges: %s", graph_paths[0]);
   }
   else
   {
-    bits_per_kmer = sizeof(BinaryKmer)*8 + // kmer
-                    sizeof(Edges)*8 * (per_col_edges ? ncols : 1) + // edges
-                    (binary_covgs ? 1 : sizeof(Covg)*8) * ncols + // covgs
-                    (gpfiles.len > 0 ? sizeof(GPath*)*8 : 0); // links
-
-    kmers_in_hash = cmd_get_kmers_in_hash(memargs.mem_to_use,
-                                          memargs.mem_to_use_set,
-                                          memargs.num_kmers,
-                                          memargs.num_kmers_set,
-                                          bits_per_kmer,
-                                          use_disk ? ctp_max_kmers : ctx_max_kmers,
-                                          use_disk ? ctp_sum_kmers : ctx_sum_kmers,
-                                          false, &graph_mem);
-
-    if(gpfiles.len)
-    {
-      // Paths memory
-      size_t rem_mem = memargs.mem_to_use - MIN2(memargs.mem_to_use, graph_mem);
-      path_mem = gpath_reader_mem_req(gpfiles.b, gpfiles.len,
-                                      ncols, rem_mem,
-                                      !binary_covgs, // load path counts
-                                      kmers_in_hash, false);
-
-      // Shift path store memory from graphs->paths
-      graph_mem -= sizeof(GPath*)*kmers_in_hash;
-      path_mem  += sizeof(GPath*)*kmers_in_hash;
-      cmd_print_mem(path_mem, "paths");
-    }
-  }
+    gfiles = ctx_calloc(num_gfiles, sizeof(GraphFileReader));
+    size_t ncols, ctx_sum_kmers = 0;
+    size_t ctp_max_kmers = 0, ctp_sum_kmers = 0;
 
-  size_t total_mem = graph_mem + path_mem;
-  cmd_check_mem_limit(memargs.mem_to_use, total_mem);
+    ncols = graph_files_open(graph_paths, gfiles, num_gfiles,
+                             &ctx_max_kmers, &ctx_sum_kmers);
 
-  // Allocate memory
-  int allocflags = DBG_ALLOC_EDGES | (binary_covgs ? DBG_ALLOC_NODE_IN_COL
-                                                   : DBG_ALLOC_COVGS);
-  if(use_disk) allocflags = 0;
+    gpath_reader_count_kmers(gpfiles.b, gpfiles.len, &ctp_max_kmers, &ctp_sum_kmers);
 
-  dBGraph db_graph;
-  db_graph_alloc(&db_graph, gfiles[0].hdr.kmer_size,
-                 ncols, per_col_edges ? ncols : 1, kmers_in_hash,
-                 allocflags);
+    // Check graph + paths are compatible
+    graphs_gpaths_compatible(gfiles, num_gfiles, gpfiles.b, gpfiles.len, -1);
 
-  // Paths - allocates nothing if gpfiles.len == 0
-  gpath_reader_alloc_gpstore(gpfiles.b, gpfiles.len,
-                             path_mem, !binary_covgs,
-                             &db_graph);
+    if(use_disk && num_gfiles > 1)
+      cmd_print_usage("Can only use --disk with one sorted graph file");
 
-  //
-  // Load graphs
-  //
-  GraphFileSearch *disk = NULL;
+    //
+    // Decide on memory
+    //
+    size_t bits_per_kmer, kmers_in_hash, graph_mem = 0, path_mem = 0;
 
-  if(use_disk) {
-    // Only load graph info
-    graph_load_ginfo(&db_graph, &gfiles[0]);
-    disk = graph_search_new(&gfiles[0]);
-  }
-  else {
-    GraphLoadingPrefs gprefs = graph_loading_prefs(&db_graph);
-    gprefs.empty_colours = true;
-    for(i = 0; i < num_gfiles; i++) {
-      graph_load(&gfiles[i], gprefs, NULL);
-      graph_file_close(&gfiles[i]);
-      gprefs.empty_colours = false;
+    // edges(1bytes) + kmer_paths(8bytes) + in_colour(1bit/col) +
+
+    if(use_disk && gpfiles.len == 0)
+    {
+      kmers_in_hash = cmd_get_kmers_in_hash(memargs.mem_to_use,
+                                            memargs.mem_to_use_set,
+                                            memargs.num_kmers,
+                                            memargs.num_kmers_set,
+                                            0, 0, 0, false, &graph_mem);
+    }
+    else
+    {
+      bits_per_kmer = sizeof(BinaryKmer)*8 + // kmer
+                      sizeof(Edges)*8 * (per_col_edges ? ncols : 1) + // edges
+                      (binary_covgs ? 1 : sizeof(Covg)*8) * ncols + // covgs
+                      (binary_covgs && ncols >= DBG_COL_CLASSES_MIN_COLS ?
+                        sizeof(uint32_t)*8 : 0) + // colour classes
+                      (gpfiles.len > 0 ? sizeof(GPath*)*8 : 0); // links
+
+      kmers_in_hash = cmd_get_kmers_in_hash(memargs.mem_to_use,
+                                            memargs.mem_to_use_set,
+                                            memargs.num_kmers,
+                                            memargs.num_kmers_set,
+                                            bits_per_kmer,
+                                            use_disk ? ctp_max_kmers : ctx_max_kmers,
+                                            use_disk ? ctp_sum_kmers : ctx_sum_kmers,
+                                            false, &graph_mem);
+
+      if(gpfiles.len)
+      {
+        // Paths memory
+        size_t rem_mem = memargs.mem_to_use - MIN2(memargs.mem_to_use, graph_mem);
+        path_mem = gpath_reader_mem_req(gpfiles.b, gpfiles.len,
+                                        ncols, rem_mem,
+                                        !binary_covgs, // load path counts
+                                        kmers_in_hash, false);
+
+        // Shift path store memory from graphs->paths
+        graph_mem -= sizeof(GPath*)*kmers_in_hash;
+        path_mem  += sizeof(GPath*)*kmers_in_hash;
+        cmd_print_mem(path_mem, "paths");
+      }
+    }
+
+    size_t total_mem = graph_mem + path_mem;
+    cmd_check_mem_limit(memargs.mem_to_use, total_mem);
+
+    // Allocate memory
+    int allocflags = DBG_ALLOC_EDGES | (binary_covgs ? DBG_ALLOC_NODE_IN_COL
+                                                     : DBG_ALLOC_COVGS);
+    if(use_disk) allocflags = 0;
+
+    db_graph_alloc(&db_graph, gfiles[0].hdr.kmer_size,
+                   ncols, per_col_edges ? ncols : 1, kmers_in_hash,
+                   allocflags);
+
+    // Paths - allocates nothing if gpfiles.len == 0
+    gpath_reader_alloc_gpstore(gpfiles.b, gpfiles.len,
+                               path_mem, !binary_covgs,
+                               &db_graph);
+
+    //
+    // Load graphs
+    //
+    if(use_disk) {
+      // Only load graph info
+      graph_load_ginfo(&db_graph, &gfiles[0]);
+      disk = graph_search_new(&gfiles[0]);
+    }
+    else {
+      GraphLoadingPrefs gprefs = graph_loading_prefs(&db_graph);
+      gprefs.empty_colours = true;
+      for(i = 0; i < num_gfiles; i++) {
+        graph_load(&gfiles[i], gprefs, NULL);
+        graph_file_close(&gfiles[i]);
+        gprefs.empty_colours = false;
+      }
     }
   }
 
   // Load link files
   int link_flags = use_disk ? GPATH_ADD_MISSING_KMERS : GPATH_DIE_MISSING_KMERS;
   for(i = 0; i < gpfiles.len; i++)
-    gpath_reader_load(&gpfiles.b[i], link_flags, &db_graph);
+    gpath_reader_load(&gpfiles.b[i], link_flags, DEFAULT_NTHREADS, &db_graph);
+
+  // Links are now read only
+  gpath_store_compact(&db_graph.gpstore);
 
   hash_table_print_stats(&db_graph.ht);
 
+  // Graph is now read only: share colour bits between kmers with the same
+  // colours if there are many colours
+  if(!use_image && !use_disk) db_graph_compress_colours(&db_graph);
+
   // Create array of cJSON** from input files
   cJSON **hdrs = ctx_malloc(gpfiles.len * sizeof(cJSON*));
   for(i = 0; i < gpfiles.len; i++) hdrs[i] = gpfiles.b[i].json;
@@ -11,14 +11,22 @@
 const char sort_usage[] =
 "usage: "CMD" sort [options] <in.ctx>\n"
 "\n"
-"  Sort a cortex graph file. Loads entire graph into memory then sorts.\n"
+"  Sort a cortex graph file. Kmers are read in runs that fit in memory, each run\n"
+"  is sorted with multiple threads. If the graph does not fit in memory, sorted\n"
+"  runs are written to temporary files then merged into the output.\n"
+"  With --compress writes a v7 graph: kmers stored in compressed blocks with an\n"
+"  index of blocks, to save space and for fast look up by `"CMD" server --disk`.\n"
 "\n"
 "  -h, --help              This help message\n"
 "  -q, --quiet             Silence status output normally printed to STDERR\n"
 "  -f, --force             Overwrite output files\n"
 "  -m, --memory <mem>      Memory to use\n"
-"  -n, --nkmers <kmers>    Number of hash table entries (e.g. 1G ~ 1 billion)\n"
+"  -n, --nkmers <kmers>    Number of kmers expected when reading from a stream\n"
+"  -t, --threads <T>       Number of threads to use [default: "QUOTE_VALUE(DEFAULT_NTHREADS)"]\n"
+"  -T, --tmp <dir>         Directory for temporary files [default: output dir]\n"
 "  -o, --out <out.ctx>     Output file [default: overwrite input]\n"
+"  -Z, --compress          Write compressed graph (.ctx v7) [requires --out]\n"
+"  -B, --block-kmers <N>   Kmers per compressed block [default: "QUOTE_VALUE(GRAPH_BLOCK_KMERS)"]\n"
 "\n";
 
 static struct option longopts[] =
@@ -27,20 +35,255 @@ static struct option longopts[] =
   {"force",        no_argument,       NULL, 'f'},
   {"memory",       required_argument, NULL, 'm'},
   {"nkmers",       required_argument, NULL, 'n'},
+  {"threads",      required_argument, NULL, 't'},
+  {"tmp",          required_argument, NULL, 'T'},
   {"out",          required_argument, NULL, 'o'},
+  {"compress",     no_argument,       NULL, 'Z'},
+  {"block-kmers",  required_argument, NULL, 'B'},
   {NULL, 0, NULL, 0}
 };
 
-// Sort graph file entries. Pointers must point to binary kmer
-static inline void sort_block(char **entries, size_t num)
+// Radix partition on the top 8 bits of the kmer, then sort each partition
+#define SORT_NPARTS 256
+
+// Top 8 bits of a kmer key, ignoring unused high bits of the first word
+static inline size_t sort_kmer_part(const char *ptr, size_t kmer_size)
+{
+  BinaryKmer bkmer;
+  memcpy(bkmer.b, ptr, sizeof(BinaryKmer));
+  const size_t topbits = BKMER_TOP_BITS(kmer_size);
+  uint64_t top = bkmer.b[0] << (64 - topbits);
+  #if NUM_BKMER_WORDS > 1
+    top |= bkmer.b[1] >> topbits;
+  #endif
+  return top >> 56;
+}
+
+typedef struct
+{
+  char **src, **dst;
+  size_t start, end, kmer_size;
+  size_t counts[SORT_NPARTS];
+} SortPartWorker;
+
+static void sort_part_count(void *arg, size_t threadid)
+{
+  (void)threadid;
+  SortPartWorker *wrkr = (SortPartWorker*)arg;
+  size_t i;
+  memset(wrkr->counts, 0, sizeof(wrkr->counts));
+  for(i = wrkr->start; i < wrkr->end; i++)
+    wrkr->counts[sort_kmer_part(wrkr->src[i], wrkr->kmer_size)]++;
+}
+
+// counts[] have been converted to offsets into dst
+static void sort_part_scatter(void *arg, size_t threadid)
+{
+  (void)threadid;
+  SortPartWorker *wrkr = (SortPartWorker*)arg;
+  size_t i, p;
+  for(i = wrkr->start; i < wrkr->end; i++) {
+    p = sort_kmer_part(wrkr->src[i], wrkr->kmer_size);
+    wrkr->dst[wrkr->counts[p]++] = wrkr->src[i];
+  }
+}
+
+typedef struct
 {
-  qsort(entries, num, sizeof(char*), binary_kmers_qcmp_unaligned_ptrs);
+  char **entries;
+  size_t num;
+} SortBucket;
+
+static void sort_bucket(void *arg, size_t threadid)
+{
+  (void)threadid;
+  SortBucket *bckt = (SortBucket*)arg;
+  qsort(bckt->entries, bckt->num, sizeof(char*),
+        binary_kmers_qcmp_unaligned_ptrs);
+}
+
+// Sort graph file entries. Pointers must point to binary kmer.
+// `tmp` must be the same length as `entries`. Sorted pointers are written to
+// `tmp`: partition entries by kmer prefix with one chunk per thread, then sort
+// partitions in parallel.
+static void sort_entries_mt(char **entries, char **tmp, size_t num,
+                            size_t kmer_size, size_t nthreads)
+{
+  size_t i, p, offset = 0;
+  SortPartWorker *wrkrs = ctx_calloc(nthreads, sizeof(SortPartWorker));
+  SortBucket bckts[SORT_NPARTS];
+
+  for(i = 0; i < nthreads; i++) {
+    wrkrs[i].src = entries;
+    wrkrs[i].dst = tmp;
+    wrkrs[i].start = (num * i) / nthreads;
+    wrkrs[i].end = (num * (i+1)) / nthreads;
+    wrkrs[i].kmer_size = kmer_size;
+  }
+
+  util_run_threads(wrkrs, nthreads, sizeof(wrkrs[0]), nthreads,
+                   sort_part_count);
+
+  // Convert counts to offsets: partitions in order, threads in order within
+  for(p = 0; p < SORT_NPARTS; p++) {
+    bckts[p].entries = tmp + offset;
+    for(i = 0; i < nthreads; i++) {
+      size_t n = wrkrs[i].counts[p];
+      wrkrs[i].counts[p] = offset;
+      offset += n;
+    }
+    bckts[p].num = offset - (bckts[p].entries - tmp);
+  }
+
+  util_run_threads(wrkrs, nthreads, sizeof(wrkrs[0]), nthreads,
+                   sort_part_scatter);
+
+  util_run_threads(bckts, SORT_NPARTS, sizeof(bckts[0]), nthreads, sort_bucket);
+
+  ctx_free(wrkrs);
+}
+
+// Read up to `max` kmers into `mem` in the v6 fixed width layout
+// Returns the number of kmers read
+static size_t sort_read_kmers(GraphFileReader *gfile, char *mem, size_t max,
+                              size_t kmer_mem)
+{
+  const size_t ncols = gfile->hdr.num_of_cols;
+  size_t i, nbytes;
+
+  if(gfile->blkbuf)
+  {
+    // v7: decode records into the same layout as a v6 file
+    BinaryKmer bkmer;
+    Covg covgs[ncols];
+    Edges edges[ncols];
+    for(i = 0; i < max && graph_file_read_raw(gfile, &bkmer, covgs, edges); i++)
+    {
+      memcpy(mem, bkmer.b, sizeof(BinaryKmer));
+      memcpy(mem+sizeof(BinaryKmer), covgs, ncols*sizeof(Covg));
+      memcpy(mem+sizeof(BinaryKmer)+ncols*sizeof(Covg), edges,
+             ncols*sizeof(Edges));
+      mem += kmer_mem;
+    }
+    return i;
+  }
+
+  nbytes = graph_file_fread(gfile, mem, max*kmer_mem);
+  if(nbytes % kmer_mem != 0) {
+    die("Truncated graph file: %s [%zu bytes per kmer]",
+        file_filter_path(&gfile->fltr), kmer_mem);
+  }
+  return nbytes / kmer_mem;
+}
+
+//
+// Output to v6 or v7 file
+//
+typedef struct
+{
+  FILE *fh;
+  const char *path;
+  size_t ncols, kmer_mem;
+  GraphBlockWriter *wtr; // NULL unless writing v7
+} SortOutput;
+
+static inline void sort_output_kmer(SortOutput *out, const char *entry)
+{
+  if(out->wtr == NULL) {
+    if(fwrite(entry, 1, out->kmer_mem, out->fh) != out->kmer_mem)
+      die("Cannot write to file: %s", out->path);
+  }
+  else {
+    BinaryKmer bkmer;
+    Covg covgs[out->ncols];
+    Edges edges[out->ncols];
+    memcpy(bkmer.b, entry, sizeof(BinaryKmer));
+    memcpy(covgs, entry+sizeof(BinaryKmer), out->ncols*sizeof(Covg));
+    memcpy(edges, entry+sizeof(BinaryKmer)+out->ncols*sizeof(Covg),
+           out->ncols*sizeof(Edges));
+    graph_block_writer_add(out->wtr, bkmer, covgs, edges);
+  }
+}
+
+//
+// Merge sorted runs from temporary files
+//
+typedef struct
+{
+  FILE *fh;
+  char *buf;
+  size_t cap, n, pos; // records in buffer, next record
+  BinaryKmer bkmer; // kmer of the next record
+} SortRun;
+
+// Returns false if there are no more kmers in this run
+static inline bool sort_run_next(SortRun *run, size_t kmer_mem)
+{
+  if(run->pos+1 < run->n) run->pos++;
+  else {
+    run->n = fread(run->buf, kmer_mem, run->cap, run->fh);
+    run->pos = 0;
+    if(ferror(run->fh)) die("Cannot read temporary file [%s]", strerror(errno));
+    if(run->n == 0) return false;
+  }
+  memcpy(run->bkmer.b, run->buf + run->pos*kmer_mem, sizeof(BinaryKmer));
+  return true;
+}
+
+// Min-heap of runs ordered by their next kmer
+static inline void sort_heap_down(SortRun **heap, size_t n, size_t i)
+{
+  size_t c;
+  while((c = 2*i+1) < n) {
+    if(c+1 < n && binary_kmer_lt(heap[c+1]->bkmer, heap[c]->bkmer)) c++;
+    if(!binary_kmer_lt(heap[c]->bkmer, heap[i]->bkmer)) break;
+    SWAP(heap[i], heap[c]);
+    i = c;
+  }
+}
+
+// Merge runs using `mem` (`memsize` bytes) for read buffers. Closes run files.
+// Returns number of kmers written
+static size_t sort_merge_runs(FILE **run_fhs, size_t nruns,
+                              char *mem, size_t memsize, SortOutput *out)
+{
+  const size_t kmer_mem = out->kmer_mem;
+  size_t i, nheap = 0, nkmers = 0, bufkmers = memsize / kmer_mem / nruns;
+  SortRun *runs = ctx_calloc(nruns, sizeof(SortRun));
+  SortRun **heap = ctx_calloc(nruns, sizeof(SortRun*));
+
+  if(bufkmers == 0) die("Not enough memory to merge %zu runs", nruns);
+
+  for(i = 0; i < nruns; i++) {
+    runs[i].fh = run_fhs[i];
+    runs[i].buf = mem + i*bufkmers*kmer_mem;
+    runs[i].cap = bufkmers;
+    if(fseek(runs[i].fh, 0, SEEK_SET) != 0) die("fseek failed on temp file");
+    if(sort_run_next(&runs[i], kmer_mem)) heap[nheap++] = &runs[i];
+  }
+
+  for(i = nheap; i-- > 0; ) sort_heap_down(heap, nheap, i);
+
+  while(nheap > 0) {
+    SortRun *run = heap[0];
+    sort_output_kmer(out, run->buf + run->pos*kmer_mem);
+    nkmers++;
+    if(!sort_run_next(run, kmer_mem)) heap[0] = heap[--nheap];
+    sort_heap_down(heap, nheap, 0);
+  }
+
+  for(i = 0; i < nruns; i++) fclose(runs[i].fh);
+  ctx_free(runs);
+  ctx_free(heap);
+  return nkmers;
 }
 
 int ctx_sort(int argc, char **argv)
 {
-  const char *out_path = NULL;
+  const char *out_path = NULL, *tmp_dir = NULL;
   struct MemArgs memargs = MEM_ARGS_INIT;
+  size_t nthreads = 0, block_kmers = 0;
+  bool compress = false;
 
   // Arg parsing
   char cmd[100];
@@ -59,7 +302,11 @@ int ctx_sort(int argc, char **argv)
       case 'f': cmd_check(!futil_get_force(), cmd); futil_set_force(true); break;
       case 'm': cmd_mem_args_set_memory(&memargs, optarg); break;
       case 'n': cmd_mem_args_set_nkmers(&memargs, optarg); break;
+      case 't': cmd_check(!nthreads, cmd); nthreads = cmd_uint32_nonzero(cmd, optarg); break;
+      case 'T': cmd_check(!tmp_dir, cmd); tmp_dir = optarg; break;
       case 'o': cmd_check(!out_path, cmd); out_path = optarg; break;
+      case 'Z': cmd_check(!compress, cmd); compress = true; break;
+      case 'B': cmd_check(!block_kmers, cmd); block_kmers = cmd_uint32_nonzero(cmd, optarg); break;
       case ':': /* BADARG */
       case '?': /* BADCH getopt_long has already printed error */
         // cmd_print_usage(NULL);
@@ -68,11 +315,18 @@ int ctx_sort(int argc, char **argv)
     }
   }
 
+  if(nthreads == 0) nthreads = DEFAULT_NTHREADS;
+
   if(optind+1 != argc)
     cmd_print_usage("Require exactly one input graph file (.ctx)");
 
   const char *ctx_path = argv[optind];
 
+  if(block_kmers && !compress)
+    cmd_print_usage("--block-kmers requires --compress");
+  if(block_kmers > (1U<<24))
+    cmd_print_usage("--block-kmers too big (max 2^24)");
+
   //
   // Open Graph file
   //
@@ -83,78 +337,128 @@ int ctx_sort(int argc, char **argv)
   if(!file_filter_from_direct(&gfile.fltr))
     die("Cannot open graph file with a filter ('in.ctx:blah' syntax)");
 
-  size_t num_kmers, memory;
-
-  // Reading from a stream
-  if(gfile.num_of_kmers < 0) {
-    if(!memargs.num_kmers_set)
-      die("If reading from a stream, must give -n <num_kmers>");
-    num_kmers = memargs.num_kmers;
-  }
-  else num_kmers = gfile.num_of_kmers;
+  // v7 input is decoded and written out as v6 unless --compress is passed
+  bool in_blocked = (gfile.hdr.version >= CTX_GRAPH_FILEFORMAT_BLOCKED);
+  if((compress || in_blocked) && out_path == NULL)
+    cmd_print_usage("Need --out <out.ctx> to change graph file format");
 
   // Open output path (if given)
   FILE *fout = out_path ? futil_fopen_create(out_path, "w") : NULL;
 
-  size_t i;
+  // Temporary files go next to the output by default
+  StrBuf tmp_dir_buf;
+  strbuf_alloc(&tmp_dir_buf, 256);
+  if(tmp_dir == NULL) {
+    const char *out_file = out_path ? out_path : ctx_path;
+    if(strcmp(out_file, "-") == 0) strbuf_set(&tmp_dir_buf, "/tmp");
+    else futil_get_strbuf_of_dir_path(out_file, &tmp_dir_buf);
+    tmp_dir = tmp_dir_buf.b;
+  }
+
+  size_t i, nruns = 0, nkmers = 0, nread;
   size_t ncols = gfile.hdr.num_of_cols;
+  size_t kmer_size = gfile.hdr.kmer_size;
   size_t kmer_mem = sizeof(BinaryKmer) + (sizeof(Edges)+sizeof(Covg))*ncols;
 
-  memory = (sizeof(char*) + kmer_mem) * num_kmers;
-
-  char mem_str[50];
-  bytes_to_str(memory, 1, mem_str);
-
-  if(memory > memargs.mem_to_use)
-    die("Require at least %s memory", mem_str);
+  // Kmers per run: each kmer needs its entry plus two pointers for sorting
+  size_t run_kmers = memargs.mem_to_use / (kmer_mem + 2*sizeof(char*));
+  int64_t expected_kmers = gfile.num_of_kmers;
+  if(expected_kmers < 0 && memargs.num_kmers_set)
+    expected_kmers = memargs.num_kmers;
+  if(expected_kmers >= 0)
+    run_kmers = MIN2(run_kmers, (size_t)expected_kmers+1);
 
-  status("[memory] Total: %s", mem_str);
+  if(run_kmers < 2) die("Not enough memory to sort (-m %zu)", memargs.mem_to_use);
 
-  char *mem = ctx_malloc(kmer_mem * num_kmers);
-  char **kmers = ctx_malloc(num_kmers*sizeof(char*));
-
-  // Read in whole file
-  // if(graph_file_fseek(gfile, gfile.hdr_size, SEEK_SET) != 0) die("fseek failed");
-  size_t nkread = graph_file_fread(&gfile, mem, num_kmers*kmer_mem);
-
-  if(nkread != num_kmers*kmer_mem)
-    die("Could only read %zu bytes [<%zu]", nkread, num_kmers*kmer_mem);
-
-  // check we are at the end of the file
-  char tmpc;
-  if(graph_file_fread(&gfile, &tmpc, 1) != 0) {
-    die("More kmers in file than believed (kmers: %zu ncols: %zu).",
-        num_kmers, ncols);
+  char mem_str[50];
+  bytes_to_str(run_kmers * (kmer_mem + 2*sizeof(char*)), 1, mem_str);
+  status("[memory] Total: %s (%zu kmers per run)", mem_str, run_kmers);
+
+  char *mem = ctx_malloc(run_kmers * kmer_mem);
+  char **kmers = ctx_malloc(run_kmers * sizeof(char*));
+  char **sorted = ctx_malloc(run_kmers * sizeof(char*));
+  FILE **run_fhs = NULL;
+
+  // Read and sort runs. A run shorter than run_kmers means we hit the end of
+  // the file, if it is the first run everything is in memory.
+  while((nread = sort_read_kmers(&gfile, mem, run_kmers, kmer_mem)) > 0)
+  {
+    for(i = 0; i < nread; i++) kmers[i] = mem + kmer_mem*i;
+    sort_entries_mt(kmers, sorted, nread, kmer_size, nthreads);
+    nkmers += nread;
+
+    if(nruns == 0 && nread < run_kmers) break;
+
+    run_fhs = ctx_reallocarray(run_fhs, nruns+1, sizeof(FILE*));
+    run_fhs[nruns] = futil_create_tmp_file(tmp_dir);
+    for(i = 0; i < nread; i++)
+      if(fwrite(sorted[i], 1, kmer_mem, run_fhs[nruns]) != kmer_mem)
+        die("Cannot write temporary file in: %s", tmp_dir);
+    if(fflush(run_fhs[nruns]) != 0)
+      die("Cannot write temporary file in: %s", tmp_dir);
+    nruns++;
+    status("Sorted run %zu: %zu kmers written to temporary file", nruns, nread);
   }
 
-  status("Read %zu kmers with %zu colour%s", num_kmers,
+  status("Read %zu kmers with %zu colour%s", nkmers,
          ncols, util_plural_str(ncols));
 
-  for(i = 0; i < num_kmers; i++)
-    kmers[i] = mem + kmer_mem*i;
-
-  sort_block(kmers, num_kmers);
-
   // Print
+  size_t hdr_size;
   if(out_path != NULL) {
     // saving to a different destination - write header
-    graph_write_header(fout, &gfile.hdr);
+    if(compress) {
+      gfile.hdr.version = CTX_GRAPH_FILEFORMAT_BLOCKED;
+      gfile.hdr.block_kmers = block_kmers ? block_kmers : GRAPH_BLOCK_KMERS;
+    }
+    else if(in_blocked) gfile.hdr.version = CTX_GRAPH_FILEFORMAT;
+    hdr_size = graph_write_header(fout, &gfile.hdr);
   }
   else {
     // Directly manipulating gfile.fh here, using it to write later
     // Not doing any more reading
     if(fseek(gfile.fh, gfile.hdr_size, SEEK_SET) != 0) die("fseek failed");
     fout = gfile.fh;
+    hdr_size = gfile.hdr_size;
+  }
+
+  GraphBlockWriter wtr;
+  SortOutput out = {.fh = fout, .path = out_path ? out_path : ctx_path,
+                    .ncols = ncols, .kmer_mem = kmer_mem,
+                    .wtr = compress ? &wtr : NULL};
+
+  if(compress) {
+    graph_block_writer_alloc(&wtr, fout, out.path, ncols,
+                             gfile.hdr.block_kmers, hdr_size);
   }
 
-  for(i = 0; i < num_kmers; i++)
-    if(fwrite(kmers[i], 1, kmer_mem, fout) != kmer_mem)
-      die("Cannot write to file");
+  if(nruns == 0) {
+    for(i = 0; i < nkmers; i++) sort_output_kmer(&out, sorted[i]);
+  }
+  else {
+    // Merge using all of the run memory for read buffers
+    status("Merging %zu sorted runs", nruns);
+    ctx_free(kmers);
+    ctx_free(sorted);
+    kmers = sorted = NULL;
+    if(sort_merge_runs(run_fhs, nruns, mem, run_kmers*kmer_mem, &out) != nkmers)
+      die("Lost kmers merging temporary files");
+  }
+
+  if(compress) {
+    graph_block_writer_finish(&wtr);
+    bytes_to_str(wtr.offset, 1, mem_str); // offset is now the file size
+    graph_block_writer_dealloc(&wtr);
+    status("Wrote %zu kmers in %s compressed", nkmers, mem_str);
+  }
 
   if(out_path) fclose(fout);
 
   graph_file_close(&gfile);
+  strbuf_dealloc(&tmp_dir_buf);
+  ctx_free(run_fhs);
   ctx_free(kmers);
+  ctx_free(sorted);
   ctx_free(mem);
 
   return EXIT_SUCCESS;
@@ -105,6 +105,7 @@ int ctx_subgraph(int argc, char **argv)
 
   // Defaults
   if(nthreads == 0) nthreads = DEFAULT_NTHREADS;
+  alloc_large_set_nthreads(nthreads);
   if(use_ncols == 0) use_ncols = 1;
 
   if(sfilebuf.len == 0) cmd_print_usage("Require at least one --seq file");
@@ -185,6 +186,7 @@ int ctx_subgraph(int argc, char **argv)
   // Load graphs
   //
   GraphLoadingPrefs gprefs = graph_loading_prefs(&db_graph);
+  gprefs.nthreads = nthreads;
 
   StrBuf intersect_gname;
   strbuf_alloc(&intersect_gname, 1024);
@@ -239,7 +241,7 @@ int ctx_subgraph(int argc, char **argv)
   graph_writer_merge_mkhdr(out_path, gfiles, num_gfiles,
                           kmers_loaded, colours_loaded,
                           intersect_edges, intersect_gname.b,
-                          false, &db_graph);
+                          false, nthreads, &db_graph);
 
   ctx_free(intersect_edges);
   strbuf_dealloc(&intersect_gname);
@@ -26,6 +26,7 @@ const char thread_usage[] =
 "  -p, --paths <in.ctp>     Load link file (can specify multiple times)\n"
 "  -0, --zero-paths         Zero counts on initially loaded links. Use if existing\n"
 "                           links were built from sequence being re-used by this run\n"
+"  -b, --binary             Save links in binary format (faster to load)\n"
 "\n"
 "  Input:\n"
 "  -1, --seq <in.fa>        Thread reads from file (supports sam,bam,fq,*.gz\n"
@@ -69,6 +70,7 @@ static struct option longopts[] =
   {"threads",       required_argument, NULL, 't'},
   {"paths",         required_argument, NULL, 'p'},
   {"zero-paths",    no_argument,       NULL, '0'},
+  {"binary",        no_argument,       NULL, 'b'},
 // command specific
   {"seq",           required_argument, NULL, '1'},
   {"seq2",          required_argument, NULL, '2'},
@@ -123,8 +125,10 @@ int ctx_thread(int argc, char **argv)
   size_t path_hash_mem, path_store_mem, path_mem;
   bool sep_path_list = (!args.use_new_paths && gpfiles->len > 0);
 
+  // Single colour: edges and colour bit of a node are kept together in a
+  // record, with 8 bits for the colour (see db_graph.h)
   bits_per_kmer = sizeof(BinaryKmer)*8 + sizeof(Edges)*8 + sizeof(GPath*)*8 +
-                  2 * args.nthreads; // Have traversed
+                  8 + 2 * args.nthreads; // Have traversed
 
   // false -> don't use mem_to_use to decide how many kmers to store in hash
   // since we need some of that memory for storing paths
@@ -166,7 +170,8 @@ int ctx_thread(int argc, char **argv)
   //
   // Open output file
   //
-  gzFile gzout = futil_gzopen_create(args.out_ctp_path, "w");
+  BgzfWriter ctpout;
+  bgzf_writer_open(&ctpout, args.out_ctp_path);
 
   status("Creating paths file: %s", futil_outpath_str(args.out_ctp_path));
 
@@ -176,7 +181,8 @@ int ctx_thread(int argc, char **argv)
   dBGraph db_graph;
   size_t kmer_size = gfile->hdr.kmer_size;
   db_graph_alloc(&db_graph, kmer_size, 1, 1, kmers_in_hash,
-                 DBG_ALLOC_EDGES | DBG_ALLOC_NODE_IN_COL);
+                 DBG_ALLOC_EDGES | DBG_ALLOC_NODE_IN_COL |
+                 DBG_ALLOC_NODE_RECORDS);
 
   // Split path memory 2:1 between store and hash
   // Create a path store that tracks path counts
@@ -214,6 +220,7 @@ int ctx_thread(int argc, char **argv)
   // Setup for loading graphs graph
   // Don't set gprefs.empty_colours => we've already loaded paths
   GraphLoadingPrefs gprefs = graph_loading_prefs(&db_graph);
+  gprefs.nthreads = args.nthreads;
 
   // Load graph, print stats, close file
   graph_load(gfile, gprefs, NULL);
@@ -222,7 +229,8 @@ int ctx_thread(int argc, char **argv)
 
   // Load existing paths
   for(i = 0; i < gpfiles->len; i++)
-    gpath_reader_load(&gpfiles->b[i], GPATH_DIE_MISSING_KMERS, &db_graph);
+    gpath_reader_load(&gpfiles->b[i], GPATH_DIE_MISSING_KMERS, args.nthreads,
+                      &db_graph);
 
   // zero link counts of already loaded links
   if(args.zero_link_counts) {
@@ -267,12 +275,13 @@ int ctx_thread(int argc, char **argv)
     cJSON_AddItemToArray(inputs_hdr, correct_aln_input_json_hdr(&inputs->b[i]));
 
   // Write output file
-  gpath_save(gzout, args.out_ctp_path, output_threads, true,
+  gpath_save(&ctpout, args.out_ctp_path, output_threads,
+             true, args.binary_links,
              "thread", thread_hdr, hdrs, gpfiles->len,
              &aln_stats->contig_histgrm, 1,
              &db_graph);
 
-  gzclose(gzout);
+  bgzf_writer_close(&ctpout);
   ctx_free(hdrs);
 
   // Optionally run path checks for debugging
@@ -232,6 +232,7 @@ int ctx_uniqkmers(int argc, char **argv)
   // Defaults for unset values
   if(out_path == NULL) out_path = "-";
   if(nthreads == 0) nthreads = DEFAULT_NTHREADS;
+  alloc_large_set_nthreads(nthreads);
 
   if(optind+1 != argc) cmd_print_usage("Expected <N> for number of kmers only");
 
@@ -292,6 +293,7 @@ int ctx_uniqkmers(int argc, char **argv)
   // Load graphs
   //
   GraphLoadingPrefs gprefs = graph_loading_prefs(&db_graph);
+  gprefs.nthreads = nthreads;
   gprefs.empty_colours = true;
 
   for(i = 0; i < gfilebuf.len; i++) {
@@ -304,6 +304,7 @@ int ctx_unitigs(int argc, char **argv)
   // Defaults for unset values
   if(out_path == NULL) out_path = "-";
   if(nthreads == 0) nthreads = DEFAULT_NTHREADS;
+  alloc_large_set_nthreads(nthreads);
 
   if(optind >= argc) cmd_print_usage(NULL);
 
@@ -365,6 +366,7 @@ int ctx_unitigs(int argc, char **argv)
 
   // Load graphs
   GraphLoadingPrefs gprefs = graph_loading_prefs(&db_graph);
+  gprefs.nthreads = nthreads;
 
   for(i = 0; i < num_gfiles; i++) {
     file_filter_flatten(&gfiles[i].fltr, 0);
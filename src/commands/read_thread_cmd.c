@@ -66,6 +66,11 @@ void read_thread_args_parse(struct ReadThreadCmdArgs *args,
         cmd_check(!args->zero_link_counts, cmd);
         args->zero_link_counts = true;
         break;
+      case 'b':
+        if(correct_cmd) cmd_print_usage("Invalid binary option: %s", cmd);
+        cmd_check(!args->binary_links, cmd);
+        args->binary_links = true;
+        break;
       case 't':
         cmd_check(!args->nthreads, cmd);
         args->nthreads = cmd_uint32_nonzero(cmd, optarg);
@@ -127,6 +132,7 @@ void read_thread_args_parse(struct ReadThreadCmdArgs *args,
   }
 
   if(args->nthreads == 0) args->nthreads = DEFAULT_NTHREADS;
+  alloc_large_set_nthreads(args->nthreads);
 
   // Check that optind+1 == argc
   if(optind+1 > argc)
@@ -2,6 +2,14 @@
 #include "ctx_alloc.h"
 #include "util.h"
 
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+  #include <sys/syscall.h>
+  #include <linux/mempolicy.h>
+#endif
+
 static volatile size_t ctx_num_allocs = 0, ctx_num_frees = 0;
 
 static inline void _oom(void *ptr, size_t nel, size_t elsize,
@@ -58,6 +66,172 @@ void alloc_free(void *ptr)
     __sync_add_and_fetch(&ctx_num_frees, 1); // ++ctx_num_frees
 }
 
+//
+// Large allocations
+//
+
+#define ALLOC_HUGE_PAGE_SIZE (1UL<<21) /* 2MB */
+#define ALLOC_PAGE_SIZE 4096
+
+static bool alloc_hugepages = false;
+static AllocNuma alloc_numa = ALLOC_NUMA_NONE;
+static bool alloc_prefault_pages = false;
+static size_t alloc_nthreads = 1; // threads used to fault in pages
+
+// mmap'd regions, so we know what to munmap() in alloc_large_free()
+static struct { void *ptr; size_t len; } alloc_maps[ALLOC_LARGE_MAX_MAPS];
+static size_t alloc_nmaps = 0;
+static pthread_mutex_t alloc_maps_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Not threadsafe: call before making large allocations
+void alloc_large_config(bool hugepages, AllocNuma numa, bool prefault)
+{
+  alloc_hugepages = hugepages;
+  alloc_numa = numa;
+  alloc_prefault_pages = prefault;
+}
+
+// Not threadsafe: call before making large allocations
+void alloc_large_set_nthreads(size_t nthreads)
+{
+  alloc_nthreads = MAX2(nthreads, 1);
+}
+
+bool alloc_numa_parse(const char *str, AllocNuma *numa)
+{
+  if(strcasecmp(str, "none") == 0) *numa = ALLOC_NUMA_NONE;
+  else if(strcasecmp(str, "interleave") == 0) *numa = ALLOC_NUMA_INTERLEAVE;
+  else return false;
+  return true;
+}
+
+// Interleave pages across the NUMA nodes we are allowed to use
+static void alloc_interleave(void *ptr, size_t len)
+{
+#if defined(__linux__) && defined(SYS_mbind) && defined(SYS_get_mempolicy)
+  unsigned long nodemask[16] = {0}; // up to 1024 nodes
+  const unsigned long maxnode = sizeof(nodemask)*8;
+  int mode;
+  if(syscall(SYS_get_mempolicy, &mode, nodemask, maxnode, NULL,
+             MPOL_F_MEMS_ALLOWED) != 0 ||
+     syscall(SYS_mbind, ptr, len, MPOL_INTERLEAVE, nodemask, maxnode, 0) != 0)
+  {
+    warn("Cannot interleave memory across NUMA nodes: %s", strerror(errno));
+  }
+#else
+  (void)ptr; (void)len;
+  warn("Cannot interleave memory across NUMA nodes on this platform");
+#endif
+}
+
+typedef struct {
+  char *ptr;
+  size_t len, step;
+} AllocTouch;
+
+static void alloc_touch_pages(void *arg, size_t threadid)
+{
+  const AllocTouch *t = (const AllocTouch*)arg;
+  size_t start = threadid * t->step, end = MIN2(start + t->step, t->len), i;
+  for(i = start; i < end; i += ALLOC_PAGE_SIZE)
+    ((volatile char*)t->ptr)[i] = 0;
+}
+
+// Fault in pages with alloc_nthreads threads, each touching a contiguous range
+static void alloc_prefault(void *ptr, size_t len)
+{
+  size_t nthreads = alloc_nthreads;
+  size_t step = (len + nthreads - 1) / nthreads;
+  step = (step + ALLOC_PAGE_SIZE - 1) / ALLOC_PAGE_SIZE * ALLOC_PAGE_SIZE;
+  AllocTouch touch = {.ptr = (char*)ptr, .len = len, .step = step};
+  util_multi_thread(&touch, nthreads, alloc_touch_pages);
+}
+
+// Map zeroed memory, with huge pages if requested. Returns MAP_FAILED on error
+static void* alloc_map(size_t *len)
+{
+  void *ptr = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+  if(alloc_hugepages) {
+    // Explicit huge pages, only available if reserved by the administrator
+    size_t hugelen = (*len + ALLOC_HUGE_PAGE_SIZE - 1) /
+                     ALLOC_HUGE_PAGE_SIZE * ALLOC_HUGE_PAGE_SIZE;
+    ptr = mmap(NULL, hugelen, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(ptr != MAP_FAILED) { *len = hugelen; return ptr; }
+  }
+#endif
+
+  ptr = mmap(NULL, *len, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+#ifdef MADV_HUGEPAGE
+  // Transparent huge pages
+  if(ptr != MAP_FAILED && alloc_hugepages)
+    (void)madvise(ptr, *len, MADV_HUGEPAGE);
+#endif
+
+  return ptr;
+}
+
+void* alloc_large(size_t nel, size_t elsize,
+                  const char *file, const char *func, int line)
+{
+  if(nel && elsize && SIZE_MAX / elsize < nel)
+    _oom(NULL, nel, elsize, file, func, line);
+
+  size_t len = nel * elsize;
+  void *ptr;
+
+  if(len < ALLOC_LARGE_MIN) return alloc_mem(NULL, nel, elsize, true,
+                                             file, func, line);
+
+  if((ptr = alloc_map(&len)) == MAP_FAILED)
+    _oom(NULL, nel, elsize, file, func, line);
+
+  pthread_mutex_lock(&alloc_maps_lock);
+  bool added = (alloc_nmaps < ALLOC_LARGE_MAX_MAPS);
+  if(added) {
+    alloc_maps[alloc_nmaps].ptr = ptr;
+    alloc_maps[alloc_nmaps].len = len;
+    alloc_nmaps++;
+  }
+  pthread_mutex_unlock(&alloc_maps_lock);
+
+  if(!added) {
+    munmap(ptr, len);
+    return alloc_mem(NULL, nel, elsize, true, file, func, line);
+  }
+
+  // Place pages before they are first used
+  if(alloc_numa == ALLOC_NUMA_INTERLEAVE) alloc_interleave(ptr, len);
+  if(alloc_prefault_pages) alloc_prefault(ptr, len);
+
+  __sync_add_and_fetch(&ctx_num_allocs, 1);
+  return ptr;
+}
+
+// `ptr` is allowed to be NULL
+void alloc_large_free(void *ptr)
+{
+  size_t i, len = 0;
+  if(ptr == NULL) return;
+
+  pthread_mutex_lock(&alloc_maps_lock);
+  for(i = 0; i < alloc_nmaps && alloc_maps[i].ptr != ptr; i++) {}
+  if(i < alloc_nmaps) {
+    len = alloc_maps[i].len;
+    alloc_maps[i] = alloc_maps[--alloc_nmaps];
+  }
+  pthread_mutex_unlock(&alloc_maps_lock);
+
+  if(len == 0) { alloc_free(ptr); return; }
+
+  if(munmap(ptr, len) != 0) warn("munmap failed: %s", strerror(errno));
+  __sync_add_and_fetch(&ctx_num_frees, 1);
+}
+
 size_t alloc_get_num_allocs()
 {
   return (size_t)ctx_num_allocs;
@@ -33,6 +33,50 @@ void* alloc_recallocarray(void *ptr, size_t oldnel, size_t newnel, size_t elsize
 // Free allocated memory, `ptr` is allowed to be NULL
 void alloc_free(void *ptr);
 
+//
+// Large allocations (hash table and graph node arrays)
+//
+// Allocations of at least ALLOC_LARGE_MIN bytes are mmap'd so that they can
+// be backed by huge pages and placed across NUMA nodes, as configured with
+// alloc_large_config(). If prefaulting is turned on, pages are faulted in
+// (zeroed by the kernel) up front by the threads set with
+// alloc_large_set_nthreads(), each touching a contiguous range, rather than
+// one at a time by whichever thread first uses them. Smaller allocations use
+// calloc().
+// Memory is zeroed. Must be freed with ctx_free_large().
+//
+
+#define ALLOC_LARGE_MIN (1UL<<26) /* 64MB */
+#define ALLOC_LARGE_MAX_MAPS 256 /* then fall back to calloc() */
+
+#define ctx_calloc_large(nel,elsize) alloc_large(nel,elsize,__FILE__,__func__,__LINE__)
+#define ctx_free_large(ptr) alloc_large_free(ptr)
+
+typedef enum
+{
+  ALLOC_NUMA_NONE, // pages on the node of the thread that faults them in
+  ALLOC_NUMA_INTERLEAVE // pages interleaved across all allowed nodes
+} AllocNuma;
+
+// Not threadsafe: call before making large allocations
+// hugepages: try MAP_HUGETLB then fall back to transparent huge pages
+// prefault: commit all pages when allocating instead of on first use
+void alloc_large_config(bool hugepages, AllocNuma numa, bool prefault);
+
+// Not threadsafe: call before making large allocations
+// Number of threads used to prefault pages. Commands call this with their
+// -t <T> once options are parsed [default 1]
+void alloc_large_set_nthreads(size_t nthreads);
+
+// Returns false if `str` is not a valid placement (none|interleave)
+bool alloc_numa_parse(const char *str, AllocNuma *numa);
+
+void* alloc_large(size_t nel, size_t elsize,
+                  const char *file, const char *func, int line);
+
+// `ptr` is allowed to be NULL
+void alloc_large_free(void *ptr);
+
 // Get number of allocations / frees
 size_t alloc_get_num_allocs();
 size_t alloc_get_num_frees();
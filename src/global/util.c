@@ -679,3 +679,28 @@ void util_multi_thread(void *arg, size_t nthreads,
     ctx_free(workers);
   }
 }
+
+#define UTIL_MEMSET_MIN (1UL<<20) /* min bytes per thread */
+
+typedef struct {
+  char *ptr;
+  int c;
+  size_t len, step;
+} UtilMemset;
+
+static void util_memset_thread(void *arg, size_t threadid)
+{
+  const UtilMemset *m = (const UtilMemset*)arg;
+  size_t start = MIN2(threadid * m->step, m->len);
+  size_t end = MIN2(start + m->step, m->len);
+  memset(m->ptr + start, m->c, end - start);
+}
+
+void util_memset_mt(void *ptr, int c, size_t len, size_t nthreads)
+{
+  ctx_assert(nthreads > 0);
+  nthreads = MAX2(MIN2(nthreads, len / UTIL_MEMSET_MIN), 1);
+  UtilMemset m = {.ptr = (char*)ptr, .c = c, .len = len,
+                  .step = (len + nthreads - 1) / nthreads};
+  util_multi_thread(&m, nthreads, util_memset_thread);
+}
@@ -184,6 +184,10 @@ void util_run_threads(void *args, size_t nel, size_t elsize,
 void util_multi_thread(void *arg, size_t nthreads,
                        void (*func)(void *_arg, size_t _tid));
 
+// memset() with `nthreads`, each setting a contiguous range of `ptr`
+// Uses fewer threads if len is small
+void util_memset_mt(void *ptr, int c, size_t len, size_t nthreads);
+
 //
 // Safe Counting (thread-safe + no overflow)
 //
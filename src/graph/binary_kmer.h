@@ -25,16 +25,30 @@ extern const BinaryKmer zero_bkmer;
 // Hash functions
 #include "hash.h"
 
+// Rolling hash is always available for testing, but only used by
+// binary_kmer_hash() if USE_ROLL_HASH is defined (compile with HASH=ROLL)
+#include "roll_hash.h"
+
 #if defined(USE_CITY_HASH)
   #define binary_kmer_hash(bkmer,rehash) ctx_hash32((bkmer).b, BKMER_BYTES, rehash)
 #elif defined(USE_XXHASH)
   #define binary_kmer_hash(bkmer,rehash) ctx_hash32((bkmer).b, BKMER_BYTES, rehash)
+#elif defined(USE_ROLL_HASH)
+  #define binary_kmer_hash(bkmer,rehash) \
+          roll_hash_final(roll_hash_words((bkmer).b, NUM_BKMER_WORDS), (rehash))
 #else
   // Optimised lookup3
   #include "kmer_hash.h"
   #define binary_kmer_hash(bkmer,rehash) bklk3_hashlittle((bkmer), (rehash))
 #endif
 
+// BINARY_KMER_ROLL_HASH is 1 if hashes can be updated one base at a time
+// with binary_kmer_roll_hash() and roll_hash_shift()
+#if defined(USE_ROLL_HASH)
+  #define BINARY_KMER_ROLL_HASH 1
+#else
+  #define BINARY_KMER_ROLL_HASH 0
+#endif
 
 // Since kmer_size is always odd, top word always has <= 62 bits used
 // Number of bases store in all but the top word
@@ -178,6 +192,19 @@ BinaryKmer binary_kmer_right_shift_add(const BinaryKmer bkmer, size_t kmer_size,
 // Reverse complement a binary kmer from kmer into revcmp_kmer
 BinaryKmer binary_kmer_reverse_complement(const BinaryKmer bkmer, size_t kmer_size);
 
+// Rolling hash of a kmer and its reverse complement, from scratch
+static inline RollHash binary_kmer_roll_hash(const BinaryKmer bkmer,
+                                             size_t kmer_size)
+{
+  BinaryKmer bkrev = binary_kmer_reverse_complement(bkmer, kmer_size);
+  return (RollHash){.fw = roll_hash_words(bkmer.b, NUM_BKMER_WORDS),
+                    .rc = roll_hash_words(bkrev.b, NUM_BKMER_WORDS)};
+}
+
+// Pick the rolling hash matching the orientation of the kmer key
+#define binary_kmer_roll_hash_key(bkmer,bkey,rh) \
+        (binary_kmer_eq((bkmer), (bkey)) ? (rh).fw : (rh).rc)
+
 // Get a random binary kmer -- useful for testing
 BinaryKmer binary_kmer_random(size_t kmer_size);
 
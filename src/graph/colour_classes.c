@@ -0,0 +1,300 @@
+#include "global.h"
+#include "colour_classes.h"
+#include "util.h"
+#include "hash.h"
+
+#include "htslib/khash.h"
+
+KHASH_MAP_INIT_INT64(ClassHash, uint32_t)
+
+//
+// Encoding
+//
+// Each class starts with a header word: number of colours (bits 0-31),
+// Elias-Fano low bit width (bits 32-39) and whether it is Elias-Fano encoded
+// (bit 63). A bitmap class is followed by ncols bits. An Elias-Fano class is
+// followed by n*l low bits, then n+(ncols>>l)+1 high bits: colour i sets bit
+// (col>>l)+i.
+//
+
+#define CC_EF_FLAG (1UL<<63)
+#define cc_hdr_n(hdr) ((size_t)((hdr) & 0xffffffffUL))
+#define cc_hdr_l(hdr) ((size_t)(((hdr) >> 32) & 0xff))
+
+static inline size_t cc_ef_lowbits(size_t ncols, size_t n)
+{
+  size_t l = 0;
+  while(n > 0 && (n << (l+1)) <= ncols) l++;
+  return l;
+}
+
+#define cc_bitmap_words(ncols) roundup_bits2words64(ncols)
+#define cc_ef_low_words(n,l) roundup_bits2words64((n)*(l))
+#define cc_ef_high_bits(ncols,n,l) ((n) + ((ncols) >> (l)) + 1)
+
+static inline size_t cc_ef_words(size_t ncols, size_t n, size_t l)
+{
+  return cc_ef_low_words(n, l) +
+         roundup_bits2words64(cc_ef_high_bits(ncols, n, l));
+}
+
+// Read/write `l` <= 32 bits at bit position `pos`
+static inline uint64_t cc_get_bits(const uint64_t *words, size_t pos, size_t l)
+{
+  size_t w = pos / 64, o = pos % 64;
+  uint64_t v = words[w] >> o;
+  if(o + l > 64) v |= words[w+1] << (64 - o);
+  return l ? v & ((1UL << l) - 1) : 0;
+}
+
+static inline void cc_set_bits(uint64_t *words, size_t pos, size_t l,
+                               uint64_t v)
+{
+  size_t w = pos / 64, o = pos % 64;
+  if(!l) return;
+  words[w] |= v << o;
+  if(o + l > 64) words[w+1] |= v >> (64 - o);
+}
+
+// Encode a row of ncols bits with n set. Returns number of words written to
+// `out`, which must have space for 1+cc_bitmap_words(ncols) words
+static size_t cc_encode(const uint64_t *row, size_t ncols, size_t n,
+                        uint64_t *out)
+{
+  size_t i, w, col, l = cc_ef_lowbits(ncols, n);
+  size_t ef_words = cc_ef_words(ncols, n, l);
+
+  if(ef_words >= cc_bitmap_words(ncols)) {
+    out[0] = n;
+    memcpy(out+1, row, cc_bitmap_words(ncols) * sizeof(uint64_t));
+    return 1 + cc_bitmap_words(ncols);
+  }
+
+  uint64_t *low = out + 1, *high = low + cc_ef_low_words(n, l);
+  out[0] = n | ((uint64_t)l << 32) | CC_EF_FLAG;
+  memset(low, 0, ef_words * sizeof(uint64_t));
+
+  for(w = i = 0; w < cc_bitmap_words(ncols); w++) {
+    uint64_t bits = row[w];
+    while(bits) {
+      col = w*64 + __builtin_ctzl(bits);
+      bits &= bits - 1;
+      cc_set_bits(low, i*l, l, col & ((1UL << l) - 1));
+      bitset_set(high, (col >> l) + i);
+      i++;
+    }
+  }
+
+  return 1 + ef_words;
+}
+
+static inline const uint64_t* cc_class(const ColourClasses *cc, uint32_t cls)
+{
+  return cc->words + cc->class_offset[cls];
+}
+
+size_t colour_classes_size(const ColourClasses *cc, uint32_t cls)
+{
+  return cc_hdr_n(cc_class(cc, cls)[0]);
+}
+
+bool colour_classes_has_col(const ColourClasses *cc, uint32_t cls, size_t col)
+{
+  const uint64_t *ptr = cc_class(cc, cls), hdr = ptr[0];
+  if(!(hdr & CC_EF_FLAG)) return bitset_get(ptr+1, col);
+
+  const size_t n = cc_hdr_n(hdr), l = cc_hdr_l(hdr);
+  const uint64_t *low = ptr + 1, *high = low + cc_ef_low_words(n, l);
+  const size_t nbits = cc_ef_high_bits(cc->ncols, n, l);
+  size_t pos = 0, i = 0, bkt = col >> l, zeros = 0, w, c;
+  uint64_t word, lowcol = col & ((1UL << l) - 1);
+
+  // Find the start of bucket `bkt`: the position after its bkt'th zero
+  for(w = 0; zeros < bkt; w++) {
+    word = ~high[w];
+    if(w*64+64 > nbits) word &= (1UL << (nbits - w*64)) - 1;
+    c = __builtin_popcountl(word);
+    if(zeros + c < bkt) { zeros += c; continue; }
+    // bkt'th zero is in this word
+    while(zeros < bkt) {
+      pos = w*64 + __builtin_ctzl(word) + 1;
+      word &= word - 1;
+      zeros++;
+    }
+    break;
+  }
+
+  // Colours in bucket are set bits from pos, in increasing order
+  i = pos - bkt;
+  for(; pos < nbits && bitset_get(high, pos); pos++, i++) {
+    uint64_t v = cc_get_bits(low, i*l, l);
+    if(v >= lowcol) return v == lowcol;
+  }
+
+  return false;
+}
+
+size_t colour_classes_get_cols(const ColourClasses *cc, uint32_t cls,
+                               uint32_t *cols)
+{
+  const uint64_t *ptr = cc_class(cc, cls), hdr = ptr[0];
+  const size_t n = cc_hdr_n(hdr), l = cc_hdr_l(hdr);
+  size_t i, w, nwords, pos;
+  uint64_t word;
+
+  if(!(hdr & CC_EF_FLAG)) {
+    nwords = cc_bitmap_words(cc->ncols);
+    for(i = w = 0; w < nwords; w++) {
+      for(word = ptr[1+w]; word; word &= word - 1)
+        cols[i++] = w*64 + __builtin_ctzl(word);
+    }
+    return i;
+  }
+
+  const uint64_t *low = ptr + 1, *high = low + cc_ef_low_words(n, l);
+  nwords = roundup_bits2words64(cc_ef_high_bits(cc->ncols, n, l));
+
+  for(i = w = 0; w < nwords && i < n; w++) {
+    for(word = high[w]; word && i < n; word &= word - 1, i++) {
+      pos = w*64 + __builtin_ctzl(word);
+      cols[i] = ((pos - i) << l) | cc_get_bits(low, i*l, l);
+    }
+  }
+  return i;
+}
+
+//
+// Building
+//
+
+typedef struct
+{
+  ColourClasses *cc;
+  khash_t(ClassHash) *h;
+  size_t classes_cap, words_cap;
+} ClassBuilder;
+
+// Return class id of an encoded class, adding it if new
+static uint32_t cc_builder_add(ClassBuilder *bld, const uint64_t *enc,
+                               size_t nwords)
+{
+  ColourClasses *cc = bld->cc;
+  uint64_t rehash, hash;
+  khiter_t k;
+  uint32_t cls;
+  int ret;
+
+  // Rehash on the rare 64 bit hash collision between two classes
+  for(rehash = 0; ; rehash++)
+  {
+    hash = ctx_hash64((void*)enc, nwords * sizeof(uint64_t), rehash);
+    k = kh_put(ClassHash, bld->h, hash, &ret);
+    if(ret < 0) die("Out of memory");
+    if(ret > 0) break;
+    cls = kh_value(bld->h, k);
+    if(cc->class_offset[cls+1] - cc->class_offset[cls] == nwords &&
+       memcmp(cc_class(cc, cls), enc, nwords * sizeof(uint64_t)) == 0) {
+      return cls;
+    }
+  }
+
+  if(cc->nclasses >= UINT32_MAX) die("Too many colour classes");
+  cls = cc->nclasses++;
+  kh_value(bld->h, k) = cls;
+
+  if(cc->nclasses+1 > bld->classes_cap) {
+    bld->classes_cap *= 2;
+    cc->class_offset = ctx_reallocarray(cc->class_offset, bld->classes_cap,
+                                        sizeof(uint64_t));
+  }
+  if(cc->nwords + nwords > bld->words_cap) {
+    bld->words_cap = MAX2(bld->words_cap * 2, cc->nwords + nwords);
+    cc->words = ctx_reallocarray(cc->words, bld->words_cap, sizeof(uint64_t));
+  }
+
+  memcpy(cc->words + cc->nwords, enc, nwords * sizeof(uint64_t));
+  cc->nwords += nwords;
+  cc->class_offset[cc->nclasses] = cc->nwords;
+  return cls;
+}
+
+void colour_classes_build(ColourClasses *cc, const uint8_t *node_in_cols,
+                          size_t ncols, const HashTable *ht)
+{
+  ctx_assert(ncols > 0 && ncols < UINT32_MAX);
+
+  const size_t capacity = ht->capacity, rowwords = cc_bitmap_words(ncols);
+  size_t i, b, col, n, nwords, nbytes = roundup_bits2bytes(capacity);
+  hkey_t hkey;
+  uint8_t byte;
+
+  uint64_t *rows = ctx_calloc(8 * rowwords, sizeof(uint64_t));
+  uint64_t *enc = ctx_calloc(1 + rowwords, sizeof(uint64_t));
+
+  memset(cc, 0, sizeof(ColourClasses));
+  cc->ncols = ncols;
+  cc->capacity = capacity;
+  cc->node_class = ctx_calloc_large(capacity, sizeof(uint32_t));
+
+  ClassBuilder bld = {.cc = cc, .h = kh_init(ClassHash),
+                      .classes_cap = 1024, .words_cap = 1024 * (1 + rowwords)};
+  cc->class_offset = ctx_calloc(bld.classes_cap, sizeof(uint64_t));
+  cc->words = ctx_calloc(bld.words_cap, sizeof(uint64_t));
+
+  // Class 0 is the empty set
+  memset(rows, 0, rowwords * sizeof(uint64_t));
+  nwords = cc_encode(rows, ncols, 0, enc);
+  cc_builder_add(&bld, enc, nwords);
+
+  // Colours of 8 kmers are in ncols consecutive bytes: transpose them into
+  // one row of ncols bits per kmer
+  for(i = 0; i < nbytes; i++)
+  {
+    memset(rows, 0, 8 * rowwords * sizeof(uint64_t));
+    for(col = 0; col < ncols; col++) {
+      for(byte = node_in_cols[i*ncols+col]; byte; byte &= byte - 1) {
+        b = __builtin_ctz(byte);
+        rows[b*rowwords + col/64] |= 1UL << (col%64);
+      }
+    }
+
+    for(b = 0; b < 8; b++) {
+      hkey = i*8 + b;
+      if(hkey >= capacity || !hash_table_assigned(ht, hkey)) continue;
+      for(col = n = 0; col < rowwords; col++)
+        n += __builtin_popcountl(rows[b*rowwords + col]);
+      nwords = cc_encode(rows + b*rowwords, ncols, n, enc);
+      cc->node_class[hkey] = cc_builder_add(&bld, enc, nwords);
+    }
+  }
+
+  // Count kmers per class
+  cc->class_nkmers = ctx_calloc(cc->nclasses, sizeof(uint64_t));
+  for(hkey = 0; hkey < capacity; hkey++)
+    if(hash_table_assigned(ht, hkey)) cc->class_nkmers[cc->node_class[hkey]]++;
+
+  // Shrink to fit
+  cc->class_offset = ctx_reallocarray(cc->class_offset, cc->nclasses+1,
+                                      sizeof(uint64_t));
+  cc->words = ctx_reallocarray(cc->words, cc->nwords, sizeof(uint64_t));
+
+  kh_destroy(ClassHash, bld.h);
+  ctx_free(rows);
+  ctx_free(enc);
+}
+
+void colour_classes_dealloc(ColourClasses *cc)
+{
+  ctx_free_large(cc->node_class);
+  ctx_free(cc->class_offset);
+  ctx_free(cc->class_nkmers);
+  ctx_free(cc->words);
+  memset(cc, 0, sizeof(ColourClasses));
+}
+
+size_t colour_classes_mem(const ColourClasses *cc)
+{
+  return cc->capacity * sizeof(uint32_t) +
+         (cc->nclasses * 2 + 1) * sizeof(uint64_t) +
+         cc->nwords * sizeof(uint64_t);
+}
@@ -0,0 +1,50 @@
+#ifndef COLOUR_CLASSES_H_
+#define COLOUR_CLASSES_H_
+
+#include "cortex_types.h"
+#include "hash_table.h"
+
+//
+// Compressed colour presence for graphs with many colours (read only)
+//
+// node_in_cols stores one bit per colour per kmer, but kmers share a small
+// number of distinct colour sets ("classes"). Each kmer stores a 32 bit class
+// id instead, and each class is stored once: either as a plain bitmap of
+// ncols bits, or Elias-Fano encoded (a sorted list of colours in about
+// 2+log2(ncols/n) bits per colour), whichever is smaller. Sparse classes, the
+// common case with thousands of samples, take a few words each.
+//
+// Class 0 is always the empty set, held by unused hash table entries.
+//
+
+typedef struct
+{
+  size_t ncols, nclasses, capacity;
+  uint32_t *node_class; // class of each hash table entry, capacity entries
+  uint64_t *class_offset; // start of each class in words, nclasses+1 entries
+  uint64_t *class_nkmers; // number of kmers in each class
+  uint64_t *words; // encoded classes
+  size_t nwords;
+} ColourClasses;
+
+// Build classes for all entries in `ht` from a node_in_cols array with
+// `ncols` colours (see db_node.h). Unused entries get class 0.
+void colour_classes_build(ColourClasses *cc, const uint8_t *node_in_cols,
+                          size_t ncols, const HashTable *ht);
+
+void colour_classes_dealloc(ColourClasses *cc);
+
+// Memory used in bytes
+size_t colour_classes_mem(const ColourClasses *cc);
+
+// Number of colours in a class
+size_t colour_classes_size(const ColourClasses *cc, uint32_t cls);
+
+bool colour_classes_has_col(const ColourClasses *cc, uint32_t cls, size_t col);
+
+// Write colours of a class to `cols` in increasing order, return how many.
+// `cols` must have space for colour_classes_size() entries
+size_t colour_classes_get_cols(const ColourClasses *cc, uint32_t cls,
+                               uint32_t *cols);
+
+#endif /* COLOUR_CLASSES_H_ */
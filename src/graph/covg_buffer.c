@@ -0,0 +1,51 @@
+#include "global.h"
+#include "covg_buffer.h"
+
+void covg_buffer_alloc(CovgBuffer *buf, dBGraph *db_graph)
+{
+  CovgBufferEntry *entries = ctx_calloc(COVG_BUFFER_SIZE,
+                                        sizeof(CovgBufferEntry));
+  size_t i;
+  for(i = 0; i < COVG_BUFFER_SIZE; i++) entries[i].hkey = HASH_NOT_FOUND;
+
+  CovgBuffer tmp = {.db_graph = db_graph, .entries = entries,
+                    .mask = COVG_BUFFER_SIZE-1, .nflushed = 0};
+
+  memcpy(buf, &tmp, sizeof(CovgBuffer));
+}
+
+void covg_buffer_dealloc(CovgBuffer *buf)
+{
+  ctx_free(buf->entries);
+  memset(buf, 0, sizeof(CovgBuffer));
+}
+
+void covg_buffer_flush_entry(CovgBuffer *buf, CovgBufferEntry *e)
+{
+  dBGraph *db_graph = buf->db_graph;
+  if(e->hkey == HASH_NOT_FOUND) return;
+
+  if(e->covg) {
+    if(db_graph->node_in_cols != NULL)
+      db_node_set_col_mt(db_graph, e->hkey, e->col);
+    if(db_graph_has_covgs(db_graph))
+      db_node_add_col_covg_mt(db_graph, e->hkey, e->col, e->covg);
+  }
+
+  if(e->edges) {
+    size_t edge_col = db_graph->num_edge_cols == 1 ? 0 : e->col;
+    __sync_or_and_fetch(&db_node_edges(db_graph, e->hkey, edge_col), e->edges);
+  }
+
+  e->hkey = HASH_NOT_FOUND;
+  e->covg = 0;
+  e->edges = 0;
+  buf->nflushed++;
+}
+
+void covg_buffer_flush(CovgBuffer *buf)
+{
+  size_t i;
+  for(i = 0; i <= buf->mask; i++)
+    covg_buffer_flush_entry(buf, &buf->entries[i]);
+}
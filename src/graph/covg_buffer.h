@@ -0,0 +1,98 @@
+#ifndef COVG_BUFFER_H_
+#define COVG_BUFFER_H_
+
+#include "db_graph.h"
+#include "db_node.h"
+
+//
+// Per-thread buffer of coverage and edge updates for recently seen nodes.
+//
+// High copy kmers (repeats, adapters) are updated by every thread at once, so
+// the cache lines holding their coverage and edges bounce between cores. A
+// small open-addressing table per thread sums updates to each (node, colour)
+// and writes them to the graph with atomic ops only when the entry is evicted
+// or the buffer is flushed.
+//
+// Node keys in the buffer are only valid until the hash table changes: flush
+// before growing or emptying the table, and before reading coverage/edges.
+//
+
+#define COVG_BUFFER_SIZE 1024 /* entries, must be a power of two */
+#define COVG_BUFFER_PROBE 4 /* slots searched before evicting an entry */
+
+typedef struct
+{
+  hkey_t hkey; // HASH_NOT_FOUND if empty
+  uint32_t col;
+  Covg covg; // number of node updates
+  Edges edges; // in edge colour of col
+} CovgBufferEntry;
+
+typedef struct
+{
+  dBGraph *const db_graph;
+  CovgBufferEntry *const entries;
+  const size_t mask;
+  size_t nflushed; // entries written to the graph
+} CovgBuffer;
+
+void covg_buffer_alloc(CovgBuffer *buf, dBGraph *db_graph);
+void covg_buffer_dealloc(CovgBuffer *buf);
+
+// Write all buffered updates to the graph, leaving the buffer empty
+void covg_buffer_flush(CovgBuffer *buf);
+
+// Write a single entry to the graph and mark it empty
+void covg_buffer_flush_entry(CovgBuffer *buf, CovgBufferEntry *e);
+
+// Get the entry for (hkey, col), evicting an entry if needed
+static inline CovgBufferEntry* covg_buffer_get(CovgBuffer *buf,
+                                               hkey_t hkey, Colour col)
+{
+  size_t i, h = ((hkey * 0x9E3779B97F4A7C15UL) >> 32) + col;
+  CovgBufferEntry *e;
+
+  for(i = 0; i < COVG_BUFFER_PROBE; i++) {
+    e = &buf->entries[(h + i) & buf->mask];
+    if(e->hkey == hkey && e->col == col) return e;
+    if(e->hkey == HASH_NOT_FOUND) break;
+  }
+
+  if(i == COVG_BUFFER_PROBE) {
+    // All slots taken: evict the entry where our search started
+    e = &buf->entries[h & buf->mask];
+    covg_buffer_flush_entry(buf, e);
+  }
+
+  e->hkey = hkey;
+  e->col = col;
+  return e;
+}
+
+// Buffered db_graph_update_node_mt()
+static inline void covg_buffer_update_node(CovgBuffer *buf, dBNode node,
+                                           Colour col)
+{
+  CovgBufferEntry *e = covg_buffer_get(buf, node.key, col);
+  e->covg = SAFE_ADD_COVG(e->covg, 1);
+}
+
+// Buffered db_graph_add_edge_mt(). Note: `col` is the sample colour, not the
+// edge colour, since edges are stored with the node's entry for `col`
+static inline void covg_buffer_add_edge(CovgBuffer *buf, Colour col,
+                                        dBNode src, dBNode tgt)
+{
+  const dBGraph *db_graph = buf->db_graph;
+  if(db_graph->col_edges == NULL) return;
+
+  Nucleotide lhs_nuc, rhs_nuc;
+  lhs_nuc = db_node_get_first_nuc(src, db_graph);
+  rhs_nuc = db_node_get_last_nuc(tgt, db_graph);
+
+  covg_buffer_get(buf, src.key, col)->edges |=
+    nuc_orient_to_edge(rhs_nuc, src.orient);
+  covg_buffer_get(buf, tgt.key, col)->edges |=
+    nuc_orient_to_edge(dna_nuc_complement(lhs_nuc), !tgt.orient);
+}
+
+#endif /* COVG_BUFFER_H_ */
@@ -0,0 +1,84 @@
+#include "global.h"
+#include "covg_overflow.h"
+
+#include "bit_array/bit_macros.h"
+
+// Pick a map with the top bits of a multiplicative hash, since khash uses the
+// low bits of its own hash to pick a bucket
+#define covg_ovf_stripe(idx) \
+        ((size_t)(((idx) * 0x9E3779B97F4A7C15UL) >> 56) % COVG_OVF_NSTRIPES)
+
+void covg_ovf_alloc(CovgOverflow *ovf)
+{
+  size_t i;
+  for(i = 0; i < COVG_OVF_NSTRIPES; i++) ovf->maps[i] = kh_init(CovgOvf);
+  ovf->locks = ctx_calloc(roundup_bits2bytes(COVG_OVF_NSTRIPES), 1);
+}
+
+void covg_ovf_dealloc(CovgOverflow *ovf)
+{
+  size_t i;
+  for(i = 0; i < COVG_OVF_NSTRIPES; i++) kh_destroy(CovgOvf, ovf->maps[i]);
+  ctx_free(ovf->locks);
+  memset(ovf, 0, sizeof(CovgOverflow));
+}
+
+void covg_ovf_reset(CovgOverflow *ovf)
+{
+  size_t i;
+  for(i = 0; i < COVG_OVF_NSTRIPES; i++) kh_clear(CovgOvf, ovf->maps[i]);
+}
+
+size_t covg_ovf_size(const CovgOverflow *ovf)
+{
+  size_t i, n = 0;
+  for(i = 0; i < COVG_OVF_NSTRIPES; i++) n += kh_size(ovf->maps[i]);
+  return n;
+}
+
+Covg covg_ovf_get(const CovgOverflow *ovf, uint64_t idx)
+{
+  size_t s = covg_ovf_stripe(idx);
+  khash_t(CovgOvf) *h = ovf->maps[s];
+  Covg covg = 0;
+  bitlock_yield_acquire(ovf->locks, s);
+  khiter_t k = kh_get(CovgOvf, h, idx);
+  if(k != kh_end(h)) covg = kh_value(h, k);
+  bitlock_release(ovf->locks, s);
+  return covg;
+}
+
+void covg_ovf_add(const CovgOverflow *ovf, uint64_t idx, Covg update)
+{
+  size_t s = covg_ovf_stripe(idx);
+  khash_t(CovgOvf) *h = ovf->maps[s];
+  int ret;
+  bitlock_yield_acquire(ovf->locks, s);
+  khiter_t k = kh_put(CovgOvf, h, idx, &ret);
+  if(ret < 0) die("Out of memory");
+  if(ret > 0) kh_value(h, k) = update;
+  else SAFE_SUM_COVG(kh_value(h, k), update);
+  bitlock_release(ovf->locks, s);
+}
+
+void covg_ovf_set(const CovgOverflow *ovf, uint64_t idx, Covg covg)
+{
+  size_t s = covg_ovf_stripe(idx);
+  khash_t(CovgOvf) *h = ovf->maps[s];
+  int ret;
+  bitlock_yield_acquire(ovf->locks, s);
+  khiter_t k = kh_put(CovgOvf, h, idx, &ret);
+  if(ret < 0) die("Out of memory");
+  kh_value(h, k) = covg;
+  bitlock_release(ovf->locks, s);
+}
+
+void covg_ovf_del(const CovgOverflow *ovf, uint64_t idx)
+{
+  size_t s = covg_ovf_stripe(idx);
+  khash_t(CovgOvf) *h = ovf->maps[s];
+  bitlock_yield_acquire(ovf->locks, s);
+  khiter_t k = kh_get(CovgOvf, h, idx);
+  if(k != kh_end(h)) kh_del(CovgOvf, h, k);
+  bitlock_release(ovf->locks, s);
+}
@@ -0,0 +1,50 @@
+#ifndef COVG_OVERFLOW_H_
+#define COVG_OVERFLOW_H_
+
+#include "htslib/khash.h"
+#include "cortex_types.h"
+
+//
+// Coverages that don't fit in 8 bit counters (DBG_ALLOC_SMALL_COVGS)
+//
+// Most kmers are seen fewer than 255 times in a sample, so coverage can be
+// stored in one byte per node per colour. A byte of COVG8_ESCAPE means the
+// count is held in this side table instead, keyed by the index of the byte
+// (hkey*num_of_cols+col). Keys are split between COVG_OVF_NSTRIPES hash maps,
+// each with its own lock, so threads updating different high coverage kmers
+// rarely wait for each other.
+//
+
+#define COVG8_ESCAPE 255
+#define COVG_OVF_NSTRIPES 256
+
+KHASH_MAP_INIT_INT64(CovgOvf, Covg)
+
+typedef struct
+{
+  khash_t(CovgOvf) *maps[COVG_OVF_NSTRIPES];
+  uint8_t *locks; // one bit lock per map
+} CovgOverflow;
+
+void covg_ovf_alloc(CovgOverflow *ovf);
+void covg_ovf_dealloc(CovgOverflow *ovf);
+
+// Remove all entries
+void covg_ovf_reset(CovgOverflow *ovf);
+
+// Number of entries
+size_t covg_ovf_size(const CovgOverflow *ovf);
+
+// All of the following are thread safe
+
+// Returns 0 if idx is not in the table
+Covg covg_ovf_get(const CovgOverflow *ovf, uint64_t idx);
+
+// Add to the coverage at idx, which starts at zero if not in the table.
+// Saturates at COVG_MAX
+void covg_ovf_add(const CovgOverflow *ovf, uint64_t idx, Covg update);
+
+void covg_ovf_set(const CovgOverflow *ovf, uint64_t idx, Covg covg);
+void covg_ovf_del(const CovgOverflow *ovf, uint64_t idx);
+
+#endif /* COVG_OVERFLOW_H_ */
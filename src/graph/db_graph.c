@@ -5,6 +5,8 @@
 #include "db_node.h"
 #include "graph_info.h"
 
+#include <sys/mman.h> // munmap()
+
 static void db_graph_status(const dBGraph *db_graph)
 {
   char capacity_str[100];
@@ -18,6 +20,76 @@ const int DBG_ALLOC_COVGS       =  2;
 const int DBG_ALLOC_BKTLOCKS    =  4;
 const int DBG_ALLOC_READSTRT    =  8;
 const int DBG_ALLOC_NODE_IN_COL = 16;
+const int DBG_ALLOC_NODE_RECORDS = 32;
+const int DBG_ALLOC_SMALL_COVGS = 64;
+
+// Allocate col_edges, col_covgs and node_in_cols for `capacity` nodes, either
+// as separate arrays or as one array of node records. If small_covgs,
+// coverages are 8 bit counters in col_covgs8 instead of col_covgs
+static void db_graph_alloc_node_arrays(dBGraph *db_graph, uint64_t capacity,
+                                       bool edges, bool covgs, bool in_cols,
+                                       bool records, bool small_covgs)
+{
+  const size_t ncols = db_graph->num_of_cols;
+  const size_t nedgecols = db_graph->num_edge_cols;
+
+  ctx_assert2(!records || !small_covgs, "Node records use 32 bit coverages");
+
+  db_graph->col_edges = NULL;
+  db_graph->col_covgs = NULL;
+  db_graph->col_covgs8 = NULL;
+  db_graph->node_in_cols = NULL;
+  db_graph->node_recs = NULL;
+  db_graph->node_stride = 0;
+
+  if(records && (edges || covgs || in_cols))
+  {
+    // Record is [covgs][edges][colour bits], padded to align coverages
+    size_t covgs_bytes = covgs ? ncols * sizeof(Covg) : 0;
+    size_t edges_bytes = edges ? nedgecols * sizeof(Edges) : 0;
+    size_t in_cols_bytes = in_cols ? roundup_bits2bytes(ncols) : 0;
+    size_t stride = covgs_bytes + edges_bytes + in_cols_bytes;
+    if(covgs) stride = (stride + sizeof(Covg) - 1) / sizeof(Covg) * sizeof(Covg);
+
+    db_graph->node_recs = ctx_calloc_large(capacity, stride);
+    db_graph->node_stride = stride;
+    if(covgs) db_graph->col_covgs = (Covg*)db_graph->node_recs;
+    if(edges) db_graph->col_edges = (Edges*)(db_graph->node_recs + covgs_bytes);
+    if(in_cols)
+      db_graph->node_in_cols = db_graph->node_recs + covgs_bytes + edges_bytes;
+  }
+  else
+  {
+    if(edges)
+      db_graph->col_edges = ctx_calloc_large(capacity*nedgecols, sizeof(Edges));
+    if(covgs && small_covgs) {
+      db_graph->col_covgs8 = ctx_calloc_large(capacity*ncols, sizeof(uint8_t));
+      covg_ovf_alloc(&db_graph->covg_ovf);
+    }
+    else if(covgs)
+      db_graph->col_covgs = ctx_calloc_large(capacity*ncols, sizeof(Covg));
+    if(in_cols) {
+      db_graph->node_in_cols = ctx_calloc_large(roundup_bits2bytes(capacity)*ncols,
+                                                1);
+    }
+  }
+}
+
+// Free col_edges, col_covgs and node_in_cols
+static void db_graph_free_node_arrays(dBGraph *db_graph)
+{
+  if(db_graph->node_recs != NULL) {
+    ctx_free_large(db_graph->node_recs);
+  } else {
+    ctx_free_large(db_graph->col_covgs); // num_of_cols * capacity
+    if(db_graph->col_covgs8 != NULL) {
+      ctx_free_large(db_graph->col_covgs8);
+      covg_ovf_dealloc(&db_graph->covg_ovf);
+    }
+    ctx_free_large(db_graph->col_edges); // num_col_edges * capacity
+    ctx_free_large(db_graph->node_in_cols);
+  }
+}
 
 // alloc_flags specifies where fields to malloc. OR together DBG_ALLOC_* values
 void db_graph_alloc(dBGraph *db_graph, size_t kmer_size,
@@ -33,8 +105,11 @@ void db_graph_alloc(dBGraph *db_graph, size_t kmer_size,
                  .ginfo = NULL,
                  .col_edges = NULL,
                  .col_covgs = NULL,
+                 .col_covgs8 = NULL,
                  .node_in_cols = NULL,
-                 .readstrt = NULL};
+                 .readstrt = NULL,
+                 .image = NULL,
+                 .image_size = 0};
 
   ctx_assert(num_of_cols > 0);
   ctx_assert(num_edge_cols == 0 || num_edge_cols == 1 || num_edge_cols == num_of_cols);
@@ -49,23 +124,19 @@ void db_graph_alloc(dBGraph *db_graph, size_t kmer_size,
   for(i = 0; i < num_of_cols; i++)
     graph_info_alloc(&tmp.ginfo[i]);
 
-  if(alloc_flags & DBG_ALLOC_EDGES)
-    tmp.col_edges = ctx_calloc(tmp.ht.capacity * num_edge_cols, sizeof(Edges));
-
-  if(alloc_flags & DBG_ALLOC_COVGS)
-    tmp.col_covgs = ctx_calloc(tmp.ht.capacity * num_of_cols, sizeof(Covg));
+  db_graph_alloc_node_arrays(&tmp, tmp.ht.capacity,
+                             alloc_flags & DBG_ALLOC_EDGES,
+                             alloc_flags & DBG_ALLOC_COVGS,
+                             alloc_flags & DBG_ALLOC_NODE_IN_COL,
+                             alloc_flags & DBG_ALLOC_NODE_RECORDS,
+                             alloc_flags & DBG_ALLOC_SMALL_COVGS);
 
   if(alloc_flags & DBG_ALLOC_BKTLOCKS)
     tmp.bktlocks = ctx_calloc(roundup_bits2bytes(tmp.ht.num_of_buckets), 1);
 
   // 1 bit for forward, 1 bit for reverse per kmer
   if(alloc_flags & DBG_ALLOC_READSTRT)
-    tmp.readstrt = ctx_calloc(roundup_bits2bytes(tmp.ht.capacity)*2, 1);
-
-  if(alloc_flags & DBG_ALLOC_NODE_IN_COL) {
-    size_t bytes_per_col = roundup_bits2bytes(tmp.ht.capacity);
-    tmp.node_in_cols = ctx_calloc(bytes_per_col*num_of_cols, 1);
-  }
+    tmp.readstrt = ctx_calloc_large(roundup_bits2bytes(tmp.ht.capacity)*2, 1);
 
   memcpy(db_graph, &tmp, sizeof(dBGraph));
   db_graph_status(db_graph);
@@ -76,17 +147,24 @@ void db_graph_dealloc(dBGraph *db_graph)
 {
   size_t i;
 
-  hash_table_dealloc(&db_graph->ht);
+  if(db_graph->image != NULL) {
+    // hash table, edges and coverages are mapped from a graph image
+    if(munmap(db_graph->image, db_graph->image_size) != 0)
+      warn("Cannot unmap graph image: %s", strerror(errno));
+  } else {
+    hash_table_dealloc(&db_graph->ht);
+    db_graph_free_node_arrays(db_graph);
+  }
 
   for(i = 0; i < db_graph->num_of_cols; i++)
     graph_info_dealloc(db_graph->ginfo+i);
   ctx_free(db_graph->ginfo);
 
   ctx_free(db_graph->bktlocks);
-  ctx_free(db_graph->col_covgs); // num_of_cols * capacity
-  ctx_free(db_graph->col_edges); // num_col_edges * capacity
-  ctx_free(db_graph->node_in_cols);
-  ctx_free(db_graph->readstrt);
+  if(db_graph->image != NULL) ctx_free(db_graph->node_in_cols);
+  if(db_graph_has_col_classes(db_graph))
+    colour_classes_dealloc(&db_graph->col_classes);
+  ctx_free_large(db_graph->readstrt);
 
   gpath_hash_dealloc(&db_graph->gphash);
   gpath_store_dealloc(&db_graph->gpstore);
@@ -101,7 +179,7 @@ void db_graph_dealloc(dBGraph *db_graph)
 void db_graph_update_node_mt(dBGraph *db_graph, dBNode node, Colour col)
 {
   if(db_graph->node_in_cols != NULL) db_node_set_col_mt(db_graph, node.key, col);
-  if(db_graph->col_covgs != NULL) db_node_increment_coverage_mt(db_graph, node.key, col);
+  if(db_graph_has_covgs(db_graph)) db_node_increment_coverage_mt(db_graph, node.key, col);
 }
 
 // Not thread safe, use db_graph_find_or_add_node_mt for that
@@ -119,7 +197,9 @@ dBNode db_graph_find_or_add_node(dBGraph *db_graph, BinaryKmer bkmer,
 dBNode db_graph_find_node_mt(dBGraph *db_graph, BinaryKmer bkmer)
 {
   BinaryKmer bkey = binary_kmer_get_key(bkmer, db_graph->kmer_size);
-  hkey_t hkey = hash_table_find_mt(&db_graph->ht, bkey, db_graph->bktlocks);
+  hkey_t hkey = db_graph->bktlocks != NULL
+                ? hash_table_find_mt(&db_graph->ht, bkey, db_graph->bktlocks)
+                : hash_table_find_cas(&db_graph->ht, bkey);
   return (dBNode){.key = hkey, .orient = bkmer_get_orientation(bkey, bkmer)};
 }
 
@@ -127,12 +207,116 @@ dBNode db_graph_find_or_add_node_mt(dBGraph *db_graph, BinaryKmer bkmer,
                                     bool *foundptr)
 {
   BinaryKmer bkey = binary_kmer_get_key(bkmer, db_graph->kmer_size);
-  hkey_t hkey = hash_table_find_or_insert_mt(&db_graph->ht, bkey, foundptr,
-                                             db_graph->bktlocks);
+  hkey_t hkey = db_graph->bktlocks != NULL
+                ? hash_table_find_or_insert_mt(&db_graph->ht, bkey, foundptr,
+                                               db_graph->bktlocks)
+                : hash_table_find_or_insert_cas(&db_graph->ht, bkey, foundptr);
 
   return (dBNode){.key = hkey, .orient = bkmer_get_orientation(bkey, bkmer)};
 }
 
+// Get kmer keys and their rolling hashes for a batch of up to HASH_BATCH_SIZE
+// Returns NULL if rhashes is NULL, otherwise prehash
+static inline uint64_t* _db_graph_batch_keys(const dBGraph *db_graph,
+                                             const BinaryKmer *bkmers,
+                                             const RollHash *rhashes, size_t n,
+                                             BinaryKmer *bkeys, uint64_t *prehash)
+{
+  size_t i;
+  for(i = 0; i < n; i++)
+    bkeys[i] = binary_kmer_get_key(bkmers[i], db_graph->kmer_size);
+
+  if(rhashes == NULL) return NULL;
+
+  for(i = 0; i < n; i++)
+    prehash[i] = binary_kmer_roll_hash_key(bkmers[i], bkeys[i], rhashes[i]);
+
+  return prehash;
+}
+
+void db_graph_find_nodes(const dBGraph *db_graph, const BinaryKmer *bkmers,
+                         const RollHash *rhashes, size_t n, dBNode *nodes)
+{
+  BinaryKmer bkeys[HASH_BATCH_SIZE];
+  uint64_t prehash[HASH_BATCH_SIZE], *ph;
+  hkey_t hkeys[HASH_BATCH_SIZE];
+  size_t i, j, m;
+
+  for(i = 0; i < n; i += m) {
+    m = MIN2(n - i, HASH_BATCH_SIZE);
+    ph = _db_graph_batch_keys(db_graph, bkmers+i, rhashes ? rhashes+i : NULL,
+                              m, bkeys, prehash);
+    hash_table_find_batch(&db_graph->ht, bkeys, ph, m, hkeys);
+    for(j = 0; j < m; j++) {
+      nodes[i+j] = (dBNode){.key = hkeys[j],
+                            .orient = bkmer_get_orientation(bkeys[j], bkmers[i+j])};
+    }
+  }
+}
+
+void db_graph_find_nodes_mt(dBGraph *db_graph, const BinaryKmer *bkmers,
+                            const RollHash *rhashes, size_t n, dBNode *nodes)
+{
+  BinaryKmer bkeys[HASH_BATCH_SIZE];
+  uint64_t prehash[HASH_BATCH_SIZE], *ph;
+  hkey_t hkeys[HASH_BATCH_SIZE];
+  size_t i, j, m;
+
+  for(i = 0; i < n; i += m) {
+    m = MIN2(n - i, HASH_BATCH_SIZE);
+    ph = _db_graph_batch_keys(db_graph, bkmers+i, rhashes ? rhashes+i : NULL,
+                              m, bkeys, prehash);
+
+    if(db_graph->bktlocks != NULL) {
+      for(j = 0; j < m; j++)
+        hkeys[j] = hash_table_find_mt(&db_graph->ht, bkeys[j],
+                                      db_graph->bktlocks);
+    } else {
+      hash_table_find_batch_cas(&db_graph->ht, bkeys, ph, m, hkeys);
+    }
+
+    for(j = 0; j < m; j++) {
+      nodes[i+j] = (dBNode){.key = hkeys[j],
+                            .orient = bkmer_get_orientation(bkeys[j], bkmers[i+j])};
+    }
+  }
+}
+
+size_t db_graph_find_or_add_nodes_mt(dBGraph *db_graph,
+                                     const BinaryKmer *bkmers,
+                                     const RollHash *rhashes, size_t n,
+                                     dBNode *nodes, bool *found)
+{
+  BinaryKmer bkeys[HASH_BATCH_SIZE];
+  uint64_t prehash[HASH_BATCH_SIZE], *ph;
+  hkey_t hkeys[HASH_BATCH_SIZE];
+  size_t i, j, m, nadded;
+
+  for(i = 0; i < n; i += m) {
+    m = MIN2(n - i, HASH_BATCH_SIZE);
+    ph = _db_graph_batch_keys(db_graph, bkmers+i, rhashes ? rhashes+i : NULL,
+                              m, bkeys, prehash);
+
+    if(db_graph->bktlocks != NULL) {
+      nadded = hash_table_find_or_insert_batch_mt(&db_graph->ht, bkeys, ph, m,
+                                                  hkeys, found+i,
+                                                  db_graph->bktlocks);
+    } else {
+      nadded = hash_table_find_or_insert_batch_cas(&db_graph->ht, bkeys, ph, m,
+                                                   hkeys, found+i);
+    }
+
+    for(j = 0; j < nadded; j++) {
+      nodes[i+j] = (dBNode){.key = hkeys[j],
+                            .orient = bkmer_get_orientation(bkeys[j], bkmers[i+j])};
+    }
+
+    if(nadded < m) return i + nadded; // table full
+  }
+
+  return n;
+}
+
 dBNode db_graph_find_str(const dBGraph *db_graph, const char *str)
 {
   BinaryKmer bkmer;
@@ -278,10 +462,11 @@ uint8_t db_graph_next_nodes_in_col(const dBGraph *db_graph,
               (db_graph->num_of_cols == 1 && colour == 0) ||
               db_graph->num_of_cols == db_graph->num_edge_cols ||
               (db_graph->num_of_cols > 1 && db_graph->num_edge_cols == 1 &&
-                (db_graph->node_in_cols || db_graph->col_covgs)),
+                (db_graph_has_node_in_cols(db_graph) ||
+                 db_graph_has_covgs(db_graph))),
               "col: %i; cols: %zu edges: %zu node_in_cols: %i col_covgs: %i",
               colour, db_graph->num_of_cols, db_graph->num_edge_cols,
-              !!db_graph->node_in_cols, !!db_graph->col_covgs);
+              db_graph_has_node_in_cols(db_graph), db_graph_has_covgs(db_graph));
 
   size_t i, j;
   Edges edges;
@@ -307,8 +492,9 @@ uint8_t db_graph_next_nodes_in_col(const dBGraph *db_graph,
   if(colour >= 0 && db_graph->num_edge_cols < db_graph->num_of_cols)
   {
     for(i = j = 0; i < count; i++) {
-      if(( db_graph->node_in_cols && db_node_has_col(db_graph, nodes[i].key, colour)) ||
-         (!db_graph->node_in_cols && db_node_covg(db_graph, nodes[i].key, colour) > 0))
+      if(db_graph_has_node_in_cols(db_graph)
+           ? db_node_has_col(db_graph, nodes[i].key, colour)
+           : db_node_get_covg(db_graph, nodes[i].key, colour) > 0)
       {
         nodes[j] = nodes[i];
         fw_nucs[j] = fw_nucs[i];
@@ -359,7 +545,7 @@ uint8_t db_graph_prev_nodes_with_mask(const dBGraph *db_graph, dBNode node,
                                  prev_nodes, prev_bases);
 
   // If we have the ability, slim down nodes by those in this colour
-  if(colour >= 0 && db_graph->node_in_cols != NULL) {
+  if(colour >= 0 && db_graph_has_node_in_cols(db_graph)) {
     for(i = j = 0; i < num_prev; i++) {
       if(db_node_has_col(db_graph, prev_nodes[i].key, colour)) {
         prev_nodes[j] = prev_nodes[i];
@@ -454,27 +640,261 @@ void db_graph_healthcheck(const dBGraph *db_graph)
 // Functions applying to whole graph
 //
 
-void db_graph_reset(dBGraph *db_graph)
+// Zero node data for nodes start..end-1
+static void db_graph_reset_range(hkey_t start, hkey_t end, void *arg)
 {
-  size_t col, capacity = db_graph->ht.capacity;
+  dBGraph *db_graph = (dBGraph*)arg;
   size_t ncols = db_graph->num_of_cols, nedgecols = db_graph->num_edge_cols;
+  size_t n = end - start;
+
+  if(db_graph->node_recs != NULL) {
+    memset(db_graph->node_recs + start * db_graph->node_stride, 0,
+           n * db_graph->node_stride);
+  } else {
+    if(db_graph->col_edges != NULL)
+      memset(db_graph->col_edges + start * nedgecols, 0,
+             n * nedgecols * sizeof(Edges));
+    if(db_graph->col_covgs != NULL)
+      memset(db_graph->col_covgs + start * ncols, 0, n * ncols * sizeof(Covg));
+    if(db_graph->col_covgs8 != NULL)
+      memset(db_graph->col_covgs8 + start * ncols, 0, n * ncols);
+    // ranges start on a byte boundary (start is a multiple of 64)
+    if(db_graph->node_in_cols != NULL)
+      memset(db_graph->node_in_cols + start / 8 * ncols, 0,
+             (roundup_bits2bytes(end) - start / 8) * ncols);
+  }
+  if(db_graph->readstrt != NULL)
+    memset(db_graph->readstrt + start / 4, 0,
+           roundup_bits2bytes(2 * end) - start / 4);
+}
+
+// Only regions of the hash table that have been written to are cleared
+void db_graph_reset(dBGraph *db_graph, size_t nthreads)
+{
+  size_t col, ncols = db_graph->num_of_cols;
+
+  ctx_assert2(!db_graph_has_col_classes(db_graph), "Colour classes are read only");
 
   for(col = 0; col < ncols; col++)
     graph_info_init(&db_graph->ginfo[col]);
 
-  hash_table_empty(&db_graph->ht);
+  // Clear node data while the dirty bitmap is still set
+  hash_table_dirty_iterate(&db_graph->ht, nthreads,
+                           db_graph_reset_range, db_graph);
+  hash_table_empty(&db_graph->ht, nthreads);
+  if(db_graph->col_covgs8 != NULL) covg_ovf_reset(&db_graph->covg_ovf);
   db_graph->num_of_cols_used = 0;
 
-  if(db_graph->col_edges != NULL)
-    memset(db_graph->col_edges, 0, nedgecols * sizeof(Edges) * capacity);
-  if(db_graph->col_covgs != NULL)
-    memset(db_graph->col_covgs, 0, ncols * sizeof(Covg) * capacity);
-  if(db_graph->node_in_cols != NULL)
-    memset(db_graph->node_in_cols, 0, roundup_bits2bytes(capacity) * ncols);
+  gpath_store_reset(&db_graph->gpstore);
+}
+
+bool db_graph_compress_colours(dBGraph *db_graph)
+{
+  const size_t ncols = db_graph->num_of_cols;
+  const size_t bitset_mem = roundup_bits2bytes(db_graph->ht.capacity) * ncols;
+  ColourClasses *cc = &db_graph->col_classes;
+
+  if(db_graph->node_in_cols == NULL || db_graph->node_stride ||
+     ncols < DBG_COL_CLASSES_MIN_COLS) return false;
+
+  colour_classes_build(cc, db_graph->node_in_cols, ncols, &db_graph->ht);
+
+  size_t cc_mem = colour_classes_mem(cc);
+  char nclasses_str[50], cc_mem_str[50], bitset_mem_str[50];
+  ulong_to_str(cc->nclasses, nclasses_str);
+  bytes_to_str(cc_mem, 1, cc_mem_str);
+  bytes_to_str(bitset_mem, 1, bitset_mem_str);
+
+  if(cc_mem >= bitset_mem) {
+    status("[graph] Not using %s colour classes: %s vs %s",
+           nclasses_str, cc_mem_str, bitset_mem_str);
+    colour_classes_dealloc(cc);
+    return false;
+  }
+
+  status("[graph] Using %s colour classes: %s instead of %s",
+         nclasses_str, cc_mem_str, bitset_mem_str);
+
+  if(db_graph->image != NULL) ctx_free(db_graph->node_in_cols);
+  else ctx_free_large(db_graph->node_in_cols);
+  db_graph->node_in_cols = NULL;
+  return true;
+}
+
+//
+// Growing the hash table
+//
+
+void db_graph_set_growable(dBGraph *db_graph, size_t nthreads)
+{
+  ctx_assert(db_graph->image == NULL);
+  ctx_assert(!db_graph_has_col_classes(db_graph));
+  db_graph->grow_nthreads = nthreads;
+  db_graph->ht.growable = (nthreads > 0);
+}
+
+void db_graph_set_grow_flush(dBGraph *db_graph, void (*func)(void *arg),
+                             void *arg)
+{
+  db_graph->grow_flush = func;
+  db_graph->grow_flush_arg = arg;
+}
+
+void db_graph_grow_enter(dBGraph *db_graph)
+{
+  if(!db_graph->grow_nthreads) return;
+  while(1) {
+    while(db_graph->grow_busy) sched_yield();
+    __sync_fetch_and_add(&db_graph->grow_nactive, 1);
+    if(!db_graph->grow_busy) break;
+    // Lost a race with a thread starting to grow the table
+    __sync_fetch_and_sub(&db_graph->grow_nactive, 1);
+  }
+}
+
+void db_graph_grow_exit(dBGraph *db_graph)
+{
+  if(!db_graph->grow_nthreads) return;
+  __sync_fetch_and_sub(&db_graph->grow_nactive, 1);
+}
+
+void db_graph_grow_mt(dBGraph *db_graph, uint64_t capacity)
+{
+  ctx_assert(db_graph->grow_nthreads > 0);
+  db_graph_grow_exit(db_graph);
+
+  if(__sync_bool_compare_and_swap(&db_graph->grow_busy, false, true)) {
+    // Wait for all other threads to drop their node keys
+    while(db_graph->grow_nactive > 0) sched_yield();
+    if(db_graph->ht.capacity == capacity) {
+      if(db_graph->grow_flush) db_graph->grow_flush(db_graph->grow_flush_arg);
+      db_graph_grow(db_graph, db_graph->grow_nthreads);
+    }
+    __sync_synchronize();
+    db_graph->grow_busy = false;
+  }
+
+  db_graph_grow_enter(db_graph);
+}
+
+typedef struct
+{
+  const dBGraph *src;
+  dBGraph *dst;
+  hkey_t start, end;
+} GraphGrowJob;
+
+// Move nodes start..end-1 from src to dst
+static void db_graph_grow_job(void *arg, size_t threadid)
+{
+  (void)threadid;
+  const GraphGrowJob *job = (const GraphGrowJob*)arg;
+  const dBGraph *src = job->src;
+  dBGraph *dst = job->dst;
+  const size_t ncols = src->num_of_cols, nedgecols = src->num_edge_cols;
+  size_t col;
+  hkey_t hkey, newkey;
+  bool found;
+
+  for(hkey = job->start; hkey < job->end; hkey++)
+  {
+    if(!db_graph_node_assigned(src, hkey)) continue;
+    newkey = hash_table_find_or_insert_cas(&dst->ht,
+                                           hash_table_fetch(&src->ht, hkey),
+                                           &found);
+    ctx_assert(!found);
+
+    if(src->col_edges != NULL) {
+      memcpy(&db_node_edges(dst, newkey, 0), &db_node_edges(src, hkey, 0),
+             nedgecols * sizeof(Edges));
+    }
+    if(src->col_covgs != NULL) {
+      memcpy(&db_node_covg(dst, newkey, 0), &db_node_covg(src, hkey, 0),
+             ncols * sizeof(Covg));
+    }
+    if(src->col_covgs8 != NULL) {
+      for(col = 0; col < ncols; col++)
+        db_node_set_covg(dst, newkey, col, db_node_get_covg(src, hkey, col));
+    }
+    if(src->node_in_cols != NULL) {
+      for(col = 0; col < ncols; col++)
+        if(db_node_has_col(src, hkey, col)) db_node_set_col_mt(dst, newkey, col);
+    }
+    if(src->readstrt != NULL) {
+      if(bitset_get(src->readstrt, 2*hkey))
+        (void)bitset_set_mt(dst->readstrt, 2*newkey);
+      if(bitset_get(src->readstrt, 2*hkey+1))
+        (void)bitset_set_mt(dst->readstrt, 2*newkey+1);
+    }
+  }
+}
+
+void db_graph_grow(dBGraph *db_graph, size_t nthreads)
+{
+  ctx_assert(db_graph->image == NULL);
+  ctx_assert2(!gpath_store_is_alloced(&db_graph->gpstore),
+              "Cannot grow with links");
+  ctx_assert(!db_graph_has_path_hash(db_graph));
+
+  const bool growable = db_graph->ht.growable;
+  nthreads = MAX2(nthreads, 1);
+
+  // Copy of the graph with a table twice the size
+  dBGraph newgraph;
+  memcpy(&newgraph, db_graph, sizeof(dBGraph));
+  hash_table_alloc(&newgraph.ht, db_graph->ht.capacity * 2);
+  const uint64_t capacity = newgraph.ht.capacity;
+
+  db_graph_alloc_node_arrays(&newgraph, capacity,
+                             db_graph->col_edges != NULL,
+                             db_graph_has_covgs(db_graph),
+                             db_graph->node_in_cols != NULL,
+                             db_graph->node_recs != NULL,
+                             db_graph->col_covgs8 != NULL);
+  if(db_graph->bktlocks != NULL)
+    newgraph.bktlocks = ctx_calloc(roundup_bits2bytes(newgraph.ht.num_of_buckets), 1);
   if(db_graph->readstrt != NULL)
-    memset(db_graph->readstrt, 0, 2 * roundup_bits2bytes(capacity) * ncols);
+    newgraph.readstrt = ctx_calloc_large(roundup_bits2bytes(capacity)*2, 1);
+
+  // Split old table between jobs
+  size_t i, njobs = nthreads * 8;
+  hkey_t step = (db_graph->ht.capacity + njobs - 1) / njobs;
+  GraphGrowJob *jobs = ctx_calloc(njobs, sizeof(GraphGrowJob));
+  for(i = 0; i < njobs; i++) {
+    jobs[i].src = db_graph;
+    jobs[i].dst = &newgraph;
+    jobs[i].start = MIN2(i * step, db_graph->ht.capacity);
+    jobs[i].end = MIN2((i+1) * step, db_graph->ht.capacity);
+  }
 
-  gpath_store_reset(&db_graph->gpstore);
+  util_run_threads(jobs, njobs, sizeof(GraphGrowJob), nthreads,
+                   db_graph_grow_job);
+
+  ctx_free(jobs);
+  ctx_assert(newgraph.ht.num_kmers == db_graph->ht.num_kmers);
+
+  hash_table_dealloc(&db_graph->ht);
+  db_graph_free_node_arrays(db_graph);
+  ctx_free(db_graph->bktlocks);
+  ctx_free_large(db_graph->readstrt);
+
+  // Only copy back the fields that changed: other threads may be updating
+  // grow_nactive while waiting for us
+  newgraph.ht.growable = growable;
+  memcpy(&db_graph->ht, &newgraph.ht, sizeof(HashTable));
+  db_graph->col_edges = newgraph.col_edges;
+  db_graph->col_covgs = newgraph.col_covgs;
+  db_graph->col_covgs8 = newgraph.col_covgs8;
+  db_graph->covg_ovf = newgraph.covg_ovf;
+  db_graph->bktlocks = newgraph.bktlocks;
+  db_graph->readstrt = newgraph.readstrt;
+  db_graph->node_in_cols = newgraph.node_in_cols;
+  db_graph->node_recs = newgraph.node_recs;
+
+  char capacity_str[50];
+  ulong_to_str(capacity, capacity_str);
+  status("[graph] Grew hash table to %s entries", capacity_str);
+  hash_table_print_stats_brief(&db_graph->ht);
 }
 
 //
@@ -549,6 +969,18 @@ void db_graph_wipe_colour(dBGraph *db_graph, Colour col)
 
   graph_info_init(&db_graph->ginfo[col]);
 
+  if(db_graph->node_recs != NULL || db_graph->col_covgs8 != NULL)
+  {
+    for(i = 0; i < capacity; i++) {
+      if(db_graph->node_in_cols != NULL) db_node_del_col_mt(db_graph, i, col);
+      if(db_graph_has_covgs(db_graph)) db_node_set_covg(db_graph, i, col, 0);
+      if(db_graph->col_edges != NULL) {
+        db_node_edges(db_graph, i, db_graph->num_edge_cols == 1 ? 0 : col) = 0;
+      }
+    }
+    return;
+  }
+
   if(db_graph->node_in_cols != NULL)
   {
     size_t nbytes = roundup_bits2bytes(capacity);
@@ -666,6 +1098,7 @@ static void intersect_edges(void *arg, size_t threadid)
 
 void db_graph_intersect_edges(dBGraph *db_graph, size_t nthreads, Edges *edges)
 {
+  ctx_assert2(db_graph->node_recs == NULL, "Requires separate edge array");
   IntersectEdgesJob job = {.isec_edges = edges,
                            .db_graph = db_graph,
                            .nthreads = nthreads};
@@ -720,8 +1153,12 @@ void db_graph_print_kmer2(BinaryKmer bkmer, Covg *covgs, Edges *edges,
 void db_graph_print_kmer(hkey_t node, dBGraph *db_graph, FILE *fout)
 {
   BinaryKmer bkmer = db_node_get_bkey(db_graph, node);
-  Covg *covgs = &db_node_covg(db_graph, node, 0);
+  Covg covgs[db_graph->num_of_cols];
   Edges *edges = &db_node_edges(db_graph, node, 0);
+  size_t col;
+
+  for(col = 0; col < db_graph->num_of_cols; col++)
+    covgs[col] = db_node_get_covg(db_graph, node, col);
 
   db_graph_print_kmer2(bkmer, covgs, edges,
                        db_graph->num_of_cols, db_graph->kmer_size,
@@ -10,12 +10,16 @@
 #include "graph_info.h"
 #include "gpath_store.h"
 #include "gpath_hash.h"
+#include "covg_overflow.h"
+#include "colour_classes.h"
 
 extern const int DBG_ALLOC_EDGES;
 extern const int DBG_ALLOC_COVGS;
 extern const int DBG_ALLOC_BKTLOCKS;
 extern const int DBG_ALLOC_READSTRT;
 extern const int DBG_ALLOC_NODE_IN_COL;
+extern const int DBG_ALLOC_NODE_RECORDS;
+extern const int DBG_ALLOC_SMALL_COVGS;
 
 //
 // Graph
@@ -40,6 +44,7 @@ typedef struct
   Covg *col_covgs; // num_edge_cols*ht.capacity size addr: [hkey*num_edge_cols + col]
 
   // This should be cast to volatile to read / write
+  // If NULL, threadsafe find/insert use lock-free compare-and-swap instead
   uint8_t *bktlocks;
 
   // 1 bit per kmer, per colour
@@ -47,18 +52,72 @@ typedef struct
   // [num_of_colours*hkey/64+col] >> hkey%64
   uint8_t *node_in_cols;
 
+  // If not NULL, col_covgs, col_edges and node_in_cols point into this array
+  // of one record per node, node_stride bytes each (DBG_ALLOC_NODE_RECORDS).
+  // Always use the accessors in db_node.h, which hide the layout.
+  uint8_t *node_recs;
+  size_t node_stride; // zero unless node_recs is set
+
+  // If not NULL, coverages are 8 bit counters (DBG_ALLOC_SMALL_COVGS) laid out
+  // like col_covgs, which is then NULL. Counts that don't fit are in covg_ovf.
+  uint8_t *col_covgs8;
+  CovgOverflow covg_ovf;
+
+  // If col_classes.node_class is not NULL, colour bits are held as shared
+  // colour classes instead of in node_in_cols, which is then NULL. Read only,
+  // see db_graph_compress_colours()
+  ColourClasses col_classes;
+
   // New path data
   GPathStore gpstore;
   GPathHash gphash; // adding new paths quickly
 
   // Loading reads, 2 bits per kmers
   uint8_t *readstrt;
+
+  // If not NULL, ht, col_edges and col_covgs point into this read-only
+  // mmap'd graph image (see graph_image.h)
+  void *image;
+  size_t image_size;
+
+  // Growing the hash table when it is full (see db_graph_set_growable())
+  // grow_nthreads is zero unless growable
+  size_t grow_nthreads;
+  volatile size_t grow_nactive; // threads that may hold node keys
+  volatile bool grow_busy; // a thread is growing the table
+  // If not NULL, called before nodes move (see db_graph_set_grow_flush())
+  void (*grow_flush)(void *arg);
+  void *grow_flush_arg;
 } dBGraph;
 
 #define db_graph_has_path_hash(graph) ((graph)->gphash.table != NULL)
 #define db_graph_node_assigned(graph,hkey) hash_table_assigned(&(graph)->ht, hkey)
+#define db_graph_has_covgs(graph) \
+        ((graph)->col_covgs != NULL || (graph)->col_covgs8 != NULL)
+#define db_graph_has_col_classes(graph) ((graph)->col_classes.node_class != NULL)
+// Whether db_node_has_col() can be used
+#define db_graph_has_node_in_cols(graph) \
+        ((graph)->node_in_cols != NULL || db_graph_has_col_classes(graph))
+
+// Distance between nodes in col_edges and col_covgs, in elements
+#define db_graph_edges_stride(graph) \
+        ((graph)->node_stride ? (graph)->node_stride : (graph)->num_edge_cols)
+#define db_graph_covgs_stride(graph) \
+        ((graph)->node_stride ? (graph)->node_stride / sizeof(Covg) \
+                              : (graph)->num_of_cols)
+
+// Traversal commands (contigs, thread, bubbles) use node records when there are
+// at most this many colours. Colour bits then take one byte per node.
+#define DBG_NODE_RECORDS_MAX_COLS 3
 
 // alloc_flags specifies where fields to malloc. OR together DBG_ALLOC_* values
+// DBG_ALLOC_NODE_RECORDS stores the coverages, edges and colour bits of a node
+// together in one record, rather than in separate arrays. Traversals then
+// touch fewer cache lines per node, but graph images, ctx build --intersect
+// and merging graph files require separate arrays.
+// DBG_ALLOC_SMALL_COVGS (with DBG_ALLOC_COVGS) stores coverages in one byte
+// per node per colour, with larger counts in a side table. Use the coverage
+// accessors in db_node.h. Not for use with node records or graph images.
 void db_graph_alloc(dBGraph *db_graph, size_t kmer_size,
                     size_t num_of_cols, size_t num_edge_cols,
                     uint64_t capacity, int alloc_flags);
@@ -66,7 +125,53 @@ void db_graph_alloc(dBGraph *db_graph, size_t kmer_size,
 // Free memory used by all fields as well
 void db_graph_dealloc(dBGraph *db_graph);
 
-void db_graph_reset(dBGraph *db_graph);
+// Remove all nodes and paths, using nthreads to clear node data
+void db_graph_reset(dBGraph *db_graph, size_t nthreads);
+
+// Colour classes only save memory with many colours, since each node stores
+// a 32 bit class id
+#define DBG_COL_CLASSES_MIN_COLS 64
+
+// Replace node_in_cols with colour classes (see colour_classes.h) if that uses
+// less memory. Call once the graph is loaded: no more kmers or colour bits can
+// be added afterwards, but db_node_has_col() still works.
+// Returns true if node_in_cols was replaced.
+bool db_graph_compress_colours(dBGraph *db_graph);
+
+//
+// Growing the hash table
+//
+// Node keys index every per-node array, so growing the hash table moves every
+// node. When growable, threadsafe inserts return nodes with key
+// HASH_NOT_FOUND if the table is full, instead of exiting. Threads that hold
+// node keys whilst others may be inserting must do so between
+// db_graph_grow_enter() and db_graph_grow_exit(). On a failed insert they call
+// db_graph_grow_mt(), then look up again any nodes they held.
+//
+
+// Allow the hash table to grow, using nthreads to move nodes
+// nthreads == 0 turns off growing
+void db_graph_set_growable(dBGraph *db_graph, size_t nthreads);
+
+// Threads may also keep node keys outside of the region, e.g. in per-thread
+// buffers of updates. `func(arg)` is called by the thread growing the table
+// once no other thread is in the region, before nodes move, to write them out.
+// Pass func == NULL to remove.
+void db_graph_set_grow_flush(dBGraph *db_graph, void (*func)(void *arg),
+                             void *arg);
+
+// Enter/exit a region in which node keys are held. No-ops unless growable
+void db_graph_grow_enter(dBGraph *db_graph);
+void db_graph_grow_exit(dBGraph *db_graph);
+
+// Call between db_graph_grow_enter() and db_graph_grow_exit() after an insert
+// failed. Waits for other threads to exit, then doubles the hash table unless
+// another thread has already grown it since it had `capacity` entries.
+void db_graph_grow_mt(dBGraph *db_graph, uint64_t capacity);
+
+// Not threadsafe. Double the hash table capacity and move all nodes with their
+// edges, coverages, colour and read start bits. Node keys all change.
+void db_graph_grow(dBGraph *db_graph, size_t nthreads);
 
 //
 // Add to the de bruijn graph
@@ -81,7 +186,8 @@ void db_graph_update_node_mt(dBGraph *db_graph, dBNode node, Colour col);
 dBNode db_graph_find_or_add_node(dBGraph *db_graph, BinaryKmer bkmer,
                                  bool *found);
 
-// Thread safe
+// Thread safe, uses bucket locks if allocated (DBG_ALLOC_BKTLOCKS) otherwise
+// lock-free inserts
 // Note: node may alreay exist in the graph
 dBNode db_graph_find_or_add_node_mt(dBGraph *db_graph, BinaryKmer bkmer,
                                     bool *found);
@@ -91,6 +197,23 @@ dBNode db_graph_find_node(const dBGraph *db_graph, BinaryKmer bkmer);
 dBNode db_graph_find_node_mt(dBGraph *db_graph, BinaryKmer bkmer);
 dBNode db_graph_find_str(const dBGraph *db_graph, const char *str);
 
+// Batched versions of db_graph_find_node(), db_graph_find_node_mt() and
+// db_graph_find_or_add_node_mt()
+// Look up n kmers, prefetching hash table buckets ahead of searching them.
+// Results in nodes[0..n-1] (and found[0..n-1]) in the order of bkmers.
+// `rhashes` are rolling hashes of bkmers, NULL unless BINARY_KMER_ROLL_HASH
+void db_graph_find_nodes(const dBGraph *db_graph, const BinaryKmer *bkmers,
+                         const RollHash *rhashes, size_t n, dBNode *nodes);
+void db_graph_find_nodes_mt(dBGraph *db_graph, const BinaryKmer *bkmers,
+                            const RollHash *rhashes, size_t n, dBNode *nodes);
+// db_graph_find_or_add_nodes_mt() stops at the first kmer that does not fit
+// in a growable table and returns its index (n if all were found or added).
+// nodes[] and found[] are only set for kmers before it.
+size_t db_graph_find_or_add_nodes_mt(dBGraph *db_graph,
+                                     const BinaryKmer *bkmers,
+                                     const RollHash *rhashes, size_t n,
+                                     dBNode *nodes, bool *found);
+
 // In the case of self-loops in palindromes the two edges collapse into one
 void db_graph_add_edge(dBGraph *db_graph, Colour colour,
                        hkey_t src_node, hkey_t tgt_node,
@@ -125,19 +125,94 @@ char* db_node_get_edges_str(Edges edges, char *kmer_col_edge_str)
 // Coverages
 //
 
+// Add to an 8 bit coverage, moving the count to the overflow table once it
+// reaches COVG8_ESCAPE
+static void db_node_add_covg8(dBGraph *graph, hkey_t hkey, Colour col,
+                              Covg update)
+{
+  uint8_t *ptr = &db_node_covg8(graph,hkey,col);
+  if(*ptr < COVG8_ESCAPE) {
+    if((uint64_t)*ptr + update < COVG8_ESCAPE) { *ptr += update; return; }
+    update = SAFE_ADD_COVG(*ptr, update);
+    *ptr = COVG8_ESCAPE;
+  }
+  covg_ovf_add(&graph->covg_ovf, db_node_covg8_idx(graph,hkey,col), update);
+}
+
+// Adds to the overflow table commute, so threads racing to move the same
+// counter to the table still sum correctly
+static void db_node_add_covg8_mt(dBGraph *graph, hkey_t hkey, Colour col,
+                                 Covg update)
+{
+  volatile uint8_t *ptr = &db_node_covg8(graph,hkey,col);
+  uint8_t v;
+  while((v = *ptr) < COVG8_ESCAPE) {
+    if((uint64_t)v + update < COVG8_ESCAPE) {
+      if(__sync_bool_compare_and_swap(ptr, v, (uint8_t)(v + update))) return;
+    }
+    else if(__sync_bool_compare_and_swap(ptr, v, COVG8_ESCAPE)) {
+      update = SAFE_ADD_COVG(v, update);
+      break;
+    }
+  }
+  covg_ovf_add(&graph->covg_ovf, db_node_covg8_idx(graph,hkey,col), update);
+}
+
+void db_node_set_covg(dBGraph *graph, hkey_t hkey, Colour col, Covg covg)
+{
+  if(graph->col_covgs8 == NULL) { db_node_covg(graph,hkey,col) = covg; return; }
+
+  uint8_t *ptr = &db_node_covg8(graph,hkey,col);
+  uint64_t idx = db_node_covg8_idx(graph,hkey,col);
+  if(covg >= COVG8_ESCAPE) covg_ovf_set(&graph->covg_ovf, idx, covg);
+  else if(*ptr == COVG8_ESCAPE) covg_ovf_del(&graph->covg_ovf, idx);
+  *ptr = (uint8_t)MIN2(covg, COVG8_ESCAPE);
+}
+
+void db_node_zero_covgs(dBGraph *graph, hkey_t hkey)
+{
+  size_t col, ncols = graph->num_of_cols;
+  if(graph->col_covgs8 == NULL) {
+    memset(&db_node_covg(graph,hkey,0), 0, ncols * sizeof(Covg));
+    return;
+  }
+  for(col = 0; col < ncols; col++) db_node_set_covg(graph, hkey, col, 0);
+}
+
 void db_node_add_col_covg(dBGraph *graph, hkey_t hkey, Colour col, Covg update)
 {
-  SAFE_SUM_COVG(db_node_covg(graph,hkey,col), update);
+  if(graph->col_covgs8 != NULL) db_node_add_covg8(graph, hkey, col, update);
+  else SAFE_SUM_COVG(db_node_covg(graph,hkey,col), update);
 }
 
 void db_node_increment_coverage(dBGraph *graph, hkey_t hkey, Colour col)
 {
-  SAFE_SUM_COVG(db_node_covg(graph,hkey,col), 1);
+  db_node_add_col_covg(graph, hkey, col, 1);
+}
+
+// Thread safe, overflow safe, coverage update
+void db_node_add_col_covg_mt(dBGraph *graph, hkey_t hkey, Colour col,
+                             Covg update)
+{
+  if(graph->col_covgs8 != NULL) {
+    db_node_add_covg8_mt(graph, hkey, col, update);
+    return;
+  }
+
+  Covg v;
+  while((v = db_node_covg(graph,hkey,col)) < COVG_MAX &&
+        !__sync_bool_compare_and_swap(&db_node_covg(graph,hkey,col), v,
+                                      SAFE_ADD_COVG(v, update)));
 }
 
 // Thread safe, overflow safe, coverage increment
 void db_node_increment_coverage_mt(dBGraph *graph, hkey_t hkey, Colour col)
 {
+  if(graph->col_covgs8 != NULL) {
+    db_node_add_covg8_mt(graph, hkey, col, 1);
+    return;
+  }
+
   Covg v;
   while((v = db_node_covg(graph,hkey,col)) < COVG_MAX &&
         !__sync_bool_compare_and_swap(&db_node_covg(graph,hkey,col), v, v+1));
@@ -264,34 +339,25 @@ void db_nodes_print(const dBNode *nodes, size_t num,
   }
 }
 
-void db_nodes_gzprint(const dBNode *nodes, size_t num,
-                      const dBGraph *db_graph, gzFile out)
+void db_nodes_sprint(const dBNode *nodes, size_t num,
+                     const dBGraph *db_graph, StrBuf *sbuf)
 {
-  size_t i, kmer_size = db_graph->kmer_size;
-  Nucleotide nuc;
-  BinaryKmer bkmer;
-  char tmp[MAX_KMER_SIZE+1];
-
-  bkmer = db_node_oriented_bkmer(db_graph, nodes[0]);
-  binary_kmer_to_str(bkmer, kmer_size, tmp);
-  gzputs(out, tmp);
-
-  for(i = 1; i < num; i++) {
-    nuc = db_node_get_last_nuc(nodes[i], db_graph);
-    gzputc(out, dna_nuc_to_char(nuc));
-  }
+  strbuf_ensure_capacity(sbuf, sbuf->end + db_graph->kmer_size + num);
+  sbuf->end += db_nodes_to_str(nodes, num, db_graph, sbuf->b+sbuf->end);
 }
 
 // Do not print first k-1 bases => 3 nodes gives 3bp instead of 3+k-1
-void db_nodes_gzprint_cont(const dBNode *nodes, size_t num,
-                           const dBGraph *db_graph, gzFile out)
+void db_nodes_sprint_cont(const dBNode *nodes, size_t num,
+                          const dBGraph *db_graph, StrBuf *sbuf)
 {
   size_t i;
   Nucleotide nuc;
+  strbuf_ensure_capacity(sbuf, sbuf->end + num);
   for(i = 0; i < num; i++) {
     nuc = db_node_get_last_nuc(nodes[i], db_graph);
-    gzputc(out, dna_nuc_to_char(nuc));
+    sbuf->b[sbuf->end++] = dna_nuc_to_char(nuc);
   }
+  sbuf->b[sbuf->end] = '\0';
 }
 
 // Print:
@@ -44,41 +44,52 @@ static inline BinaryKmer db_node_get_bkey(const dBGraph *db_graph, hkey_t hkey)
 /* word index */
 #define ksetw(arr,ncols,hkey,col) (((hkey)/(sizeof(*arr)*8))*(ncols)+(col))
 
-static inline bool db_node_in_col(const dBGraph *graph, hkey_t hkey, size_t col)
+// With node records (DBG_ALLOC_NODE_RECORDS) a node's colour bits are a
+// bitset in its record instead
+#define db_node_colw(graph,hkey,col) \
+        ((graph)->node_stride ? (hkey)*(graph)->node_stride + (col)/8 \
+         : ksetw((graph)->node_in_cols,(graph)->num_of_cols,hkey,col))
+#define db_node_colo(graph,hkey,col) \
+        ((graph)->node_stride ? (col)%8 : kseto((graph)->node_in_cols,hkey))
+
+// With colour classes (db_graph_compress_colours()) node_in_cols is NULL and
+// colour bits can only be read
+static inline bool db_node_has_col(const dBGraph *graph, hkey_t hkey, size_t col)
 {
-  return graph->node_in_cols == NULL ||
-         bitset2_get(graph->node_in_cols,
-                     ksetw(graph->node_in_cols,graph->num_of_cols,hkey,col),
-                     kseto(graph->node_in_cols,hkey));
+  if(graph->node_in_cols == NULL) {
+    const ColourClasses *cc = &graph->col_classes;
+    return colour_classes_has_col(cc, cc->node_class[hkey], col);
+  }
+  return bitset2_get(graph->node_in_cols,
+                     db_node_colw(graph,hkey,col),
+                     db_node_colo(graph,hkey,col));
 }
 
-static inline bool db_node_has_col(const dBGraph *graph, hkey_t hkey, size_t col)
+static inline bool db_node_in_col(const dBGraph *graph, hkey_t hkey, size_t col)
 {
-  return bitset2_get(graph->node_in_cols,
-                     ksetw(graph->node_in_cols,graph->num_of_cols,hkey,col),
-                     kseto(graph->node_in_cols,hkey));
+  return !db_graph_has_node_in_cols(graph) || db_node_has_col(graph, hkey, col);
 }
 
 static inline void db_node_set_col(const dBGraph *graph, hkey_t hkey, size_t col)
 {
   bitset2_set(graph->node_in_cols,
-              ksetw(graph->node_in_cols,graph->num_of_cols,hkey,col),
-              kseto(graph->node_in_cols,hkey));
+              db_node_colw(graph,hkey,col),
+              db_node_colo(graph,hkey,col));
 }
 
 static inline void db_node_del_col_mt(const dBGraph *graph, hkey_t hkey, size_t col)
 {
   (void)bitset2_del_mt(graph->node_in_cols,
-                       ksetw(graph->node_in_cols,graph->num_of_cols,hkey,col),
-                       kseto(graph->node_in_cols,hkey));
+                       db_node_colw(graph,hkey,col),
+                       db_node_colo(graph,hkey,col));
 }
 
 static inline void db_node_or_col(const dBGraph *graph, hkey_t hkey,
                                   size_t col, uint8_t bit)
 {
   bitset2_or(graph->node_in_cols,
-             ksetw(graph->node_in_cols,graph->num_of_cols,hkey,col),
-             kseto(graph->node_in_cols,hkey),bit);
+             db_node_colw(graph,hkey,col),
+             db_node_colo(graph,hkey,col),bit);
 }
 
 // Threadsafe
@@ -86,8 +97,8 @@ static inline void db_node_set_col_mt(const dBGraph *graph,
                                       hkey_t hkey, size_t col)
 {
   (void)bitset2_set_mt(graph->node_in_cols,
-                       ksetw(graph->node_in_cols,graph->num_of_cols,hkey,col),
-                       kseto(graph->node_in_cols,hkey));
+                       db_node_colw(graph,hkey,col),
+                       db_node_colo(graph,hkey,col));
 }
 
 
@@ -238,15 +249,14 @@ static inline char *edges_get_str(Edges fw_edges, char *str)
 //
 
 #define db_node_edges(graph,hkey,col) \
-        ((graph)->col_edges[(hkey)*(graph)->num_edge_cols + (col)])
+        ((graph)->col_edges[(hkey)*db_graph_edges_stride(graph) + (col)])
 
 static inline Edges db_node_get_edges(const dBGraph *graph, hkey_t hkey, Colour col) {
   return db_node_edges(graph, hkey, col);
 }
 
 static inline Edges db_node_get_edges_union(const dBGraph *graph, hkey_t hkey) {
-  return edges_get_union(graph->col_edges + hkey * graph->num_edge_cols,
-                         graph->num_edge_cols);
+  return edges_get_union(&db_node_edges(graph, hkey, 0), graph->num_edge_cols);
 }
 
 // Edges restricted to this colour, only in one direction (node.orient)
@@ -263,7 +273,7 @@ Edges db_node_both_edges_in_col(hkey_t hkey, size_t col, const dBGraph *db_graph
         db_node_outdegree_in_col(db_node_reverse(node),col,graph)
 
 #define db_node_zero_edges(graph,hkey) \
-        memset((graph)->col_edges + (hkey)*(graph)->num_edge_cols, 0, \
+        memset(&db_node_edges(graph,hkey,0), 0, \
                (graph)->num_edge_cols * sizeof(Edges))
 
 #define db_node_set_col_edge(graph,hkey,col,nuc,or) \
@@ -282,29 +292,46 @@ char* db_node_get_edges_str(Edges edges, char *kmer_col_edge_str);
 //
 
 #define db_node_covg(graph,hkey,col) \
-        ((graph)->col_covgs[(hkey)*(graph)->num_of_cols+(col)])
+        ((graph)->col_covgs[(hkey)*db_graph_covgs_stride(graph)+(col)])
+
+// 8 bit coverages (DBG_ALLOC_SMALL_COVGS), index is also the overflow key
+#define db_node_covg8_idx(graph,hkey,col) ((hkey)*(graph)->num_of_cols+(col))
+#define db_node_covg8(graph,hkey,col) \
+        ((graph)->col_covgs8[db_node_covg8_idx(graph,hkey,col)])
 
 static inline Covg db_node_get_covg(const dBGraph *db_graph,
                                     hkey_t hkey, Colour col) {
+  if(db_graph->col_covgs8 != NULL) {
+    uint8_t covg = db_node_covg8(db_graph, hkey, col);
+    return covg < COVG8_ESCAPE ? covg
+           : covg_ovf_get(&db_graph->covg_ovf,
+                          db_node_covg8_idx(db_graph, hkey, col));
+  }
   return db_node_covg(db_graph, hkey, col);
 }
 
-#define db_node_zero_covgs(graph,hkey) \
-        memset((graph)->col_covgs + (hkey)*(graph)->num_of_cols, 0, \
-               (graph)->num_of_cols * sizeof(Covg))
+// Not thread safe for the same node and colour
+void db_node_set_covg(dBGraph *graph, hkey_t hkey, Colour col, Covg covg);
+
+// Thread safe for different nodes
+void db_node_zero_covgs(dBGraph *graph, hkey_t hkey);
 
 void db_node_add_col_covg(dBGraph *graph, hkey_t hkey, Colour col, Covg update);
 void db_node_increment_coverage(dBGraph *graph, hkey_t hkey, Colour col);
 
+// Thread safe, overflow safe, coverage update
+void db_node_add_col_covg_mt(dBGraph *graph, hkey_t hkey, Colour col,
+                             Covg update);
+
 // Thread safe, overflow safe, coverage increment
 void db_node_increment_coverage_mt(dBGraph *graph, hkey_t hkey, Colour col);
 
 static inline Covg db_node_sum_covg(const dBGraph *graph, hkey_t hkey)
 {
-  const Covg *covgs = &db_node_covg(graph,hkey,0);
-  Covg sum_covg = covgs[0];
+  Covg sum_covg = db_node_get_covg(graph, hkey, 0);
   size_t c, ncols = graph->num_of_cols;
-  for(c = 1; c < ncols; c++) SAFE_SUM_COVG(sum_covg, covgs[c]);
+  for(c = 1; c < ncols; c++)
+    SAFE_SUM_COVG(sum_covg, db_node_get_covg(graph, hkey, c));
   return sum_covg;
 }
 
@@ -350,12 +377,13 @@ size_t db_nodes_to_str(const dBNode *nodes, size_t num,
 void db_nodes_print(const dBNode *nodes, size_t num,
                     const dBGraph *db_graph, FILE *out);
 
-void db_nodes_gzprint(const dBNode *nodes, size_t num,
-                      const dBGraph *db_graph, gzFile out);
+// Append to a string buffer
+void db_nodes_sprint(const dBNode *nodes, size_t num,
+                     const dBGraph *db_graph, StrBuf *sbuf);
 
 // Do not print first k-1 bases => 3 nodes gives 3bp instead of 3+k-1
-void db_nodes_gzprint_cont(const dBNode *nodes, size_t num,
-                           const dBGraph *db_graph, gzFile out);
+void db_nodes_sprint_cont(const dBNode *nodes, size_t num,
+                          const dBGraph *db_graph, StrBuf *sbuf);
 
 // Print:
 // 0: AAACCCAAATGCAAACCCAAATGCAAACCCA:1 TGGGTTTGCATTTGGGTTTGCATTTGGGTTT
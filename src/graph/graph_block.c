@@ -0,0 +1,363 @@
+#include "global.h"
+#include "graph_block.h"
+
+//
+// Varints: 7 bits per byte, least significant first, top bit set if more
+//
+
+static inline uint8_t* varint_put(uint8_t *ptr, uint64_t x)
+{
+  while(x >= 0x80) { *ptr++ = (uint8_t)(x | 0x80); x >>= 7; }
+  *ptr++ = (uint8_t)x;
+  return ptr;
+}
+
+// Returns NULL if we run off the end of the buffer
+static inline const uint8_t* varint_get(const uint8_t *ptr, const uint8_t *end,
+                                        uint64_t *x)
+{
+  uint64_t v = 0;
+  size_t shift;
+  for(shift = 0; ptr < end && shift < 64; shift += 7) {
+    v |= (uint64_t)(*ptr & 0x7f) << shift;
+    if(!(*ptr++ & 0x80)) { *x = v; return ptr; }
+  }
+  return NULL;
+}
+
+#define VARINT_MAX_BYTES 10
+
+// x - y, where words are most significant first
+static inline BinaryKmer bkmer_sub(BinaryKmer x, BinaryKmer y)
+{
+  BinaryKmer d;
+  uint64_t borrow = 0, b;
+  size_t i;
+  for(i = NUM_BKMER_WORDS; i-- > 0; ) {
+    b = (x.b[i] < y.b[i]) || (x.b[i] == y.b[i] && borrow);
+    d.b[i] = x.b[i] - y.b[i] - borrow;
+    borrow = b;
+  }
+  return d;
+}
+
+static inline BinaryKmer bkmer_add(BinaryKmer x, BinaryKmer y)
+{
+  BinaryKmer s;
+  uint64_t carry = 0;
+  size_t i;
+  for(i = NUM_BKMER_WORDS; i-- > 0; ) {
+    s.b[i] = x.b[i] + y.b[i] + carry;
+    carry = (s.b[i] < x.b[i]) || (s.b[i] == x.b[i] && carry);
+  }
+  return s;
+}
+
+//
+// Block buffer
+//
+
+GraphBlockBuffer* graph_block_buf_new(size_t ncols, size_t block_kmers)
+{
+  GraphBlockBuffer *buf = ctx_calloc(1, sizeof(GraphBlockBuffer));
+  buf->ncols = ncols;
+  buf->block_kmers = block_kmers;
+  buf->kmers = ctx_calloc(block_kmers, sizeof(BinaryKmer));
+  buf->covgs = ctx_calloc(block_kmers * ncols, sizeof(Covg));
+  buf->edges = ctx_calloc(block_kmers * ncols, sizeof(Edges));
+  return buf;
+}
+
+void graph_block_buf_free(GraphBlockBuffer *buf)
+{
+  if(buf == NULL) return;
+  ctx_free(buf->kmers);
+  ctx_free(buf->covgs);
+  ctx_free(buf->edges);
+  ctx_free(buf->raw);
+  ctx_free(buf->enc);
+  ctx_free(buf);
+}
+
+static inline void _ensure_capacity(uint8_t **ptr, size_t *cap, size_t len)
+{
+  if(len > *cap) {
+    *cap = MAX2(len, *cap * 2);
+    *ptr = ctx_realloc(*ptr, *cap);
+  }
+}
+
+uint8_t* graph_block_buf_enc(GraphBlockBuffer *buf, size_t len)
+{
+  _ensure_capacity(&buf->enc, &buf->enc_cap, len);
+  return buf->enc;
+}
+
+// Upper bound on the raw payload size of a block
+static inline size_t block_raw_maxlen(size_t nkmers, size_t ncols)
+{
+  return sizeof(BinaryKmer) + nkmers * NUM_BKMER_WORDS * VARINT_MAX_BYTES +
+         nkmers * ncols * (VARINT_MAX_BYTES + sizeof(Edges));
+}
+
+void graph_block_decode(GraphBlockBuffer *buf, const GraphBlockHeader *bhdr,
+                        const char *path)
+{
+  const size_t n = bhdr->nkmers, ncols = buf->ncols;
+  const uint8_t *ptr, *end;
+  uint64_t v;
+  size_t i, w, col;
+
+  if(n > buf->block_kmers)
+    die("Graph block too big [%zu > %zu]: %s", n, buf->block_kmers, path);
+
+  if(bhdr->codec == GRAPH_BLOCK_RAW) {
+    if(bhdr->raw_len != bhdr->enc_len) die("Corrupt graph block: %s", path);
+    ptr = buf->enc;
+  }
+  else if(bhdr->codec == GRAPH_BLOCK_ZLIB) {
+    _ensure_capacity(&buf->raw, &buf->raw_cap, bhdr->raw_len);
+    uLongf rawlen = bhdr->raw_len;
+    if(uncompress(buf->raw, &rawlen, buf->enc, bhdr->enc_len) != Z_OK ||
+       rawlen != bhdr->raw_len) {
+      die("Cannot decompress graph block: %s", path);
+    }
+    ptr = buf->raw;
+  }
+  else die("Unknown graph block codec %u: %s", (unsigned)bhdr->codec, path);
+
+  end = ptr + bhdr->raw_len;
+
+  if(n == 0 || bhdr->raw_len < sizeof(BinaryKmer))
+    die("Corrupt graph block: %s", path);
+
+  // Kmers
+  memcpy(buf->kmers[0].b, ptr, sizeof(BinaryKmer));
+  ptr += sizeof(BinaryKmer);
+
+  BinaryKmer delta;
+  for(i = 1; i < n; i++) {
+    for(w = 0; w < NUM_BKMER_WORDS; w++) {
+      if((ptr = varint_get(ptr, end, &v)) == NULL)
+        die("Corrupt graph block: %s", path);
+      delta.b[w] = v;
+    }
+    buf->kmers[i] = bkmer_add(buf->kmers[i-1], delta);
+  }
+
+  // Coverages
+  for(col = 0; col < ncols; col++) {
+    for(i = 0; i < n; i++) {
+      if((ptr = varint_get(ptr, end, &v)) == NULL || v > COVG_MAX)
+        die("Corrupt graph block: %s", path);
+      buf->covgs[i*ncols+col] = (Covg)v;
+    }
+  }
+
+  // Edges
+  if((size_t)(end - ptr) != n * ncols) die("Corrupt graph block: %s", path);
+  for(col = 0; col < ncols; col++)
+    for(i = 0; i < n; i++)
+      buf->edges[i*ncols+col] = *ptr++;
+
+  buf->n = n;
+  buf->pos = 0;
+}
+
+long graph_block_buf_find(const GraphBlockBuffer *buf, BinaryKmer bkey)
+{
+  long l = 0, r = (long)buf->n - 1, mid;
+  while(l <= r) {
+    mid = (l+r)/2;
+    if(binary_kmer_eq(buf->kmers[mid], bkey)) return mid;
+    if(binary_kmer_lt(buf->kmers[mid], bkey)) l = mid+1;
+    else r = mid-1;
+  }
+  return -1;
+}
+
+//
+// Writer
+//
+
+void graph_block_writer_alloc(GraphBlockWriter *wtr, FILE *fh,
+                              const char *path, size_t ncols,
+                              size_t block_kmers, uint64_t offset)
+{
+  memset(wtr, 0, sizeof(*wtr));
+  wtr->fh = fh;
+  wtr->path = path;
+  wtr->offset = offset;
+  wtr->buf.ncols = ncols;
+  wtr->buf.block_kmers = block_kmers;
+  wtr->buf.kmers = ctx_calloc(block_kmers, sizeof(BinaryKmer));
+  wtr->buf.covgs = ctx_calloc(block_kmers * ncols, sizeof(Covg));
+  wtr->buf.edges = ctx_calloc(block_kmers * ncols, sizeof(Edges));
+  wtr->idxcap = 256;
+  wtr->first = ctx_calloc(wtr->idxcap, sizeof(BinaryKmer));
+  wtr->offsets = ctx_calloc(wtr->idxcap, sizeof(uint64_t));
+}
+
+void graph_block_writer_dealloc(GraphBlockWriter *wtr)
+{
+  ctx_free(wtr->buf.kmers);
+  ctx_free(wtr->buf.covgs);
+  ctx_free(wtr->buf.edges);
+  ctx_free(wtr->buf.raw);
+  ctx_free(wtr->buf.enc);
+  ctx_free(wtr->first);
+  ctx_free(wtr->offsets);
+  memset(wtr, 0, sizeof(*wtr));
+}
+
+static void block_fwrite(GraphBlockWriter *wtr, const void *ptr, size_t len)
+{
+  if(fwrite(ptr, 1, len, wtr->fh) != len)
+    die("Cannot write to file: %s", wtr->path);
+  wtr->offset += len;
+}
+
+static void graph_block_writer_flush(GraphBlockWriter *wtr)
+{
+  GraphBlockBuffer *buf = &wtr->buf;
+  const size_t n = buf->n, ncols = buf->ncols;
+  size_t i, w, col;
+  uint8_t *ptr;
+
+  if(n == 0) return;
+
+  // Add to index
+  if(wtr->nblocks == wtr->idxcap) {
+    wtr->first = ctx_recallocarray(wtr->first, wtr->idxcap, wtr->idxcap*2,
+                                   sizeof(BinaryKmer));
+    wtr->offsets = ctx_recallocarray(wtr->offsets, wtr->idxcap, wtr->idxcap*2,
+                                     sizeof(uint64_t));
+    wtr->idxcap *= 2;
+  }
+  wtr->first[wtr->nblocks] = buf->kmers[0];
+  wtr->offsets[wtr->nblocks] = wtr->offset;
+  wtr->nblocks++;
+
+  // Encode
+  _ensure_capacity(&buf->raw, &buf->raw_cap, block_raw_maxlen(n, ncols));
+  ptr = buf->raw;
+
+  memcpy(ptr, buf->kmers[0].b, sizeof(BinaryKmer));
+  ptr += sizeof(BinaryKmer);
+
+  BinaryKmer delta;
+  for(i = 1; i < n; i++) {
+    delta = bkmer_sub(buf->kmers[i], buf->kmers[i-1]);
+    for(w = 0; w < NUM_BKMER_WORDS; w++) ptr = varint_put(ptr, delta.b[w]);
+  }
+
+  for(col = 0; col < ncols; col++)
+    for(i = 0; i < n; i++)
+      ptr = varint_put(ptr, buf->covgs[i*ncols+col]);
+
+  for(col = 0; col < ncols; col++)
+    for(i = 0; i < n; i++)
+      *ptr++ = buf->edges[i*ncols+col];
+
+  GraphBlockHeader bhdr;
+  memset(&bhdr, 0, sizeof(bhdr));
+  bhdr.nkmers = n;
+  bhdr.raw_len = ptr - buf->raw;
+
+  // Compress, keep raw if that doesn't help
+  uLongf enclen = compressBound(bhdr.raw_len);
+  _ensure_capacity(&buf->enc, &buf->enc_cap, enclen);
+  if(compress2(buf->enc, &enclen, buf->raw, bhdr.raw_len,
+               Z_DEFAULT_COMPRESSION) == Z_OK && enclen < bhdr.raw_len) {
+    bhdr.codec = GRAPH_BLOCK_ZLIB;
+    bhdr.enc_len = enclen;
+    ptr = buf->enc;
+  } else {
+    bhdr.codec = GRAPH_BLOCK_RAW;
+    bhdr.enc_len = bhdr.raw_len;
+    ptr = buf->raw;
+  }
+
+  block_fwrite(wtr, &bhdr, sizeof(bhdr));
+  block_fwrite(wtr, ptr, bhdr.enc_len);
+
+  buf->n = 0;
+}
+
+void graph_block_writer_add(GraphBlockWriter *wtr, BinaryKmer bkmer,
+                            const Covg *covgs, const Edges *edges)
+{
+  GraphBlockBuffer *buf = &wtr->buf;
+
+  if(wtr->nkmers > 0 && !binary_kmer_lt(wtr->prev, bkmer))
+    die("Kmers must be sorted to write a v7 graph: %s", wtr->path);
+
+  memcpy(buf->covgs + buf->n*buf->ncols, covgs, buf->ncols*sizeof(Covg));
+  memcpy(buf->edges + buf->n*buf->ncols, edges, buf->ncols*sizeof(Edges));
+  buf->kmers[buf->n++] = bkmer;
+  wtr->prev = bkmer;
+  wtr->nkmers++;
+
+  if(buf->n == buf->block_kmers) graph_block_writer_flush(wtr);
+}
+
+uint64_t graph_block_writer_finish(GraphBlockWriter *wtr)
+{
+  uint64_t start = wtr->offset;
+  size_t i;
+
+  graph_block_writer_flush(wtr);
+
+  // Terminating block
+  GraphBlockHeader bhdr;
+  memset(&bhdr, 0, sizeof(bhdr));
+  block_fwrite(wtr, &bhdr, sizeof(bhdr));
+
+  GraphBlockFooter footer;
+  memset(&footer, 0, sizeof(footer));
+  footer.nkmers = wtr->nkmers;
+  footer.nblocks = wtr->nblocks;
+  footer.index_offset = wtr->offset;
+  strcpy(footer.magic, GRAPH_BLOCK_MAGIC);
+
+  for(i = 0; i < wtr->nblocks; i++) {
+    block_fwrite(wtr, wtr->first[i].b, sizeof(BinaryKmer));
+    block_fwrite(wtr, &wtr->offsets[i], sizeof(uint64_t));
+  }
+
+  block_fwrite(wtr, &footer, sizeof(footer));
+
+  return wtr->offset - start;
+}
+
+//
+// Index
+//
+
+void graph_block_index_alloc(GraphBlockIndex *idx, size_t nblocks)
+{
+  idx->nblocks = nblocks;
+  idx->first = ctx_calloc(nblocks+1, sizeof(BinaryKmer));
+  idx->offsets = ctx_calloc(nblocks+1, sizeof(uint64_t));
+  memset(idx->first[nblocks].b, 0xff, BKMER_BYTES); // sentinel kmer
+}
+
+void graph_block_index_dealloc(GraphBlockIndex *idx)
+{
+  ctx_free(idx->first);
+  ctx_free(idx->offsets);
+  memset(idx, 0, sizeof(*idx));
+}
+
+long graph_block_index_find(const GraphBlockIndex *idx, BinaryKmer bkey)
+{
+  long l = 0, r = idx->nblocks, mid;
+  if(idx->nblocks == 0 || binary_kmer_lt(bkey, idx->first[0])) return -1;
+  // Find last block with first kmer <= bkey
+  while(l+1 < r) {
+    mid = (l+r)/2;
+    if(binary_kmer_le(idx->first[mid], bkey)) l = mid;
+    else r = mid;
+  }
+  return l;
+}
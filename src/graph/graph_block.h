@@ -0,0 +1,120 @@
+#ifndef GRAPH_BLOCK_H_
+#define GRAPH_BLOCK_H_
+
+#include "cortex_types.h"
+#include "binary_kmer.h"
+
+//
+// Blocked, compressed graph records (.ctx v7)
+//
+// A v7 graph file has the same header as v6 followed by the number of kmers
+// per block (uint32). Kmers must be sorted. Records are stored in blocks of
+// `block_kmers` kmers (the last block may be shorter), then a terminating
+// empty block, an index of blocks and a fixed size footer:
+//
+//   [header][block_kmers]
+//   [GraphBlockHeader][payload] ... [GraphBlockHeader{nkmers=0}]
+//   [index: nblocks x (BinaryKmer first_kmer, uint64_t file_offset)]
+//   [GraphBlockFooter]
+//
+// Block payload before compression:
+//   kmers: first kmer as raw words, then each kmer as the difference from the
+//          previous kmer, one varint per word (most significant word first)
+//   covgs: one varint per kmer, colour by colour
+//   edges: one byte per kmer, colour by colour
+// The payload is stored with zlib if that makes it smaller, otherwise raw.
+//
+// Streams are read by decoding blocks until the empty block. When the file
+// can be seeked the footer gives the number of kmers and the index is used to
+// jump to a block containing a given kmer.
+//
+
+#define GRAPH_BLOCK_KMERS 4096
+#define GRAPH_BLOCK_MAGIC "CTXBLK7"
+
+#define GRAPH_BLOCK_RAW 0
+#define GRAPH_BLOCK_ZLIB 1
+
+typedef struct
+{
+  uint32_t nkmers; // zero marks the end of the blocks
+  uint8_t codec, padding[3];
+  uint32_t raw_len, enc_len; // payload length before/after compression
+} GraphBlockHeader;
+
+typedef struct
+{
+  uint64_t nkmers, nblocks, index_offset;
+  char magic[8];
+} GraphBlockFooter;
+
+// A decoded block
+typedef struct
+{
+  size_t ncols, block_kmers;
+  size_t n, pos; // number of kmers in block, next kmer to return
+  bool end; // read the terminating block
+  BinaryKmer *kmers;
+  Covg *covgs; // covgs[i*ncols+col]
+  Edges *edges; // edges[i*ncols+col]
+  uint8_t *raw, *enc;
+  size_t raw_cap, enc_cap;
+} GraphBlockBuffer;
+
+// Block index read from the end of a file
+typedef struct
+{
+  size_t block_kmers, nblocks;
+  uint64_t nkmers;
+  BinaryKmer *first; // first kmer of each block, plus sentinel
+  uint64_t *offsets; // file offset of each block
+} GraphBlockIndex;
+
+typedef struct
+{
+  FILE *fh;
+  const char *path;
+  GraphBlockBuffer buf;
+  uint64_t offset, nkmers; // offset is position in file
+  BinaryKmer prev;
+  BinaryKmer *first;
+  uint64_t *offsets;
+  size_t nblocks, idxcap;
+} GraphBlockWriter;
+
+GraphBlockBuffer* graph_block_buf_new(size_t ncols, size_t block_kmers);
+void graph_block_buf_free(GraphBlockBuffer *buf);
+
+#define graph_block_buf_reset(buf) \
+        ((buf)->n = (buf)->pos = 0, (buf)->end = false)
+
+// Get buffer to read an encoded block of `len` bytes into
+uint8_t* graph_block_buf_enc(GraphBlockBuffer *buf, size_t len);
+
+// Decode block from buf->enc into buf, dies if the block is corrupt
+void graph_block_decode(GraphBlockBuffer *buf, const GraphBlockHeader *bhdr,
+                        const char *path);
+
+// Returns index of bkey in the decoded block or -1 if not found
+long graph_block_buf_find(const GraphBlockBuffer *buf, BinaryKmer bkey);
+
+// `offset` is the current position in the file (i.e. size of header written)
+void graph_block_writer_alloc(GraphBlockWriter *wtr, FILE *fh,
+                              const char *path, size_t ncols,
+                              size_t block_kmers, uint64_t offset);
+void graph_block_writer_dealloc(GraphBlockWriter *wtr);
+
+// Kmers must be added in sorted order
+void graph_block_writer_add(GraphBlockWriter *wtr, BinaryKmer bkmer,
+                            const Covg *covgs, const Edges *edges);
+
+// Write last block, index and footer. Returns number of bytes written.
+uint64_t graph_block_writer_finish(GraphBlockWriter *wtr);
+
+void graph_block_index_alloc(GraphBlockIndex *idx, size_t nblocks);
+void graph_block_index_dealloc(GraphBlockIndex *idx);
+
+// Returns the block that may contain bkey or -1 if bkey is not in range
+long graph_block_index_find(const GraphBlockIndex *idx, BinaryKmer bkey);
+
+#endif /* GRAPH_BLOCK_H_ */
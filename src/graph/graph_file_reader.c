@@ -19,6 +19,7 @@ void graph_file_set_buffered(GraphFileReader *file, size_t bufsize)
 int graph_file_fseek(GraphFileReader *file, off_t offset, int whence)
 {
   if(file_filter_isstdin(&file->fltr)) die("Cannot fseek on STDIN");
+  if(file->blkbuf) graph_block_buf_reset(file->blkbuf);
   if(graph_file_is_buffered(file))
     return fseek_buf(file->fh, offset, whence, &file->strm);
   else
@@ -58,6 +59,88 @@ do { \
   } \
 } while(0)
 
+bool graph_file_read_block(GraphFileReader *file)
+{
+  GraphBlockHeader bhdr;
+  const char *path = file_filter_path(&file->fltr);
+
+  // Don't read past the terminating block into the index
+  if(file->blkbuf->end) return false;
+
+  size_t n = graph_file_fread(file, &bhdr, sizeof(bhdr));
+
+  graph_block_buf_reset(file->blkbuf);
+  if(n == 0) return false;
+  if(n != sizeof(bhdr)) die("Unexpected end of file: %s", path);
+  if(bhdr.nkmers == 0) { file->blkbuf->end = true; return false; }
+
+  uint8_t *enc = graph_block_buf_enc(file->blkbuf, bhdr.enc_len);
+  _gfread(file, enc, bhdr.enc_len, "graph block");
+  graph_block_decode(file->blkbuf, &bhdr, path);
+  return true;
+}
+
+// Load block index from the end of a v7 file, leaves file at the first block
+static void graph_file_read_block_index(GraphFileReader *file)
+{
+  GraphBlockFooter footer;
+  const char *path = file_filter_path(&file->fltr);
+  size_t i, n;
+
+  if(graph_file_fseek(file, -(off_t)sizeof(footer), SEEK_END) != 0)
+    die("fseek failed: %s [%s]", strerror(errno), path);
+  _gfread(file, &footer, sizeof(footer), "block index footer");
+
+  if(strncmp(footer.magic, GRAPH_BLOCK_MAGIC, sizeof(footer.magic)) != 0)
+    die("Graph file is missing its block index (truncated?): %s", path);
+
+  n = footer.nblocks * (sizeof(BinaryKmer) + sizeof(uint64_t));
+  if(footer.index_offset + n + sizeof(footer) != (uint64_t)file->file_size ||
+     footer.nblocks > footer.nkmers ||
+     (footer.nkmers+file->hdr.block_kmers-1) / file->hdr.block_kmers
+       != footer.nblocks) {
+    die("Corrupt block index: %s", path);
+  }
+
+  GraphBlockIndex *idx = ctx_calloc(1, sizeof(GraphBlockIndex));
+  graph_block_index_alloc(idx, footer.nblocks);
+  idx->nkmers = footer.nkmers;
+  idx->block_kmers = file->hdr.block_kmers;
+
+  if(graph_file_fseek(file, footer.index_offset, SEEK_SET) != 0)
+    die("fseek failed: %s [%s]", strerror(errno), path);
+
+  for(i = 0; i < idx->nblocks; i++) {
+    _gfread(file, idx->first[i].b, sizeof(BinaryKmer), "block index");
+    _gfread(file, &idx->offsets[i], sizeof(uint64_t), "block index");
+  }
+
+  file->blkidx = idx;
+  file->num_of_kmers = footer.nkmers;
+
+  if(graph_file_fseek(file, file->hdr_size, SEEK_SET) != 0)
+    die("fseek failed: %s [%s]", strerror(errno), path);
+}
+
+int graph_file_seek_kmer(GraphFileReader *file, size_t i)
+{
+  if(file->blkbuf == NULL)
+    return graph_file_fseek(file, graph_file_offset(file, i), SEEK_SET);
+
+  const GraphBlockIndex *idx = file->blkidx;
+  ctx_assert(idx != NULL);
+
+  // Past the last kmer: nothing left to read
+  if(idx->nblocks == 0) return graph_file_fseek(file, file->hdr_size, SEEK_SET);
+  size_t b = MIN2(i / idx->block_kmers, idx->nblocks-1);
+
+  if(graph_file_fseek(file, idx->offsets[b], SEEK_SET) != 0) return -1;
+  if(!graph_file_read_block(file))
+    die("Missing graph block: %s", file_filter_path(&file->fltr));
+  file->blkbuf->pos = MIN2(i - b * idx->block_kmers, file->blkbuf->n);
+  return 0;
+}
+
 void graph_file_merge_header(GraphFileHeader *hdr, const GraphFileReader *file)
 {
   size_t i, fromcol, intocol;
@@ -266,6 +349,13 @@ size_t graph_file_read_header(GraphFileReader *file)
   }
   bytes_read += strlen("CORTEX");
 
+  if(h->version >= CTX_GRAPH_FILEFORMAT_BLOCKED) {
+    _gfread(file, &h->block_kmers, sizeof(uint32_t), "kmers per block");
+    bytes_read += sizeof(uint32_t);
+    if(h->block_kmers == 0 || h->block_kmers > (1U<<24))
+      die("Bad number of kmers per block: %u [path: %s]", h->block_kmers, path);
+  }
+
   return bytes_read;
 }
 
@@ -313,8 +403,22 @@ int graph_file_open2(GraphFileReader *file, const char *input, const char *mode,
 
   size_t bytes_per_kmer, bytes_remaining;
 
+  file->blkbuf = NULL;
+  file->blkidx = NULL;
+
+  if(hdr->version >= CTX_GRAPH_FILEFORMAT_BLOCKED)
+  {
+    // Blocks store whole BinaryKmers
+    if(hdr->num_of_bitfields != NUM_BKMER_WORDS) {
+      die("v7 graph needs a build with MAXK=%u: %s",
+          hdr->num_of_bitfields*32-1, path);
+    }
+    file->blkbuf = graph_block_buf_new(hdr->num_of_cols, hdr->block_kmers);
+    // Number of kmers is stored in the block index at the end of the file
+    if(file->file_size != -1) graph_file_read_block_index(file);
+  }
   // If reading from STDIN we don't know file size
-  if(file->file_size != -1)
+  else if(file->file_size != -1)
   {
     // File header checks
     // Get number of kmers
@@ -338,6 +442,11 @@ int graph_file_open2(GraphFileReader *file, const char *input, const char *mode,
 // Close file
 void graph_file_close(GraphFileReader *file)
 {
+  graph_block_buf_free(file->blkbuf);
+  if(file->blkidx) {
+    graph_block_index_dealloc(file->blkidx);
+    ctx_free(file->blkidx);
+  }
   strm_buf_dealloc(&file->strm);
   if(file->fh) fclose(file->fh);
   file_filter_close(&file->fltr);
@@ -355,15 +464,30 @@ size_t graph_file_read_raw(GraphFileReader *file,
   int num_bytes_read;
   char kstr[MAX_KMER_SIZE+1];
 
-  num_bytes_read = graph_file_fread(file, bkmer->b, sizeof(BinaryKmer));
+  if(file->blkbuf)
+  {
+    // v7: take next kmer from the decoded block
+    GraphBlockBuffer *buf = file->blkbuf;
+    if(buf->pos == buf->n && !graph_file_read_block(file)) return 0;
+    *bkmer = buf->kmers[buf->pos];
+    memcpy(covgs, buf->covgs + buf->pos*buf->ncols, buf->ncols*sizeof(Covg));
+    memcpy(edges, buf->edges + buf->pos*buf->ncols, buf->ncols*sizeof(Edges));
+    buf->pos++;
+    num_bytes_read = sizeof(BinaryKmer) +
+                     h->num_of_cols * (sizeof(uint32_t) + sizeof(uint8_t));
+  }
+  else
+  {
+    num_bytes_read = graph_file_fread(file, bkmer->b, sizeof(BinaryKmer));
 
-  if(num_bytes_read == 0) return 0;
-  if(num_bytes_read != (int)(sizeof(uint64_t)*h->num_of_bitfields))
-    die("Unexpected end of file: %s", path);
+    if(num_bytes_read == 0) return 0;
+    if(num_bytes_read != (int)(sizeof(uint64_t)*h->num_of_bitfields))
+      die("Unexpected end of file: %s", path);
 
-  _gfread(file, covgs, h->num_of_cols * sizeof(uint32_t), "Coverages");
-  _gfread(file, edges, h->num_of_cols * sizeof(uint8_t), "Edges");
-  num_bytes_read += h->num_of_cols * (sizeof(uint32_t) + sizeof(uint8_t));
+    _gfread(file, covgs, h->num_of_cols * sizeof(uint32_t), "Coverages");
+    _gfread(file, edges, h->num_of_cols * sizeof(uint8_t), "Edges");
+    num_bytes_read += h->num_of_cols * (sizeof(uint32_t) + sizeof(uint8_t));
+  }
 
   // Check top word of each kmer
   if(binary_kmer_oversized(*bkmer, h->kmer_size))
@@ -5,6 +5,7 @@
 #include "graph_format.h"
 #include "file_filter.h"
 #include "binary_kmer.h"
+#include "graph_block.h"
 
 //
 // Read graph files from disk
@@ -19,6 +20,9 @@ typedef struct
   off_t hdr_size, file_size;
   int64_t num_of_kmers; // set if reading from file (i.e. not stream) else -1
   bool error_zero_covg, error_missing_covg; // Whether we saw loading errors
+  // v7 files only: decoded block and block index (NULL if reading a stream)
+  GraphBlockBuffer *blkbuf;
+  GraphBlockIndex *blkidx;
 } GraphFileReader;
 
 #include "madcrowlib/madcrow_buffer.h"
@@ -30,7 +34,7 @@ madcrow_buffer(gfile_buf, GraphFileBuffer, GraphFileReader);
 // Returns 0 if not set instead of -1
 #define graph_file_nkmers(rdr) ((uint64_t)MAX2((rdr)->num_of_kmers, 0))
 
-// Get file offset of a given kmer
+// Get file offset of a given kmer (v6 files only)
 static inline off_t graph_file_offset(const GraphFileReader *gfr, size_t i)
 {
   size_t s = sizeof(BinaryKmer)+gfr->fltr.srcncols*(sizeof(Covg)+sizeof(Edges));
@@ -44,6 +48,14 @@ void graph_file_set_buffered(GraphFileReader *file, size_t bufsize);
 int graph_file_fseek(GraphFileReader *file, off_t offset, int whence);
 off_t graph_file_ftell(GraphFileReader *file);
 
+// Seek to the i-th kmer in the file. For v7 files this needs the block index.
+// Returns 0 on success, like fseek
+int graph_file_seek_kmer(GraphFileReader *file, size_t i);
+
+// Read and decode the next block of a v7 file into file->blkbuf
+// Returns false at the end of the blocks
+bool graph_file_read_block(GraphFileReader *file);
+
 // read `n` bytes from `file` into `ptr`
 size_t graph_file_fread(GraphFileReader *file, void *ptr, size_t n);
 
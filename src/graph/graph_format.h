@@ -4,12 +4,16 @@
 // graph file format version
 #define CTX_GRAPH_FILEFORMAT 6
 
+// sorted graph stored in compressed blocks (see graph_block.h)
+#define CTX_GRAPH_FILEFORMAT_BLOCKED 7
+
 #include "graph_info.h"
 
 // Graph (.ctx)
 typedef struct
 {
   uint32_t version, kmer_size, num_of_bitfields, num_of_cols;
+  uint32_t block_kmers; // kmers per block (v7 only)
   GraphInfo *ginfo; // Cleaning info etc for each colour
   size_t capacity;
 } GraphFileHeader;
@@ -0,0 +1,289 @@
+#include "global.h"
+#include "graph_image.h"
+#include "db_graph.h"
+#include "file_util.h"
+#include "hash.h" // HASH_NAME_STR
+
+#include <fcntl.h> // open()
+#include <sys/mman.h> // mmap()
+
+// Arrays are aligned to page boundaries in the file
+#define IMAGE_ALIGN 4096
+
+typedef struct
+{
+  char magic[8];
+  uint32_t version, kmer_size, num_bkmer_words;
+  uint32_t num_of_cols, num_edge_cols, bucket_size, seed;
+  char hash_name[32];
+  uint64_t num_of_buckets, capacity, num_kmers;
+  uint64_t collisions[REHASH_LIMIT];
+  // byte offsets of arrays in the file, zero if not saved
+  uint64_t table_offset, buckets_offset, edges_offset, covgs_offset;
+  uint64_t file_size;
+} GraphImageHeader;
+
+static inline uint64_t image_align(uint64_t offset)
+{
+  return (offset + IMAGE_ALIGN - 1) / IMAGE_ALIGN * IMAGE_ALIGN;
+}
+
+//
+// GraphInfo
+//
+
+static void image_write_strbuf(FILE *fh, const StrBuf *sbuf)
+{
+  uint32_t len = sbuf->end;
+  fwrite(&len, sizeof(len), 1, fh);
+  fwrite(sbuf->b, 1, len, fh);
+}
+
+static void image_read_strbuf(FILE *fh, StrBuf *sbuf, const char *path)
+{
+  uint32_t len = 0;
+  if(fread(&len, sizeof(len), 1, fh) != 1) die("Truncated image: %s", path);
+  strbuf_ensure_capacity(sbuf, len);
+  if(fread(sbuf->b, 1, len, fh) != len) die("Truncated image: %s", path);
+  sbuf->b[sbuf->end = len] = '\0';
+}
+
+static void image_write_ginfo(FILE *fh, const GraphInfo *ginfo)
+{
+  const ErrorCleaning *cln = &ginfo->cleaning;
+  uint8_t flags[4] = {cln->cleaned_tips, cln->cleaned_unitigs,
+                      cln->cleaned_kmers, cln->is_graph_intersection};
+  fwrite(&ginfo->mean_read_length, sizeof(uint32_t), 1, fh);
+  fwrite(&ginfo->total_sequence, sizeof(uint64_t), 1, fh);
+  fwrite(&ginfo->seq_err, sizeof(long double), 1, fh);
+  fwrite(flags, 1, 4, fh);
+  fwrite(&cln->clean_unitigs_thresh, sizeof(Covg), 1, fh);
+  fwrite(&cln->clean_kmers_thresh, sizeof(Covg), 1, fh);
+  image_write_strbuf(fh, &ginfo->sample_name);
+  image_write_strbuf(fh, &cln->intersection_name);
+}
+
+static void image_read_ginfo(FILE *fh, GraphInfo *ginfo, const char *path)
+{
+  ErrorCleaning *cln = &ginfo->cleaning;
+  uint8_t flags[4];
+  size_t n = 0;
+  n += fread(&ginfo->mean_read_length, sizeof(uint32_t), 1, fh);
+  n += fread(&ginfo->total_sequence, sizeof(uint64_t), 1, fh);
+  n += fread(&ginfo->seq_err, sizeof(long double), 1, fh);
+  n += fread(flags, 4, 1, fh);
+  n += fread(&cln->clean_unitigs_thresh, sizeof(Covg), 1, fh);
+  n += fread(&cln->clean_kmers_thresh, sizeof(Covg), 1, fh);
+  if(n != 6) die("Truncated image: %s", path);
+  cln->cleaned_tips = flags[0];
+  cln->cleaned_unitigs = flags[1];
+  cln->cleaned_kmers = flags[2];
+  cln->is_graph_intersection = flags[3];
+  image_read_strbuf(fh, &ginfo->sample_name, path);
+  image_read_strbuf(fh, &cln->intersection_name, path);
+}
+
+//
+// Save
+//
+
+// Write zeros up to offset
+static void image_pad(FILE *fh, uint64_t offset, const char *path)
+{
+  char zeros[256] = {0};
+  long pos = ftell(fh);
+  if(pos < 0) die("Cannot get file position: %s", path);
+  while((uint64_t)pos < offset) {
+    size_t n = MIN2(sizeof(zeros), offset - pos);
+    if(fwrite(zeros, 1, n, fh) != n) die("Cannot write image: %s", path);
+    pos += n;
+  }
+}
+
+static uint64_t image_write_array(FILE *fh, uint64_t offset,
+                                  const void *ptr, size_t nbytes,
+                                  const char *path)
+{
+  offset = image_align(offset);
+  image_pad(fh, offset, path);
+  if(fwrite(ptr, 1, nbytes, fh) != nbytes) die("Cannot write image: %s", path);
+  return offset;
+}
+
+size_t graph_image_save(const char *path, const dBGraph *db_graph,
+                        const GraphFileHeader *hdr)
+{
+  const HashTable *ht = &db_graph->ht;
+  const GraphInfo *ginfo = hdr ? hdr->ginfo : db_graph->ginfo;
+  size_t i, nbytes;
+  uint64_t offset;
+
+  ctx_assert(hdr == NULL || hdr->num_of_cols == db_graph->num_of_cols);
+
+  // The image layout is the split hash table plus separate arrays
+  if(db_graph->col_edges == NULL)
+    die("Cannot save image without edges: %s", path);
+  if(db_graph->node_recs != NULL)
+    die("Cannot save image of a graph with node records: %s", path);
+  if(db_graph->ht.blocks != NULL)
+    die("Cannot save image of a tagged hash table: %s", path);
+  if(db_graph->col_covgs8 != NULL)
+    die("Cannot save image with 8 bit coverages: %s", path);
+
+  GraphImageHeader ihdr;
+  memset(&ihdr, 0, sizeof(ihdr));
+  strcpy(ihdr.magic, CTX_IMAGE_MAGIC);
+  strncpy(ihdr.hash_name, HASH_NAME_STR, sizeof(ihdr.hash_name)-1);
+  ihdr.version = CTX_IMAGE_FILEFORMAT;
+  ihdr.kmer_size = db_graph->kmer_size;
+  ihdr.num_bkmer_words = NUM_BKMER_WORDS;
+  ihdr.num_of_cols = db_graph->num_of_cols;
+  ihdr.num_edge_cols = db_graph->num_edge_cols;
+  ihdr.bucket_size = ht->bucket_size;
+  ihdr.seed = ht->seed;
+  ihdr.num_of_buckets = ht->num_of_buckets;
+  ihdr.capacity = ht->capacity;
+  ihdr.num_kmers = ht->num_kmers;
+  memcpy(ihdr.collisions, ht->collisions, sizeof(ihdr.collisions));
+
+  // Header is rewritten at the end, so we need to be able to seek
+  if(strcmp(path, "-") == 0) die("Cannot write a graph image to STDOUT");
+
+  FILE *fh = futil_fopen(path, "w");
+
+  if(fwrite(&ihdr, sizeof(ihdr), 1, fh) != 1) die("Cannot write: %s", path);
+  for(i = 0; i < db_graph->num_of_cols; i++) image_write_ginfo(fh, &ginfo[i]);
+  futil_fcheck(0, fh, path);
+
+  offset = ftell(fh);
+  nbytes = ht->capacity * sizeof(BinaryKmer);
+  ihdr.table_offset = image_write_array(fh, offset, ht->table, nbytes, path);
+  offset = ihdr.table_offset + nbytes;
+
+  nbytes = ht->num_of_buckets * sizeof(uint8_t[2]);
+  ihdr.buckets_offset = image_write_array(fh, offset, ht->buckets, nbytes, path);
+  offset = ihdr.buckets_offset + nbytes;
+
+  nbytes = ht->capacity * db_graph->num_edge_cols * sizeof(Edges);
+  ihdr.edges_offset = image_write_array(fh, offset, db_graph->col_edges,
+                                        nbytes, path);
+  offset = ihdr.edges_offset + nbytes;
+
+  if(db_graph->col_covgs != NULL) {
+    nbytes = ht->capacity * db_graph->num_of_cols * sizeof(Covg);
+    ihdr.covgs_offset = image_write_array(fh, offset, db_graph->col_covgs,
+                                          nbytes, path);
+    offset = ihdr.covgs_offset + nbytes;
+  }
+
+  ihdr.file_size = offset;
+
+  if(fseek(fh, 0, SEEK_SET) != 0 || fwrite(&ihdr, sizeof(ihdr), 1, fh) != 1)
+    die("Cannot write image header: %s", path);
+
+  futil_fclose(fh);
+
+  char kmers_str[50], mem_str[50];
+  ulong_to_str(ht->num_kmers, kmers_str);
+  bytes_to_str(ihdr.file_size, 1, mem_str);
+  status("[image] Saved %s kmers, %zu colour%s, %s to: %s", kmers_str,
+         db_graph->num_of_cols, util_plural_str(db_graph->num_of_cols),
+         mem_str, path);
+
+  return ihdr.file_size;
+}
+
+//
+// Load
+//
+
+bool graph_image_is_image(const char *path)
+{
+  char magic[8] = {0};
+  FILE *fh = fopen(path, "r");
+  if(fh == NULL) return false;
+  size_t n = fread(magic, 1, sizeof(magic), fh);
+  fclose(fh);
+  return (n == sizeof(magic) && strcmp(magic, CTX_IMAGE_MAGIC) == 0);
+}
+
+static void image_check_header(const GraphImageHeader *ihdr, off_t file_size,
+                               const char *path)
+{
+  if(strcmp(ihdr->magic, CTX_IMAGE_MAGIC) != 0)
+    die("Not a graph image: %s", path);
+  if(ihdr->version != CTX_IMAGE_FILEFORMAT)
+    die("Unsupported graph image version %u: %s", ihdr->version, path);
+  if(ihdr->num_bkmer_words != NUM_BKMER_WORDS) {
+    die("Graph image needs a build with MAXK=%u: %s",
+        ihdr->num_bkmer_words*32-1, path);
+  }
+  if(strncmp(ihdr->hash_name, HASH_NAME_STR, sizeof(ihdr->hash_name)) != 0) {
+    die("Graph image built with a different hash function (%s vs %s): %s",
+        ihdr->hash_name, HASH_NAME_STR, path);
+  }
+  if(ihdr->file_size != (uint64_t)file_size)
+    die("Graph image is truncated: %s", path);
+
+  db_graph_check_kmer_size(ihdr->kmer_size, path);
+}
+
+void graph_image_load(const char *path, dBGraph *db_graph)
+{
+  GraphImageHeader ihdr;
+  size_t i;
+
+  off_t file_size = futil_get_file_size(path);
+  FILE *fh = futil_fopen(path, "r");
+
+  if(fread(&ihdr, sizeof(ihdr), 1, fh) != 1) die("Truncated image: %s", path);
+  image_check_header(&ihdr, file_size, path);
+
+  dBGraph tmp = {.kmer_size = ihdr.kmer_size,
+                 .num_of_cols = ihdr.num_of_cols,
+                 .num_edge_cols = ihdr.num_edge_cols,
+                 .num_of_cols_used = ihdr.num_of_cols,
+                 .bktlocks = NULL,
+                 .node_in_cols = NULL,
+                 .readstrt = NULL};
+
+  memset(&tmp.gpstore, 0, sizeof(GPathStore));
+  memset(&tmp.gphash, 0, sizeof(GPathHash));
+
+  tmp.ginfo = ctx_calloc(ihdr.num_of_cols, sizeof(GraphInfo));
+  for(i = 0; i < ihdr.num_of_cols; i++) {
+    graph_info_alloc(&tmp.ginfo[i]);
+    image_read_ginfo(fh, &tmp.ginfo[i], path);
+  }
+
+  futil_fclose(fh);
+
+  // Map the whole file read-only and shared, so other processes using the
+  // same image share the page cache
+  int fd = open(path, O_RDONLY);
+  if(fd < 0) die("Cannot open graph image: %s [%s]", path, strerror(errno));
+  char *image = mmap(NULL, ihdr.file_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if(image == MAP_FAILED)
+    die("Cannot mmap graph image: %s [%s]", path, strerror(errno));
+
+  tmp.image = image;
+  tmp.image_size = ihdr.file_size;
+
+  hash_table_wrap(&tmp.ht, (BinaryKmer*)(image + ihdr.table_offset),
+                  (uint8_t(*)[2])(image + ihdr.buckets_offset),
+                  ihdr.num_of_buckets, ihdr.bucket_size, ihdr.seed,
+                  ihdr.num_kmers, ihdr.collisions);
+
+  tmp.col_edges = (Edges*)(image + ihdr.edges_offset);
+  tmp.col_covgs = ihdr.covgs_offset ? (Covg*)(image + ihdr.covgs_offset) : NULL;
+
+  memcpy(db_graph, &tmp, sizeof(dBGraph));
+
+  char kmers_str[50], mem_str[50];
+  ulong_to_str(ihdr.num_kmers, kmers_str);
+  bytes_to_str(ihdr.file_size, 1, mem_str);
+  status("[image] Mapped %s kmers, %u colour%s, %s from: %s", kmers_str,
+         ihdr.num_of_cols, util_plural_str(ihdr.num_of_cols), mem_str, path);
+}
@@ -0,0 +1,37 @@
+#ifndef GRAPH_IMAGE_H_
+#define GRAPH_IMAGE_H_
+
+#include "db_graph.h"
+#include "graph_format.h"
+
+//
+// Graph image (.cti): the in-memory hash table and colour arrays of a dBGraph
+// dumped to disk as-is, so they can be mmap'd read-only rather than parsed
+// and re-inserted into a new hash table. Pages are shared between processes
+// reading the same image.
+//
+// Images are only readable by a build with the same MAXK and hash function
+// on a machine with the same endianness.
+//
+// Layout: [GraphImageHeader][per colour GraphInfo] then page aligned arrays:
+//   table[capacity], buckets[num_of_buckets],
+//   col_edges[capacity*num_edge_cols], col_covgs[capacity*num_of_cols]
+//
+
+#define CTX_IMAGE_FILEFORMAT 1
+#define CTX_IMAGE_MAGIC "CTXIMG"
+
+// Save graph hash table and colour arrays. db_graph must have col_edges.
+// `hdr` is used for colour info (GraphInfo) if not NULL, otherwise
+// db_graph->ginfo. Returns number of bytes written.
+size_t graph_image_save(const char *path, const dBGraph *db_graph,
+                        const GraphFileHeader *hdr);
+
+// Returns true if path is a graph image (checks magic word only)
+bool graph_image_is_image(const char *path);
+
+// mmap a graph image read-only into db_graph. Do not modify the graph.
+// Free with db_graph_dealloc()
+void graph_image_load(const char *path, dBGraph *db_graph);
+
+#endif /* GRAPH_IMAGE_H_ */
@@ -7,6 +7,7 @@ struct GraphFileSearch {
   BinaryKmer *index;
   size_t blocksize, nblocks;
   void *block; // read file into block to linear search
+  long curr_block; // v7: block currently decoded in file->blkbuf
 };
 
 // #define INDEX_SIZE 4 /* debugging */
@@ -26,6 +27,16 @@ GraphFileSearch *graph_search_new(GraphFileReader *file)
   gs->file = file;
   gs->nkmers = file->num_of_kmers;
   gs->ncols = file->hdr.num_of_cols;
+  gs->curr_block = -1;
+
+  // v7 files have an index of blocks in the file
+  if(file->blkidx) {
+    status("[graph_search] on-disk-graph %zu cols %zu blocks %zu kmers"
+           " using block index", gs->ncols, file->blkidx->nblocks, gs->nkmers);
+    graph_file_set_buffered(file, 0); // Turn OFF buffered input
+    return gs;
+  }
+
   gs->entrysize = sizeof(BinaryKmer) + gs->ncols * (sizeof(Covg)+sizeof(Edges));
   gs->nblocks = MIN2(gs->nkmers, INDEX_SIZE);
   gs->blocksize = gs->nkmers / gs->nblocks;
@@ -109,14 +120,13 @@ static inline void* search_file_sec(GraphFileSearch *gs, BinaryKmer bkey,
   return NULL;
 }
 
-// Given an entry from a graph file, load edges and coverage
+// Given coverages and edges from a graph file, load edges and coverage
 static inline void filter_covgs_edges(const FileFilter *fltr,
                                       Covg *covgs, Edges *edges,
-                                      const void *ptr)
+                                      const char *allcovgs,
+                                      const char *alledges)
 {
   size_t from, into, i;
-  const char *allcovgs = (const char*)ptr + sizeof(BinaryKmer);
-  const char *alledges = (const char*)allcovgs + fltr->srcncols*sizeof(Covg);
   Covg c;
   Edges e;
   memset(covgs, 0, file_filter_into_ncols(fltr) * sizeof(Covg));
@@ -135,9 +145,41 @@ static inline void filter_covgs_edges(const FileFilter *fltr,
   }
 }
 
+// Given an entry from a v6 graph file, load edges and coverage
+static inline void filter_entry(const FileFilter *fltr,
+                                Covg *covgs, Edges *edges, const void *ptr)
+{
+  const char *allcovgs = (const char*)ptr + sizeof(BinaryKmer);
+  const char *alledges = (const char*)allcovgs + fltr->srcncols*sizeof(Covg);
+  filter_covgs_edges(fltr, covgs, edges, allcovgs, alledges);
+}
+
+// v7: find the block, decode it (if not already) then binary search
+static bool graph_search_find_block(GraphFileSearch *gs, BinaryKmer bkey,
+                                    Covg *covgs, Edges *edges)
+{
+  GraphFileReader *file = gs->file;
+  GraphBlockBuffer *buf = file->blkbuf;
+  long b = graph_block_index_find(file->blkidx, bkey), i;
+  if(b < 0) return false;
+  if(b != gs->curr_block || buf->n == 0) {
+    if(graph_file_fseek(file, file->blkidx->offsets[b], SEEK_SET) != 0)
+      die("fseek failed: %s", strerror(errno));
+    if(!graph_file_read_block(file))
+      die("Cannot search graph from disk: %s", file_filter_path(&file->fltr));
+    gs->curr_block = b;
+  }
+  if((i = graph_block_buf_find(buf, bkey)) < 0) return false;
+  filter_covgs_edges(&file->fltr, covgs, edges,
+                     (const char*)(buf->covgs + i*buf->ncols),
+                     (const char*)(buf->edges + i*buf->ncols));
+  return true;
+}
+
 bool graph_search_find(GraphFileSearch *gs, BinaryKmer bkey,
                        Covg *covgs, Edges *edges)
 {
+  if(gs->file->blkidx) return graph_search_find_block(gs, bkey, covgs, edges);
   char *ptr;
   // Binary search on the index
   long x = binary_search_index(bkey,gs->index,gs->nblocks);
@@ -145,20 +187,28 @@ bool graph_search_find(GraphFileSearch *gs, BinaryKmer bkey,
   size_t blockstart = x*gs->blocksize;
   size_t blockend = (size_t)x+1 < gs->nblocks ? blockstart+gs->blocksize : gs->nkmers;
   if((ptr = search_file_sec(gs, bkey, blockstart, blockend)) == NULL) return false;
-  filter_covgs_edges(&gs->file->fltr, covgs, edges, ptr);
+  filter_entry(&gs->file->fltr, covgs, edges, ptr);
   return true;
 }
 
 void graph_search_fetch(GraphFileSearch *gs, size_t idx, BinaryKmer *bkey,
                         Covg *covgs, Edges *edges)
 {
+  if(gs->file->blkidx) {
+    gs->curr_block = -1;
+    if(graph_file_seek_kmer(gs->file, idx) != 0)
+      die("fseek failed: %s", strerror(errno));
+    if(!graph_file_read_reset(gs->file, bkey, covgs, edges))
+      die("Cannot search graph from disk: %s", file_filter_path(&gs->file->fltr));
+    return;
+  }
   if(graph_file_fseek(gs->file, gs->file->hdr_size+gs->entrysize*idx, SEEK_SET) != 0)
     die("fseek failed: %s", strerror(errno));
   // read one entry
   if(graph_file_fread(gs->file, gs->block, gs->entrysize) != gs->entrysize)
     die("Cannot search graph from disk: %s", file_filter_path(&gs->file->fltr));
   memcpy(bkey, gs->block, sizeof(BinaryKmer)); // copy binary kmer
-  filter_covgs_edges(&gs->file->fltr, covgs, edges, gs->block);
+  filter_entry(&gs->file->fltr, covgs, edges, gs->block);
 }
 
 void graph_search_rand(GraphFileSearch *gs,
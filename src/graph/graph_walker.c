@@ -33,7 +33,7 @@ static void print_path_list(const GPathFollowBuffer *pbuf, FILE *fout)
 
   for(i = 0; i < pbuf->len; i++) {
     path = &pbuf->b[i];
-    fprintf(fout, "   %p ", path->gpath->seq);
+    fprintf(fout, "   %p ", path->seq);
     for(j = 0; j < path->len; j++)
       fputc(dna_nuc_to_char(gpath_follow_get_base(path, j)), fout);
     fprintf(fout, " [%zu/%zu] age: %zu %c\n", (size_t)path->pos,
@@ -154,7 +154,7 @@ static inline size_t pickup_paths(GraphWalker *wlk, dBNode node,
   const dBGraph *db_graph = wlk->db_graph;
   const GPathStore *gpstore = wlk->gpstore;
   GPathFollowBuffer *pbuf = counter ? &wlk->cntr_paths : &wlk->paths;
-  const size_t ncols = gpstore->gpset.ncols, num_paths = pbuf->len;
+  const size_t num_paths = pbuf->len;
 
   // Picking up paths is turned off
   if(!gpath_store_use_traverse(gpstore)) return 0;
@@ -170,13 +170,15 @@ static inline size_t pickup_paths(GraphWalker *wlk, dBNode node,
   bool cntr_filter_nuc0
     = (counter && db_node_outdegree_in_col(node, wlk->ctxcol, db_graph) > 1);
 
+  const GPathSet *gpset = &gpstore->gpset;
   GPath *gpath = gpath_store_fetch_traverse(gpstore, node.key);
 
-  for(; gpath != NULL; gpath = gpath->next)
+  for(; gpath != NULL; gpath = gpath_get_next(gpset, gpath))
   {
-    if(node.orient == gpath->orient && gpath_has_colour(gpath, ncols, wlk->ctpcol))
+    if(node.orient == gpath->orient &&
+       gpath_has_colour(gpset, gpath, wlk->ctpcol))
     {
-      GPathFollow fpath = gpath_follow_create(gpath);
+      GPathFollow fpath = gpath_follow_create(gpset, gpath);
 
       if(!cntr_filter_nuc0) gpath_follow_buf_add(pbuf, fpath);
       else if(gpath_follow_get_base(&fpath, 0) == next_nuc) {
@@ -104,6 +104,12 @@ size_t graph_write_header(FILE *fh, const GraphFileHeader *h)
   act += fwrite("CORTEX", 1, strlen("CORTEX"), fh);
   b += strlen("CORTEX");
 
+  if(h->version >= CTX_GRAPH_FILEFORMAT_BLOCKED) {
+    uint32_t block_kmers = h->block_kmers ? h->block_kmers : GRAPH_BLOCK_KMERS;
+    act += fwrite(&block_kmers, 1, sizeof(uint32_t), fh);
+    b += sizeof(uint32_t);
+  }
+
   if(act != b) die("Cannot write file");
 
   return b;
@@ -131,44 +137,77 @@ static inline void graph_write_kmer_direct(hkey_t hkey,
                                            const GraphFileHeader *hdr,
                                            FILE *fh, const dBGraph *db_graph)
 {
+  Covg covgs[db_graph->col_covgs8 != NULL ? hdr->num_of_cols : 1];
+  const Covg *covgptr = covgs;
+  size_t col;
+
+  // 8 bit coverages are expanded to the file's 32 bit coverages
+  if(db_graph->col_covgs8 != NULL) {
+    for(col = 0; col < hdr->num_of_cols; col++)
+      covgs[col] = db_node_get_covg(db_graph, hkey, col);
+  }
+  else covgptr = &db_node_covg(db_graph, hkey, 0);
+
   graph_write_kmer(fh, hdr->num_of_cols,
                    hash_table_fetch(&db_graph->ht, hkey),
-                   &db_node_covg(db_graph, hkey, 0),
-                   &db_node_edges(db_graph, hkey, 0));
+                   covgptr, &db_node_edges(db_graph, hkey, 0));
 }
 
 
-// Dump node: only print kmers with coverages in given colours
-static void graph_write_kmer_indirect(hkey_t hkey, const GraphFileHeader *hdr,
-                                      const FileFilter *fltr, FILE *fh,
-                                      const dBGraph *db_graph,
-                                      size_t *num_dumped)
+// Get covgs and edges of a kmer in the file colours, merged with a filter
+// Returns true if this node has coverage in one of the specified colours
+static inline bool graph_kmer_filtered(hkey_t hkey, const GraphFileHeader *hdr,
+                                       const FileFilter *fltr,
+                                       const dBGraph *db_graph,
+                                       Covg *covgs, Edges *edges)
 {
   size_t i, into, from;
-  BinaryKmer bkmer = db_node_get_bkey(db_graph, hkey);
-  Covg covgs[hdr->num_of_cols], merge_covgs = 0;
-  Edges edges[hdr->num_of_cols], merge_edges = 0;
+  Covg merge_covgs = 0;
+  Edges merge_edges = 0;
 
   memset(covgs, 0, sizeof(Covg) * hdr->num_of_cols);
   memset(edges, 0, sizeof(Edges) * hdr->num_of_cols);
 
-  Edges (*col_edges)[db_graph->num_of_cols]
-    = (Edges (*)[db_graph->num_of_cols])db_graph->col_edges;
-  Covg (*col_covgs)[db_graph->num_of_cols]
-    = (Covg (*)[db_graph->num_of_cols])db_graph->col_covgs;
-
   for(i = 0; i < file_filter_num(fltr); i++) {
     into = file_filter_intocol(fltr, i);
     from = file_filter_fromcol(fltr, i);
-    SAFE_SUM_COVG(covgs[into], col_covgs[hkey][from]);
-    edges[into] |= col_edges[hkey][from];
+    SAFE_SUM_COVG(covgs[into], db_node_get_covg(db_graph, hkey, from));
+    edges[into] |= db_node_get_edges(db_graph, hkey, from);
     merge_covgs |= covgs[into];
     merge_edges |= edges[into];
   }
 
-  // Check this node has coverage in one of the specified colours
-  if(merge_covgs > 0) {
-    graph_write_kmer(fh, hdr->num_of_cols, bkmer, covgs, edges);
+  return (merge_covgs > 0);
+}
+
+// Dump node: only print kmers with coverages in given colours
+static void graph_write_kmer_indirect(hkey_t hkey, const GraphFileHeader *hdr,
+                                      const FileFilter *fltr, FILE *fh,
+                                      const dBGraph *db_graph,
+                                      size_t *num_dumped)
+{
+  Covg covgs[hdr->num_of_cols];
+  Edges edges[hdr->num_of_cols];
+
+  if(graph_kmer_filtered(hkey, hdr, fltr, db_graph, covgs, edges)) {
+    graph_write_kmer(fh, hdr->num_of_cols, db_node_get_bkey(db_graph, hkey),
+                     covgs, edges);
+    (*num_dumped)++;
+  }
+}
+
+// Add node to a v7 block writer, if it has coverage in given colours
+static void graph_write_kmer_block(hkey_t hkey, const GraphFileHeader *hdr,
+                                   const FileFilter *fltr,
+                                   GraphBlockWriter *wtr,
+                                   const dBGraph *db_graph,
+                                   size_t *num_dumped)
+{
+  Covg covgs[hdr->num_of_cols];
+  Edges edges[hdr->num_of_cols];
+
+  if(graph_kmer_filtered(hkey, hdr, fltr, db_graph, covgs, edges)) {
+    graph_block_writer_add(wtr, db_node_get_bkey(db_graph, hkey), covgs, edges);
     (*num_dumped)++;
   }
 }
@@ -209,6 +248,26 @@ size_t graph_write_all_kmers_filtered(FILE *fh, const dBGraph *db_graph,
   return num_nodes_dumped;
 }
 
+// Write all kmers sorted into compressed blocks followed by the block index
+// `hdr_size` is the number of bytes already written to fh
+// Returns num of kmers written
+size_t graph_write_all_kmers_blocked(FILE *fh, const char *path,
+                                     size_t hdr_size, const dBGraph *db_graph,
+                                     const GraphFileHeader *hdr,
+                                     const FileFilter *fltr)
+{
+  size_t num_nodes_dumped = 0;
+  size_t block_kmers = hdr->block_kmers ? hdr->block_kmers : GRAPH_BLOCK_KMERS;
+  GraphBlockWriter wtr;
+  graph_block_writer_alloc(&wtr, fh, path, hdr->num_of_cols,
+                           block_kmers, hdr_size);
+  HASH_ITERATE_SORTED(&db_graph->ht, graph_write_kmer_block,
+                      hdr, fltr, &wtr, db_graph, &num_nodes_dumped);
+  graph_block_writer_finish(&wtr);
+  graph_block_writer_dealloc(&wtr);
+  return num_nodes_dumped;
+}
+
 // Pass your own header
 // If sort_kmers is true, save kmers in lexigraphical order
 // returns number of nodes written out
@@ -217,7 +276,7 @@ uint64_t graph_writer_save(const char *path, const dBGraph *db_graph,
                            const FileFilter *fltr)
 {
   ctx_assert(db_graph->col_edges != NULL);
-  ctx_assert(db_graph->col_covgs != NULL);
+  ctx_assert(db_graph_has_covgs(db_graph));
 
   uint64_t n_nodes = 0;
   const char *out_name = futil_outpath_str(path);
@@ -228,9 +287,13 @@ uint64_t graph_writer_save(const char *path, const dBGraph *db_graph,
   FILE *fh = futil_fopen(path, "w");
 
   // Write header
-  graph_write_header(fh, hdr);
+  size_t hdr_size = graph_write_header(fh, hdr);
 
-  if(file_filter_into_direct(fltr,hdr->num_of_cols)) {
+  if(hdr->version >= CTX_GRAPH_FILEFORMAT_BLOCKED) {
+    n_nodes = graph_write_all_kmers_blocked(fh, path, hdr_size, db_graph, hdr,
+                                            fltr);
+  }
+  else if(file_filter_into_direct(fltr,hdr->num_of_cols)) {
     n_nodes = graph_write_all_kmers_direct(fh, db_graph, sort_kmers, hdr);
   }
   else {
@@ -372,8 +435,8 @@ static void graph_writer_update_file_kmers(const dBGraph *db_graph,
       else { // linear search of the hash table (it's fast!)
         while(!db_graph_node_assigned(db_graph, hkey)) hkey++;
       }
-      covgs = db_graph->col_covgs + hkey * db_graph->num_of_cols;
-      edges = db_graph->col_edges + hkey * db_graph->num_of_cols;
+      covgs = &db_node_covg(db_graph, hkey, 0);
+      edges = &db_node_edges(db_graph, hkey, 0);
       memptr += sizeof(BinaryKmer);
       memcpy(memptr + first_filecol*sizeof(Covg), covgs, ngraphcols*sizeof(Covg));
       memptr += sizeof(Covg)*nfilecols;
@@ -401,6 +464,8 @@ size_t graph_writer_stream(const char *out_ctx_path, GraphFileReader *file,
 {
   const FileFilter *fltr = &file->fltr;
   bool only_load_if_in_graph = (only_load_if_in_edges != NULL);
+  ctx_assert2(hdr->version < CTX_GRAPH_FILEFORMAT_BLOCKED,
+              "Cannot stream into a v7 graph file");
   status("Filtering %s to %s with stream filter", fltr->path.b,
          futil_outpath_str(out_ctx_path));
   graph_loading_print_status(file);
@@ -490,7 +555,7 @@ size_t graph_writer_merge(const char *out_ctx_path,
                           bool kmers_loaded, bool colours_loaded,
                           const Edges *only_load_if_in_edges,
                           GraphFileHeader *hdr, bool sort_kmers,
-                          dBGraph *db_graph)
+                          size_t nthreads, dBGraph *db_graph)
 {
   bool only_load_if_in_graph = (only_load_if_in_edges != NULL);
   ctx_assert(!only_load_if_in_graph || kmers_loaded);
@@ -514,6 +579,7 @@ size_t graph_writer_merge(const char *out_ctx_path,
   GraphLoadingPrefs gprefs = graph_loading_prefs(db_graph);
   gprefs.must_exist_in_graph = only_load_if_in_graph;
   gprefs.must_exist_in_edges = only_load_if_in_edges;
+  gprefs.nthreads = nthreads;
 
   if(kmers_loaded && colours_loaded)
   {
@@ -553,6 +619,10 @@ size_t graph_writer_merge(const char *out_ctx_path,
   {
     ctx_assert2(strcmp(out_ctx_path,"-") != 0,
                 "Cannot use STDOUT for output if not enough colours to load");
+    ctx_assert2(hdr->version < CTX_GRAPH_FILEFORMAT_BLOCKED,
+                "Cannot update a v7 graph file in place");
+    ctx_assert2(db_graph->node_recs == NULL,
+                "Cannot wipe colours in node records");
 
     // Have to load a few colours at a time then dump, rinse and repeat
     status("[overwriting] Saving %zu colours, %zu colours at a time",
@@ -590,8 +660,10 @@ size_t graph_writer_merge(const char *out_ctx_path,
       // Wipe colour coverages and edges if needed
       if(firstcol == 0 || files_loaded) {
         status("Wiping colours");
-        memset(db_graph->col_edges, 0, num_kmer_cols * sizeof(Edges));
-        memset(db_graph->col_covgs, 0, num_kmer_cols * sizeof(Covg));
+        util_memset_mt(db_graph->col_edges, 0, num_kmer_cols * sizeof(Edges),
+                       nthreads);
+        util_memset_mt(db_graph->col_covgs, 0, num_kmer_cols * sizeof(Covg),
+                       nthreads);
       }
 
       files_loaded = false;
@@ -654,7 +726,8 @@ size_t graph_writer_merge_mkhdr(const char *out_ctx_path,
                                bool kmers_loaded, bool colours_loaded,
                                const Edges *only_load_if_in_edges,
                                const char *intersect_gname,
-                               bool sort_kmers, dBGraph *db_graph)
+                               bool sort_kmers, size_t nthreads,
+                               dBGraph *db_graph)
 {
   size_t i, num_kmers;
   GraphFileHeader hdr;
@@ -672,7 +745,182 @@ size_t graph_writer_merge_mkhdr(const char *out_ctx_path,
   num_kmers = graph_writer_merge(out_ctx_path, files, num_files,
                                  kmers_loaded, colours_loaded,
                                  only_load_if_in_edges,
-                                 &hdr, sort_kmers, db_graph);
+                                 &hdr, sort_kmers, nthreads, db_graph);
+
+  graph_header_dealloc(&hdr);
+  return num_kmers;
+}
+
+//
+// Merge sorted graph files without a hash table
+//
+
+// Next kmer from one input of a sorted merge
+typedef struct
+{
+  GraphFileReader *file;
+  BinaryKmer bkmer;
+  Covg *covgs;
+  Edges *edges;
+} SortedMergeInput;
+
+// Read the next kmer with coverage from an input, returns false at the end.
+// Kmers with no coverage are skipped, as when loading a graph.
+static bool sorted_merge_next(SortedMergeInput *in, bool first,
+                              size_t kmer_size)
+{
+  BinaryKmer prev = in->bkmer;
+  size_t i, ncols = file_filter_into_ncols(&in->file->fltr);
+  Covg keep_kmer;
+
+  do {
+    if(!graph_file_read_reset(in->file, &in->bkmer, in->covgs, in->edges))
+      return false;
+    for(i = 0, keep_kmer = 0; i < ncols; i++) keep_kmer |= in->covgs[i];
+    if(!first && !binary_kmer_lt(prev, in->bkmer)) {
+      char bkmerstr[MAX_KMER_SIZE+1];
+      binary_kmer_to_str(in->bkmer, kmer_size, bkmerstr);
+      die("Graph file is not sorted: %s [%s]",
+          file_filter_path(&in->file->fltr), bkmerstr);
+    }
+    prev = in->bkmer;
+    first = false;
+  } while(!keep_kmer);
+
+  return true;
+}
+
+// Min-heap of inputs ordered by their current kmer
+static void sorted_merge_heap_down(SortedMergeInput **heap, size_t n, size_t i)
+{
+  size_t c;
+  while((c = 2*i+1) < n) {
+    if(c+1 < n && binary_kmer_lt(heap[c+1]->bkmer, heap[c]->bkmer)) c++;
+    if(!binary_kmer_lt(heap[c]->bkmer, heap[i]->bkmer)) break;
+    SWAP(heap[i], heap[c]);
+    i = c;
+  }
+}
+
+// Merge graph files that are already sorted (e.g. with `ctx sort`) by reading
+// them all in parallel (k-way merge). Uses memory for one kmer per file.
+// Files must be at the start of their kmers (i.e. just opened) and may be
+// streams. Dies if a file is found to be unsorted.
+// Returns number of kmers written
+uint64_t graph_writer_merge_sorted(const char *out_ctx_path,
+                                   GraphFileReader *files, size_t num_files,
+                                   const GraphFileHeader *hdr)
+{
+  ctx_assert(num_files > 0);
+
+  size_t i, f, nheap = 0, ncols = hdr->num_of_cols;
+  size_t kmer_size = files[0].hdr.kmer_size;
+  uint64_t nkmers = 0;
+
+  for(f = 0; f < num_files; f++) {
+    ctx_assert(file_filter_into_ncols(&files[f].fltr) <= ncols);
+    if(files[f].hdr.kmer_size != kmer_size) {
+      die("Kmer-size mismatch %zu vs %u [%s vs %s]",
+          kmer_size, files[f].hdr.kmer_size,
+          files[0].fltr.path.b, files[f].fltr.path.b);
+    }
+  }
+
+  status("[graphwriter] Merging %zu sorted graph file%s to %s with a stream",
+         num_files, util_plural_str(num_files),
+         futil_outpath_str(out_ctx_path));
+
+  SortedMergeInput *inputs = ctx_calloc(num_files, sizeof(SortedMergeInput));
+  SortedMergeInput **heap = ctx_calloc(num_files, sizeof(SortedMergeInput*));
+  Covg *in_covgs = ctx_calloc(num_files * ncols, sizeof(Covg));
+  Edges *in_edges = ctx_calloc(num_files * ncols, sizeof(Edges));
+
+  for(f = 0; f < num_files; f++) {
+    graph_loading_print_status(&files[f]);
+    inputs[f].file = &files[f];
+    inputs[f].covgs = in_covgs + f*ncols;
+    inputs[f].edges = in_edges + f*ncols;
+    if(sorted_merge_next(&inputs[f], true, kmer_size))
+      heap[nheap++] = &inputs[f];
+  }
+
+  for(i = nheap/2; i-- > 0; ) sorted_merge_heap_down(heap, nheap, i);
+
+  FILE *fout = futil_fopen(out_ctx_path, "w");
+  size_t hdr_size = graph_write_header(fout, hdr);
+
+  GraphBlockWriter wtr;
+  bool blocked = (hdr->version >= CTX_GRAPH_FILEFORMAT_BLOCKED);
+  if(blocked) {
+    graph_block_writer_alloc(&wtr, fout, out_ctx_path, ncols,
+                             hdr->block_kmers ? hdr->block_kmers
+                                              : GRAPH_BLOCK_KMERS,
+                             hdr_size);
+  }
+
+  BinaryKmer bkmer;
+  Covg covgs[ncols];
+  Edges edges[ncols];
+
+  while(nheap > 0)
+  {
+    // Combine all inputs with the smallest kmer
+    bkmer = heap[0]->bkmer;
+    memset(covgs, 0, sizeof(covgs));
+    memset(edges, 0, sizeof(edges));
+
+    while(nheap > 0 && binary_kmer_eq(heap[0]->bkmer, bkmer))
+    {
+      SortedMergeInput *in = heap[0];
+      for(i = 0; i < file_filter_into_ncols(&in->file->fltr); i++) {
+        covgs[i] = SAFE_ADD_COVG(covgs[i], in->covgs[i]);
+        edges[i] |= in->edges[i];
+      }
+      if(!sorted_merge_next(in, false, kmer_size)) heap[0] = heap[--nheap];
+      sorted_merge_heap_down(heap, nheap, 0);
+    }
+
+    if(blocked) graph_block_writer_add(&wtr, bkmer, covgs, edges);
+    else graph_write_kmer(fout, ncols, bkmer, covgs, edges);
+    nkmers++;
+  }
+
+  if(blocked) {
+    graph_block_writer_finish(&wtr);
+    graph_block_writer_dealloc(&wtr);
+  }
+
+  fclose(fout);
+
+  ctx_free(in_covgs);
+  ctx_free(in_edges);
+  ctx_free(heap);
+  ctx_free(inputs);
+
+  graph_writer_print_status(nkmers, ncols, out_ctx_path, hdr->version);
+
+  return nkmers;
+}
+
+uint64_t graph_writer_merge_sorted_mkhdr(const char *out_ctx_path,
+                                         GraphFileReader *files,
+                                         size_t num_files,
+                                         bool compress, size_t block_kmers)
+{
+  size_t i;
+  uint64_t num_kmers;
+  GraphFileHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+
+  for(i = 0; i < num_files; i++)
+    graph_file_merge_header(&hdr, &files[i]);
+
+  if(compress) {
+    hdr.version = CTX_GRAPH_FILEFORMAT_BLOCKED;
+    hdr.block_kmers = block_kmers ? block_kmers : GRAPH_BLOCK_KMERS;
+  }
+
+  num_kmers = graph_writer_merge_sorted(out_ctx_path, files, num_files, &hdr);
 
   graph_header_dealloc(&hdr);
   return num_kmers;
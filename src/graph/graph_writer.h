@@ -44,8 +44,18 @@ size_t graph_write_all_kmers_filtered(FILE *fh, const dBGraph *db_graph,
                                       bool sort_kmers, const GraphFileHeader *hdr,
                                       const FileFilter *fltr);
 
+// Dump all kmers sorted into compressed blocks followed by the block index
+// (.ctx v7). Filter kmers and re-arrange colours.
+// `hdr_size` is the number of bytes already written to fh
+// Returns num of kmers written
+size_t graph_write_all_kmers_blocked(FILE *fh, const char *path,
+                                     size_t hdr_size, const dBGraph *db_graph,
+                                     const GraphFileHeader *hdr,
+                                     const FileFilter *fltr);
+
 // Pass your own header, ncols in file taken from the header
 // If sort_kmers is true, save kmers in lexigraphical order
+// If hdr->version is CTX_GRAPH_FILEFORMAT_BLOCKED (7), kmers are always sorted
 // returns number of nodes written out
 uint64_t graph_writer_save(const char *path, const dBGraph *db_graph,
                            const GraphFileHeader *hdr, bool sort_kmers,
@@ -77,12 +87,13 @@ size_t graph_writer_stream_mkhdr(const char *out_ctx_path, GraphFileReader *file
                                  const Edges *only_load_if_in_edges,
                                  const char *intersect_gname);
 
+// `nthreads` is the number of threads used to load each graph file
 size_t graph_writer_merge(const char *out_ctx_path,
                           GraphFileReader *files, size_t num_files,
                           bool kmers_loaded, bool colours_loaded,
                           const Edges *only_load_if_in_edges,
                           GraphFileHeader *hdr, bool sort_kmers,
-                          dBGraph *db_graph);
+                          size_t nthreads, dBGraph *db_graph);
 
 // if intersect only load kmers that are already in the hash table
 // returns number of kmers written
@@ -91,6 +102,21 @@ size_t graph_writer_merge_mkhdr(const char *out_ctx_path,
                                 bool kmers_loaded, bool colours_loaded,
                                 const Edges *only_load_if_in_edges,
                                 const char *intersect_gname,
-                                bool sort_kmers, dBGraph *db_graph);
+                                bool sort_kmers, size_t nthreads,
+                                dBGraph *db_graph);
+
+// Merge graph files that are already sorted with a k-way merge, without a
+// hash table. Files must not have been read from yet. Dies if a file is not
+// sorted. Returns number of kmers written
+uint64_t graph_writer_merge_sorted(const char *out_ctx_path,
+                                   GraphFileReader *files, size_t num_files,
+                                   const GraphFileHeader *hdr);
+
+// If `compress` is true, write a compressed graph (.ctx v7) with `block_kmers`
+// kmers per block (0 for the default), otherwise v6
+uint64_t graph_writer_merge_sorted_mkhdr(const char *out_ctx_path,
+                                         GraphFileReader *files,
+                                         size_t num_files,
+                                         bool compress, size_t block_kmers);
 
 #endif /* GRAPH_WRITER_H_ */
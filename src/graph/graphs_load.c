@@ -6,6 +6,8 @@
 #include "db_node.h"
 #include "graph_info.h"
 
+#include <sys/time.h> // gettimeofday()
+
 //
 // Graph loading stats
 //
@@ -43,6 +45,16 @@ void graph_loading_print_status(const GraphFileReader *file)
   }
 }
 
+// Print loading throughput
+void graph_loading_print_rate(uint64_t nkmers, double seconds, size_t nthreads)
+{
+  char nkmers_str[50], rate_str[50];
+  ulong_to_str(nkmers, nkmers_str);
+  ulong_to_str(seconds > 0 ? nkmers / seconds : 0, rate_str);
+  status("[GReader] Read %s kmers in %.2f secs (%s kmers/sec), %zu thread%s",
+         nkmers_str, seconds, rate_str, nthreads, util_plural_str(nthreads));
+}
+
 // Load ginfo from file header into the graph and check compatible
 void graph_load_ginfo(dBGraph *graph, GraphFileReader *file)
 {
@@ -75,6 +87,186 @@ void graph_load_ginfo(dBGraph *graph, GraphFileReader *file)
   graph->num_of_cols_used = MAX2(graph->num_of_cols_used, ncols);
 }
 
+// Counts for one thread loading part of a graph file
+typedef struct
+{
+  uint64_t nkmers_read, nkmers_loaded, nkmers_novel;
+  uint64_t *nkmers, *sumcov; // one per colour, NULL if not collecting stats
+} GraphLoadCounts;
+
+// Add one kmer read from a graph file to the graph
+// `use_mt` if true, use thread safe updates and inserts
+static inline void _graph_load_kmer(BinaryKmer bkmer,
+                                    Covg *covgs, Edges *edges, size_t ncols,
+                                    const GraphLoadingPrefs *prefs,
+                                    GraphLoadCounts *counts, bool use_mt)
+{
+  dBGraph *graph = prefs->db_graph;
+  hkey_t hkey;
+  size_t i;
+
+  // If kmer has no covg -> don't load
+  Covg keep_kmer = 0;
+  for(i = 0; i < ncols; i++) keep_kmer |= covgs[i];
+  if(keep_kmer == 0) return;
+
+  if(counts->nkmers) {
+    for(i = 0; i < ncols; i++) {
+      counts->nkmers[i] += covgs[i] > 0;
+      counts->sumcov[i] += covgs[i];
+    }
+  }
+
+  if(prefs->boolean_covgs)
+    for(i = 0; i < ncols; i++)
+      covgs[i] = covgs[i] > 0;
+
+  // Fetch node in the de bruijn graph
+  if(prefs->must_exist_in_graph)
+  {
+    if((hkey = hash_table_find(&graph->ht, bkmer)) == HASH_NOT_FOUND) return;
+  }
+  else
+  {
+    bool found;
+    if(use_mt) hkey = db_graph_find_or_add_node_mt(graph, bkmer, &found).key;
+    else hkey = hash_table_find_or_insert(&graph->ht, bkmer, &found);
+    if(prefs->empty_colours && found) die("Duplicate kmer loaded");
+    counts->nkmers_novel += !found;
+  }
+
+  // Set presence in colours
+  if(graph->node_in_cols != NULL) {
+    for(i = 0; i < ncols; i++) {
+      if(!use_mt) db_node_or_col(graph, hkey, i, (covgs[i] || edges[i]));
+      else if(covgs[i] || edges[i]) db_node_set_col_mt(graph, hkey, i);
+    }
+  }
+
+  if(db_graph_has_covgs(graph)) {
+    for(i = 0; i < ncols; i++) {
+      if(!use_mt) db_node_add_col_covg(graph, hkey, i, covgs[i]);
+      else if(covgs[i]) db_node_add_col_covg_mt(graph, hkey, i, covgs[i]);
+    }
+  }
+
+  // Merge all edges into one colour
+  if(graph->col_edges != NULL)
+  {
+    // Edges edge_mask = db_node_get_edges_union(graph, hkey);
+    Edges edge_mask = 0xff, e;
+
+    if(prefs->must_exist_in_edges)
+      edge_mask = prefs->must_exist_in_edges[hkey];
+    else if(prefs->must_exist_in_graph)
+      edge_mask = db_node_get_edges_union(graph, hkey);
+
+    Edges *col_edges = &db_node_edges(graph, hkey, 0);
+
+    for(i = 0; i < ncols; i++) {
+      e = edges[i] & edge_mask;
+      Edges *ptr = col_edges + (graph->num_edge_cols == 1 ? 0 : i);
+      if(!use_mt) *ptr |= e;
+      else if(e && (*ptr & e) != e) __sync_fetch_and_or(ptr, e);
+    }
+  }
+
+  counts->nkmers_loaded++;
+}
+
+// Worker thread loading kmers [start, end) of a graph file
+typedef struct
+{
+  GraphFileReader file; // shallow copy with its own file handle + buffer
+  const GraphLoadingPrefs *prefs;
+  size_t start, end;
+  GraphLoadCounts counts;
+} GraphLoadWorker;
+
+static void graph_load_worker(void *arg, size_t threadid)
+{
+  (void)threadid;
+  GraphLoadWorker *wrkr = (GraphLoadWorker*)arg;
+  GraphFileReader *file = &wrkr->file;
+  size_t i, ncols = file_filter_into_ncols(&file->fltr);
+  BinaryKmer bkmer;
+  Covg covgs[ncols];
+  Edges edges[ncols];
+
+  if(graph_file_seek_kmer(file, wrkr->start) != 0)
+    die("fseek failed: %s", strerror(errno));
+
+  for(i = wrkr->start; i < wrkr->end; i++) {
+    if(!graph_file_read_reset(file, &bkmer, covgs, edges)) break;
+    wrkr->counts.nkmers_read++;
+    _graph_load_kmer(bkmer, covgs, edges, ncols, wrkr->prefs,
+                     &wrkr->counts, true);
+  }
+}
+
+// Split the file into one range of kmers per thread. Each thread opens the
+// file and seeks to its range, decodes records and adds them to the graph
+// with thread safe inserts (bucket locks if allocated, otherwise lock-free)
+static void graph_load_mt(GraphFileReader *file, const GraphLoadingPrefs *prefs,
+                          size_t nthreads, GraphLoadCounts *counts)
+{
+  size_t i, j, ncols = file_filter_into_ncols(&file->fltr);
+  size_t nkmers = graph_file_nkmers(file);
+  const char *path = file_filter_path(&file->fltr);
+  GraphLoadWorker *wrkrs = ctx_calloc(nthreads, sizeof(GraphLoadWorker));
+
+  for(i = 0; i < nthreads; i++) {
+    wrkrs[i].file = *file;
+    wrkrs[i].file.fh = futil_fopen(path, "r");
+    strm_buf_alloc(&wrkrs[i].file.strm, ONE_MEGABYTE);
+    // v7: each thread decodes its own blocks, the block index is shared
+    if(file->blkbuf) {
+      wrkrs[i].file.blkbuf = graph_block_buf_new(file->hdr.num_of_cols,
+                                                 file->hdr.block_kmers);
+    }
+    wrkrs[i].prefs = prefs;
+    wrkrs[i].start = (nkmers * i) / nthreads;
+    wrkrs[i].end = (nkmers * (i+1)) / nthreads;
+    if(counts->nkmers) {
+      wrkrs[i].counts.nkmers = ctx_calloc(ncols, sizeof(uint64_t));
+      wrkrs[i].counts.sumcov = ctx_calloc(ncols, sizeof(uint64_t));
+    }
+  }
+
+  util_run_threads(wrkrs, nthreads, sizeof(wrkrs[0]),
+                   nthreads, graph_load_worker);
+
+  for(i = 0; i < nthreads; i++) {
+    GraphLoadCounts *c = &wrkrs[i].counts;
+    counts->nkmers_read += c->nkmers_read;
+    counts->nkmers_loaded += c->nkmers_loaded;
+    counts->nkmers_novel += c->nkmers_novel;
+    if(counts->nkmers) {
+      for(j = 0; j < ncols; j++) {
+        counts->nkmers[j] += c->nkmers[j];
+        counts->sumcov[j] += c->sumcov[j];
+      }
+    }
+    // Only warn once per file about bad kmers
+    file->error_zero_covg |= wrkrs[i].file.error_zero_covg;
+    file->error_missing_covg |= wrkrs[i].file.error_missing_covg;
+    strm_buf_dealloc(&wrkrs[i].file.strm);
+    graph_block_buf_free(wrkrs[i].file.blkbuf);
+    fclose(wrkrs[i].file.fh);
+    ctx_free(c->nkmers);
+    ctx_free(c->sumcov);
+  }
+
+  ctx_free(wrkrs);
+}
+
+static double graph_load_seconds()
+{
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return now.tv_sec + now.tv_usec / 1e6;
+}
+
 // We assume only_load_if_in_colour < load_first_colour_into
 // if all_kmers_are_unique != 0 an error is thrown if a node already exists
 // If stats != NULL, updates:
@@ -89,7 +281,7 @@ size_t graph_load(GraphFileReader *file, const GraphLoadingPrefs prefs,
 {
   dBGraph *graph = prefs.db_graph;
   FileFilter *fltr = &file->fltr;
-  size_t i, ncols = file_filter_into_ncols(fltr);
+  size_t ncols = file_filter_into_ncols(fltr);
 
   ctx_assert(file_filter_num(fltr) > 0);
 
@@ -106,102 +298,69 @@ size_t graph_load(GraphFileReader *file, const GraphLoadingPrefs prefs,
   // Load ginfo from file header into the graph and check compatible
   graph_load_ginfo(graph, file);
 
-  // Read kmers, align colours to those they are updating
-  //  e.g. covgs[i] -> colour i in the graph
-  BinaryKmer bkmer;
-  Covg covgs[ncols];
-  Edges edges[ncols];
-  hkey_t hkey;
-  size_t nkmers_read = 0, nkmers_loaded = 0, nkmers_novel = 0;
-
-  if(stats) graph_loading_stats_capacity(stats, ncols);
+  GraphLoadCounts counts;
+  memset(&counts, 0, sizeof(counts));
 
-  for(; graph_file_read_reset(file, &bkmer, covgs, edges); nkmers_read++)
-  {
-    // If kmer has no covg -> don't load
-    Covg keep_kmer = 0;
-    for(i = 0; i < ncols; i++) keep_kmer |= covgs[i];
-    if(keep_kmer == 0) continue;
-
-    if(stats) {
-      for(i = 0; i < ncols; i++) {
-        stats->nkmers[i] += covgs[i] > 0;
-        stats->sumcov[i] += covgs[i];
-      }
-    }
-
-    if(prefs.boolean_covgs)
-      for(i = 0; i < ncols; i++)
-        covgs[i] = covgs[i] > 0;
-
-    // Fetch node in the de bruijn graph
-    if(prefs.must_exist_in_graph)
-    {
-      if((hkey = hash_table_find(&graph->ht, bkmer)) == HASH_NOT_FOUND) continue;
-    }
-    else
-    {
-      bool found;
-      hkey = hash_table_find_or_insert(&graph->ht, bkmer, &found);
-      if(prefs.empty_colours && found) die("Duplicate kmer loaded");
-      nkmers_novel += !found;
-    }
-
-    // Set presence in colours
-    if(graph->node_in_cols != NULL) {
-      for(i = 0; i < ncols; i++) {
-        db_node_or_col(graph, hkey, i, (covgs[i] || edges[i]));
-      }
-    }
-
-    if(graph->col_covgs != NULL) {
-      for(i = 0; i < ncols; i++)
-        db_node_add_col_covg(graph, hkey, i, covgs[i]);
-    }
-
-    // Merge all edges into one colour
-    if(graph->col_edges != NULL)
-    {
-      // Edges edge_mask = db_node_get_edges_union(graph, hkey);
-      Edges edge_mask = 0xff;
+  if(stats) {
+    graph_loading_stats_capacity(stats, ncols);
+    counts.nkmers = ctx_calloc(ncols, sizeof(uint64_t));
+    counts.sumcov = ctx_calloc(ncols, sizeof(uint64_t));
+  }
 
-      if(prefs.must_exist_in_edges)
-        edge_mask = prefs.must_exist_in_edges[hkey];
-      else if(prefs.must_exist_in_graph)
-        edge_mask = db_node_get_edges_union(graph, hkey);
+  // Need to know the number of kmers to split the file between threads,
+  // so streams are read with a single thread
+  size_t nthreads = MAX2(prefs.nthreads, 1);
+  if(file_filter_isstdin(fltr) || file->num_of_kmers < 0) nthreads = 1;
+  nthreads = MIN2(nthreads, graph_file_nkmers(file) / 1024 + 1);
 
-      Edges *col_edges = &db_node_edges(graph, hkey, 0);
+  double start_time = graph_load_seconds();
 
-      if(graph->num_edge_cols == 1) {
-        for(i = 0; i < ncols; i++)
-          col_edges[0] |= edges[i] & edge_mask;
-      }
-      else {
-        for(i = 0; i < ncols; i++)
-          col_edges[i] |= edges[i] & edge_mask;
-      }
+  if(nthreads > 1)
+  {
+    graph_load_mt(file, &prefs, nthreads, &counts);
+  }
+  else
+  {
+    // Read kmers, align colours to those they are updating
+    //  e.g. covgs[i] -> colour i in the graph
+    BinaryKmer bkmer;
+    Covg covgs[ncols];
+    Edges edges[ncols];
+
+    while(graph_file_read_reset(file, &bkmer, covgs, edges)) {
+      counts.nkmers_read++;
+      _graph_load_kmer(bkmer, covgs, edges, ncols, &prefs, &counts, false);
     }
-
-    nkmers_loaded++;
   }
 
+  double seconds = graph_load_seconds() - start_time;
+  uint64_t nkmers_read = counts.nkmers_read;
+  uint64_t nkmers_loaded = counts.nkmers_loaded;
+
   if(file->num_of_kmers >= 0 && nkmers_read != (uint64_t)file->num_of_kmers)
   {
     warn("%s kmers in the graph file than expected "
          "[exp: %zu; act: %zu; path: %s]",
          nkmers_read > (uint64_t)file->num_of_kmers ? "More" : "Fewer",
-         (size_t)file->num_of_kmers, nkmers_read, fltr->path.b);
+         (size_t)file->num_of_kmers, (size_t)nkmers_read, fltr->path.b);
   }
 
   if(stats != NULL)
   {
+    size_t i;
+    for(i = 0; i < ncols; i++) {
+      stats->nkmers[i] += counts.nkmers[i];
+      stats->sumcov[i] += counts.sumcov[i];
+    }
     stats->nkmers_read += nkmers_read;
     stats->nkmers_loaded += nkmers_loaded;
-    stats->nkmers_novel += nkmers_novel;
+    stats->nkmers_novel += counts.nkmers_novel;
     // for(i = 0; i < file_filter_num(fltr); i++) {
     //   fromcol = file_filter_fromcol(fltr,i);
     //   stats->total_bases_read += hdr->ginfo[fromcol].total_sequence;
     // }
+    ctx_free(counts.nkmers);
+    ctx_free(counts.sumcov);
   }
 
   char n0[50], n1[50];
@@ -210,6 +369,8 @@ size_t graph_load(GraphFileReader *file, const GraphLoadingPrefs prefs,
          ulong_to_str(nkmers_read, n1),
          safe_percent(nkmers_loaded, nkmers_read));
 
+  graph_loading_print_rate(nkmers_read, seconds, nthreads);
+
   return nkmers_loaded;
 }
 
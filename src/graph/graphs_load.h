@@ -18,6 +18,9 @@ typedef struct
   // if empty_colours is true an error is thrown if a kmer from a graph file
   // is already in the graph
   bool empty_colours;
+  // Number of threads to decode and insert kmers with. Inserts use bucket
+  // locks if the graph has them, otherwise lock-free inserts
+  size_t nthreads;
 } GraphLoadingPrefs;
 
 typedef struct
@@ -38,7 +41,8 @@ static inline GraphLoadingPrefs graph_loading_prefs(dBGraph *graph)
     .boolean_covgs = false,
     .must_exist_in_graph = false,
     .must_exist_in_edges = NULL,
-    .empty_colours = false
+    .empty_colours = false,
+    .nthreads = 1
   };
   return prefs;
 }
@@ -46,6 +50,9 @@ static inline GraphLoadingPrefs graph_loading_prefs(dBGraph *graph)
 // Print loading message
 void graph_loading_print_status(const GraphFileReader *file);
 
+// Print loading throughput (kmers/sec)
+void graph_loading_print_rate(uint64_t nkmers, double seconds, size_t nthreads);
+
 // Load ginfo from file header into the graph and check compatible
 void graph_load_ginfo(dBGraph *graph, GraphFileReader *file);
 
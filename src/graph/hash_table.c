@@ -6,23 +6,239 @@
 // bit macros from BitArray library used for spinlocking
 #include "bit_array/bit_macros.h"
 
-// Hash table prefetching doesn't appear to be faster
-// #define HASH_PREFETCH 1
-
 #define ht_bckt_ptr(ht,bckt) ((ht)->table + (size_t)bckt * (ht)->bucket_size)
-#define hash_table_bsize_mt(ht,bkt) (*(volatile uint8_t*)&ht->buckets[bkt][HT_BSIZE])
-#define hash_table_bitems_mt(ht,bkt) (*(volatile uint8_t*)&ht->buckets[bkt][HT_BITEMS])
+#define ht_hash(ht,key,i) (binary_kmer_hash(key,(ht)->seed+(i)) & (ht)->hash_mask)
+#define hash_table_bsize_mt(ht,bkt) (*(volatile uint8_t*)&hash_table_bsize(ht,bkt))
+#define hash_table_bitems_mt(ht,bkt) (*(volatile uint8_t*)&hash_table_bitems(ht,bkt))
+
+#define ht_ndirty(nbkts) (((nbkts)+HT_DIRTY_BUCKETS-1)/HT_DIRTY_BUCKETS)
+
+// Mark the region holding a bucket as used, checking first to avoid writes
+static inline void ht_set_dirty(HashTable *ht, uint_fast32_t bucket)
+{
+  size_t r = bucket / HT_DIRTY_BUCKETS;
+  if(ht->dirty != NULL && !bitset_get_mt(ht->dirty, r))
+    bitset_set_mt(ht->dirty, r);
+}
+
+// Tag probes read 16 tags at a time
+#if (MAX_BUCKET_SIZE+15)/16*16 > HT_BLOCK_NTAGS
+  #error "MAX_BUCKET_SIZE too large for tagged hash table blocks"
+#endif
+
+//
+// Bucket probes: search n slots starting at ptr for bkmer (with flag set)
+//
+
+static const BinaryKmer* ht_probe_scalar(const BinaryKmer *ptr, size_t n,
+                                         BinaryKmer bkmer)
+{
+  const BinaryKmer *end = ptr + n;
+  while(ptr < end) {
+    if(binary_kmer_eq(bkmer, *ptr)) return ptr;
+    ptr++;
+  }
+  return NULL; // Not found
+}
+
+#if HT_PROBE_SIMD
+
+#include <immintrin.h>
+
+// Compare two kmers (k<=31) or one kmer (k<=63) per instruction
+__attribute__((target("sse4.2")))
+static const BinaryKmer* ht_probe_sse42(const BinaryKmer *ptr, size_t n,
+                                        BinaryKmer bkmer)
+{
+  const BinaryKmer *end = ptr + n;
+  int m;
+  #if NUM_BKMER_WORDS == 1
+    const __m128i key = _mm_set1_epi64x((long long)bkmer.b[0]);
+    for(; ptr+2 <= end; ptr += 2) {
+      __m128i v = _mm_loadu_si128((const __m128i*)ptr);
+      m = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(v, key)));
+      if(m) return ptr + __builtin_ctz(m);
+    }
+  #else
+    const __m128i key = _mm_set_epi64x((long long)bkmer.b[1], (long long)bkmer.b[0]);
+    for(; ptr < end; ptr++) {
+      __m128i v = _mm_loadu_si128((const __m128i*)ptr);
+      m = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(v, key)));
+      if(m == 3) return ptr;
+    }
+  #endif
+  return ht_probe_scalar(ptr, (size_t)(end - ptr), bkmer);
+}
+
+// Compare four kmers (k<=31) or two kmers (k<=63) per instruction
+__attribute__((target("avx2")))
+static const BinaryKmer* ht_probe_avx2(const BinaryKmer *ptr, size_t n,
+                                       BinaryKmer bkmer)
+{
+  const BinaryKmer *end = ptr + n;
+  int m;
+  #if NUM_BKMER_WORDS == 1
+    const __m256i key = _mm256_set1_epi64x((long long)bkmer.b[0]);
+    for(; ptr+4 <= end; ptr += 4) {
+      __m256i v = _mm256_loadu_si256((const __m256i*)ptr);
+      m = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(v, key)));
+      if(m) return ptr + __builtin_ctz(m);
+    }
+  #else
+    const __m256i key = _mm256_set_epi64x((long long)bkmer.b[1], (long long)bkmer.b[0],
+                                          (long long)bkmer.b[1], (long long)bkmer.b[0]);
+    for(; ptr+2 <= end; ptr += 2) {
+      __m256i v = _mm256_loadu_si256((const __m256i*)ptr);
+      m = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(v, key)));
+      if((m & 0x3) == 0x3) return ptr;
+      if((m & 0xc) == 0xc) return ptr+1;
+    }
+  #endif
+  return ht_probe_scalar(ptr, (size_t)(end - ptr), bkmer);
+}
+
+#endif /* HT_PROBE_SIMD */
+
+//
+// Tag probes: search the first n tags of a block for `tag`, comparing kmers in
+// slots with a matching tag. ptr is the first slot of the bucket.
+//
+
+// 8 bit fingerprint of a kmer (without flags), never zero
+static inline uint8_t ht_tag(BinaryKmer bkmer)
+{
+  uint64_t x = bkmer.b[NUM_BKMER_WORDS-1] * 0x9E3779B97F4A7C15UL;
+  uint8_t tag = (uint8_t)(x >> 56);
+  return tag ? tag : 1;
+}
+
+static inline const BinaryKmer* ht_probe_tags(const HashTableBlock *blk,
+                                              const BinaryKmer *ptr, size_t n,
+                                              BinaryKmer bkmer, uint8_t tag)
+{
+  size_t i;
+  #if HT_PROBE_SIMD
+    // SSE2 is always available on x86-64
+    const __m128i t = _mm_set1_epi8((char)tag);
+    uint32_t m;
+    for(i = 0; i < n; i += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i*)(blk->tags+i));
+      m = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, t));
+      if(n - i < 16) m &= (1U << (n - i)) - 1;
+      for(; m; m &= m-1) {
+        size_t j = i + __builtin_ctz(m);
+        if(binary_kmer_eq(bkmer, ptr[j])) return ptr + j;
+      }
+    }
+  #else
+    for(i = 0; i < n; i++)
+      if(blk->tags[i] == tag && binary_kmer_eq(bkmer, ptr[i])) return ptr + i;
+  #endif
+  return NULL; // Not found
+}
+
+typedef const BinaryKmer* (*HashTableProbeFunc)(const BinaryKmer *ptr, size_t n,
+                                                BinaryKmer bkmer);
+
+static HashTableProbeFunc ht_probe_func = ht_probe_scalar;
+static HashTableProbe ht_probe = HT_PROBE_SCALAR;
+static bool ht_probe_set = false;
+
+const char* hash_table_probe_str(HashTableProbe probe)
+{
+  switch(probe) {
+    case HT_PROBE_SCALAR: return "scalar";
+    case HT_PROBE_SSE42: return "sse4.2";
+    case HT_PROBE_AVX2: return "avx2";
+    default: return "best";
+  }
+}
+
+bool hash_table_probe_supported(HashTableProbe probe)
+{
+  #if HT_PROBE_SIMD
+    __builtin_cpu_init();
+    switch(probe) {
+      case HT_PROBE_SCALAR: return true;
+      case HT_PROBE_SSE42: return __builtin_cpu_supports("sse4.2");
+      case HT_PROBE_AVX2: return __builtin_cpu_supports("avx2");
+      default: return false;
+    }
+  #else
+    return probe == HT_PROBE_SCALAR;
+  #endif
+}
+
+// Not threadsafe: call before any threads start using hash tables
+HashTableProbe hash_table_set_probe(HashTableProbe probe)
+{
+  if(probe == HT_PROBE_BEST) {
+    probe = hash_table_probe_supported(HT_PROBE_AVX2) ? HT_PROBE_AVX2 :
+            (hash_table_probe_supported(HT_PROBE_SSE42) ? HT_PROBE_SSE42
+                                                        : HT_PROBE_SCALAR);
+  }
+  else if(!hash_table_probe_supported(probe)) {
+    warn("CPU does not support %s bucket probe, using scalar",
+         hash_table_probe_str(probe));
+    probe = HT_PROBE_SCALAR;
+  }
+
+  switch(probe) {
+    #if HT_PROBE_SIMD
+      case HT_PROBE_SSE42: ht_probe_func = ht_probe_sse42; break;
+      case HT_PROBE_AVX2: ht_probe_func = ht_probe_avx2; break;
+    #endif
+    default: ht_probe_func = ht_probe_scalar; probe = HT_PROBE_SCALAR;
+  }
+
+  ht_probe = probe;
+  ht_probe_set = true;
+  return probe;
+}
+
+HashTableProbe hash_table_get_probe()
+{
+  return ht_probe;
+}
+
+static HashTableLayout ht_layout = HT_LAYOUT_SPLIT;
+
+const char* hash_table_layout_str(HashTableLayout layout)
+{
+  return layout == HT_LAYOUT_TAGS ? "tags" : "split";
+}
+
+// Not threadsafe: call before any threads start using hash tables
+void hash_table_set_layout(HashTableLayout layout)
+{
+  ht_layout = layout;
+}
+
+HashTableLayout hash_table_get_layout()
+{
+  return ht_layout;
+}
+
+// Memory used to store bucket metadata (and tags)
+static inline size_t ht_bucket_mem(uint64_t num_of_buckets, bool tags)
+{
+  return tags ? (num_of_buckets+1) * sizeof(HashTableBlock)
+              : num_of_buckets * sizeof(uint8_t[2]);
+}
 
 void hash_table_alloc(HashTable *ht, uint64_t req_capacity)
 {
   uint64_t num_of_buckets, capacity;
   uint8_t bucket_size;
 
+  if(!ht_probe_set) hash_table_set_probe(HT_PROBE_BEST);
+
   capacity = hash_table_cap(req_capacity, &num_of_buckets, &bucket_size);
   uint_fast32_t hash_mask = (uint_fast32_t)(num_of_buckets - 1);
 
+  bool tags = (ht_layout == HT_LAYOUT_TAGS);
   size_t mem = capacity * sizeof(BinaryKmer) +
-               num_of_buckets * sizeof(uint8_t[2]);
+               ht_bucket_mem(num_of_buckets, tags);
 
   char num_bkts_str[100], bkt_size_str[100], cap_str[100], mem_str[100];
   ulong_to_str(num_of_buckets, num_bkts_str);
@@ -30,12 +246,25 @@ void hash_table_alloc(HashTable *ht, uint64_t req_capacity)
   ulong_to_str(capacity, cap_str);
   bytes_to_str(mem, 1, mem_str);
   status("[hasht] Allocating table with %s entries, using %s", cap_str, mem_str);
-  status("[hasht]  number of buckets: %s, bucket size: %s", num_bkts_str, bkt_size_str);
+  status("[hasht]  number of buckets: %s, bucket size: %s, layout: %s",
+         num_bkts_str, bkt_size_str, hash_table_layout_str(ht_layout));
 
   // calloc is required for bucket_data to set the first element of each bucket
   // to the 0th pos
-  BinaryKmer *table = ctx_calloc(capacity, sizeof(BinaryKmer));
-  uint8_t (*const buckets)[2] = ctx_calloc(num_of_buckets, sizeof(uint8_t[2]));
+  BinaryKmer *table = ctx_calloc_large(capacity, sizeof(BinaryKmer));
+  uint8_t (*buckets)[2] = NULL;
+  HashTableBlock *blocks = NULL;
+  void *blocks_mem = NULL;
+
+  if(tags) {
+    // Allocate an extra block so we can align blocks to cache lines
+    blocks_mem = ctx_calloc_large(num_of_buckets+1, sizeof(HashTableBlock));
+    blocks = (HashTableBlock*)(((size_t)blocks_mem + sizeof(HashTableBlock)-1) /
+                               sizeof(HashTableBlock) * sizeof(HashTableBlock));
+  }
+  else buckets = ctx_calloc_large(num_of_buckets, sizeof(uint8_t[2]));
+
+  uint8_t *dirty = ctx_calloc(roundup_bits2bytes(ht_ndirty(num_of_buckets)), 1);
 
   HashTable data = {
     .table = table,
@@ -44,23 +273,110 @@ void hash_table_alloc(HashTable *ht, uint64_t req_capacity)
     .bucket_size = bucket_size,
     .capacity = capacity,
     .buckets = buckets,
+    .blocks = blocks,
+    .blocks_mem = blocks_mem,
+    .dirty = dirty,
     .num_kmers = 0,
     .collisions = {0},
-    .seed = rand()};
+    .seed = rand(),
+    .growable = false};
+
+  memcpy(ht, &data, sizeof(data));
+}
+
+void hash_table_wrap(HashTable *ht, BinaryKmer *table, uint8_t (*buckets)[2],
+                     uint64_t num_of_buckets, uint8_t bucket_size,
+                     uint32_t seed, uint64_t num_kmers,
+                     const uint64_t *collisions)
+{
+  ctx_assert(num_of_buckets > 0 && !(num_of_buckets & (num_of_buckets-1)));
+
+  if(!ht_probe_set) hash_table_set_probe(HT_PROBE_BEST);
+
+  HashTable data = {
+    .table = table,
+    .num_of_buckets = num_of_buckets,
+    .hash_mask = (uint_fast32_t)(num_of_buckets - 1),
+    .bucket_size = bucket_size,
+    .capacity = num_of_buckets * bucket_size,
+    .buckets = buckets,
+    .blocks = NULL,
+    .blocks_mem = NULL,
+    .dirty = NULL,
+    .num_kmers = num_kmers,
+    .collisions = {0},
+    .seed = seed,
+    .growable = false};
 
+  memcpy(data.collisions, collisions, sizeof(data.collisions));
   memcpy(ht, &data, sizeof(data));
 }
 
 void hash_table_dealloc(HashTable *hash_table)
 {
-  ctx_free(hash_table->table);
-  ctx_free(hash_table->buckets);
+  ctx_free_large(hash_table->table);
+  ctx_free_large(hash_table->buckets);
+  ctx_free_large(hash_table->blocks_mem);
+  ctx_free(hash_table->dirty);
 }
 
-void hash_table_empty(HashTable *const ht)
+typedef struct
 {
-  memset(ht->table, 0, ht->capacity * sizeof(BinaryKmer));
-  memset(ht->buckets, 0, ht->num_of_buckets * sizeof(uint8_t[2]));
+  const HashTable *ht;
+  size_t nthreads;
+  void (*func)(hkey_t _start, hkey_t _end, void *_arg);
+  void *arg;
+} HashTableDirtyIterator;
+
+// Each thread takes a contiguous run of regions, joining adjacent dirty
+// regions into a single range
+static void _hash_table_dirty_iterate(void *arg, size_t threadid)
+{
+  const HashTableDirtyIterator *itr = (const HashTableDirtyIterator*)arg;
+  const HashTable *ht = itr->ht;
+  const size_t nregions = ht_ndirty(ht->num_of_buckets);
+  const size_t step = (nregions + itr->nthreads - 1) / itr->nthreads;
+  const size_t rgn_kmers = HT_DIRTY_BUCKETS * (size_t)ht->bucket_size;
+  size_t r, end = MIN2((threadid+1) * step, nregions), start = SIZE_MAX;
+
+  for(r = MIN2(threadid * step, nregions); r <= end; r++) {
+    bool dirty = r < end && (ht->dirty == NULL || bitset_get(ht->dirty, r));
+    if(dirty && start == SIZE_MAX) start = r;
+    else if(!dirty && start != SIZE_MAX) {
+      itr->func(start * rgn_kmers, MIN2(r * rgn_kmers, ht->capacity), itr->arg);
+      start = SIZE_MAX;
+    }
+  }
+}
+
+void hash_table_dirty_iterate(const HashTable *ht, size_t nthreads,
+                              void (*func)(hkey_t _start, hkey_t _end,
+                                           void *_arg),
+                              void *arg)
+{
+  ctx_assert(nthreads > 0);
+  nthreads = MIN2(nthreads, ht_ndirty(ht->num_of_buckets));
+  HashTableDirtyIterator itr = {.ht = ht, .nthreads = nthreads,
+                                .func = func, .arg = arg};
+  util_multi_thread(&itr, nthreads, _hash_table_dirty_iterate);
+}
+
+static void _hash_table_empty_range(hkey_t start, hkey_t end, void *arg)
+{
+  HashTable *ht = (HashTable*)arg;
+  size_t b0 = start / ht->bucket_size, b1 = end / ht->bucket_size;
+  memset(ht->table + start, 0, (end - start) * sizeof(BinaryKmer));
+  if(ht->blocks != NULL)
+    memset(ht->blocks + b0, 0, (b1 - b0) * sizeof(HashTableBlock));
+  else
+    memset(ht->buckets + b0, 0, (b1 - b0) * sizeof(uint8_t[2]));
+}
+
+void hash_table_empty(HashTable *const ht, size_t nthreads)
+{
+  hash_table_dirty_iterate(ht, nthreads, _hash_table_empty_range, ht);
+  if(ht->dirty != NULL)
+    memset(ht->dirty, 0, roundup_bits2bytes(ht_ndirty(ht->num_of_buckets)));
 
   HashTable data = {
     .table = ht->table,
@@ -69,8 +385,13 @@ void hash_table_empty(HashTable *const ht)
     .bucket_size = ht->bucket_size,
     .capacity = ht->capacity,
     .buckets = ht->buckets,
+    .blocks = ht->blocks,
+    .blocks_mem = ht->blocks_mem,
+    .dirty = ht->dirty,
     .num_kmers = 0,
-    .collisions = {0}};
+    .collisions = {0},
+    .seed = ht->seed,
+    .growable = ht->growable};
 
   memcpy(ht, &data, sizeof(data));
 }
@@ -80,14 +401,16 @@ static inline const BinaryKmer* hash_table_find_in_bucket(const HashTable *const
                                                           BinaryKmer bkmer)
 {
   const BinaryKmer *ptr = ht_bckt_ptr(ht, bucket);
-  const BinaryKmer *end = ptr + hash_table_bsize(ht, bucket);
-  bkmer.b[0] |= BKMER_SET_FLAG; // mark as assigned in the hash table
 
-  while(ptr < end) {
-    if(binary_kmer_eq(bkmer, *ptr)) return ptr;
-    ptr++;
+  if(ht->blocks != NULL) {
+    uint8_t tag = ht_tag(bkmer);
+    bkmer.b[0] |= BKMER_SET_FLAG;
+    return ht_probe_tags(&ht->blocks[bucket], ptr,
+                         hash_table_bsize(ht, bucket), bkmer, tag);
   }
-  return NULL; // Not found
+
+  bkmer.b[0] |= BKMER_SET_FLAG; // mark as assigned in the hash table
+  return ht_probe_func(ptr, hash_table_bsize(ht, bucket), bkmer);
 }
 
 // Remember to increment ht->num_kmers
@@ -100,20 +423,26 @@ static inline BinaryKmer* hash_table_insert_in_bucket(HashTable *ht,
   ctx_assert(bitems < ht->bucket_size);
   ctx_assert(bitems <= bsize);
   BinaryKmer *ptr = ht_bckt_ptr(ht, bucket);
+  uint8_t *tags = ht->blocks != NULL ? ht->blocks[bucket].tags : NULL;
+  uint8_t tag = ht_tag(bkmer);
+  size_t i = bsize;
   bkmer.b[0] |= BKMER_SET_FLAG; // mark as assigned in the hash table
 
   if(bitems == bsize) {
-    ptr += bsize;
-    ht->buckets[bucket][HT_BSIZE]++;
+    hash_table_bsize(ht, bucket)++;
   }
   else {
     // Find an entry that has been deleted from this bucket previously
-    while(HASH_ENTRY_ASSIGNED(*ptr)) ptr++;
+    i = 0;
+    if(tags != NULL) { while(tags[i]) i++; }
+    else { while(HASH_ENTRY_ASSIGNED(ptr[i])) i++; }
   }
 
-  *ptr = bkmer;
-  ht->buckets[bucket][HT_BITEMS]++;
-  return ptr;
+  ptr[i] = bkmer;
+  if(tags != NULL) tags[i] = tag;
+  hash_table_bitems(ht, bucket)++;
+  ht_set_dirty(ht, bucket);
+  return ptr + i;
 }
 
 #define rehash_error_exit(ht) do { \
@@ -122,37 +451,38 @@ static inline BinaryKmer* hash_table_insert_in_bucket(HashTable *ht,
   die("Hash table is full"); \
 } while(0)
 
-hkey_t hash_table_find(const HashTable *const ht, const BinaryKmer key)
+// Called from insert functions when no bucket has space for a kmer
+#define hash_table_full(ht) do { \
+  if((ht)->growable) return HASH_NOT_FOUND; \
+  rehash_error_exit(ht); \
+} while(0)
+
+// Each lookup function takes the first bucket `h` that the key hashes to,
+// so that batched versions can hash and prefetch buckets in advance
+// of searching them
+
+static inline hkey_t _hash_table_find(const HashTable *const ht,
+                                      const BinaryKmer key, uint_fast32_t h)
 {
   const BinaryKmer *ptr;
   size_t i;
-  uint_fast32_t h;
-
-  #ifdef HASH_PREFETCH
-    uint_fast32_t h2 = binary_kmer_hash(key,ht->seed+0) & ht->hash_mask;
-    __builtin_prefetch(ht_bckt_ptr(ht, h2), 0, 1);
-  #endif
 
   for(i = 0; i < REHASH_LIMIT; i++)
   {
-    #ifdef HASH_PREFETCH
-      h = h2;
-      if(ht->buckets[h][HT_BSIZE] == ht->bucket_size) {
-        h2 = binary_kmer_hash(key,ht->seed+i+1) & ht->hash_mask;
-        __builtin_prefetch(ht_bckt_ptr(ht, h2), 0, 1);
-      }
-    #else
-      h = binary_kmer_hash(key,ht->seed+i) & ht->hash_mask;
-    #endif
-
+    if(i > 0) h = ht_hash(ht, key, i);
     ptr = hash_table_find_in_bucket(ht, h, key);
     if(ptr != NULL) return (hkey_t)(ptr - ht->table);
-    if(ht->buckets[h][HT_BSIZE] < ht->bucket_size) break;
+    if(hash_table_bsize(ht, h) < ht->bucket_size) break;
   }
 
   return HASH_NOT_FOUND;
 }
 
+hkey_t hash_table_find(const HashTable *const ht, const BinaryKmer key)
+{
+  return _hash_table_find(ht, key, ht_hash(ht, key, 0));
+}
+
 hkey_t hash_table_find_mt(HashTable *ht, const BinaryKmer key,
                           volatile uint8_t *bktlocks)
 {
@@ -162,7 +492,7 @@ hkey_t hash_table_find_mt(HashTable *ht, const BinaryKmer key,
 
   for(i = 0; i < REHASH_LIMIT; i++)
   {
-    h = binary_kmer_hash(key,ht->seed+i) & ht->hash_mask;
+    h = ht_hash(ht, key, i);
     bitlock_yield_acquire(bktlocks, h);
     ptr = hash_table_find_in_bucket(ht, h, key);
 
@@ -193,8 +523,8 @@ hkey_t hash_table_insert(HashTable *const ht, const BinaryKmer key)
 
   for(i = 0; i < REHASH_LIMIT; i++)
   {
-    h = binary_kmer_hash(key,ht->seed+i) & ht->hash_mask;
-    if(ht->buckets[h][HT_BITEMS] < ht->bucket_size) {
+    h = ht_hash(ht, key, i);
+    if(hash_table_bitems(ht, h) < ht->bucket_size) {
       ptr = hash_table_insert_in_bucket(ht, h, key);
       ht->collisions[i]++; // only increment collisions when inserting
       ht->num_kmers++;
@@ -202,40 +532,26 @@ hkey_t hash_table_insert(HashTable *const ht, const BinaryKmer key)
     }
   }
 
-  rehash_error_exit(ht);
+  hash_table_full(ht);
 }
 
-hkey_t hash_table_find_or_insert(HashTable *ht, const BinaryKmer key,
-                                 bool *found)
+static inline hkey_t _hash_table_find_or_insert(HashTable *ht,
+                                                const BinaryKmer key,
+                                                uint_fast32_t h, bool *found)
 {
   const BinaryKmer *ptr;
   size_t i;
-  uint_fast32_t h;
-
-  #ifdef HASH_PREFETCH
-    uint_fast32_t h2 = binary_kmer_hash(key,ht->seed+0) & ht->hash_mask;
-    __builtin_prefetch(ht_bckt_ptr(ht, h2), 0, 1);
-  #endif
 
   for(i = 0; i < REHASH_LIMIT; i++)
   {
-    #ifdef HASH_PREFETCH
-      h = h2;
-      if(ht->buckets[h][HT_BSIZE] == ht->bucket_size) {
-        h2 = binary_kmer_hash(key,ht->seed+i+1) & ht->hash_mask;
-        __builtin_prefetch(ht_bckt_ptr(ht, h2), 0, 1);
-      }
-    #else
-      h = binary_kmer_hash(key,ht->seed+i) & ht->hash_mask;
-    #endif
-
+    if(i > 0) h = ht_hash(ht, key, i);
     ptr = hash_table_find_in_bucket(ht, h, key);
 
     if(ptr != NULL)  {
       *found = true;
       return (hkey_t)(ptr - ht->table);
     }
-    else if(ht->buckets[h][HT_BITEMS] < ht->bucket_size) {
+    else if(hash_table_bitems(ht, h) < ht->bucket_size) {
       *found = false;
       ptr = hash_table_insert_in_bucket(ht, h, key);
       ht->collisions[i]++; // only increment collisions when inserting
@@ -244,19 +560,26 @@ hkey_t hash_table_find_or_insert(HashTable *ht, const BinaryKmer key,
     }
   }
 
-  rehash_error_exit(ht);
+  hash_table_full(ht);
 }
 
-hkey_t hash_table_find_or_insert_mt(HashTable *ht, const BinaryKmer key,
-                                    bool *found, volatile uint8_t *bktlocks)
+hkey_t hash_table_find_or_insert(HashTable *ht, const BinaryKmer key,
+                                 bool *found)
+{
+  return _hash_table_find_or_insert(ht, key, ht_hash(ht, key, 0), found);
+}
+
+static inline hkey_t _hash_table_find_or_insert_mt(HashTable *ht,
+                                                   const BinaryKmer key,
+                                                   uint_fast32_t h, bool *found,
+                                                   volatile uint8_t *bktlocks)
 {
   const BinaryKmer *ptr;
   size_t i;
-  uint_fast32_t h;
 
   for(i = 0; i < REHASH_LIMIT; i++)
   {
-    h = binary_kmer_hash(key,ht->seed+i) & ht->hash_mask;
+    if(i > 0) h = ht_hash(ht, key, i);
     bitlock_yield_acquire(bktlocks, h);
     ptr = hash_table_find_in_bucket(ht, h, key);
 
@@ -277,7 +600,377 @@ hkey_t hash_table_find_or_insert_mt(HashTable *ht, const BinaryKmer key,
     bitlock_release(bktlocks, h);
   }
 
-  rehash_error_exit(ht);
+  hash_table_full(ht);
+}
+
+hkey_t hash_table_find_or_insert_mt(HashTable *ht, const BinaryKmer key,
+                                    bool *found, volatile uint8_t *bktlocks)
+{
+  return _hash_table_find_or_insert_mt(ht, key, ht_hash(ht, key, 0), found,
+                                       bktlocks);
+}
+
+//
+// Lock-free find / insert
+//
+// The first word of each slot moves from empty (0) to claimed (BUSY flag) to
+// assigned (SET flag | kmer) and never back whilst inserting. Inserts claim the
+// first empty slot in a bucket, so slots past the bucket's size (high water
+// mark) are filled contiguously. Two threads adding the same kmer race for the
+// same slot, the loser waits for the winner to write the kmer then compares.
+//
+// In the tagged layout the tag byte is claimed instead: a slot moves from
+// empty (tag 0) to claimed (tag set, kmer 0) to assigned (kmer written).
+//
+
+#define ht_slot_word_mt(ptr) (*(volatile uint64_t*)&(ptr)->b[0])
+
+// Wait for a claimed slot to be written, returns the first word of the slot
+static inline uint64_t hash_table_slot_wait(const BinaryKmer *ptr)
+{
+  uint64_t w;
+  while((w = ht_slot_word_mt(ptr)) == BKMER_BUSY_FLAG) sched_yield();
+  #if NUM_BKMER_WORDS > 1
+    __sync_synchronize(); // other words written before first
+  #endif
+  return w;
+}
+
+// Wait for the kmer in a slot with a claimed tag to be written
+static inline uint64_t hash_table_tagged_slot_wait(const BinaryKmer *ptr)
+{
+  uint64_t w;
+  while((w = ht_slot_word_mt(ptr)) == 0) sched_yield();
+  #if NUM_BKMER_WORDS > 1
+    __sync_synchronize(); // other words written before first
+  #endif
+  return w;
+}
+
+static inline bool hash_table_slot_eq(const BinaryKmer *ptr, uint64_t w,
+                                      BinaryKmer bkmer)
+{
+  #if NUM_BKMER_WORDS == 1
+    (void)ptr;
+    return w == bkmer.b[0];
+  #else
+    return w == bkmer.b[0] &&
+           memcmp(ptr->b+1, bkmer.b+1, (NUM_BKMER_WORDS-1)*sizeof(uint64_t)) == 0;
+  #endif
+}
+
+// Search a bucket for a kmer without locking
+// Returns pointer to kmer if found, otherwise NULL
+// Sets *empty to the index of the first empty slot seen or bucket_size if full
+// Sets *end true if the kmer cannot be in a later bucket (this one not full)
+static inline const BinaryKmer* hash_table_find_in_bucket_cas(const HashTable *ht,
+                                                              uint_fast32_t bucket,
+                                                              BinaryKmer bkmer,
+                                                              size_t *empty,
+                                                              bool *end)
+{
+  const BinaryKmer *ptr = ht_bckt_ptr(ht, bucket);
+  const volatile uint8_t *tags = ht->blocks ? ht->blocks[bucket].tags : NULL;
+  const size_t bsize = hash_table_bsize_mt(ht, bucket);
+  const uint8_t tag = ht_tag(bkmer);
+  const BinaryKmer *found;
+  size_t i;
+  uint64_t w;
+  bkmer.b[0] |= BKMER_SET_FLAG;
+
+  *empty = ht->bucket_size;
+  *end = false;
+
+  // Kmers are published by writing their first word last, so slots being
+  // claimed cannot match the (SIMD) probe and are only waited on below if the
+  // kmer was not found. A probe may read the words of a kmer in any order,
+  // so re-read the others after the first.
+  found = tags != NULL ? ht_probe_tags(&ht->blocks[bucket], ptr, bsize,
+                                       bkmer, tag)
+                       : ht_probe_func(ptr, bsize, bkmer);
+  #if NUM_BKMER_WORDS > 1
+    if(found != NULL && !hash_table_slot_eq(found, hash_table_slot_wait(found),
+                                            bkmer)) found = NULL;
+  #endif
+  if(found != NULL) return found;
+
+  for(i = 0; i < ht->bucket_size; i++, ptr++) {
+    if(tags != NULL) {
+      w = tags[i];
+      if(w == tag) w = hash_table_tagged_slot_wait(ptr);
+      else if(w != 0) continue;
+    }
+    else w = hash_table_slot_wait(ptr);
+
+    if(w == 0) {
+      if(*empty == ht->bucket_size) *empty = i;
+      // Past the high water mark all filled slots are contiguous
+      if(i >= bsize) { *end = true; break; }
+    }
+    else if(hash_table_slot_eq(ptr, w, bkmer)) return ptr;
+  }
+
+  return NULL;
+}
+
+// Raise the size (high water mark) of a bucket to at least `size`
+static inline void hash_table_bsize_raise_mt(HashTable *ht, uint_fast32_t bucket,
+                                             uint8_t size)
+{
+  volatile uint8_t *ptr = &hash_table_bsize_mt(ht, bucket);
+  uint8_t curr;
+  while((curr = *ptr) < size && !__sync_bool_compare_and_swap(ptr, curr, size)) {}
+}
+
+// Tagged layout version of hash_table_claim_in_bucket_cas()
+static inline const BinaryKmer* hash_table_claim_in_block_cas(HashTable *ht,
+                                                              uint_fast32_t bucket,
+                                                              BinaryKmer bkmer,
+                                                              size_t start,
+                                                              bool *found)
+{
+  BinaryKmer *ptr = ht_bckt_ptr(ht, bucket) + start;
+  volatile uint8_t *tags = ht->blocks[bucket].tags;
+  const uint8_t tag = ht_tag(bkmer);
+  size_t i;
+  uint64_t w;
+  bkmer.b[0] |= BKMER_SET_FLAG;
+
+  for(i = start; i < ht->bucket_size; i++, ptr++)
+  {
+    if(__sync_bool_compare_and_swap(&tags[i], 0, tag)) {
+      #if NUM_BKMER_WORDS > 1
+        memcpy(ptr->b+1, bkmer.b+1, (NUM_BKMER_WORDS-1)*sizeof(uint64_t));
+        __sync_synchronize(); // write other words before publishing the first
+      #endif
+      ht_slot_word_mt(ptr) = bkmer.b[0];
+      __sync_fetch_and_add(&hash_table_bitems_mt(ht, bucket), 1);
+      hash_table_bsize_raise_mt(ht, bucket, (uint8_t)(i+1));
+      ht_set_dirty(ht, bucket);
+      *found = false;
+      return ptr;
+    }
+
+    // Lost the race for this slot - check if it was the same kmer
+    if(tags[i] == tag) {
+      w = hash_table_tagged_slot_wait(ptr);
+      if(hash_table_slot_eq(ptr, w, bkmer)) { *found = true; return ptr; }
+    }
+  }
+
+  return NULL;
+}
+
+// Try to claim an empty slot in a bucket, starting at index `start`
+// Returns pointer to the kmer in the table and sets *found if another thread
+// added it first. Returns NULL if the bucket filled up without us.
+static inline const BinaryKmer* hash_table_claim_in_bucket_cas(HashTable *ht,
+                                                               uint_fast32_t bucket,
+                                                               BinaryKmer bkmer,
+                                                               size_t start,
+                                                               bool *found)
+{
+  BinaryKmer *ptr = ht_bckt_ptr(ht, bucket) + start;
+  size_t i;
+  uint64_t w;
+
+  if(ht->blocks != NULL)
+    return hash_table_claim_in_block_cas(ht, bucket, bkmer, start, found);
+
+  bkmer.b[0] |= BKMER_SET_FLAG;
+
+  for(i = start; i < ht->bucket_size; i++, ptr++)
+  {
+    #if NUM_BKMER_WORDS == 1
+      if(__sync_bool_compare_and_swap(&ptr->b[0], 0, bkmer.b[0])) {
+    #else
+      if(__sync_bool_compare_and_swap(&ptr->b[0], 0, BKMER_BUSY_FLAG)) {
+        memcpy(ptr->b+1, bkmer.b+1, (NUM_BKMER_WORDS-1)*sizeof(uint64_t));
+        __sync_synchronize(); // write other words before publishing the first
+        ht_slot_word_mt(ptr) = bkmer.b[0];
+    #endif
+      __sync_fetch_and_add(&hash_table_bitems_mt(ht, bucket), 1);
+      hash_table_bsize_raise_mt(ht, bucket, (uint8_t)(i+1));
+      ht_set_dirty(ht, bucket);
+      *found = false;
+      return ptr;
+    }
+
+    // Lost the race for this slot - check if it was the same kmer
+    w = hash_table_slot_wait(ptr);
+    if(hash_table_slot_eq(ptr, w, bkmer)) { *found = true; return ptr; }
+  }
+
+  return NULL;
+}
+
+static inline hkey_t _hash_table_find_cas(const HashTable *ht,
+                                          const BinaryKmer key,
+                                          uint_fast32_t h)
+{
+  const BinaryKmer *ptr;
+  size_t i, empty;
+  bool end;
+
+  for(i = 0; i < REHASH_LIMIT; i++)
+  {
+    if(i > 0) h = ht_hash(ht, key, i);
+    ptr = hash_table_find_in_bucket_cas(ht, h, key, &empty, &end);
+    if(ptr != NULL) return (hkey_t)(ptr - ht->table);
+    if(end) break;
+  }
+
+  return HASH_NOT_FOUND;
+}
+
+hkey_t hash_table_find_cas(const HashTable *ht, const BinaryKmer key)
+{
+  return _hash_table_find_cas(ht, key, ht_hash(ht, key, 0));
+}
+
+static inline hkey_t _hash_table_find_or_insert_cas(HashTable *ht,
+                                                    const BinaryKmer key,
+                                                    uint_fast32_t h,
+                                                    bool *found)
+{
+  const BinaryKmer *ptr;
+  size_t i, empty;
+  bool end;
+
+  for(i = 0; i < REHASH_LIMIT; i++)
+  {
+    if(i > 0) h = ht_hash(ht, key, i);
+    ptr = hash_table_find_in_bucket_cas(ht, h, key, &empty, &end);
+
+    if(ptr != NULL) {
+      *found = true;
+      return (hkey_t)(ptr - ht->table);
+    }
+    else if(empty < ht->bucket_size) {
+      ptr = hash_table_claim_in_bucket_cas(ht, h, key, empty, found);
+      if(ptr != NULL) {
+        if(!*found) {
+          __sync_add_and_fetch((volatile uint64_t*)&ht->collisions[i], 1);
+          __sync_add_and_fetch((volatile uint64_t*)&ht->num_kmers, 1);
+        }
+        return (hkey_t)(ptr - ht->table);
+      }
+    }
+  }
+
+  hash_table_full(ht);
+}
+
+hkey_t hash_table_find_or_insert_cas(HashTable *ht, const BinaryKmer key,
+                                     bool *found)
+{
+  return _hash_table_find_or_insert_cas(ht, key, ht_hash(ht, key, 0), found);
+}
+
+//
+// Batched lookups
+//
+// Hash a batch of keys and prefetch their first buckets before searching any
+// of them, so that cache misses on a large table overlap rather than stall
+// one after another.
+//
+
+// Prefetch with write intent when we may insert
+// If prehash is not NULL, use rolling hash values instead of hashing keys
+static inline void hash_table_prefetch_batch(const HashTable *ht,
+                                             const BinaryKmer *keys,
+                                             const uint64_t *prehash, size_t n,
+                                             uint_fast32_t *h, bool write)
+{
+  ctx_assert(prehash == NULL || BINARY_KMER_ROLL_HASH);
+  size_t i;
+  for(i = 0; i < n; i++) {
+    h[i] = prehash ? roll_hash_final(prehash[i], ht->seed) & ht->hash_mask
+                   : ht_hash(ht, keys[i], 0);
+    if(ht->blocks != NULL) {
+      // Kmers are only read once their tag matches
+      if(write) __builtin_prefetch(&ht->blocks[h[i]], 1, 1);
+      else __builtin_prefetch(&ht->blocks[h[i]], 0, 1);
+    } else if(write) {
+      __builtin_prefetch(ht_bckt_ptr(ht, h[i]), 1, 1);
+      __builtin_prefetch(&ht->buckets[h[i]], 1, 1);
+    } else {
+      __builtin_prefetch(ht_bckt_ptr(ht, h[i]), 0, 1);
+      __builtin_prefetch(&ht->buckets[h[i]], 0, 1);
+    }
+  }
+}
+
+void hash_table_find_batch(const HashTable *ht, const BinaryKmer *keys,
+                           const uint64_t *prehash, size_t n, hkey_t *hkeys)
+{
+  uint_fast32_t h[HASH_BATCH_SIZE];
+  size_t i, j, m;
+
+  for(i = 0; i < n; i += m) {
+    m = MIN2(n - i, HASH_BATCH_SIZE);
+    hash_table_prefetch_batch(ht, keys+i, prehash ? prehash+i : NULL, m,
+                              h, false);
+    for(j = 0; j < m; j++)
+      hkeys[i+j] = _hash_table_find(ht, keys[i+j], h[j]);
+  }
+}
+
+void hash_table_find_batch_cas(const HashTable *ht, const BinaryKmer *keys,
+                               const uint64_t *prehash, size_t n, hkey_t *hkeys)
+{
+  uint_fast32_t h[HASH_BATCH_SIZE];
+  size_t i, j, m;
+
+  for(i = 0; i < n; i += m) {
+    m = MIN2(n - i, HASH_BATCH_SIZE);
+    hash_table_prefetch_batch(ht, keys+i, prehash ? prehash+i : NULL, m,
+                              h, false);
+    for(j = 0; j < m; j++)
+      hkeys[i+j] = _hash_table_find_cas(ht, keys[i+j], h[j]);
+  }
+}
+
+size_t hash_table_find_or_insert_batch_mt(HashTable *ht, const BinaryKmer *keys,
+                                          const uint64_t *prehash, size_t n,
+                                          hkey_t *hkeys, bool *found,
+                                          volatile uint8_t *bktlocks)
+{
+  uint_fast32_t h[HASH_BATCH_SIZE];
+  size_t i, j, m;
+
+  for(i = 0; i < n; i += m) {
+    m = MIN2(n - i, HASH_BATCH_SIZE);
+    hash_table_prefetch_batch(ht, keys+i, prehash ? prehash+i : NULL, m,
+                              h, true);
+    for(j = 0; j < m; j++) {
+      hkeys[i+j] = _hash_table_find_or_insert_mt(ht, keys[i+j], h[j],
+                                                 &found[i+j], bktlocks);
+      if(hkeys[i+j] == HASH_NOT_FOUND) return i+j; // full, can grow
+    }
+  }
+  return n;
+}
+
+size_t hash_table_find_or_insert_batch_cas(HashTable *ht,
+                                           const BinaryKmer *keys,
+                                           const uint64_t *prehash, size_t n,
+                                           hkey_t *hkeys, bool *found)
+{
+  uint_fast32_t h[HASH_BATCH_SIZE];
+  size_t i, j, m;
+
+  for(i = 0; i < n; i += m) {
+    m = MIN2(n - i, HASH_BATCH_SIZE);
+    hash_table_prefetch_batch(ht, keys+i, prehash ? prehash+i : NULL, m,
+                              h, true);
+    for(j = 0; j < m; j++) {
+      hkeys[i+j] = _hash_table_find_or_insert_cas(ht, keys[i+j], h[j],
+                                                  &found[i+j]);
+      if(hkeys[i+j] == HASH_NOT_FOUND) return i+j; // full, can grow
+    }
+  }
+  return n;
 }
 
 // Safe to call on different entries at the same time
@@ -290,8 +983,10 @@ void hash_table_delete(HashTable *const ht, hkey_t pos)
   ctx_assert(HASH_ENTRY_ASSIGNED(ht->table[pos]));
 
   memset(ht->table+pos, 0, sizeof(BinaryKmer));
+  if(ht->blocks != NULL)
+    ht->blocks[bucket].tags[pos - bucket * ht->bucket_size] = 0;
   n = __sync_fetch_and_sub((volatile uint64_t *)&ht->num_kmers, 1);
-  m = __sync_fetch_and_sub((volatile uint8_t *)&ht->buckets[bucket][HT_BITEMS], 1);
+  m = __sync_fetch_and_sub(&hash_table_bitems_mt(ht, bucket), 1);
 
   ctx_assert2(n > 0, "Deleted from empty table");
   ctx_assert2(m > 0, "Deleted from empty bucket");
@@ -303,7 +998,7 @@ void hash_table_print_stats_brief(const HashTable *const ht)
   size_t nbytes, nkeybits;
   double occupancy = (100.0 * ht->num_kmers) / ht->capacity;
   nbytes = ht->capacity * sizeof(BinaryKmer) +
-           ht->num_of_buckets * sizeof(uint8_t[2]);
+           ht_bucket_mem(ht->num_of_buckets, ht->blocks != NULL);
   nkeybits = (size_t)__builtin_ctzl(ht->num_of_buckets);
 
   char mem_str[50], num_buckets_str[100], num_entries_str[100], capacity_str[100];
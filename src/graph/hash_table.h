@@ -12,8 +12,25 @@
 
 #define HASH_NOT_FOUND (UINT64_MAX>>1)
 #define BKMER_SET_FLAG (1UL<<63)
+// Marks a slot claimed by a lock-free insert whose kmer is not yet written
+#define BKMER_BUSY_FLAG (1UL<<62)
 #define HASH_ENTRY_ASSIGNED(bkmer) (((bkmer).b[0] & BKMER_SET_FLAG))
 
+// Tagged bucket layout: a bucket's size, number of items and an 8 bit tag
+// (fingerprint) for each of its slots share one cache line. Lookups compare
+// tags and only read a kmer from the table when its tag matches.
+#define HT_BLOCK_NTAGS 62
+
+typedef struct
+{
+  uint8_t meta[2]; // [HT_BSIZE], [HT_BITEMS] as in HashTable.buckets
+  uint8_t tags[HT_BLOCK_NTAGS]; // zero if slot is empty
+} __attribute__((aligned(64))) HashTableBlock;
+
+// Emptying the table only clears regions of HT_DIRTY_BUCKETS buckets that
+// have had kmers added since it was last emptied
+#define HT_DIRTY_BUCKETS 64
+
 // Struct is public so ITERATE macros can operate on it
 typedef struct
 {
@@ -24,16 +41,67 @@ typedef struct
   const uint64_t capacity; // num_of_buckets * bucket_size
   // buckets[b][0] is the size of the bucket (can only increase)
   // buckets[b][1] is the number of filled entries in a bucket (can go up/down)
+  // NULL if using the tagged layout
   uint8_t (*const buckets)[2];
+  // Bucket metadata and tags if using the tagged layout, otherwise NULL
+  HashTableBlock *const blocks;
+  void *const blocks_mem; // allocation holding blocks
+  // Bit per HT_DIRTY_BUCKETS buckets, set when a kmer is added to one of them
+  // NULL if unknown (all regions may be dirty)
+  uint8_t *const dirty;
   uint64_t num_kmers;
   uint64_t collisions[REHASH_LIMIT];
   const uint32_t seed; // random seed used in hashing
+  // If true, inserts return HASH_NOT_FOUND when the table is full instead of
+  // exiting, so the caller can grow the table (see db_graph_grow())
+  bool growable;
 } HashTable;
 
+// SIMD bucket probes are available on x86-64 for k <= 63
+#if defined(__x86_64__) && defined(__GNUC__) && NUM_BKMER_WORDS <= 2
+  #define HT_PROBE_SIMD 1
+#else
+  #define HT_PROBE_SIMD 0
+#endif
+
+// How to compare a kmer against the entries in a bucket
+typedef enum { HT_PROBE_BEST, HT_PROBE_SCALAR,
+               HT_PROBE_SSE42, HT_PROBE_AVX2 } HashTableProbe;
+
+// Pick the bucket probe used by all hash tables. HT_PROBE_BEST picks the
+// fastest the CPU supports, which is the default. Falls back to scalar if the
+// CPU does not support the requested probe. Returns the probe now in use.
+// Not threadsafe: call before any threads start using hash tables
+HashTableProbe hash_table_set_probe(HashTableProbe probe);
+HashTableProbe hash_table_get_probe();
+// Check if we can use a given probe on this machine
+bool hash_table_probe_supported(HashTableProbe probe);
+const char* hash_table_probe_str(HashTableProbe probe);
+
+// Bucket layout: split uses separate arrays for kmers and bucket metadata,
+// tags puts bucket metadata and 8 bit kmer tags in a cache line per bucket.
+typedef enum { HT_LAYOUT_SPLIT, HT_LAYOUT_TAGS } HashTableLayout;
+
+// Pick the layout of hash tables allocated from now on [default: split].
+// Tagged tables cannot be saved as graph images. The bucket probe setting is
+// not used by tagged tables.
+// Not threadsafe: call before any threads start using hash tables
+void hash_table_set_layout(HashTableLayout layout);
+HashTableLayout hash_table_get_layout();
+const char* hash_table_layout_str(HashTableLayout layout);
+
 // Returns NULL if not enough memory
 void hash_table_alloc(HashTable *htable, uint64_t capacity);
 void hash_table_dealloc(HashTable *ht);
 
+// Set up a hash table around existing table and bucket arrays, e.g. mmap'd
+// from a graph image. Do not call hash_table_dealloc() on it.
+// `collisions` must be of length REHASH_LIMIT
+void hash_table_wrap(HashTable *ht, BinaryKmer *table, uint8_t (*buckets)[2],
+                     uint64_t num_of_buckets, uint8_t bucket_size,
+                     uint32_t seed, uint64_t num_kmers,
+                     const uint64_t *collisions);
+
 #define hash_table_size(ht) (ht)->capacity
 #define hash_table_nkmers(ht) (ht)->num_kmers
 #define hash_table_assigned(ht,key) HASH_ENTRY_ASSIGNED((ht)->table[key])
@@ -47,9 +115,13 @@ static inline BinaryKmer hash_table_fetch(const HashTable *const ht, hkey_t key)
 
 #define hash_table_nbuckets(ht) ((ht)->num_of_buckets)
 #define hash_table_bucket_size(ht) ((ht)->bucket_size)
-#define hash_table_bsize(ht,bkt) ((ht)->buckets[bkt][HT_BSIZE])
-#define hash_table_bitems(ht,bkt) ((ht)->buckets[bkt][HT_BITEMS])
+#define hash_table_bmeta(ht,bkt) \
+  ((ht)->blocks != NULL ? (ht)->blocks[bkt].meta : (ht)->buckets[bkt])
+#define hash_table_bsize(ht,bkt) (hash_table_bmeta(ht,bkt)[HT_BSIZE])
+#define hash_table_bitems(ht,bkt) (hash_table_bmeta(ht,bkt)[HT_BITEMS])
 
+// Insert functions exit with an error if the table is full, unless
+// ht->growable is set, in which case they return HASH_NOT_FOUND
 hkey_t hash_table_find(const HashTable *const htable, const BinaryKmer bkmer);
 hkey_t hash_table_insert(HashTable *const htable, const BinaryKmer bkmer);
 hkey_t hash_table_find_or_insert(HashTable *htable, const BinaryKmer bkmer,
@@ -63,12 +135,58 @@ hkey_t hash_table_find_mt(HashTable *ht, const BinaryKmer key,
 hkey_t hash_table_find_or_insert_mt(HashTable *htable, const BinaryKmer key,
                                     bool *found, volatile uint8_t *bktlocks);
 
+// Lock-free threadsafe find, safe to call whilst other threads are calling
+// hash_table_find_or_insert_cas()
+hkey_t hash_table_find_cas(const HashTable *ht, const BinaryKmer key);
+
+// Lock-free threadsafe find or insert. Slots are claimed by compare-and-swap
+// on the first word of the kmer rather than by taking a bucket lock.
+// Do not mix with hash_table_find_mt() / hash_table_find_or_insert_mt() calls
+// on the same table at the same time.
+hkey_t hash_table_find_or_insert_cas(HashTable *ht, const BinaryKmer key,
+                                     bool *found);
+
+// Batched lookups: hash all keys and prefetch their buckets before searching
+// them, so memory latency is overlapped. Results are written to hkeys[0..n-1]
+// (and found[0..n-1]) in the same order as keys. Same thread safety as the
+// single key versions above.
+// `prehash` may be NULL, otherwise it holds rolling hashes of the keys
+// (only if BINARY_KMER_ROLL_HASH, see binary_kmer_roll_hash_key())
+#define HASH_BATCH_SIZE 16
+
+void hash_table_find_batch(const HashTable *ht, const BinaryKmer *keys,
+                           const uint64_t *prehash, size_t n, hkey_t *hkeys);
+
+void hash_table_find_batch_cas(const HashTable *ht, const BinaryKmer *keys,
+                               const uint64_t *prehash, size_t n, hkey_t *hkeys);
+
+// Insert versions stop at the first key that does not fit (only if
+// ht->growable) and return its index: keys after it are neither inserted nor
+// looked up. Otherwise they return n.
+size_t hash_table_find_or_insert_batch_mt(HashTable *ht, const BinaryKmer *keys,
+                                          const uint64_t *prehash, size_t n,
+                                          hkey_t *hkeys, bool *found,
+                                          volatile uint8_t *bktlocks);
+
+size_t hash_table_find_or_insert_batch_cas(HashTable *ht,
+                                           const BinaryKmer *keys,
+                                           const uint64_t *prehash, size_t n,
+                                           hkey_t *hkeys, bool *found);
+
 // Safe to call on different entries at the same time
 // NOT safe to do find() whilst doing delete()
 void hash_table_delete(HashTable *const htable, hkey_t pos);
 
-// Delete all entries from a hash table
-void hash_table_empty(HashTable *const htable);
+// Delete all entries from a hash table, using nthreads
+void hash_table_empty(HashTable *const htable, size_t nthreads);
+
+// Call func(start,end,arg) on ranges of entries [start,end) that may have been
+// used since the table was last emptied, using nthreads. Ranges are multiples
+// of 64 entries. Used to clear arrays indexed by hkey_t.
+void hash_table_dirty_iterate(const HashTable *ht, size_t nthreads,
+                              void (*func)(hkey_t _start, hkey_t _end,
+                                           void *_arg),
+                              void *arg);
 
 void hash_table_print_stats(const HashTable *const htable);
 void hash_table_print_stats_brief(const HashTable *const htable);
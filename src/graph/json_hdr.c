@@ -304,6 +304,14 @@ void json_hdr_fprint(cJSON *jsonhdr, FILE *fout)
   free(jstr);
 }
 
+void json_hdr_sprint(cJSON *jsonhdr, StrBuf *sbuf)
+{
+  char *jstr = cJSON_Print(jsonhdr);
+  strbuf_append_str(sbuf, jstr);
+  strbuf_append_str(sbuf, "\n\n");
+  free(jstr);
+}
+
 cJSON* json_hdr_try(cJSON *jsonhdr, const char *field, int type, const char *path)
 {
   cJSON *obj = cJSON_GetObjectItem(jsonhdr, field);
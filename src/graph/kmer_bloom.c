@@ -0,0 +1,96 @@
+#include "global.h"
+#include "kmer_bloom.h"
+#include "util.h"
+
+// Largest power of two <= x (x > 0)
+static inline uint64_t _rounddown2pow(uint64_t x)
+{
+  uint64_t p = 1;
+  while(p <= x / 2) p *= 2;
+  return p;
+}
+
+void kmer_bloom_alloc(KmerBloom *bloom, size_t mem, size_t min_count)
+{
+  ctx_assert(min_count > 1 && min_count <= KMER_BLOOM_MAX_COUNT);
+  ctx_assert(mem >= 16);
+
+  // Half of memory for each level
+  uint64_t seen_bits = _rounddown2pow(mem / 2 * 8);
+  uint64_t ncounts = _rounddown2pow(mem / 2 * 2);
+  size_t seen_words = roundup_bits2words64(seen_bits);
+  size_t count_bytes = ncounts / 2;
+
+  uint64_t *seen = ctx_calloc(seen_words, sizeof(uint64_t));
+  uint8_t *counts = ctx_calloc(count_bytes, sizeof(uint8_t));
+
+  KmerBloom tmp = {.seen = seen, .counts = counts,
+                   .seen_mask = seen_bits-1, .counts_mask = ncounts-1,
+                   .min_count = min_count,
+                   .mem_bytes = seen_words*sizeof(uint64_t) + count_bytes};
+
+  memcpy(bloom, &tmp, sizeof(KmerBloom));
+
+  char mem_str[50];
+  bytes_to_str(bloom->mem_bytes, 1, mem_str);
+  status("[bloom] Using %s to only add kmers seen %zu times",
+         mem_str, min_count);
+}
+
+void kmer_bloom_dealloc(KmerBloom *bloom)
+{
+  ctx_free(bloom->seen);
+  ctx_free(bloom->counts);
+  memset(bloom, 0, sizeof(KmerBloom));
+}
+
+#define _count_get(counts,i) (((counts)[(i)/2] >> (((i)&1)*4)) & 0xf)
+
+// Increment a 4 bit counter unless it is saturated
+static inline void _count_incr_mt(uint8_t *counts, uint64_t i)
+{
+  volatile uint8_t *ptr = (volatile uint8_t*)&counts[i/2];
+  size_t shift = (i&1)*4;
+  uint8_t v, incr = (uint8_t)(1U << shift);
+  do {
+    v = *ptr;
+    if(((v >> shift) & 0xf) == 0xf) return;
+  } while(!__sync_bool_compare_and_swap(ptr, v, (uint8_t)(v + incr)));
+}
+
+size_t kmer_bloom_add_mt(KmerBloom *bloom, BinaryKmer bkey)
+{
+  // Double hashing: two 32 bit hashes give KMER_BLOOM_NHASH positions.
+  // Low bits of h1 and h2 come from different hashes, since only low bits are
+  // used in small filters.
+  uint64_t a = binary_kmer_hash(bkey, 0), b = binary_kmer_hash(bkey, 1);
+  uint64_t h1 = (a << 32) | b, h2 = ((b << 32) | a) | 1;
+  uint64_t hash[KMER_BLOOM_NHASH];
+  size_t i, c, mincount = 0xf;
+  bool seen = true;
+
+  for(i = 0; i < KMER_BLOOM_NHASH; i++) {
+    hash[i] = h1 + i*h2;
+    seen &= bitset_get(bloom->seen, hash[i] & bloom->seen_mask);
+  }
+
+  if(!seen) {
+    for(i = 0; i < KMER_BLOOM_NHASH; i++)
+      (void)bitset_set_mt(bloom->seen, hash[i] & bloom->seen_mask);
+    return 0;
+  }
+
+  // Seen before: find the count then only increment the smallest counters
+  // (conservative update), which reduces over-counting
+  for(i = 0; i < KMER_BLOOM_NHASH; i++) {
+    c = _count_get(bloom->counts, hash[i] & bloom->counts_mask);
+    mincount = MIN2(mincount, c);
+  }
+
+  for(i = 0; i < KMER_BLOOM_NHASH; i++) {
+    if(_count_get(bloom->counts, hash[i] & bloom->counts_mask) == mincount)
+      _count_incr_mt(bloom->counts, hash[i] & bloom->counts_mask);
+  }
+
+  return 1 + mincount;
+}
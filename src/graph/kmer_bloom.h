@@ -0,0 +1,39 @@
+#ifndef KMER_BLOOM_H_
+#define KMER_BLOOM_H_
+
+#include "binary_kmer.h"
+
+//
+// Two-level counting Bloom filter of kmers, used to skip kmers seen fewer
+// than `min_count` times when building a graph (most are sequencing errors).
+//
+// Level one is a plain Bloom filter (1 bit per entry) recording kmers seen at
+// least once. Kmers seen again are counted in level two, a counting Bloom
+// filter of 4 bit saturating counters. Since most erroneous kmers are only
+// seen once they never reach level two, so it can be smaller.
+//
+// Counts may be over estimates (false positives) but are never under
+// estimates, except when two threads add the same new kmer at the same time.
+//
+
+#define KMER_BLOOM_NHASH 3
+#define KMER_BLOOM_MAX_COUNT 16 /* 1 + max 4 bit counter */
+
+typedef struct
+{
+  uint64_t *const seen; // level one bits
+  uint8_t *const counts; // level two, two counters per byte
+  const uint64_t seen_mask, counts_mask;
+  const size_t min_count, mem_bytes;
+} KmerBloom;
+
+// `mem` is split between the two levels, each gets a power of two entries
+void kmer_bloom_alloc(KmerBloom *bloom, size_t mem, size_t min_count);
+void kmer_bloom_dealloc(KmerBloom *bloom);
+
+// Record that we have seen `bkey` (must be a kmer key).
+// Thread safe. Returns how many times bkey was seen before this call
+// (at most KMER_BLOOM_MAX_COUNT-1)
+size_t kmer_bloom_add_mt(KmerBloom *bloom, BinaryKmer bkey);
+
+#endif /* KMER_BLOOM_H_ */
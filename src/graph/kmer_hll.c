@@ -0,0 +1,69 @@
+#include "global.h"
+#include "kmer_hll.h"
+
+#include <math.h>
+
+void kmer_hll_alloc(KmerHLL *hll, size_t bits)
+{
+  ctx_assert(bits >= 4 && bits <= 24);
+  size_t nregs = 1UL << bits;
+  uint8_t *regs = ctx_calloc(nregs, sizeof(uint8_t));
+  KmerHLL tmp = {.regs = regs, .bits = bits, .nregs = nregs};
+  memcpy(hll, &tmp, sizeof(KmerHLL));
+}
+
+void kmer_hll_dealloc(KmerHLL *hll)
+{
+  ctx_free(hll->regs);
+  memset(hll, 0, sizeof(KmerHLL));
+}
+
+void kmer_hll_reset(KmerHLL *hll)
+{
+  memset(hll->regs, 0, hll->nregs);
+}
+
+void kmer_hll_add(KmerHLL *hll, BinaryKmer bkey)
+{
+  // Two 32 bit hashes give a 64 bit hash: top bits pick a register, the
+  // position of the first set bit in the rest is the rank
+  uint64_t a = binary_kmer_hash(bkey, 0), b = binary_kmer_hash(bkey, 1);
+  uint64_t h = (a << 32) | b, w = h << hll->bits;
+  size_t idx = h >> (64 - hll->bits);
+  uint8_t rank = w ? (uint8_t)(__builtin_clzll(w) + 1) : (uint8_t)(65 - hll->bits);
+  if(rank > hll->regs[idx]) hll->regs[idx] = rank;
+}
+
+void kmer_hll_merge(KmerHLL *dst, const KmerHLL *src)
+{
+  ctx_assert(dst->nregs == src->nregs);
+  size_t i;
+  for(i = 0; i < dst->nregs; i++)
+    dst->regs[i] = MAX2(dst->regs[i], src->regs[i]);
+}
+
+void kmer_hll_copy(KmerHLL *dst, const KmerHLL *src)
+{
+  ctx_assert(dst->nregs == src->nregs);
+  memcpy(dst->regs, src->regs, dst->nregs);
+}
+
+uint64_t kmer_hll_estimate(const KmerHLL *hll)
+{
+  const double m = hll->nregs, alpha = 0.7213 / (1.0 + 1.079 / m);
+  double sum = 0, est;
+  size_t i, nzeros = 0;
+
+  for(i = 0; i < hll->nregs; i++) {
+    sum += ldexp(1.0, -(int)hll->regs[i]);
+    nzeros += (hll->regs[i] == 0);
+  }
+
+  est = alpha * m * m / sum;
+
+  // Small sets: use linear counting on empty registers
+  if(est <= 2.5 * m && nzeros > 0)
+    est = m * log(m / nzeros);
+
+  return (uint64_t)(est + 0.5);
+}
@@ -0,0 +1,35 @@
+#ifndef KMER_HLL_H_
+#define KMER_HLL_H_
+
+#include "binary_kmer.h"
+
+//
+// HyperLogLog sketch for estimating the number of distinct kmers in a set of
+// reads using a few KB of memory. Sketches of different inputs can be merged
+// to estimate the size of their union. Standard error is about 1.04/sqrt(m)
+// for m registers (0.8% with the default 2^14).
+//
+
+#define KMER_HLL_BITS 14
+
+typedef struct
+{
+  uint8_t *const regs; // one register per bucket: max rank seen
+  const size_t bits, nregs; // nregs = 2^bits
+} KmerHLL;
+
+void kmer_hll_alloc(KmerHLL *hll, size_t bits);
+void kmer_hll_dealloc(KmerHLL *hll);
+void kmer_hll_reset(KmerHLL *hll);
+
+// `bkey` must be a kmer key. Not thread safe
+void kmer_hll_add(KmerHLL *hll, BinaryKmer bkey);
+
+// Add the kmers in `src` to `dst`. Sketches must be the same size
+void kmer_hll_merge(KmerHLL *dst, const KmerHLL *src);
+void kmer_hll_copy(KmerHLL *dst, const KmerHLL *src);
+
+// Estimate number of distinct kmers added
+uint64_t kmer_hll_estimate(const KmerHLL *hll);
+
+#endif /* KMER_HLL_H_ */
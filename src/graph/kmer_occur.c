@@ -41,9 +41,9 @@ void koruns_print(const KOccurRun *runs, size_t n, size_t kmer_size, FILE *fout)
   }
 }
 
-void korun_gzprint(gzFile gzout, size_t kmer_size,
-                   const KOGraph *kograph, KOccurRun korun,
-                   size_t first_kmer_idx, size_t kmer_offset)
+void korun_sprint(StrBuf *sbuf, size_t kmer_size,
+                  const KOGraph *kograph, KOccurRun korun,
+                  size_t first_kmer_idx, size_t kmer_offset)
 {
   const char strand[] = {'+','-'};
   const char *chrom = kograph_chrom(kograph,korun).name;
@@ -60,20 +60,20 @@ void korun_gzprint(gzFile gzout, size_t kmer_size,
   }
   qoffset = korun.qoffset - first_kmer_idx;
   // +1 to coords to convert to 1-based
-  gzprintf(gzout, "%s:%zu-%zu:%c:%u",
-           chrom, start+1, end+1, strand[korun.strand], qoffset+1);
+  strbuf_sprintf(sbuf, "%s:%zu-%zu:%c:%zu",
+                 chrom, start+1, end+1, strand[korun.strand], qoffset+1);
 }
 
-void koruns_gzprint(gzFile gzout, size_t kmer_size, const KOGraph *kograph,
-                    const KOccurRun *koruns, size_t n,
-                    size_t first_kmer_idx, size_t kmer_offset)
+void koruns_sprint(StrBuf *sbuf, size_t kmer_size, const KOGraph *kograph,
+                   const KOccurRun *koruns, size_t n,
+                   size_t first_kmer_idx, size_t kmer_offset)
 {
   size_t i;
   if(n == 0) return;
-  korun_gzprint(gzout, kmer_size, kograph, koruns[0], first_kmer_idx, kmer_offset);
+  korun_sprint(sbuf, kmer_size, kograph, koruns[0], first_kmer_idx, kmer_offset);
   for(i = 1; i < n; i++) {
-    gzputc(gzout, ',');
-    korun_gzprint(gzout, kmer_size, kograph, koruns[i], first_kmer_idx, kmer_offset);
+    strbuf_append_char(sbuf, ',');
+    korun_sprint(sbuf, kmer_size, kograph, koruns[i], first_kmer_idx, kmer_offset);
   }
 }
 
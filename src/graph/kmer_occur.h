@@ -100,13 +100,14 @@ void korun_print(KOccurRun run, size_t kmer_size, FILE *fout);
 // Mostly used for debugging
 void koruns_print(const KOccurRun *run, size_t n, size_t kmer_size, FILE *fout);
 
-void korun_gzprint(gzFile gzout, size_t kmer_size,
-                   const KOGraph *kograph, KOccurRun korun,
-                   size_t first_kmer_idx, size_t kmer_offset);
+// Append to a string buffer
+void korun_sprint(StrBuf *sbuf, size_t kmer_size,
+                  const KOGraph *kograph, KOccurRun korun,
+                  size_t first_kmer_idx, size_t kmer_offset);
 
-void koruns_gzprint(gzFile gzout, size_t kmer_size, const KOGraph *kograph,
-                    const KOccurRun *koruns, size_t n,
-                    size_t first_kmer_idx, size_t kmer_offset);
+void koruns_sprint(StrBuf *sbuf, size_t kmer_size, const KOGraph *kograph,
+                   const KOccurRun *koruns, size_t n,
+                   size_t first_kmer_idx, size_t kmer_offset);
 
 // src, dst can point to the same place
 // returns number of elements added
@@ -15,7 +15,7 @@ void prune_node_without_edges_mt(dBGraph *db_graph, hkey_t hkey)
   if(db_graph->col_edges != NULL)
     db_node_zero_edges(db_graph,hkey);
 
-  if(db_graph->col_covgs != NULL)
+  if(db_graph_has_covgs(db_graph))
     db_node_zero_covgs(db_graph, hkey);
 
   if(db_graph->node_in_cols != NULL)
@@ -202,6 +202,7 @@ size_t gpath_fetch(dBNode node, const GPath *gpath,
 {
   ctx_assert(node.orient == gpath->orient);
 
+  const uint8_t *seq = gpath_get_seq(&db_graph->gpstore.gpset, gpath);
   size_t init_num_nodes = nbuf->len;
   size_t i, n, njuncs = 0; // number of junctions seen
   dBNode nodes[4];
@@ -216,7 +217,7 @@ size_t gpath_fetch(dBNode node, const GPath *gpath,
     ctx_assert(n > 0);
 
     if(n > 1) {
-      Nucleotide expbase = binary_seq_get(gpath->seq, njuncs);
+      Nucleotide expbase = binary_seq_get(seq, njuncs);
       for(i = 0; i < n && nucs[i] != expbase; i++);
       ctx_assert(i < n);
       node = nodes[i];
@@ -246,6 +247,7 @@ bool gpath_checks_path_col(dBNode node, const GPath *gpath,
   ctx_assert_ret(db_graph->num_edge_cols == db_graph->num_of_cols ||
                  db_graph->node_in_cols != NULL);
 
+  const uint8_t *seq = gpath_get_seq(&db_graph->gpstore.gpset, gpath);
   BinaryKmer bkmer;
   Edges edges;
   dBNode nodes[4];
@@ -264,7 +266,7 @@ bool gpath_checks_path_col(dBNode node, const GPath *gpath,
     // Check this node is in this colour
     if(db_graph->node_in_cols != NULL) {
       ctx_assert_ret(db_node_has_col(db_graph, node.key, ctxcol));
-    } else if(db_graph->col_covgs != NULL) {
+    } else if(db_graph_has_covgs(db_graph)) {
       ctx_assert_ret(db_node_get_covg(db_graph, node.key, ctxcol) > 0);
     }
 
@@ -308,7 +310,7 @@ bool gpath_checks_path_col(dBNode node, const GPath *gpath,
 
     // If fork check nucleotide
     if(n > 1) {
-      Nucleotide expbase = binary_seq_get(gpath->seq, plen);
+      Nucleotide expbase = binary_seq_get(seq, plen);
 
       for(i = 0; i < n && nucs[i] != expbase; i++);
       if(i == n) {
@@ -341,7 +343,7 @@ bool gpath_checks_path(hkey_t hkey, const GPath *gpath, const dBGraph *db_graph)
   dBNode node = {.key = hkey, .orient = gpath->orient};
 
   // Check at least one colour is set
-  uint8_t *colset = gpath_get_colset(gpath, ncols), cumm = 0;
+  uint8_t *colset = gpath_get_colset(&gpstore->gpset, gpath), cumm = 0;
   for(i = 0; i < ncols; i++) cumm |= colset[i];
   ctx_assert(cumm != 0);
 
@@ -362,7 +364,8 @@ static int _kmer_check_paths(hkey_t hkey, const dBGraph *db_graph,
   size_t num_gpaths = 0;
   GPath *gpath;
 
-  for(gpath = gpstore->paths_all[hkey]; gpath != NULL; gpath = gpath->next)
+  for(gpath = gpath_store_fetch(gpstore, hkey); gpath != NULL;
+      gpath = gpath_store_next(gpstore, gpath))
   {
     ctx_assert_ret(gpath_checks_path(hkey, gpath, db_graph));
     num_gpaths++;
@@ -431,7 +434,8 @@ static void _gpstore_update_counts(hkey_t hkey, const dBGraph *db_graph,
   (*nkmers_ptr)++;
 
   // Count paths and coloured paths
-  for(npaths = 0; gpath != NULL; gpath = gpath->next, npaths++) {}
+  for(npaths = 0; gpath != NULL; gpath = gpath_store_next(gpstore, gpath))
+    npaths++;
 
   (*npaths_ptr) += npaths;
 }
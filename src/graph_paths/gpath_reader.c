@@ -13,11 +13,26 @@
 #include "gpath_subset.h"
 #include "json_hdr.h"
 
+#include "msg-pool/msgpool.h"
+#include <pthread.h>
+
 /*
 // File format:
 <JSON_HEADER>
 kmer [num] .. ignored
 [FR] [njuncs] [nseen,nseen,nseen] [seq:ACAGT] .. ignored
+
+// Binary file format (format_version 5):
+<JSON_HEADER>
+<bkmer:BKMER_BYTES> <num:varint>
+<njuncs<<1|orient:varint> <nseen:varint>*ncols <juncs:(njuncs+3)/4 bytes>
+..
+
+<bkmer> is the kmer key as written in memory: NUM_BKMER_WORDS 64 bit words in
+host byte order, so files are only portable between machines of the same
+endianness. Varints are little endian base 128 (7 bits per byte, top bit set if
+more bytes follow). Junctions are 2 bit packed as in GPath.seq, with unused bits
+zero.
 */
 
 #define load_check(x,msg,...) if(!(x)) { die("[LoadPathError] "msg, ##__VA_ARGS__); }
@@ -186,6 +201,13 @@ void gpath_reader_open2(GPathReader *file, const char *path, const char *mode,
     die("File format is not 'ctp': %s [%s]", hdr->valuestring, path);
   hdr = json_hdr_get(file->json, "format_version", cJSON_Number, file->fltr.path.b);
   file->version = hdr->valueint;
+  if(file->version < 1 || file->version > CTP_BINARY_FORMAT_VERSION)
+    die("Unsupported ctp format version %i [%s]", file->version, path);
+
+  // Binary records start after the blank line that ends the header
+  if(gpath_reader_is_binary(file) &&
+     gzgetc_buf(file->gz, &file->strmbuf) != '\n')
+    die("Expected blank line after header [%s]", path);
 
   // Load per sample info from header
   _parse_json_header(file);
@@ -245,6 +267,101 @@ void gpath_reader_check(const GPathReader *file, size_t db_kmer_size,
   }
 }
 
+// Apply colour filter to counts of a link (one per colour in the file)
+static void _link_counts_filter(SizeBuffer *counts, const FileFilter *fltr)
+{
+  size_t i, fromcol, intocol;
+  // Use filter - append zeros first
+  size_t offset = counts->len, num_into = file_filter_into_ncols(fltr);
+  size_buf_push_zero(counts, num_into);
+  for(i = 0; i < file_filter_num(fltr); i++) {
+    fromcol = file_filter_fromcol(fltr, i);
+    intocol = file_filter_intocol(fltr, i);
+    counts->b[offset+intocol] += counts->b[fromcol];
+  }
+  memmove(counts->b, counts->b+offset, num_into*sizeof(counts->b[0]));
+  counts->len = num_into;
+}
+
+//
+// Binary files
+//
+
+static inline void _bin_read(GPathReader *file, void *ptr, size_t len)
+{
+  if(gzread_buf(file->gz, ptr, len, &file->strmbuf) != len) {
+    futil_gzcheck(0, file->gz, file_filter_path(&file->fltr));
+    die("Truncated link file [%s]", file_filter_path(&file->fltr));
+  }
+}
+
+static inline size_t _bin_read_varint(GPathReader *file)
+{
+  size_t v = 0, shift;
+  uint8_t b;
+  for(shift = 0; shift < 64; shift += 7) {
+    _bin_read(file, &b, 1);
+    v |= (size_t)(b & 0x7f) << shift;
+    if(!(b & 0x80)) return v;
+  }
+  die("Bad varint in link file [%s]", file_filter_path(&file->fltr));
+}
+
+// Returns false at the end of the file
+static bool _bin_read_kmer(GPathReader *file, BinaryKmer *bkey,
+                           size_t *num_links)
+{
+  const char *path = file_filter_path(&file->fltr);
+  size_t n;
+
+  if(file->links_left) {
+    die("Number of links mismatches: %zu missing [%s]", file->links_left, path);
+  }
+
+  n = gzread_buf(file->gz, bkey->b, BKMER_BYTES, &file->strmbuf);
+  futil_gzcheck(0, file->gz, path);
+  if(n == 0) return false;
+  if(n != BKMER_BYTES) die("Truncated link file [%s]", path);
+
+  *num_links = file->links_left = _bin_read_varint(file);
+  return true;
+}
+
+// Read one link: orientation, junctions packed into @seqbuf and counts per
+// colour with the colour filter applied
+// Returns false at the end of the links for the current kmer
+static bool _bin_read_link(GPathReader *file, bool *fw, size_t *njuncs,
+                           SizeBuffer *counts, ByteBuffer *seqbuf)
+{
+  const FileFilter *fltr = &file->fltr;
+  size_t i, v, nbytes;
+
+  if(file->links_left == 0) return false;
+  file->links_left--;
+
+  v = _bin_read_varint(file);
+  *fw = !(v & 1);
+  *njuncs = v >> 1;
+
+  if(*njuncs > GPATH_MAX_JUNCS) {
+    die("Too many junctions =%zu > %zu [%s]",
+        *njuncs, (size_t)GPATH_MAX_JUNCS, file_filter_path(fltr));
+  }
+
+  size_buf_reset(counts);
+  size_buf_capacity(counts, fltr->srcncols);
+  for(i = 0; i < fltr->srcncols; i++) counts->b[i] = _bin_read_varint(file);
+  counts->len = fltr->srcncols;
+  _link_counts_filter(counts, fltr);
+
+  nbytes = binary_seq_mem(*njuncs);
+  byte_buf_capacity(seqbuf, nbytes);
+  _bin_read(file, seqbuf->b, nbytes);
+  if(*njuncs & 3) seqbuf->b[nbytes-1] &= (1 << ((*njuncs & 3) * 2)) - 1;
+
+  return true;
+}
+
 // Reads line <kmer> <num_links>
 // Calls die() on error
 // Returns true unless end of file
@@ -257,6 +374,16 @@ bool gpath_reader_read_kmer(GPathReader *file, StrBuf *kmer, size_t *num_links)
   int c;
   char *space;
 
+  if(gpath_reader_is_binary(file)) {
+    BinaryKmer bkey;
+    size_t kmer_size = gpath_reader_get_kmer_size(file);
+    if(!_bin_read_kmer(file, &bkey, num_links)) return false;
+    strbuf_ensure_capacity(kmer, kmer_size);
+    binary_kmer_to_str(bkey, kmer_size, kmer->b);
+    kmer->end = kmer_size;
+    return true;
+  }
+
   while((c = gzgetc_buf(file->gz, &file->strmbuf)) != -1)
   {
     if(c == '#') gzskipline_buf(file->gz, &file->strmbuf);
@@ -294,7 +421,7 @@ void link_line_parse(const StrBuf *line, int version, const FileFilter *fltr,
                      StrBuf *seq, SizeBuffer *juncpos)
 {
   const char *path = file_filter_path(fltr);
-  size_t i, fromcol, intocol;
+  size_t i;
   char *end = NULL;
 
   // First first 5 required columns
@@ -340,17 +467,7 @@ void link_line_parse(const StrBuf *line, int version, const FileFilter *fltr,
   else if(counts->len != fltr->srcncols)
     bad_link_line(path,line);
 
-  // Use filter - append zeros first
-  // size_buf_reset(counts);
-  size_t offset = counts->len, num_into = file_filter_into_ncols(fltr);
-  size_buf_push_zero(counts, num_into);
-  for(i = 0; i < file_filter_num(fltr); i++) {
-    fromcol = file_filter_fromcol(fltr, i);
-    intocol = file_filter_intocol(fltr, i);
-    counts->b[offset+intocol] += counts->b[fromcol];
-  }
-  memmove(counts->b, counts->b+offset, num_into*sizeof(counts->b[0]));
-  counts->len = num_into;
+  _link_counts_filter(counts, fltr);
 
   // 4:[juncs:ACAGA]
   strbuf_reset(juncs);
@@ -424,6 +541,22 @@ bool gpath_reader_read_link(GPathReader *file,
   StrBuf *line = &file->line;
   strbuf_reset(line);
 
+  if(gpath_reader_is_binary(file)) {
+    ByteBuffer seqbuf;
+    bool found;
+    if(seq) strbuf_reset(seq);
+    if(juncpos) size_buf_reset(juncpos);
+    byte_buf_alloc(&seqbuf, 64);
+    found = _bin_read_link(file, fw, njuncs, countbuf, &seqbuf);
+    if(found) {
+      strbuf_ensure_capacity(juncs, *njuncs);
+      binary_seq_to_str(seqbuf.b, *njuncs, juncs->b);
+      juncs->end = *njuncs;
+    }
+    byte_buf_dealloc(&seqbuf);
+    return found;
+  }
+
   while((c = gzgetc_buf(file->gz, &file->strmbuf)) != -1)
   {
     if(char_is_acgt(c)) {
@@ -457,7 +590,7 @@ static hkey_t find_link_kmer(BinaryKmer bkey, int flags,
 
   switch(flags) {
     case GPATH_ADD_MISSING_KMERS:
-      hkey = hash_table_find_or_insert(&db_graph->ht, bkey, &found);
+      hkey = db_graph_find_or_add_node_mt(db_graph, bkey, &found).key;
       break;
     case GPATH_DIE_MISSING_KMERS:
       hkey = hash_table_find(&db_graph->ht, bkey);
@@ -521,111 +654,396 @@ static size_t _load_paths_from_set(dBGraph *db_graph, GPathSet *gpset,
   return subset1->list.len;
 }
 
-/**
- * @param kmer_flags must be one of:
- *   * GPATH_ADD_MISSING_KMERS - add kmers to the graph before loading path
- *   * GPATH_DIE_MISSING_KMERS - die with error if cannot find kmer
- *   * GPATH_SKIP_MISSING_KMERS - skip paths where kmer is not in graph
- */
-void gpath_reader_load(GPathReader *file, int kmer_flags, dBGraph *db_graph)
+//
+// Loading
+//
+// A reader thread splits the file into chunks of whole kmer records and passes
+// them through a MsgPool to `nthreads` workers, which parse links and add them
+// to the graph. Workers take a striped lock on the kmer whilst merging its
+// links with those already loaded, in case a kmer appears more than once.
+//
+
+#define GPATH_LOAD_NLOCKS (1<<16)
+
+typedef struct
+{
+  GPathReader *const file;
+  const int kmer_flags;
+  dBGraph *const db_graph;
+  MsgPool *const pool;
+  uint8_t *const kmer_locks;
+  volatile bool warn_nlink_mismatch;
+} GPathLoader;
+
+typedef struct
+{
+  GPathLoader *ldr;
+  GPathSet gpset; // links for current kmer
+  GPathSubset subset0, subset1;
+  StrBuf line, juncs;
+  SizeBuffer counts;
+  ByteBuffer seqbuf;
+  size_t num_kmers_seen, num_links_seen, num_kmers_loaded, num_links_loaded;
+} GPathLoadWorker;
+
+// Decode varint at ptr[*pos], stopping at `len`
+// Returns false if the varint is incomplete
+static inline bool _mem_read_varint(const uint8_t *ptr, size_t len,
+                                    size_t *pos, size_t *val, const char *path)
+{
+  size_t v = 0, shift, i = *pos;
+  for(shift = 0; shift < 64 && i < len; shift += 7, i++) {
+    v |= (size_t)(ptr[i] & 0x7f) << shift;
+    if(!(ptr[i] & 0x80)) { *pos = i+1; *val = v; return true; }
+  }
+  if(shift >= 64) die("Bad varint in link file [%s]", path);
+  return false;
+}
+
+// Length of the binary kmer record at the start of `ptr`, or 0 if the record
+// is not complete
+static size_t _bin_record_len(const uint8_t *ptr, size_t len, size_t ncols,
+                              const char *path)
+{
+  size_t i, j, v, njuncs, nlinks, pos = BKMER_BYTES;
+  if(len < pos || !_mem_read_varint(ptr, len, &pos, &nlinks, path)) return 0;
+  for(i = 0; i < nlinks; i++) {
+    if(!_mem_read_varint(ptr, len, &pos, &njuncs, path)) return 0;
+    if((njuncs >>= 1) > GPATH_MAX_JUNCS) die("Too many junctions [%s]", path);
+    for(j = 0; j < ncols; j++)
+      if(!_mem_read_varint(ptr, len, &pos, &v, path)) return 0;
+    if(pos + binary_seq_mem(njuncs) > len) return 0;
+    pos += binary_seq_mem(njuncs);
+  }
+  return pos;
+}
+
+// Length of buffer made up of complete kmer records
+static size_t _load_chunk_len(const GPathReader *file,
+                              const char *buf, size_t len)
 {
   const char *path = file_filter_path(&file->fltr);
+  size_t pos = 0, reclen;
 
-  file_filter_status(&file->fltr, false);
+  if(gpath_reader_is_binary(file)) {
+    while((reclen = _bin_record_len((const uint8_t*)buf+pos, len-pos,
+                                    file->fltr.srcncols, path)) > 0) {
+      pos += reclen;
+    }
+    return pos;
+  }
 
-  size_t into_ncols = file_filter_into_ncols(&file->fltr);
+  // Text: records end before the last line starting with a base
+  for(pos = len; pos > 1; pos--)
+    if(buf[pos-2] == '\n' && char_is_acgt(buf[pos-1])) return pos-1;
+  return 0;
+}
 
-  // Load paths into this temporary set for each kmer
-  GPathSet gpset;
-  gpath_set_alloc(&gpset, db_graph->num_of_cols, ONE_MEGABYTE, true, true);
+static void* gpath_load_reader(void *arg)
+{
+  GPathLoader *ldr = (GPathLoader*)arg;
+  GPathReader *file = ldr->file;
+  const char *path = file_filter_path(&file->fltr);
+  StrBuf buf, *chunk;
+  size_t n, len;
+  bool eof = false;
+  int pos;
 
-  GPathSubset subset0, subset1;
-  gpath_subset_alloc(&subset0);
-  gpath_subset_alloc(&subset1);
+  strbuf_alloc(&buf, 2 * GPATH_LOAD_CHUNK);
 
-  size_t i, nlink, num_links_exp = 0;
-  size_t total_kmers_exp = gpath_reader_get_num_kmers(file);
-  size_t total_links_exp = gpath_reader_get_num_paths(file);
-  size_t num_kmers_seen = 0, num_links_seen = 0;
-  size_t num_kmers_loaded = 0, num_links_loaded = 0;
-  bool warn_nlink_mismatch = false;
+  while(!eof)
+  {
+    strbuf_ensure_capacity(&buf, buf.end + GPATH_LOAD_CHUNK);
+    n = gzread_buf(file->gz, buf.b+buf.end, GPATH_LOAD_CHUNK, &file->strmbuf);
+    futil_gzcheck(0, file->gz, path);
+    buf.end += n;
+    eof = (n < GPATH_LOAD_CHUNK);
+
+    // At the end of the file, the remainder is passed on and checked by workers
+    len = eof ? buf.end : _load_chunk_len(file, buf.b, buf.end);
+    if(len == 0) continue;
+
+    pos = msgpool_claim_write(ldr->pool);
+    memcpy(&chunk, msgpool_get_ptr(ldr->pool, pos), sizeof(StrBuf*));
+    strbuf_reset(chunk);
+    strbuf_append_strn(chunk, buf.b, len);
+    msgpool_release(ldr->pool, pos, MPOOL_FULL);
+
+    memmove(buf.b, buf.b+len, buf.end-len);
+    buf.end -= len;
+  }
 
-  StrBuf kmerstr;
-  strbuf_alloc(&kmerstr, 64);
-  bool fw = true;
-  size_t njuncs = 0;
-  StrBuf juncs;
-  SizeBuffer counts;
-  strbuf_alloc(&juncs, 256);
-  size_buf_alloc(&counts, 256);
+  msgpool_close(ldr->pool);
+  strbuf_dealloc(&buf);
+  return NULL;
+}
 
-  // Buffer is collapsed into here
-  ByteBuffer seqbuf;
-  byte_buf_alloc(&seqbuf, 64);
+// Add link to the set for the current kmer, if it is in any colours
+static void _load_add_link(GPathLoadWorker *wrkr, bool fw, size_t njuncs)
+{
+  GPathSet *gpset = &wrkr->gpset;
+  const size_t *counts = wrkr->counts.b, ncols = wrkr->counts.len;
+  size_t i, link_covg = 0;
+
+  // Check if link has coverage in any colours
+  for(i = 0; i < ncols; i++) link_covg |= counts[i];
+  if(!link_covg) return;
+
+  // Add to GPathSet
+  GPathNew newgpath = {.seq = wrkr->seqbuf.b,
+                       .colset = NULL, .nseen = NULL,
+                       .orient = fw ? FORWARD : REVERSE,
+                       .num_juncs = njuncs};
+
+  GPath *gpath = gpath_set_add_mt(gpset, newgpath);
+
+  // Update nseen and colset
+  // Our temporary gpset always stores nseen counts
+  uint8_t *nseen = gpath_set_get_nseen(gpset, gpath);
+  uint8_t *colset = gpath_get_colset(gpset, gpath);
+  for(i = 0; i < ncols; i++) {
+    nseen[i] = MIN2((size_t)UINT8_MAX, (size_t)nseen[i] + counts[i]);
+    bitset_or(colset, i, counts[i] > 0);
+  }
+}
 
-  for(num_kmers_seen = 0;
-      gpath_reader_read_kmer(file, &kmerstr, &num_links_exp);
-      num_kmers_seen++)
+// Add links of a kmer to the graph
+static void _load_kmer_links(GPathLoadWorker *wrkr, BinaryKmer bkey,
+                             size_t num_links_exp, size_t nlinks)
+{
+  GPathLoader *ldr = wrkr->ldr;
+  dBGraph *db_graph = ldr->db_graph;
+  const char *path = file_filter_path(&ldr->file->fltr);
+  size_t lock;
+  hkey_t hkey;
+
+  if(nlinks != num_links_exp && !ldr->warn_nlink_mismatch &&
+     __sync_bool_compare_and_swap(&ldr->warn_nlink_mismatch, false, true))
   {
-    gpath_set_reset(&gpset);
+    char bkstr[MAX_KMER_SIZE+1];
+    binary_kmer_to_str(bkey, db_graph->kmer_size, bkstr);
+    warn("Number of links mismatches: %s %zu != %zu [%s]",
+         bkstr, num_links_exp, nlinks, path);
+  }
 
-    for(nlink = 0;
-        gpath_reader_read_link(file, &fw, &njuncs,
-                               &counts, &juncs, NULL, NULL);
-        nlink++)
-    {
-      // Check if link has coverage in any colours
-      size_t link_covg = 0;
-      for(i = 0; i < into_ncols; i++) link_covg |= counts.b[i];
+  wrkr->num_kmers_seen++;
+  wrkr->num_links_seen += nlinks;
 
-      if(link_covg)
-      {
-        byte_buf_capacity(&seqbuf, binary_seq_mem(juncs.end));
-        binary_seq_from_str(juncs.b, juncs.end, seqbuf.b);
-
-        // Add to GPathSet
-        GPathNew newgpath = {.seq = seqbuf.b,
-                             .colset = NULL, .nseen = NULL,
-                             .orient = fw ? FORWARD : REVERSE,
-                             .num_juncs = juncs.end};
-
-        GPath *gpath = gpath_set_add_mt(&gpset, newgpath);
-
-        // Update nseen and colset
-        // Our temporary gpset always stores nseen counts
-        uint8_t *nseen = gpath_set_get_nseen(&gpset, gpath);
-        uint8_t *colset = gpath_get_colset(gpath, gpset.ncols);
-        for(i = 0; i < into_ncols; i++) {
-          nseen[i] = MIN2((size_t)UINT8_MAX, (size_t)nseen[i] + counts.b[i]);
-          bitset_or(colset, i, counts.b[i] > 0);
-        }
-      }
+  if(wrkr->gpset.entries.len > 0)
+  {
+    wrkr->num_kmers_loaded++;
+    hkey = find_link_kmer(bkey, ldr->kmer_flags, path, db_graph);
+
+    if(hkey != HASH_NOT_FOUND) {
+      lock = hkey & (GPATH_LOAD_NLOCKS-1);
+      bitlock_yield_acquire(ldr->kmer_locks, lock);
+      wrkr->num_links_loaded += _load_paths_from_set(db_graph, &wrkr->gpset,
+                                                     &wrkr->subset0,
+                                                     &wrkr->subset1, hkey);
+      bitlock_release(ldr->kmer_locks, lock);
     }
+  }
+
+  gpath_set_reset(&wrkr->gpset);
+}
 
-    if(nlink != num_links_exp && !warn_nlink_mismatch) {
-      warn("Number of links mismatches: %s %zu != %zu [%s]",
-           kmerstr.b, num_links_exp, nlink, path);
-      warn_nlink_mismatch = true;
+static void _load_bin_chunk(GPathLoadWorker *wrkr, const StrBuf *chunk)
+{
+  const FileFilter *fltr = &wrkr->ldr->file->fltr;
+  const char *path = file_filter_path(fltr);
+  const uint8_t *ptr = (const uint8_t*)chunk->b;
+  const size_t len = chunk->end;
+  size_t i, pos = 0, nlinks, v, njuncs, nbytes;
+  SizeBuffer *counts = &wrkr->counts;
+  BinaryKmer bkey;
+
+  while(pos < len)
+  {
+    if(_bin_record_len(ptr+pos, len-pos, fltr->srcncols, path) == 0)
+      die("Truncated link file [%s]", path);
+
+    memcpy(bkey.b, ptr+pos, BKMER_BYTES);
+    pos += BKMER_BYTES;
+    _mem_read_varint(ptr, len, &pos, &nlinks, path);
+
+    for(i = 0; i < nlinks; i++) {
+      _mem_read_varint(ptr, len, &pos, &v, path);
+      njuncs = v >> 1;
+
+      size_buf_reset(counts);
+      size_buf_capacity(counts, fltr->srcncols);
+      for(counts->len = 0; counts->len < fltr->srcncols; counts->len++)
+        _mem_read_varint(ptr, len, &pos, &counts->b[counts->len], path);
+      _link_counts_filter(counts, fltr);
+
+      nbytes = binary_seq_mem(njuncs);
+      byte_buf_capacity(&wrkr->seqbuf, nbytes);
+      memcpy(wrkr->seqbuf.b, ptr+pos, nbytes);
+      if(njuncs & 3) wrkr->seqbuf.b[nbytes-1] &= (1 << ((njuncs & 3) * 2)) - 1;
+      pos += nbytes;
+
+      _load_add_link(wrkr, !(v & 1), njuncs);
     }
 
-    num_links_seen += nlink;
-    num_kmers_loaded += (gpset.entries.len > 0);
+    _load_kmer_links(wrkr, bkey, nlinks, nlinks);
+  }
+}
 
-    if(gpset.entries.len > 0) {
-      BinaryKmer bkey = binary_kmer_from_str(kmerstr.b, db_graph->kmer_size);
-      hkey_t hkey = find_link_kmer(bkey, kmer_flags, path, db_graph);
+static void _load_text_chunk(GPathLoadWorker *wrkr, const StrBuf *chunk)
+{
+  const GPathReader *file = wrkr->ldr->file;
+  const char *path = file_filter_path(&file->fltr);
+  const size_t kmer_size = wrkr->ldr->db_graph->kmer_size;
+  const char *ptr = chunk->b, *end = chunk->b + chunk->end, *eol;
+  StrBuf *line = &wrkr->line, *juncs = &wrkr->juncs;
+  BinaryKmer bkey;
+  size_t num_links_exp = 0, nlinks = 0, njuncs;
+  bool in_kmer = false, fw;
+  char *space;
 
-      if(hkey != HASH_NOT_FOUND) {
-        num_links_loaded += _load_paths_from_set(db_graph, &gpset,
-                                                 &subset0, &subset1,
-                                                 hkey);
+  for(; ptr < end; ptr = eol+1)
+  {
+    if((eol = memchr(ptr, '\n', end-ptr)) == NULL) eol = end;
+    strbuf_reset(line);
+    strbuf_append_strn(line, ptr, eol-ptr);
+    strbuf_chomp(line);
+
+    if(line->end == 0 || line->b[0] == '#') continue;
+    else if(char_is_acgt(line->b[0]))
+    {
+      // <kmer> <num_links>
+      if(in_kmer) _load_kmer_links(wrkr, bkey, num_links_exp, nlinks);
+      if((space = strchr(line->b, ' ')) == NULL ||
+         (size_t)(space - line->b) != kmer_size ||
+         !parse_entire_size(space+1, &num_links_exp))
+      {
+        die("Bad kmer line [%s]: %s", path, line->b);
       }
+      bkey = binary_kmer_from_str(line->b, kmer_size);
+      in_kmer = true;
+      nlinks = 0;
     }
+    else
+    {
+      if(!in_kmer) bad_link_line(path, line);
+      link_line_parse(line, file->version, &file->fltr,
+                      &fw, &njuncs, &wrkr->counts, juncs, NULL, NULL);
+      byte_buf_capacity(&wrkr->seqbuf, binary_seq_mem(njuncs));
+      binary_seq_from_str(juncs->b, njuncs, wrkr->seqbuf.b);
+      _load_add_link(wrkr, fw, njuncs);
+      nlinks++;
+    }
+  }
+
+  if(in_kmer) _load_kmer_links(wrkr, bkey, num_links_exp, nlinks);
+}
+
+static void gpath_load_worker(void *arg, size_t threadid)
+{
+  (void)threadid;
+  GPathLoadWorker *wrkr = (GPathLoadWorker*)arg;
+  GPathLoader *ldr = wrkr->ldr;
+  bool binary = gpath_reader_is_binary(ldr->file);
+  StrBuf *chunk;
+  int pos;
+
+  while((pos = msgpool_claim_read(ldr->pool)) != -1)
+  {
+    memcpy(&chunk, msgpool_get_ptr(ldr->pool, pos), sizeof(StrBuf*));
+    if(binary) _load_bin_chunk(wrkr, chunk);
+    else _load_text_chunk(wrkr, chunk);
+    msgpool_release(ldr->pool, pos, MPOOL_EMPTY);
   }
+}
 
-  strbuf_dealloc(&kmerstr);
-  strbuf_dealloc(&juncs);
-  size_buf_dealloc(&counts);
+static void _load_pool_init(void *el, size_t idx, void *args)
+{
+  StrBuf *chunks = (StrBuf*)args, *chunk = chunks + idx;
+  memcpy(el, &chunk, sizeof(StrBuf*));
+}
+
+/**
+ * @param kmer_flags must be one of:
+ *   * GPATH_ADD_MISSING_KMERS - add kmers to the graph before loading path
+ *   * GPATH_DIE_MISSING_KMERS - die with error if cannot find kmer
+ *   * GPATH_SKIP_MISSING_KMERS - skip paths where kmer is not in graph
+ * @param nthreads number of threads to parse and add links, in addition to
+ *                 a thread reading the file
+ */
+void gpath_reader_load(GPathReader *file, int kmer_flags, size_t nthreads,
+                       dBGraph *db_graph)
+{
+  ctx_assert(nthreads > 0);
+
+  file_filter_status(&file->fltr, false);
+
+  size_t i, nchunks = 2 * nthreads;
+  size_t total_kmers_exp = gpath_reader_get_num_kmers(file);
+  size_t total_links_exp = gpath_reader_get_num_paths(file);
+  size_t num_kmers_seen = 0, num_links_seen = 0;
+  size_t num_kmers_loaded = 0, num_links_loaded = 0;
+  int rc;
+
+  // Chunks of the file waiting to be loaded
+  StrBuf *chunks = ctx_calloc(nchunks, sizeof(StrBuf));
+  for(i = 0; i < nchunks; i++) strbuf_alloc(&chunks[i], GPATH_LOAD_CHUNK);
+
+  MsgPool pool;
+  msgpool_alloc(&pool, nchunks, sizeof(StrBuf*), USE_MSG_POOL);
+  msgpool_iterate(&pool, _load_pool_init, chunks);
+
+  GPathLoader ldr = {.file = file, .kmer_flags = kmer_flags,
+                     .db_graph = db_graph, .pool = &pool,
+                     .kmer_locks = ctx_calloc(GPATH_LOAD_NLOCKS/8, 1),
+                     .warn_nlink_mismatch = false};
+
+  GPathLoadWorker *wrkrs = ctx_calloc(nthreads, sizeof(GPathLoadWorker));
+
+  for(i = 0; i < nthreads; i++) {
+    wrkrs[i].ldr = &ldr;
+    // Load paths into this temporary set for each kmer
+    gpath_set_alloc(&wrkrs[i].gpset, db_graph->num_of_cols,
+                    ONE_MEGABYTE, true, true);
+    gpath_subset_alloc(&wrkrs[i].subset0);
+    gpath_subset_alloc(&wrkrs[i].subset1);
+    strbuf_alloc(&wrkrs[i].line, 1024);
+    strbuf_alloc(&wrkrs[i].juncs, 256);
+    size_buf_alloc(&wrkrs[i].counts, 256);
+    byte_buf_alloc(&wrkrs[i].seqbuf, 64);
+  }
+
+  status("[GPathReader] Loading links with %zu thread%s", nthreads,
+         util_plural_str(nthreads));
+
+  pthread_t reader;
+  rc = pthread_create(&reader, NULL, gpath_load_reader, &ldr);
+  if(rc != 0) die("Creating thread failed: %s", strerror(rc));
+
+  util_run_threads(wrkrs, nthreads, sizeof(GPathLoadWorker),
+                   nthreads, gpath_load_worker);
+
+  rc = pthread_join(reader, NULL);
+  if(rc != 0) die("Joining thread failed: %s", strerror(rc));
+
+  for(i = 0; i < nthreads; i++) {
+    num_kmers_seen += wrkrs[i].num_kmers_seen;
+    num_links_seen += wrkrs[i].num_links_seen;
+    num_kmers_loaded += wrkrs[i].num_kmers_loaded;
+    num_links_loaded += wrkrs[i].num_links_loaded;
+    gpath_set_dealloc(&wrkrs[i].gpset);
+    gpath_subset_dealloc(&wrkrs[i].subset0);
+    gpath_subset_dealloc(&wrkrs[i].subset1);
+    strbuf_dealloc(&wrkrs[i].line);
+    strbuf_dealloc(&wrkrs[i].juncs);
+    size_buf_dealloc(&wrkrs[i].counts);
+    byte_buf_dealloc(&wrkrs[i].seqbuf);
+  }
+
+  for(i = 0; i < nchunks; i++) strbuf_dealloc(&chunks[i]);
+  ctx_free(chunks);
+  ctx_free(wrkrs);
+  ctx_free(ldr.kmer_locks);
+  msgpool_dealloc(&pool);
 
   load_check(total_kmers_exp == num_kmers_seen,
              "header number of kmers don't match seen (exp %zu vs %zu)",
@@ -640,11 +1058,6 @@ void gpath_reader_load(GPathReader *file, int kmer_flags, dBGraph *db_graph)
   ulong_to_str(num_links_loaded, nlinks_str);
   ulong_to_str(num_kmers_loaded, nkmers_str);
   status("Loaded %s paths from %s kmers", nlinks_str, nkmers_str);
-
-  gpath_subset_dealloc(&subset0);
-  gpath_subset_dealloc(&subset1);
-  gpath_set_dealloc(&gpset);
-  byte_buf_dealloc(&seqbuf);
 }
 
 void gpath_reader_load_sample_names(const GPathReader *file, dBGraph *db_graph)
@@ -8,6 +8,11 @@
 #include "common_buffers.h"
 
 #define CTP_FORMAT_VERSION 4
+#define CTP_BINARY_FORMAT_VERSION 5
+
+// gpath_reader_load() reads the file in chunks of this many bytes, passing
+// complete kmer records to worker threads
+#define GPATH_LOAD_CHUNK ONE_MEGABYTE
 
 typedef struct
 {
@@ -27,8 +32,14 @@ typedef struct
   int version;
   size_t ncolours;
   cJSON **colours_json;
+
+  // Binary files only: number of links left to read for the current kmer
+  size_t links_left;
 } GPathReader;
 
+#define gpath_reader_is_binary(file) \
+        ((file)->version >= CTP_BINARY_FORMAT_VERSION)
+
 #define GPATH_ADD_MISSING_KMERS   0
 #define GPATH_DIE_MISSING_KMERS   1
 #define GPATH_SKIP_MISSING_KMERS  2
@@ -53,7 +64,9 @@ void gpath_reader_check(const GPathReader *file, size_t kmer_size, size_t ncols)
 //   GPATH_ADD_MISSING_KMERS - add kmers to the graph before loading path
 //   GPATH_DIE_MISSING_KMERS - die with error if cannot find kmer
 //   GPATH_SKIP_MISSING_KMERS - skip paths where kmer is not in graph
-void gpath_reader_load(GPathReader *file, int kmer_flags, dBGraph *db_graph);
+// Links are parsed and added by @nthreads threads, whilst another reads the file
+void gpath_reader_load(GPathReader *file, int kmer_flags, size_t nthreads,
+                       dBGraph *db_graph);
 void gpath_reader_close(GPathReader *file);
 
 // Given an array of GPathReaders, find the max and sum of the number of kmers
@@ -74,11 +87,13 @@ void link_line_parse(const StrBuf *line, int version, const FileFilter *fltr,
                      StrBuf *seq, SizeBuffer *juncpos);
 
 // Reads line <kmer> <num_links>
+// Also reads binary files, converting the kmer to a string
 // Calls die() on error
 // Returns true unless end of file
 bool gpath_reader_read_kmer(GPathReader *file, StrBuf *kmer, size_t *num_links);
 
 // Reads line [FR] <num_links>
+// Also reads binary files, which have no seq= or juncpos= entries
 // Calls die() on error
 // Returns true unless end of link entries
 bool gpath_reader_read_link(GPathReader *file,
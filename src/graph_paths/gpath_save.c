@@ -28,6 +28,7 @@ const char ctp_explanation_comment[] =
 // [FR] (nkmers) [njuncs] [nseen,nseen,nseen] [seq:ACAGT] .. (ignored)
 //
 // Note: (nkmers) is only in versions <= 3
+// Version 5 is binary, see gpath_reader.c
 
 static void _gpath_save_contig_hist2json(cJSON *json_hists,
                                          const size_t *arr_counts,
@@ -59,12 +60,13 @@ static void _gpath_save_contig_hist2json(cJSON *json_hists,
  *                    If cmdstr and cmdhdr are both NULL they are ignored
  * @param contig_hist histgram of read contig lengths
  * @param hist_len    length of array contig_hist
+ * @param binary      if true, header is for the binary format
  */
 cJSON* gpath_save_mkhdr(const char *path,
                         const char *cmdstr, cJSON *cmdhdr,
                         cJSON **hdrs, size_t nhdrs,
                         const ZeroSizeBuffer *contig_hists, size_t ncols,
-                        const dBGraph *db_graph)
+                        bool binary, const dBGraph *db_graph)
 {
   ctx_assert(!cmdstr == !cmdhdr);
 
@@ -78,7 +80,8 @@ cJSON* gpath_save_mkhdr(const char *path,
   cJSON *jsonhdr = cJSON_CreateObject();
 
   cJSON_AddStringToObject(jsonhdr, "file_format", "ctp");
-  cJSON_AddNumberToObject(jsonhdr, "format_version", CTP_FORMAT_VERSION);
+  int version = binary ? CTP_BINARY_FORMAT_VERSION : CTP_FORMAT_VERSION;
+  cJSON_AddNumberToObject(jsonhdr, "format_version", version);
 
   // Add standard cortex header info, including the command being run
   json_hdr_make_std(jsonhdr, path, hdrs, nhdrs, db_graph,
@@ -111,15 +114,6 @@ cJSON* gpath_save_mkhdr(const char *path,
 }
 
 
-static inline void _gpath_save_flush(gzFile gzout, StrBuf *sbuf,
-                                     pthread_mutex_t *outlock)
-{
-  pthread_mutex_lock(outlock);
-  gzwrite(gzout, sbuf->b, sbuf->end);
-  pthread_mutex_unlock(outlock);
-  strbuf_reset(sbuf);
-}
-
 /**
  * Print paths to a string buffer. Paths are sorted before being written.
  *
@@ -188,14 +182,15 @@ void gpath_save_sbuf(hkey_t hkey, StrBuf *sbuf, GPathSubset *subset,
 
     strbuf_append_char(sbuf, ' ');
     strbuf_ensure_capacity(sbuf, sbuf->end + gpath->num_juncs + 2);
-    binary_seq_to_str(gpath->seq, gpath->num_juncs, sbuf->b+sbuf->end);
+    binary_seq_to_str(gpath_get_seq(gpset, gpath), gpath->num_juncs,
+                      sbuf->b+sbuf->end);
     sbuf->end += gpath->num_juncs;
 
     if(nbuf)
     {
       // Trace this path through the graph
       // First, find a colour this path is in
-      for(col = 0; col < ncols && !gpath_has_colour(gpath, ncols, col); col++) {}
+      for(col = 0; col < ncols && !gpath_has_colour(gpset, gpath, col); col++) {}
       if(col == ncols) die("path is not in any colours");
 
       dBNode node = {.key = hkey, .orient = gpath->orient};
@@ -223,18 +218,75 @@ void gpath_save_sbuf(hkey_t hkey, StrBuf *sbuf, GPathSubset *subset,
   }
 }
 
+static inline void _sbuf_append_varint(StrBuf *sbuf, size_t v)
+{
+  strbuf_ensure_capacity(sbuf, sbuf->end + 10);
+  for(; v >= 0x80; v >>= 7) sbuf->b[sbuf->end++] = (char)(v | 0x80);
+  sbuf->b[sbuf->end++] = (char)v;
+  sbuf->b[sbuf->end] = '\0';
+}
+
+/**
+ * Write paths to a string buffer in the binary format (see gpath_reader.c).
+ * Paths are sorted before being written.
+ *
+ * @param hkey    All paths associated with hkey are written to the buffer
+ * @param sbuf    paths are appended to this buffer
+ * @param subset  is a temp variable that is reused each time
+ */
+void gpath_save_bin_sbuf(hkey_t hkey, StrBuf *sbuf, GPathSubset *subset,
+                         const dBGraph *db_graph)
+{
+  const GPathStore *gpstore = &db_graph->gpstore;
+  const GPathSet *gpset = &gpstore->gpset;
+  const size_t ncols = gpstore->gpset.ncols;
+  GPath *first_gpath = gpath_store_fetch(gpstore, hkey);
+  const GPath *gpath;
+  const uint8_t *nseenptr;
+  size_t i, col, nbytes;
+
+  // Load and sort paths for given kmer
+  gpath_subset_reset(subset);
+  gpath_subset_load_llist(subset, first_gpath);
+  gpath_subset_sort(subset);
+
+  if(subset->list.len == 0) return;
+
+  // <bkmer> <npaths>
+  BinaryKmer bkmer = hash_table_fetch(&db_graph->ht, hkey);
+  strbuf_append_strn(sbuf, (const char*)bkmer.b, BKMER_BYTES);
+  _sbuf_append_varint(sbuf, subset->list.len);
+
+  for(i = 0; i < subset->list.len; i++)
+  {
+    gpath = subset->list.b[i];
+    nseenptr = gpath_set_get_nseen(gpset, gpath);
+
+    _sbuf_append_varint(sbuf, ((size_t)gpath->num_juncs << 1) | gpath->orient);
+    for(col = 0; col < ncols; col++) _sbuf_append_varint(sbuf, nseenptr[col]);
+
+    // Packed junctions, with unused bits of the last byte zeroed
+    nbytes = binary_seq_mem(gpath->num_juncs);
+    strbuf_append_strn(sbuf, (const char*)gpath_get_seq(gpset, gpath), nbytes);
+    if(gpath->num_juncs & 3)
+      sbuf->b[sbuf->end-1] &= (1 << ((gpath->num_juncs & 3) * 2)) - 1;
+  }
+}
+
 // @subset is a temp variable that is reused each time
 // @sbuf   is a temp variable that is reused each time
 static inline int _gpath_gzsave_node(hkey_t hkey,
                                      StrBuf *sbuf, GPathSubset *subset,
                                      dBNodeBuffer *nbuf, SizeBuffer *jposbuf,
-                                     gzFile gzout, pthread_mutex_t *outlock,
+                                     bool binary,
+                                     BgzfWriter *out, BgzfCompressor *cmp,
                                      const dBGraph *db_graph)
 {
-  gpath_save_sbuf(hkey, sbuf, subset, nbuf, jposbuf, db_graph);
+  if(binary) gpath_save_bin_sbuf(hkey, sbuf, subset, db_graph);
+  else gpath_save_sbuf(hkey, sbuf, subset, nbuf, jposbuf, db_graph);
 
   if(sbuf->end > DEFAULT_IO_BUFSIZE)
-    _gpath_save_flush(gzout, sbuf, outlock);
+    bgzf_write_strbuf(out, cmp, sbuf);
 
   return 0; // => keep iterating
 }
@@ -243,8 +295,8 @@ typedef struct
 {
   size_t nthreads;
   bool save_seq; // write seq=... juncpos=...
-  gzFile gzout;
-  pthread_mutex_t *outlock;
+  bool binary;
+  BgzfWriter *out;
   dBGraph *db_graph;
 } GPathSaving;
 
@@ -255,10 +307,12 @@ static void gpath_save_thread(void *arg, size_t threadid)
 
   GPathSubset subset;
   StrBuf sbuf;
+  BgzfCompressor cmp;
 
   gpath_subset_alloc(&subset);
   gpath_subset_init(&subset, &save->db_graph->gpstore.gpset);
   strbuf_alloc(&sbuf, 2 * DEFAULT_IO_BUFSIZE);
+  bgzf_compressor_alloc(&cmp);
 
   dBNodeBuffer nbuf;
   SizeBuffer jposbuf;
@@ -269,27 +323,30 @@ static void gpath_save_thread(void *arg, size_t threadid)
                     _gpath_gzsave_node,
                     &sbuf, &subset,
                     save->save_seq ? &nbuf : NULL, save->save_seq ? &jposbuf : NULL,
-                    save->gzout, save->outlock,
+                    save->binary, save->out, &cmp,
                     db_graph);
 
-  _gpath_save_flush(save->gzout, &sbuf, save->outlock);
+  bgzf_write_strbuf(save->out, &cmp, &sbuf);
 
   db_node_buf_dealloc(&nbuf);
   size_buf_dealloc(&jposbuf);
   gpath_subset_dealloc(&subset);
+  bgzf_compressor_dealloc(&cmp);
   strbuf_dealloc(&sbuf);
 }
 
 /**
  * Save paths to a file.
- * @param gzout         gzFile to write to
+ * @param out           BGZF file to write to. Each thread compresses its own
+ *                      output, so saving scales with nthreads
  * @param path          path of output file
  * @param save_path_seq if true, save seq= and juncpos= for links, requires
- *                      exactly one colour in the graph
+ *                      exactly one colour in the graph. Ignored if binary
+ * @param binary        if true, write the binary format
  * @param hdrs is array of JSON headers of input files
  */
-void gpath_save(gzFile gzout, const char *path,
-                size_t nthreads, bool save_path_seq,
+void gpath_save(BgzfWriter *out, const char *path,
+                size_t nthreads, bool save_path_seq, bool binary,
                 const char *cmdstr, cJSON *cmdhdr,
                 cJSON **hdrs, size_t nhdrs,
                 const ZeroSizeBuffer *contig_hists, size_t ncols,
@@ -303,30 +360,36 @@ void gpath_save(gzFile gzout, const char *path,
   char npaths_str[50];
   ulong_to_str(db_graph->gpstore.num_paths, npaths_str);
 
-  status("Saving %s paths to: %s", npaths_str, path);
+  status("Saving %s paths to: %s%s", npaths_str, path,
+         binary ? " [binary]" : "");
   status("  using %zu threads", nthreads);
 
   // Write header
+  StrBuf hdrbuf;
+  BgzfCompressor cmp;
+  strbuf_alloc(&hdrbuf, 4096);
+  bgzf_compressor_alloc(&cmp);
+
   cJSON *jsonhdr = gpath_save_mkhdr(path, cmdstr, cmdhdr, hdrs, nhdrs,
-                                    contig_hists, ncols, db_graph);
-  json_hdr_gzprint(jsonhdr, gzout);
+                                    contig_hists, ncols, binary, db_graph);
+  json_hdr_sprint(jsonhdr, &hdrbuf);
   cJSON_Delete(jsonhdr);
 
   // Print comments about the format
-  gzputs(gzout, ctp_explanation_comment);
+  if(!binary) strbuf_append_str(&hdrbuf, ctp_explanation_comment);
+  bgzf_write_strbuf(out, &cmp, &hdrbuf);
 
-  // Multithreaded
-  pthread_mutex_t outlock;
-  if(pthread_mutex_init(&outlock, NULL) != 0) die("Mutex init failed");
+  bgzf_compressor_dealloc(&cmp);
+  strbuf_dealloc(&hdrbuf);
 
+  // Multithreaded
   GPathSaving save = {.nthreads = nthreads,
-                      .save_seq = save_path_seq,
-                      .gzout = gzout,
-                      .outlock = &outlock,
+                      .save_seq = save_path_seq && !binary,
+                      .binary = binary,
+                      .out = out,
                       .db_graph = db_graph};
 
   // Iterate over kmers writing paths
   util_multi_thread(&save, nthreads, gpath_save_thread);
-  pthread_mutex_destroy(&outlock);
   status("[GPathSave] Graph paths saved to %s", path);
 }
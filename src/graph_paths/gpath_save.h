@@ -4,6 +4,7 @@
 #include "db_graph.h"
 #include "db_node.h"
 #include "gpath_subset.h"
+#include "bgzf_writer.h"
 #include "cJSON/cJSON.h"
 
 /*
@@ -11,6 +12,8 @@
 <JSON_HEADER>
 kmer [num] .. ignored
 [FR] [njuncs] [nseen,nseen,nseen] [seq:ACAGT] .. ignored
+
+Binary format (format_version 5) is described in gpath_reader.c
 */
 
 extern const char ctp_explanation_comment[];
@@ -25,12 +28,13 @@ extern const char ctp_explanation_comment[];
  * @param nhdrs       number of elements in @hdrs
  * @param contig_hist histgram of read contig lengths
  * @param hist_len    length of array contig_hist
+ * @param binary      if true, header is for the binary format
  */
 cJSON* gpath_save_mkhdr(const char *path,
                         const char *cmdstr, cJSON *cmdhdr,
                         cJSON **hdrs, size_t nhdrs,
                         const ZeroSizeBuffer *contig_hists, size_t ncols,
-                        const dBGraph *db_graph);
+                        bool binary, const dBGraph *db_graph);
 
 /**
  * Print paths to a string buffer. Paths are sorted before being written.
@@ -45,16 +49,29 @@ void gpath_save_sbuf(hkey_t hkey, StrBuf *sbuf, GPathSubset *subset,
                      dBNodeBuffer *nbuf, SizeBuffer *jposbuf,
                      const dBGraph *db_graph);
 
+/**
+ * Write paths to a string buffer in the binary format (format_version 5).
+ * Paths are sorted before being written.
+ *
+ * @param hkey    All paths associated with hkey are written to the buffer
+ * @param sbuf    paths are appended to this buffer
+ * @param subset  is a temp variable that is reused each time
+ */
+void gpath_save_bin_sbuf(hkey_t hkey, StrBuf *sbuf, GPathSubset *subset,
+                         const dBGraph *db_graph);
+
 /**
  * Save paths to a file.
+ * @param out     BGZF file to write to, written by nthreads threads at once
+ * @param binary  if true, write the binary format instead of text
  * @param cmdstr  name of the command being run, to be used to add @cmdhdr
  * @param cmdhdr  JSON header to add under current command->@cmdstr
  *                If cmdstr and cmdhdr are both NULL they are ignored
  * @param hdrs    array of JSON headers of input files
  * @param nhdrs   number of elements in @hdrs
  */
-void gpath_save(gzFile gzout, const char *path,
-                size_t nthreads, bool save_path_seq,
+void gpath_save(BgzfWriter *out, const char *path,
+                size_t nthreads, bool save_path_seq, bool binary,
                 const char *cmdstr, cJSON *cmdhdr,
                 cJSON **hdrs, size_t nhdrs,
                 const ZeroSizeBuffer *contig_hists, size_t ncols,
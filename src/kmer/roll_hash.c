@@ -0,0 +1,163 @@
+#include "roll_hash.h"
+
+// Random seed for each base: A,C,G,T (same values as ntHash)
+const uint64_t roll_hash_seeds[4] = {
+  0x3c8bfbb395c60474UL, 0x3193c18562a02b4cUL,
+  0x20323ed082572324UL, 0x295549f54be24456UL
+};
+
+// roll_hash_byte[b] = srol^3(seed[b>>6&3]) ^ srol^2(seed[b>>4&3]) ^
+//                     srol^1(seed[b>>2&3]) ^ seed[b&3]
+const uint64_t roll_hash_byte[256] = {
+  0x53ec3f8c47623ee8UL, 0x5ef405bab00411d0UL,
+  0x4f55faef50f319b8UL, 0x46328dca99467ecaUL,
+  0x49dc4be1a9ae6098UL, 0x44c471d75ec84fa0UL,
+  0x55658e82be3f47c8UL, 0x5c02f9a7778a20baUL,
+  0x6a9fb54868407049UL, 0x67878f7e9f265f71UL,
+  0x7626702b7fd15719UL, 0x7f41070eb664306bUL,
+  0x78515b01fb2abeacUL, 0x754961370c4c9194UL,
+  0x64e89e62ecbb99fcUL, 0x6d8fe947250efe8eUL,
+  0x678cd7559afa8209UL, 0x6a94ed636d9cad31UL,
+  0x7b3512368d6ba559UL, 0x7252651344dec22bUL,
+  0x7dbca3387436dc79UL, 0x70a4990e8350f341UL,
+  0x6105665b63a7fb29UL, 0x6862117eaa129c5bUL,
+  0x5eff5d91b5d8cca8UL, 0x53e767a742bee390UL,
+  0x424698f2a249ebf8UL, 0x4b21efd76bfc8c8aUL,
+  0x4c31b3d826b2024dUL, 0x412989eed1d42d75UL,
+  0x508876bb3123251dUL, 0x59ef019ef896426fUL,
+  0x210b2a041926a3aaUL, 0x2c131032ee408c92UL,
+  0x3db2ef670eb784faUL, 0x34d59842c702e388UL,
+  0x3b3b5e69f7eafddaUL, 0x3623645f008cd2e2UL,
+  0x27829b0ae07bda8aUL, 0x2ee5ec2f29cebdf8UL,
+  0x1878a0c03604ed0bUL, 0x15609af6c162c233UL,
+  0x04c165a32195ca5bUL, 0x0da61286e820ad29UL,
+  0x0ab64e89a56e23eeUL, 0x07ae74bf52080cd6UL,
+  0x160f8beab2ff04beUL, 0x1f68fccf7b4a63ccUL,
+  0x0496f6953ff33e61UL, 0x098ecca3c8951159UL,
+  0x182f33f628621931UL, 0x114844d3e1d77e43UL,
+  0x1ea682f8d13f6011UL, 0x13beb8ce26594f29UL,
+  0x021f479bc6ae4741UL, 0x0b7830be0f1b2033UL,
+  0x3de57c5110d170c0UL, 0x30fd4667e7b75ff8UL,
+  0x215cb93207405790UL, 0x283bce17cef530e2UL,
+  0x2f2b921883bbbe25UL, 0x2233a82e74dd911dUL,
+  0x3392577b942a9975UL, 0x3af5205e5d9ffe07UL,
+  0x3b2dee3dfc53472bUL, 0x3635d40b0b356813UL,
+  0x27942b5eebc2607bUL, 0x2ef35c7b22770709UL,
+  0x211d9a50129f195bUL, 0x2c05a066e5f93663UL,
+  0x3da45f33050e3e0bUL, 0x34c32816ccbb5979UL,
+  0x025e64f9d371098aUL, 0x0f465ecf241726b2UL,
+  0x1ee7a19ac4e02edaUL, 0x1780d6bf0d5549a8UL,
+  0x10908ab0401bc76fUL, 0x1d88b086b77de857UL,
+  0x0c294fd3578ae03fUL, 0x054e38f69e3f874dUL,
+  0x0f4d06e421cbfbcaUL, 0x02553cd2d6add4f2UL,
+  0x13f4c387365adc9aUL, 0x1a93b4a2ffefbbe8UL,
+  0x157d7289cf07a5baUL, 0x186548bf38618a82UL,
+  0x09c4b7ead89682eaUL, 0x00a3c0cf1123e598UL,
+  0x363e8c200ee9b56bUL, 0x3b26b616f98f9a53UL,
+  0x2a8749431978923bUL, 0x23e03e66d0cdf549UL,
+  0x24f062699d837b8eUL, 0x29e8585f6ae554b6UL,
+  0x3849a70a8a125cdeUL, 0x312ed02f43a73bacUL,
+  0x49cafbb5a217da69UL, 0x44d2c1835571f551UL,
+  0x55733ed6b586fd39UL, 0x5c1449f37c339a4bUL,
+  0x53fa8fd84cdb8419UL, 0x5ee2b5eebbbdab21UL,
+  0x4f434abb5b4aa349UL, 0x46243d9e92ffc43bUL,
+  0x70b971718d3594c8UL, 0x7da14b477a53bbf0UL,
+  0x6c00b4129aa4b398UL, 0x6567c3375311d4eaUL,
+  0x62779f381e5f5a2dUL, 0x6f6fa50ee9397515UL,
+  0x7ece5a5b09ce7d7dUL, 0x77a92d7ec07b1a0fUL,
+  0x6c57272484c247a2UL, 0x614f1d1273a4689aUL,
+  0x70eee247935360f2UL, 0x798995625ae60780UL,
+  0x766753496a0e19d2UL, 0x7b7f697f9d6836eaUL,
+  0x6ade962a7d9f3e82UL, 0x63b9e10fb42a59f0UL,
+  0x5524ade0abe00903UL, 0x583c97d65c86263bUL,
+  0x499d6883bc712e53UL, 0x40fa1fa675c44921UL,
+  0x47ea43a9388ac7e6UL, 0x4af2799fcfece8deUL,
+  0x5b5386ca2f1be0b6UL, 0x5234f1efe6ae87c4UL,
+  0xb622149cfbeb046cUL, 0xbb3a2eaa0c8d2b54UL,
+  0xaa9bd1ffec7a233cUL, 0xa3fca6da25cf444eUL,
+  0xac1260f115275a1cUL, 0xa10a5ac7e2417524UL,
+  0xb0aba59202b67d4cUL, 0xb9ccd2b7cb031a3eUL,
+  0x8f519e58d4c94acdUL, 0x8249a46e23af65f5UL,
+  0x93e85b3bc3586d9dUL, 0x9a8f2c1e0aed0aefUL,
+  0x9d9f701147a38428UL, 0x90874a27b0c5ab10UL,
+  0x8126b5725032a378UL, 0x8841c2579987c40aUL,
+  0x8242fc452673b88dUL, 0x8f5ac673d11597b5UL,
+  0x9efb392631e29fddUL, 0x979c4e03f857f8afUL,
+  0x98728828c8bfe6fdUL, 0x956ab21e3fd9c9c5UL,
+  0x84cb4d4bdf2ec1adUL, 0x8dac3a6e169ba6dfUL,
+  0xbb3176810951f62cUL, 0xb6294cb7fe37d914UL,
+  0xa788b3e21ec0d17cUL, 0xaeefc4c7d775b60eUL,
+  0xa9ff98c89a3b38c9UL, 0xa4e7a2fe6d5d17f1UL,
+  0xb5465dab8daa1f99UL, 0xbc212a8e441f78ebUL,
+  0xc4c50114a5af992eUL, 0xc9dd3b2252c9b616UL,
+  0xd87cc477b23ebe7eUL, 0xd11bb3527b8bd90cUL,
+  0xdef575794b63c75eUL, 0xd3ed4f4fbc05e866UL,
+  0xc24cb01a5cf2e00eUL, 0xcb2bc73f9547877cUL,
+  0xfdb68bd08a8dd78fUL, 0xf0aeb1e67debf8b7UL,
+  0xe10f4eb39d1cf0dfUL, 0xe868399654a997adUL,
+  0xef78659919e7196aUL, 0xe2605fafee813652UL,
+  0xf3c1a0fa0e763e3aUL, 0xfaa6d7dfc7c35948UL,
+  0xe158dd85837a04e5UL, 0xec40e7b3741c2bddUL,
+  0xfde118e694eb23b5UL, 0xf4866fc35d5e44c7UL,
+  0xfb68a9e86db65a95UL, 0xf67093de9ad075adUL,
+  0xe7d16c8b7a277dc5UL, 0xeeb61baeb3921ab7UL,
+  0xd82b5741ac584a44UL, 0xd5336d775b3e657cUL,
+  0xc4929222bbc96d14UL, 0xcdf5e507727c0a66UL,
+  0xcae5b9083f3284a1UL, 0xc7fd833ec854ab99UL,
+  0xd65c7c6b28a3a3f1UL, 0xdf3b0b4ee116c483UL,
+  0xfd19adbcb6403ffbUL, 0xf001978a412610c3UL,
+  0xe1a068dfa1d118abUL, 0xe8c71ffa68647fd9UL,
+  0xe729d9d1588c618bUL, 0xea31e3e7afea4eb3UL,
+  0xfb901cb24f1d46dbUL, 0xf2f76b9786a821a9UL,
+  0xc46a27789962715aUL, 0xc9721d4e6e045e62UL,
+  0xd8d3e21b8ef3560aUL, 0xd1b4953e47463178UL,
+  0xd6a4c9310a08bfbfUL, 0xdbbcf307fd6e9087UL,
+  0xca1d0c521d9998efUL, 0xc37a7b77d42cff9dUL,
+  0xc97945656bd8831aUL, 0xc4617f539cbeac22UL,
+  0xd5c080067c49a44aUL, 0xdca7f723b5fcc338UL,
+  0xd34931088514dd6aUL, 0xde510b3e7272f252UL,
+  0xcff0f46b9285fa3aUL, 0xc697834e5b309d48UL,
+  0xf00acfa144facdbbUL, 0xfd12f597b39ce283UL,
+  0xecb30ac2536beaebUL, 0xe5d47de79ade8d99UL,
+  0xe2c421e8d790035eUL, 0xefdc1bde20f62c66UL,
+  0xfe7de48bc001240eUL, 0xf71a93ae09b4437cUL,
+  0x8ffeb834e804a2b9UL, 0x82e682021f628d81UL,
+  0x93477d57ff9585e9UL, 0x9a200a723620e29bUL,
+  0x95cecc5906c8fcc9UL, 0x98d6f66ff1aed3f1UL,
+  0x8977093a1159db99UL, 0x80107e1fd8ecbcebUL,
+  0xb68d32f0c726ec18UL, 0xbb9508c63040c320UL,
+  0xaa34f793d0b7cb48UL, 0xa35380b61902ac3aUL,
+  0xa443dcb9544c22fdUL, 0xa95be68fa32a0dc5UL,
+  0xb8fa19da43dd05adUL, 0xb19d6eff8a6862dfUL,
+  0xaa6364a5ced13f72UL, 0xa77b5e9339b7104aUL,
+  0xb6daa1c6d9401822UL, 0xbfbdd6e310f57f50UL,
+  0xb05310c8201d6102UL, 0xbd4b2afed77b4e3aUL,
+  0xacead5ab378c4652UL, 0xa58da28efe392120UL,
+  0x9310ee61e1f371d3UL, 0x9e08d45716955eebUL,
+  0x8fa92b02f6625683UL, 0x86ce5c273fd731f1UL,
+  0x81de00287299bf36UL, 0x8cc63a1e85ff900eUL,
+  0x9d67c54b65089866UL, 0x9400b26eacbdff14UL
+};
+
+void roll_hash_init(RollHasher *rh, size_t kmer_size, size_t nwords)
+{
+  const uint64_t *seeds = roll_hash_seeds;
+  size_t n, nbases = nwords * 32;
+
+  // Leaving base becomes a leading A and we drop the leading A that
+  // rotated out past the end of the words
+  uint64_t pad_out = roll_hash_srol_n(seeds[0], nbases);
+  uint64_t pad_k = roll_hash_srol_n(seeds[0], kmer_size);
+
+  // New first base in the rc replaces a leading A, and a leading A is
+  // added at the start of the words
+  uint64_t pad_in = roll_hash_srol_n(seeds[0], nbases-1);
+  uint64_t pad_k1 = roll_hash_srol_n(seeds[0], kmer_size-1);
+
+  rh->kmer_size = kmer_size;
+
+  for(n = 0; n < 4; n++) {
+    rh->fw_out[n] = pad_out ^ pad_k ^ roll_hash_srol_n(seeds[n], kmer_size);
+    rh->rc_in[n] = pad_in ^ pad_k1 ^ roll_hash_srol_n(seeds[3-n], kmer_size-1);
+  }
+}
@@ -0,0 +1,102 @@
+#ifndef ROLL_HASH_H_
+#define ROLL_HASH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+//
+// Rolling kmer hash (ntHash style)
+//
+// Each base has a random 64 bit seed. The hash of a sequence s_0..s_{L-1} is:
+//   F(s) = srol^(L-1)(seed[s_0]) ^ srol^(L-2)(seed[s_1]) ^ .. ^ seed[s_{L-1}]
+// where srol is a 'split rotate' left by one bit of the top 31 and bottom 33
+// bits separately, so it only repeats after lcm(31,33) = 1023 rotations.
+//
+// A BinaryKmer is hashed as all of its NUM_BKMER_WORDS*32 bases, including the
+// leading unused bases (zero = A). This means the hash of a kmer key can be
+// calculated without knowing the kmer size, and matches the value calculated
+// by shifting bases through a read.
+//
+// To roll along a read we keep F() of both the kmer and its reverse complement,
+// each updated in O(1) per base. Use the one matching the orientation of the
+// kmer key, then roll_hash_final() to mix in a seed.
+//
+
+// Forward and reverse complement hashes of a kmer
+typedef struct {
+  uint64_t fw, rc;
+} RollHash;
+
+// Per kmer size constants used to shift a base through a RollHash
+typedef struct {
+  size_t kmer_size;
+  uint64_t fw_out[4]; // remove first base from fw hash
+  uint64_t rc_in[4]; // add a new first base to the rc hash
+} RollHasher;
+
+extern const uint64_t roll_hash_seeds[4];
+
+// roll_hash_byte[b] is the hash of the four bases packed in byte b
+extern const uint64_t roll_hash_byte[256];
+
+// Split rotate: rotate top 31 bits and bottom 33 bits left by n bits each
+static inline uint64_t roll_hash_srol_n(uint64_t x, size_t n)
+{
+  const uint64_t hi_mask = (1UL<<31)-1, lo_mask = (1UL<<33)-1;
+  uint64_t hi = x >> 33, lo = x & lo_mask;
+  size_t a = n % 31, b = n % 33;
+  hi = ((hi << a) | (hi >> (31-a))) & hi_mask;
+  lo = ((lo << b) | (lo >> (33-b))) & lo_mask;
+  return (hi << 33) | lo;
+}
+
+static inline uint64_t roll_hash_srol(uint64_t x)
+{
+  uint64_t m = ((x & 0x8000000000000000UL) >> 30) | ((x & 0x100000000UL) >> 32);
+  return ((x << 1) & 0xFFFFFFFDFFFFFFFFUL) | m;
+}
+
+static inline uint64_t roll_hash_sror(uint64_t x)
+{
+  uint64_t m = ((x & 0x200000000UL) << 30) | ((x & 1UL) << 32);
+  return ((x >> 1) & 0x7FFFFFFEFFFFFFFFUL) | m;
+}
+
+// Hash of 32*nwords bases packed in words (most significant base first)
+static inline uint64_t roll_hash_words(const uint64_t *words, size_t nwords)
+{
+  uint64_t h = 0, w;
+  size_t i, j;
+  for(i = 0; i < nwords; i++) {
+    w = words[i];
+    for(j = 0; j < 8; j++)
+      h = roll_hash_srol_n(h, 4) ^ roll_hash_byte[(w >> (56 - j*8)) & 0xff];
+  }
+  return h;
+}
+
+// Mix in seed and reduce to 32 bits (MurmurHash3 finalizer)
+static inline uint32_t roll_hash_final(uint64_t h, uint32_t seed)
+{
+  h ^= (uint64_t)seed * 0x9E3779B97F4A7C15UL;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdUL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53UL;
+  h ^= h >> 33;
+  return (uint32_t)h;
+}
+
+// Set up constants to roll a kmer of kmer_size stored in nwords words
+void roll_hash_init(RollHasher *rh, size_t kmer_size, size_t nwords);
+
+// Shift one base through a rolling hash: remove first base `out` of the kmer
+// and append `in` to the end (same as binary_kmer_left_shift_add)
+static inline void roll_hash_shift(const RollHasher *rh, RollHash *h,
+                                   uint8_t out, uint8_t in)
+{
+  h->fw = roll_hash_srol(h->fw) ^ rh->fw_out[out] ^ roll_hash_seeds[in];
+  h->rc = roll_hash_sror(h->rc ^ roll_hash_seeds[3-out]) ^ rh->rc_in[in];
+}
+
+#endif /* ROLL_HASH_H_ */
@@ -191,6 +191,9 @@ static const char options[] =
 "  -t, --threads <T>     Limit on proccessing threads [default: 2]\n"
 "  -o, --out <file>      Output file\n"
 "  -p, --paths <in.ctp>  Links file to load (can specify multiple times)\n"
+"  --hugepages           Use huge pages for the graph if available\n"
+"  --numa <P>            Place graph memory: interleave|none [default: none]\n"
+"  --prefault            Commit graph memory up front using -t <T> threads\n"
 "\n";
 
 static int ctxcmd_cmp(const void *aa, const void *bb)
@@ -276,6 +279,35 @@ static bool remove_quiet_flags(int *argcp, char **argv)
   return qfound;
 }
 
+// remove --hugepages, --numa <P> and --prefault flags, setting up large
+// allocations
+// ['--numa','interleave','-f'] -> ['-f']
+static void remove_alloc_flags(int *argcp, char **argv)
+{
+  bool hugepages = false, prefault = false;
+  AllocNuma numa = ALLOC_NUMA_NONE;
+  const char *numa_str;
+  int i, j, argc = *argcp;
+
+  for(i = j = 1; i < argc; i++) {
+    if(strcmp(argv[i],"--hugepages") == 0) hugepages = true;
+    else if(strcmp(argv[i],"--prefault") == 0) prefault = true;
+    else if(strcmp(argv[i],"--numa") == 0 ||
+            strncmp(argv[i],"--numa=",7) == 0)
+    {
+      if(argv[i][6] == '=') numa_str = argv[i]+7;
+      else if(i+1 < argc) numa_str = argv[++i];
+      else cmd_print_usage("--numa <P> requires an argument");
+      if(!alloc_numa_parse(numa_str, &numa))
+        cmd_print_usage("Invalid --numa option: %s", numa_str);
+    }
+    else argv[j++] = argv[i];
+  }
+
+  *argcp = j;
+  alloc_large_config(hugepages, numa, prefault);
+}
+
 int main(int argc, char **argv)
 {
   time_t start, end;
@@ -298,6 +330,9 @@ int main(int argc, char **argv)
   // Look for -q, --quiet argument, if given silence output
   if(remove_quiet_flags(&argc, argv)) { ctx_msg_out = NULL; }
 
+  // Look for --hugepages, --numa <P>, --prefault arguments
+  remove_alloc_flags(&argc, argv);
+
   // Print status header
   cmd_print_status_header();
 
@@ -1,42 +1,47 @@
 #include "global.h"
 #include "gpath.h"
+#include "gpath_set.h"
 #include "util.h"
 #include "binary_seq.h"
 
 // Compare by orient, sequence
-int gpath_cmp(const GPath *a, const GPath *b)
+int gpath_cmp(const GPathSet *aset, const GPath *a,
+              const GPathSet *bset, const GPath *b)
 {
   int ret = (int)a->orient - (int)b->orient;
-  return ret ? ret : binary_seqs_cmp(a->seq, a->num_juncs, b->seq, b->num_juncs);
+  return ret ? ret : binary_seqs_cmp(gpath_get_seq(aset, a), a->num_juncs,
+                                     gpath_get_seq(bset, b), b->num_juncs);
 }
 
-size_t gpath_colset_bits_set(const GPath *gpath, size_t ncols)
+size_t gpath_colset_bits_set(const GPathSet *gpset, const GPath *gpath)
 {
-  size_t i, nbytes = (ncols+7)/8, nbits_set = 0;
-  const uint8_t *colset = gpath_get_colset(gpath, ncols);
+  size_t i, nbytes = gpath_colset_bytes(gpset->ncols), nbits_set = 0;
+  const uint8_t *colset = gpath_get_colset(gpset, gpath);
   for(i = 0; i < nbytes; i++) nbits_set += byte_popcount(colset[i]);
   return nbits_set;
 }
 
 // Copy colour set bits from src to dst
-void gpath_colset_or_mt(GPath *dst_gp, const GPath *src_gp, size_t ncols)
+void gpath_colset_or_mt(const GPathSet *dstset, GPath *dst_gp,
+                        const GPathSet *srcset, const GPath *src_gp)
 {
-  uint8_t *dst = gpath_get_colset(dst_gp, ncols);
-  const uint8_t *src = gpath_get_colset(src_gp, ncols);
-  size_t i, nbytes = (ncols+7)/8;
+  ctx_assert(dstset->ncols == srcset->ncols);
+  uint8_t *dst = gpath_get_colset(dstset, dst_gp);
+  const uint8_t *src = gpath_get_colset(srcset, src_gp);
+  size_t i, nbytes = gpath_colset_bytes(dstset->ncols);
   for(i = 0; i < nbytes; i++)
     __sync_fetch_and_or((volatile uint8_t*)&dst[i], src[i]);
 }
 
-// Remove from `set0` bits that are set in `set1`
+// Remove from `src_gp` colours that are set in `dst_gp`
 // Returns 0 if no colours remain in src path, 1 otherwise
-uint8_t gpath_colset_rm_intersect(const GPath *dst_gp, GPath *src_gp,
-                                  size_t ncols)
+uint8_t gpath_colset_rm_intersect(const GPathSet *gpset,
+                                  const GPath *dst_gp, GPath *src_gp)
 {
-  const uint8_t *dst = gpath_get_colset(dst_gp, ncols);
-  uint8_t *src = gpath_get_colset(src_gp, ncols);
+  const uint8_t *dst = gpath_get_colset(gpset, dst_gp);
+  uint8_t *src = gpath_get_colset(gpset, src_gp);
   const uint8_t *end; uint8_t src_or = 0;
-  for(end = dst + (ncols+7)/8; dst < end; dst++, src++) {
+  for(end = dst + gpath_colset_bytes(gpset->ncols); dst < end; dst++, src++) {
     *src &= ~*dst;
     src_or |= *src;
   }
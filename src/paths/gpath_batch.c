@@ -0,0 +1,104 @@
+#include "global.h"
+#include "gpath_batch.h"
+#include "util.h"
+#include "binary_seq.h"
+#include "misc/city.h"
+
+#define GPATH_BATCH_TABLE_SIZE (2*GPATH_BATCH_NLINKS)
+
+void gpath_batch_alloc(GPathBatch *batch, GPathHash *gphash)
+{
+  GPathBatch tmp = {.gphash = gphash,
+                    .links = ctx_calloc(GPATH_BATCH_NLINKS,
+                                        sizeof(GPathBatchLink)),
+                    .table = ctx_calloc(GPATH_BATCH_TABLE_SIZE,
+                                        sizeof(uint32_t)),
+                    .seqs = ctx_calloc(GPATH_BATCH_SEQMEM, sizeof(uint8_t)),
+                    .nlinks = 0, .seqlen = 0};
+
+  memcpy(batch, &tmp, sizeof(GPathBatch));
+}
+
+void gpath_batch_dealloc(GPathBatch *batch)
+{
+  ctx_free(batch->links);
+  ctx_free(batch->table);
+  ctx_free(batch->seqs);
+  memset(batch, 0, sizeof(GPathBatch));
+}
+
+void gpath_batch_flush(GPathBatch *batch)
+{
+  GPathSet *gpset = &batch->gphash->gpstore->gpset;
+  const GPathBatchLink *link;
+  GPath *gpath;
+  uint8_t *nseen;
+  bool found;
+  size_t i;
+
+  for(i = 0; i < batch->nlinks; i++)
+  {
+    link = &batch->links[i];
+    GPathNew newgpath = {.seq = batch->seqs + link->offset,
+                         .colset = NULL, .nseen = NULL,
+                         .num_juncs = link->num_juncs,
+                         .orient = link->orient};
+
+    gpath = gpath_hash_find_or_insert_mt(batch->gphash, link->hkey, newgpath,
+                                         &found);
+
+    // Other threads may be setting colours in the same byte
+    (void)bitset_set_mt(gpath_get_colset(gpset, gpath), link->col);
+    nseen = gpath_set_get_nseen(gpset, gpath);
+    if(nseen != NULL)
+      safe_add_uint8_mt(&nseen[link->col], MIN2(link->count, UINT8_MAX));
+  }
+
+  memset(batch->table, 0, GPATH_BATCH_TABLE_SIZE * sizeof(uint32_t));
+  batch->nlinks = batch->seqlen = 0;
+}
+
+static inline bool _batch_link_match(const GPathBatch *batch,
+                                     const GPathBatchLink *link, hkey_t hkey,
+                                     GPathNew newgpath, size_t col, size_t mem)
+{
+  return link->hkey == hkey && link->col == col &&
+         link->orient == newgpath.orient &&
+         link->num_juncs == newgpath.num_juncs &&
+         memcmp(batch->seqs + link->offset, newgpath.seq, mem) == 0;
+}
+
+void gpath_batch_add(GPathBatch *batch, hkey_t hkey, GPathNew newgpath,
+                     size_t col)
+{
+  const size_t mask = GPATH_BATCH_TABLE_SIZE - 1;
+  size_t mem = binary_seq_mem(newgpath.num_juncs), h;
+  GPathBatchLink *link;
+
+  ctx_assert(newgpath.seq != NULL);
+  ctx_assert(mem <= GPATH_BATCH_SEQMEM);
+
+  if(batch->nlinks == GPATH_BATCH_NLINKS ||
+     batch->seqlen + mem > GPATH_BATCH_SEQMEM) {
+    gpath_batch_flush(batch);
+  }
+
+  // Linear probing, the table is at most half full
+  h = CityHash64WithSeeds((const char*)newgpath.seq, mem, hkey, col);
+  for(h &= mask; batch->table[h]; h = (h+1) & mask) {
+    link = &batch->links[batch->table[h]-1];
+    if(_batch_link_match(batch, link, hkey, newgpath, col, mem)) {
+      link->count++;
+      return;
+    }
+  }
+
+  batch->table[h] = batch->nlinks+1;
+  link = &batch->links[batch->nlinks++];
+  *link = (GPathBatchLink){.hkey = hkey, .col = col, .count = 1,
+                           .offset = batch->seqlen,
+                           .num_juncs = newgpath.num_juncs,
+                           .orient = newgpath.orient};
+  memcpy(batch->seqs + batch->seqlen, newgpath.seq, mem);
+  batch->seqlen += mem;
+}
@@ -0,0 +1,56 @@
+#ifndef GPATH_BATCH_H_
+#define GPATH_BATCH_H_
+
+#include "gpath_hash.h"
+
+//
+// Per-thread batch of new links to add to a GPathHash.
+//
+// Reads from high coverage regions give the same links over and over, and
+// every thread that finds one searches the same bucket of the shared
+// GPathHash and updates the same colset and counts. Each thread collects the
+// links from a batch of reads in a small table of its own, counting repeats of
+// links it already holds, then adds each distinct link to the GPathHash once,
+// setting its colour and adding its count.
+//
+// Links are not in the GPathStore until the batch is flushed: flush before
+// reading links or writing them out.
+//
+
+#define GPATH_BATCH_NLINKS 4096 /* links per batch, must be a power of two */
+#define GPATH_BATCH_SEQMEM (1<<16) /* bytes of junctions per batch */
+
+typedef struct
+{
+  hkey_t hkey;
+  uint32_t col, count;
+  uint32_t offset; // junctions start at GPathBatch.seqs+offset
+  uint16_t num_juncs:15, orient:1;
+} GPathBatchLink;
+
+typedef struct
+{
+  GPathHash *const gphash;
+  GPathBatchLink *const links;
+  uint32_t *const table; // 1+index in links, 0 if empty
+  uint8_t *const seqs;
+  size_t nlinks, seqlen;
+} GPathBatch;
+
+#define gpath_batch_mem() \
+  (GPATH_BATCH_NLINKS * (sizeof(GPathBatchLink) + 2*sizeof(uint32_t)) + \
+   GPATH_BATCH_SEQMEM)
+
+void gpath_batch_alloc(GPathBatch *batch, GPathHash *gphash);
+void gpath_batch_dealloc(GPathBatch *batch);
+
+// Add all links in the batch to the GPathHash, leaving the batch empty
+// Threadsafe as long as each thread uses its own batch
+void gpath_batch_flush(GPathBatch *batch);
+
+// Add a link in colour `col`, flushing the batch first if it is full
+// newgpath.colset and newgpath.nseen are ignored
+void gpath_batch_add(GPathBatch *batch, hkey_t hkey, GPathNew newgpath,
+                     size_t col);
+
+#endif /* GPATH_BATCH_H_ */
@@ -13,8 +13,7 @@
 // (1-(1/(2^12)))^4080 = 0.369 = 37% of entries would have zero collisions
 // (1-(1/(2^16)))^4080 = 0.939 = 94% of entries would have zero collisions
 
-#define PATH_HASH_UNSET (0xffffffffffUL)
-#define PATH_HASH_ENTRY_EMPTY(x) ((x).hkey == PATH_HASH_UNSET)
+#define PATH_HASH_MAX_HKEY (0xffffffffffUL)
 
 void gpath_hash_alloc(GPathHash *gphash, GPathStore *gpstore, size_t mem_in_bytes)
 {
@@ -25,8 +24,8 @@ void gpath_hash_alloc(GPathHash *gphash, GPathStore *gpstore, size_t mem_in_byte
   hash_table_cap(cap_entries, &num_bkts, &bkt_size);
   cap_entries = num_bkts * bkt_size;
 
-  size_t bktlocks_mem = roundup_bits2bytes(num_bkts);
-  size_t mem = cap_entries*sizeof(GPEntry) + bktlocks_mem;
+  size_t ready_mem = roundup_bits2bytes(cap_entries);
+  size_t mem = cap_entries*sizeof(GPEntry) + ready_mem + num_bkts;
 
   char num_bkts_str[100], bkt_size_str[100], cap_str[100], mem_str[100];
   ulong_to_str(num_bkts, num_bkts_str);
@@ -36,17 +35,15 @@ void gpath_hash_alloc(GPathHash *gphash, GPathStore *gpstore, size_t mem_in_byte
   status("[GPathHash] Allocating table with %s entries, using %s", cap_str, mem_str);
   status("[GPathHash]  number of buckets: %s, bucket size: %s", num_bkts_str, bkt_size_str);
 
+  // Slots are only read once claimed and written, so table is not zeroed
   GPEntry *table = ctx_malloc(cap_entries * sizeof(GPEntry));
-  uint8_t *bktlocks = ctx_calloc(bktlocks_mem, sizeof(uint8_t));
+  uint8_t *ready = ctx_calloc(ready_mem, sizeof(uint8_t));
   uint8_t *bucket_nitems = ctx_calloc(num_bkts, sizeof(uint8_t));
 
   ctx_assert(num_bkts * bkt_size == cap_entries);
   ctx_assert(cap_entries > 0);
   ctx_assert(sizeof(GPEntry) == 10);
 
-  // Table all set to 1 to indicate empty
-  memset(table, 0xff, cap_entries * sizeof(GPEntry));
-
   GPathHash tmp = {.gpstore = gpstore, .table = table,
                   .num_of_buckets = num_bkts,
                   .bucket_size = bkt_size,
@@ -54,7 +51,7 @@ void gpath_hash_alloc(GPathHash *gphash, GPathStore *gpstore, size_t mem_in_byte
                   .mask = num_bkts - 1,
                   .num_entries = 0,
                   .bucket_nitems = bucket_nitems,
-                  .bktlocks = bktlocks};
+                  .ready = ready};
 
   memcpy(gphash, &tmp, sizeof(GPathHash));
 }
@@ -62,7 +59,7 @@ void gpath_hash_alloc(GPathHash *gphash, GPathStore *gpstore, size_t mem_in_byte
 void gpath_hash_dealloc(GPathHash *gphash)
 {
   ctx_free(gphash->bucket_nitems);
-  ctx_free(gphash->bktlocks);
+  ctx_free(gphash->ready);
   ctx_free(gphash->table);
   memset(gphash, 0, sizeof(GPathHash));
 }
@@ -70,7 +67,8 @@ void gpath_hash_dealloc(GPathHash *gphash)
 void gpath_hash_reset(GPathHash *gphash)
 {
   gphash->num_entries = 0;
-  memset(gphash->table, 0xff, gphash->capacity * sizeof(GPEntry));
+  memset(gphash->bucket_nitems, 0, gphash->num_of_buckets);
+  memset(gphash->ready, 0, roundup_bits2bytes(gphash->capacity));
 }
 
 void gpath_hash_print_stats(const GPathHash *gphash)
@@ -94,86 +92,66 @@ static inline bool _gphash_entries_match(const GPathSet *gpset, GPEntry entry,
                                          hkey_t hkey, GPathNew newgpath)
 {
   return (hkey == entry.hkey &&
-          gpaths_are_equal(gpset->entries.b[entry.gpindex], newgpath));
+          gpaths_are_equal(gpset, gpset->entries.b + entry.gpindex, newgpath));
 }
 
-// Use a bucket lock to find or add an entry
-// Returns NULL if not found or inserted
+// Find or add an entry in a bucket without locks
+// Returns NULL if not found and the bucket is full
 static inline GPath* _find_or_add_in_bucket_mt(GPathHash *gphash, uint64_t hash,
                                                hkey_t hkey, GPathNew newgpath,
                                                bool *found)
 {
   const GPathSet *gpset = &gphash->gpstore->gpset;
+  const uint64_t slot0 = hash * gphash->bucket_size;
+  volatile uint8_t *nitems = (volatile uint8_t*)&gphash->bucket_nitems[hash];
+  volatile GPEntry *start = gphash->table + slot0;
+  GPEntry entry;
+  GPath *gpath;
+  size_t i = 0, n;
 
-  GPath *gpath_ret = NULL;
-  *found = false;
-
-  ctx_assert(hash < gphash->capacity);
-
-  // Add GPath within a lock to ensure we do not add the same path more than
-  // once
-  bitlock_yield_acquire(gphash->bktlocks, hash);
+  ctx_assert(hash < gphash->num_of_buckets);
 
-        GPEntry *start = gphash->table + hash * gphash->bucket_size;
-  const GPEntry *end   = start + gphash->bucket_size;
-  volatile GPEntry *entryptr;
-
-  for(entryptr = start; entryptr < end; entryptr++)
+  while(1)
   {
-    GPEntry entry = *entryptr;
-    if(_gphash_entries_match(gpset, entry, hkey, newgpath))
-    {
-      *found = true;
-      gpath_ret = gpset->entries.b + entry.gpindex;
-      break;
-    }
-    else if(PATH_HASH_ENTRY_EMPTY(entry))
+    // Compare with entries claimed since we last looked, waiting for any that
+    // are still being written
+    for(n = *nitems; i < n; i++)
     {
-      gpath_ret = gpath_store_add_mt(gphash->gpstore, hkey, newgpath);
-      *entryptr = (GPEntry){.hkey = hkey,
-                            .gpindex = gpath_ret - gpset->entries.b};
-
-      __sync_synchronize(); // add entry before updating count
-      __sync_fetch_and_add((volatile uint8_t*)&gphash->bucket_nitems[hash], 1);
-      __sync_fetch_and_add((volatile size_t*)&gphash->num_entries, 1);
-      break;
+      while(!bitset_get_mt((volatile uint8_t*)gphash->ready, slot0+i))
+        sched_yield();
+      __sync_synchronize(); // read entry after ready bit
+      entry = start[i];
+      if(_gphash_entries_match(gpset, entry, hkey, newgpath)) {
+        *found = true;
+        return gpset->entries.b + entry.gpindex;
+      }
     }
-  }
 
-  bitlock_release(gphash->bktlocks, hash);
+    if(n == gphash->bucket_size) return NULL;
 
-  return gpath_ret;
-}
+    // Claim slot n, fails if another thread has claimed it first
+    if(__sync_bool_compare_and_swap(nitems, (uint8_t)n, (uint8_t)(n+1))) break;
+  }
 
-// Lock free search bucket for match.
-// We can traverse a full bucket without acquiring the lock first because
-// items are added but never removed from the hash. This allows us to remove
-// the use of locks and improve performance.
-// Returns NULL if not found
-static inline GPath* _find_in_bucket_mt(const GPathHash *gphash, uint64_t hash,
-                                        hkey_t hkey, GPathNew newgpath)
-{
-  const GPathSet *gpset = &gphash->gpstore->gpset;
-  const GPEntry *start = gphash->table + hash * gphash->bucket_size;
-  const GPEntry *end   = start + gphash->bucket_size;
-  volatile const GPEntry *entry;
+  gpath = gpath_store_add_mt(gphash->gpstore, hkey, newgpath);
+  start[n] = (GPEntry){.hkey = hkey, .gpindex = gpath - gpset->entries.b};
 
-  for(entry = start; entry < end; entry++)
-    if(_gphash_entries_match(gpset, *entry, hkey, newgpath))
-      return gpset->entries.b + entry->gpindex;
+  __sync_synchronize(); // write entry before ready bit
+  (void)bitset_set_mt((volatile uint8_t*)gphash->ready, slot0+n);
+  __sync_fetch_and_add((volatile size_t*)&gphash->num_entries, 1);
 
-  return NULL;
+  return gpath;
 }
 
-// Returns NULL if out of memory
-// Thread Safe: uses bucket level locks
+// Dies if out of memory
+// Thread Safe: lock-free
 GPath* gpath_hash_find_or_insert_mt(GPathHash *gphash,
                                     hkey_t hkey, GPathNew newgpath,
                                     bool *found)
 {
   ctx_assert(newgpath.seq != NULL);
   ctx_assert(gphash->table != NULL);
-  ctx_assert(hkey < PATH_HASH_UNSET);
+  ctx_assert(hkey <= PATH_HASH_MAX_HKEY);
 
   *found = false;
 
@@ -185,18 +163,7 @@ GPath* gpath_hash_find_or_insert_mt(GPathHash *gphash,
   {
     entropy = CityHash64WithSeeds((const char*)newgpath.seq, mem, entropy, i);
     hash = entropy & gphash->mask;
-
-    uint8_t bucket_fill = *(volatile uint8_t *)&gphash->bucket_nitems[hash];
-    ctx_assert2(bucket_fill <= gphash->bucket_size,
-                "hash: %zu count: %i", (size_t)hash, (int)bucket_fill);
-
-    if(bucket_fill < gphash->bucket_size)
-      gpath = _find_or_add_in_bucket_mt(gphash, hash, hkey, newgpath, found);
-    else {
-      gpath = _find_in_bucket_mt(gphash, hash, hkey, newgpath);
-      *found = (gpath != NULL);
-    }
-
+    gpath = _find_or_add_in_bucket_mt(gphash, hash, hkey, newgpath, found);
     if(gpath != NULL) return gpath;
   }
 
@@ -29,6 +29,19 @@ struct GPEntryStruct
 
 typedef struct GPEntryStruct GPEntry;
 
+//
+// Lock-free insertion
+//
+// Entries are never removed, so buckets are searched without locks. A thread
+// that does not find its path claims the next free slot in the bucket by
+// compare-and-swap on the bucket's item count, then adds the path to the
+// GPathStore, writes the entry and sets the slot's ready bit. A 10 byte entry
+// cannot be written atomically, so other threads searching the bucket wait
+// for the ready bit of a claimed slot before reading it. The count is only
+// advanced once all slots below it have been compared, so a path is only ever
+// added once.
+//
+
 typedef struct
 {
   GPathStore *const gpstore; // Add to this path store
@@ -36,10 +49,8 @@ typedef struct
   const size_t num_of_buckets; // needs to store maximum of 1<<32
   const uint8_t bucket_size; // max value 255
   const uint64_t capacity, mask; // num_of_buckets * bucket_size
-  uint8_t *const bucket_nitems; // number of items in each bucket
-  uint8_t *const bktlocks; // always cast to volatile
-  // uint8_t *const seq;
-  // size_t seq_len, seq_capacity;
+  uint8_t *const bucket_nitems; // number of slots claimed in each bucket
+  uint8_t *const ready; // one bit per slot, set once entry is written
   size_t num_entries;
 } GPathHash;
 
@@ -49,8 +60,8 @@ void gpath_hash_reset(GPathHash *phash);
 
 void gpath_hash_print_stats(const GPathHash *phash);
 
-// Returns NULL if out of memory
-// Thread Safe: uses bucket level locks
+// Dies if out of memory
+// Thread Safe: lock-free, see above
 GPath* gpath_hash_find_or_insert_mt(GPathHash *restrict phash,
                                     hkey_t hkey, GPathNew newgpath,
                                     bool *found);
@@ -41,6 +41,11 @@ void gpath_set_alloc2(GPathSet *gpset, size_t ncols,
   status("[GPathSet] Allocating for %s paths, %s colset, %s seq => %s total",
          npathstr, colmemstr, seqmemstr, totalmemstr);
 
+  ctx_assert(sizeof(GPath) == 12);
+
+  if(initpaths > GPATH_MAX_OFFSET || seq_col_mem > GPATH_MAX_OFFSET)
+    die("[GPathSet] Too many paths: offsets are limited to 40 bits");
+
   gpath_buf_alloc(&tmp.entries, initpaths);
   byte_buf_alloc(&tmp.seqs, seq_col_mem + SEQ_STORE_PADDING);
 
@@ -121,26 +126,13 @@ void gpath_set_nseen_sum_mt(const GPath *dst, GPathSet *dstset,
   }
 }
 
-// Resize buffers if needed and update internal pointers
+// Resize buffers if needed. Paths store offsets so do not need updating.
 void _check_resize(GPathSet *gpset, size_t req_num_bytes)
 {
   const size_t ncols = gpset->ncols;
-  size_t i;
-
-  GPath *old_entries = gpset->entries.b;
   size_t old_num_entries = gpset->entries.size;
   gpath_buf_capacity(&gpset->entries, gpset->entries.len+1);
 
-  if(old_entries != gpset->entries.b) {
-    // Correct all path pointers
-    for(i = 0; i < gpset->entries.len; i++) {
-      if(gpset->entries.b[i].next != NULL) {
-        gpset->entries.b[i].next = gpset->entries.b +
-                                     (gpset->entries.b[i].next - old_entries);
-      }
-    }
-  }
-
   if(old_num_entries != gpset->entries.size)
   {
     if(gpath_set_has_nseen(gpset)) {
@@ -149,18 +141,11 @@ void _check_resize(GPathSet *gpset, size_t req_num_bytes)
     }
   }
 
-  uint8_t *old_seq = gpset->seqs.b;
   byte_buf_capacity(&gpset->seqs, gpset->seqs.len+req_num_bytes+SEQ_STORE_PADDING);
 
-  if(gpset->seqs.b != old_seq) {
-    // Correct all seq pointers
-    for(i = 0; i < gpset->entries.len; i++) {
-      if(gpset->entries.b[i].seq != NULL) {
-        gpset->entries.b[i].seq = gpset->seqs.b +
-                                     (gpset->entries.b[i].seq - old_seq);
-      }
-    }
-  }
+  if(gpset->entries.size > GPATH_MAX_OFFSET ||
+     gpset->seqs.size > GPATH_MAX_OFFSET)
+    die("[GPathSet] Too many paths");
 }
 
 // Always adds new path. If newpath could be a duplicate, use gpathhash
@@ -173,14 +158,14 @@ GPath* gpath_set_add_mt(GPathSet *gpset, GPathNew newgpath)
   pkey_t pkey;
   GPath *gpath;
   uint8_t *data;
-  size_t colset_bytes = (gpset->ncols+7)/8;
+  size_t colset_bytes = gpath_colset_bytes(gpset->ncols);
   size_t junc_bytes = binary_seq_mem(newgpath.num_juncs);
   size_t nbytes = colset_bytes + junc_bytes;
 
   if(gpset->can_resize)
   {
     _check_resize(gpset, nbytes);
-    pkey = gpath_buf_add(&gpset->entries, (GPath){.seq = NULL, .num_juncs = 0});
+    pkey = gpath_buf_add(&gpset->entries, (GPath){.seq = 0, .num_juncs = 0});
     gpath = &gpset->entries.b[pkey];
     data = gpset->seqs.b + gpset->seqs.len;
     gpset->seqs.len += nbytes;
@@ -207,13 +192,13 @@ GPath* gpath_set_add_mt(GPathSet *gpset, GPathNew newgpath)
   }
 
   uint8_t *colset = data;
-  gpath->seq = data + colset_bytes;
+  gpath->seq = (data + colset_bytes) - gpset->seqs.b;
   gpath->num_juncs = newgpath.num_juncs;
   gpath->orient = newgpath.orient;
-  gpath->next = NULL;
+  gpath->next = 0;
 
   // copy seq and zero colset
-  memcpy(gpath->seq, newgpath.seq, junc_bytes);
+  memcpy(data + colset_bytes, newgpath.seq, junc_bytes);
 
   if(newgpath.colset)
     memcpy(colset, newgpath.colset, colset_bytes);
@@ -246,8 +231,8 @@ void gpath_set_zero_nseen(GPathSet *gpset)
 
 GPathNew gpath_set_get(const GPathSet *gpset, const GPath *gpath)
 {
-  GPathNew newgpath = {.seq = gpath->seq,
-                       .colset = gpath_get_colset(gpath, gpset->ncols),
+  GPathNew newgpath = {.seq = gpath_get_seq(gpset, gpath),
+                       .colset = gpath_get_colset(gpset, gpath),
                        .nseen = gpath_set_get_nseen(gpset, gpath),
                        .num_juncs = gpath->num_juncs,
                        .orient = gpath->orient};
@@ -8,8 +8,6 @@
 #include "madcrowlib/madcrow_buffer.h"
 madcrow_buffer(gpath_buf, GPathBuffer, GPath);
 
-typedef uint64_t pkey_t;
-
 // These passed around to be added
 typedef struct
 {
@@ -29,6 +27,18 @@ typedef struct
 } GPathSet;
 
 
+// Path fields that are stored as offsets into the set
+#define gpath_get_seq(gpset,gp) ((gpset)->seqs.b + (gp)->seq)
+#define gpath_get_colset(gpset,gp) \
+  (gpath_get_seq(gpset,gp) - gpath_colset_bytes((gpset)->ncols))
+#define gpath_get_next(gpset,gp) \
+  ((gp)->next ? (gpset)->entries.b + (gp)->next - 1 : NULL)
+
+#define gpath_has_colour(gpset,gp,col) bitset_get(gpath_get_colset(gpset,gp),col)
+#define gpath_set_colour(gpset,gp,col) bitset_set(gpath_get_colset(gpset,gp),col)
+#define gpath_wipe_colset(gpset,gp) \
+  memset(gpath_get_colset(gpset,gp), 0, gpath_colset_bytes((gpset)->ncols))
+
 static inline pkey_t gpset_get_pkey(const GPathSet *gpset, const GPath *gpath)
 {
   ctx_assert2(gpath >= gpset->entries.b &&
@@ -74,8 +84,33 @@ void gpath_set_zero_nseen(GPathSet *gpset);
 
 GPathNew gpath_set_get(const GPathSet *gpset, const GPath *gpath);
 
-#define gpaths_are_equal(a,b) \
-  ((a).orient == (b).orient && \
-   binary_seqs_cmp((a).seq, (a).num_juncs, (b).seq, (b).num_juncs) == 0)
+// Compare a GPath in a set with a GPathNew
+#define gpaths_are_equal(gpset,gp,b) \
+  ((gp)->orient == (b).orient && \
+   binary_seqs_cmp(gpath_get_seq(gpset,gp), (gp)->num_juncs, \
+                   (b).seq, (b).num_juncs) == 0)
+
+// Compare by orient, sequence, number of junctions
+int gpath_cmp(const GPathSet *aset, const GPath *a,
+              const GPathSet *bset, const GPath *b);
+
+// Compare two GPath* from the set passed as `arg`, for sort_r()
+static inline int gpath_cmp_void(const void *a, const void *b, void *arg) {
+  const GPathSet *gpset = (const GPathSet*)arg;
+  const GPath *gpa = *(const GPath*const*)a, *gpb = *(const GPath*const*)b;
+  return gpath_cmp(gpset, gpa, gpset, gpb);
+}
+
+// Get number of bits set
+size_t gpath_colset_bits_set(const GPathSet *gpset, const GPath *gpath);
+
+// Copy colour set bits from src to dst
+void gpath_colset_or_mt(const GPathSet *dstset, GPath *dst_gp,
+                        const GPathSet *srcset, const GPath *src_gp);
+
+// Remove from `src_gp` colours that are set in `dst_gp`
+// Returns 0 if no colours remain in src path, 1 otherwise
+uint8_t gpath_colset_rm_intersect(const GPathSet *gpset,
+                                  const GPath *dst_gp, GPath *src_gp);
 
 #endif /* GPATH_SET_H_ */
@@ -2,10 +2,90 @@
 #include "gpath_store.h"
 #include "util.h"
 
+#include "bit_array/bit_macros.h"
+
+
+//
+// GPathIndex
+//
+
+size_t gpath_index_mem(size_t graph_capacity, size_t nkmers)
+{
+  size_t nwords = roundup_bits2words64(graph_capacity);
+  size_t nblocks = (nwords + GPATH_INDEX_BLOCK - 1) / GPATH_INDEX_BLOCK;
+  return (nwords + nblocks) * sizeof(uint64_t) +
+         nkmers * sizeof(GPathFirst);
+}
+
+// Build index from an array of pkey+1 values, 0 for kmers without paths
+static void gpath_index_build(GPathIndex *idx, const GPathFirst *first,
+                              size_t capacity)
+{
+  size_t i, w, end, nkmers = 0;
+  size_t nwords = roundup_bits2words64(capacity);
+  size_t nblocks = (nwords + GPATH_INDEX_BLOCK - 1) / GPATH_INDEX_BLOCK;
+  uint64_t word;
+
+  idx->bits = ctx_calloc(nwords, sizeof(uint64_t));
+  idx->ranks = ctx_calloc(nblocks, sizeof(uint64_t));
+
+  for(w = 0; w < nwords; w++) {
+    if(w % GPATH_INDEX_BLOCK == 0) idx->ranks[w / GPATH_INDEX_BLOCK] = nkmers;
+    end = MIN2(w*64+64, capacity);
+    for(word = 0, i = w*64; i < end; i++)
+      word |= (uint64_t)(first[i].first != 0) << (i % 64);
+    idx->bits[w] = word;
+    nkmers += __builtin_popcountl(word);
+  }
+
+  idx->nkmers = nkmers;
+  idx->entries = ctx_malloc(MAX2(nkmers, 1) * sizeof(GPathFirst));
+
+  for(i = nkmers = 0; i < capacity; i++)
+    if(first[i].first) idx->entries[nkmers++] = first[i];
+}
+
+static void gpath_index_dealloc(GPathIndex *idx)
+{
+  ctx_free(idx->bits);
+  ctx_free(idx->ranks);
+  ctx_free(idx->entries);
+  memset(idx, 0, sizeof(GPathIndex));
+}
+
+// Returns pkey+1 of the first path or 0 if kmer has no paths
+static inline pkey_t gpath_index_fetch(const GPathIndex *idx, hkey_t hkey)
+{
+  size_t i, w = hkey / 64, rank;
+  uint64_t word = idx->bits[w], bit = 1UL << (hkey % 64);
+
+  if(!(word & bit)) return 0;
+
+  rank = idx->ranks[w / GPATH_INDEX_BLOCK];
+  for(i = w - w % GPATH_INDEX_BLOCK; i < w; i++)
+    rank += __builtin_popcountl(idx->bits[i]);
+  rank += __builtin_popcountl(word & (bit - 1));
+
+  return idx->entries[rank].first;
+}
+
+//
+// GPathStore
+//
+
+// Memory used by paths_all and its kmer locks
+static size_t _gpstore_first_mem(size_t graph_capacity)
+{
+  return graph_capacity * sizeof(GPathFirst) +
+         roundup_bits2bytes(graph_capacity);
+}
 
 size_t gpath_store_mem(size_t graph_capacity, bool split_linked_lists)
 {
-  return graph_capacity*sizeof(GPath*) * (split_linked_lists ? 2 : 1);
+  // Assume every kmer has paths when estimating the traversal index
+  return _gpstore_first_mem(graph_capacity) +
+         (split_linked_lists ? gpath_index_mem(graph_capacity,
+                                               graph_capacity) : 0);
 }
 
 // If num_paths != 0, we ensure at least num_paths capacity
@@ -32,28 +112,35 @@ void gpath_store_alloc(GPathStore *gpstore, size_t ncols, size_t graph_capacity,
 
   gpstore->graph_capacity = graph_capacity;
 
-  // paths_traverse is always a subset of paths_all
-  gpstore->paths_all = ctx_calloc(graph_capacity, sizeof(GPath*));
-  gpstore->paths_traverse = gpstore->paths_all;
+  // traversal paths are always a subset of paths_all
+  gpstore->paths_all = ctx_calloc(graph_capacity, sizeof(GPathFirst));
+  gpstore->kmer_locks = ctx_calloc(roundup_bits2bytes(graph_capacity), 1);
+  gpstore->use_traverse = true;
 }
 
 void gpath_store_dealloc(GPathStore *gpstore)
 {
   gpath_set_dealloc(&gpstore->gpset);
-  gpath_store_merge_read_write(gpstore);
+  gpath_index_dealloc(&gpstore->index);
   ctx_free(gpstore->paths_all);
-  if(gpstore->paths_traverse != gpstore->paths_all) ctx_free(gpstore->paths_traverse);
+  ctx_free(gpstore->kmer_locks);
   memset(gpstore, 0, sizeof(*gpstore));
 }
 
 void gpath_store_reset(GPathStore *gpstore)
 {
+  if(!gpath_store_is_alloced(gpstore)) return;
   gpath_set_reset(&gpstore->gpset);
   gpstore->num_kmers_with_paths = gpstore->num_paths = gpstore->path_bytes = 0;
-  memset(gpstore->paths_all, 0, gpstore->graph_capacity * sizeof(GPath*));
-  if(gpstore->paths_traverse != gpstore->paths_all)
-    ctx_free(gpstore->paths_traverse);
-  gpstore->paths_traverse = gpstore->paths_all;
+  gpath_index_dealloc(&gpstore->index);
+  if(gpstore->paths_all == NULL) {
+    gpstore->paths_all = ctx_calloc(gpstore->graph_capacity, sizeof(GPathFirst));
+    gpstore->kmer_locks = ctx_calloc(roundup_bits2bytes(gpstore->graph_capacity),
+                                     1);
+  }
+  else
+    memset(gpstore->paths_all, 0, gpstore->graph_capacity * sizeof(GPathFirst));
+  gpstore->use_traverse = true;
 }
 
 void gpath_store_print_stats(const GPathStore *gpstore)
@@ -70,42 +157,83 @@ void gpath_store_print_stats(const GPathStore *gpstore)
 
 void gpath_store_split_read_write(GPathStore *gpstore)
 {
-  if(gpstore->paths_traverse == gpstore->paths_all)
+  if(gpstore->paths_all != NULL && gpstore->index.bits == NULL &&
+     gpstore->use_traverse)
   {
     status("[GPathStore] Creating separate read/write GraphPath linked lists");
     if(gpstore->num_paths == 0)
     {
-      gpstore->paths_traverse = NULL;
+      gpstore->use_traverse = false;
     }
     else
     {
-      // Copy current paths over to path set to be updated
-      status("[GPathStore]   (allocating new linked lists)");
-      size_t mem = gpstore->graph_capacity * sizeof(GPath*);
-      gpstore->paths_traverse = ctx_calloc(gpstore->graph_capacity, sizeof(GPath*));
-      memcpy(gpstore->paths_traverse, gpstore->paths_all, mem);
+      // Index current paths for traversal, new paths are not added to it
+      status("[GPathStore]   (indexing current linked lists)");
+      gpath_index_build(&gpstore->index, gpstore->paths_all,
+                        gpstore->graph_capacity);
     }
   }
 }
 
 void gpath_store_merge_read_write(GPathStore *gpstore)
 {
-  if(gpstore->paths_traverse != gpstore->paths_all)
+  if(gpstore->paths_all != NULL &&
+     (gpstore->index.bits != NULL || !gpstore->use_traverse))
   {
     status("[GPathStore] Merging read/write GraphPath linked lists");
-    ctx_free(gpstore->paths_traverse); // does nothing if NULL
-    gpstore->paths_traverse = gpstore->paths_all;
+    gpath_index_dealloc(&gpstore->index);
+    gpstore->use_traverse = true;
   }
 }
 
+void gpath_store_compact(GPathStore *gpstore)
+{
+  if(gpstore->paths_all == NULL) return;
+
+  gpath_store_merge_read_write(gpstore);
+  gpath_index_build(&gpstore->index, gpstore->paths_all,
+                    gpstore->graph_capacity);
+  ctx_free(gpstore->paths_all);
+  ctx_free(gpstore->kmer_locks);
+  gpstore->paths_all = NULL;
+  gpstore->kmer_locks = NULL;
+
+  char old_mem_str[50], new_mem_str[50];
+  bytes_to_str(_gpstore_first_mem(gpstore->graph_capacity), 1, old_mem_str);
+  bytes_to_str(gpath_index_mem(gpstore->graph_capacity, gpstore->index.nkmers),
+               1, new_mem_str);
+  status("[GPathStore] Indexed first links of kmers: %s -> %s",
+         old_mem_str, new_mem_str);
+}
+
+static inline GPath* _gpstore_get(const GPathStore *gpstore, pkey_t first)
+{
+  return first ? gpstore->gpset.entries.b + first - 1 : NULL;
+}
+
+// 5 byte entries cannot be read atomically, so take the kmer lock
+static inline pkey_t _gpstore_first_mt(const GPathStore *gpstore, hkey_t hkey)
+{
+  pkey_t first;
+  bitlock_yield_acquire(gpstore->kmer_locks, hkey);
+  first = gpstore->paths_all[hkey].first;
+  bitlock_release(gpstore->kmer_locks, hkey);
+  return first;
+}
+
 GPath* gpath_store_fetch(const GPathStore *gpstore, hkey_t hkey)
 {
-  return gpstore->paths_all[hkey];
+  return _gpstore_get(gpstore, gpstore->paths_all
+                                ? _gpstore_first_mt(gpstore, hkey)
+                                : gpath_index_fetch(&gpstore->index, hkey));
 }
 
 GPath* gpath_store_fetch_traverse(const GPathStore *gpstore, hkey_t hkey)
 {
-  return gpstore->paths_traverse[hkey];
+  if(!gpstore->use_traverse) return NULL;
+  return _gpstore_get(gpstore, gpstore->index.bits
+                                ? gpath_index_fetch(&gpstore->index, hkey)
+                                : _gpstore_first_mt(gpstore, hkey));
 }
 
 // Update stats after removing a path
@@ -120,17 +248,20 @@ void gpstore_path_removal_update_stats(GPathStore *gpstore, GPath *gpath)
 // You do not need to acquire the kmer lock before calling this function
 static void _gpstore_add_to_llist_mt(GPathStore *gpstore, hkey_t hkey, GPath *gpath)
 {
+  ctx_assert2(gpstore->paths_all != NULL, "Cannot add paths once compacted");
+
+  pkey_t first, pkey = gpset_get_pkey(&gpstore->gpset, gpath) + 1;
+
   // Add to linked list
-  ctx_assert(sizeof(size_t) == sizeof(GPath*));
-  do {
-    gpath->next = *(GPath *volatile const*)&gpstore->paths_all[hkey];
-  }
-  while(!__sync_bool_compare_and_swap((volatile size_t*)&gpstore->paths_all[hkey],
-                                      (size_t)gpath->next, (size_t)gpath));
+  bitlock_yield_acquire(gpstore->kmer_locks, hkey);
+  first = gpstore->paths_all[hkey].first;
+  gpath->next = first;
+  gpstore->paths_all[hkey].first = pkey;
+  bitlock_release(gpstore->kmer_locks, hkey);
 
   // Update stats
   size_t nbytes = binary_seq_mem(gpath->num_juncs);
-  size_t new_kmer = (gpath->next == NULL ? 1 : 0);
+  size_t new_kmer = (first == 0 ? 1 : 0);
   __sync_fetch_and_add((volatile uint64_t*)&gpstore->num_kmers_with_paths, new_kmer);
   __sync_fetch_and_add((volatile uint64_t*)&gpstore->num_paths, 1);
   __sync_fetch_and_add((volatile uint64_t*)&gpstore->path_bytes, nbytes);
@@ -140,8 +271,8 @@ static void _gpstore_add_to_llist_mt(GPathStore *gpstore, hkey_t hkey, GPath *gp
 GPath* gpstore_find(const GPathStore *gpstore, hkey_t hkey, GPathNew find)
 {
   GPath *gpath = gpath_store_fetch(gpstore, hkey);
-  for(; gpath != NULL; gpath = gpath->next)
-    if(gpaths_are_equal(*gpath, find))
+  for(; gpath != NULL; gpath = gpath_store_next(gpstore, gpath))
+    if(gpaths_are_equal(&gpstore->gpset, gpath, find))
       return gpath;
   return NULL;
 }
@@ -3,16 +3,49 @@
 
 #include "gpath_set.h"
 
+// First path of a kmer as pkey+1 (0 if none), packed into 5 bytes
+struct GPathFirstStruct
+{
+  pkey_t first:40;
+} __attribute__((packed));
+
+typedef struct GPathFirstStruct GPathFirst;
+
+// Read only map of {[hkey] -> [first path pkey+1]} for kmers with paths.
+// A bit is set for each kmer with paths, the rank of that bit is the index
+// of its 5 byte entry. Cumulative counts every GPATH_INDEX_BLOCK words make
+// rank a lookup and at most 7 popcounts. Uses 1.125 bits per kmer plus
+// 5 bytes per kmer with paths, compared to 5 bytes per kmer in a dense array.
+#define GPATH_INDEX_BLOCK 8
+
+typedef struct
+{
+  uint64_t *bits, *ranks;
+  GPathFirst *entries;
+  size_t nkmers;
+} GPathIndex;
+
 // GPathStore is a map from {[kmer/hkey] -> [GPath linked list]}
+// While paths can be added, the first path of each kmer is stored in the
+// 5 byte entries of paths_all, which are read and written under a per-kmer
+// bitlock (5 bytes + 1 bit per kmer). gpath_store_split_read_write() makes a
+// read only GPathIndex of the lists to traverse, and gpath_store_compact()
+// replaces paths_all with one once we are done adding paths.
 typedef struct
 {
   // num_paths may not match gpset->num_paths if we have dropped paths
   uint64_t num_kmers_with_paths, num_paths, path_bytes;
   uint64_t graph_capacity;
   GPathSet gpset;
-  GPath **paths_all, **paths_traverse;
+  GPathFirst *paths_all; // NULL once compacted
+  uint8_t *kmer_locks; // guard paths_all entries, NULL once compacted
+  GPathIndex index; // read only index of traversal paths
+  bool use_traverse; // false if traversal should not pick up paths
 } GPathStore;
 
+// Memory used by an index over `graph_capacity` kmers, `nkmers` with paths
+size_t gpath_index_mem(size_t graph_capacity, size_t nkmers);
+
 size_t gpath_store_mem(size_t graph_capacity, bool split_linked_lists);
 
 // If num_paths != 0, we ensure at least num_paths capacity
@@ -31,12 +64,20 @@ void gpath_store_print_stats(const GPathStore *gpstore);
 void gpath_store_split_read_write(GPathStore *gpstore);
 void gpath_store_merge_read_write(GPathStore *gpstore);
 
+// Replace the array of first paths with a read only index, once all paths
+// have been added. Paths cannot be added afterwards.
+void gpath_store_compact(GPathStore *gpstore);
+
 // Traversal paths are a subset of all paths
-#define gpath_store_safe_fetch(gpstore,hkey) ((gpstore)->paths_all ? gpath_store_fetch(gpstore,hkey) : NULL)
-#define gpath_store_use_traverse(gpstore) ((gpstore)->paths_traverse != NULL)
+#define gpath_store_is_alloced(gpstore) ((gpstore)->graph_capacity > 0)
+#define gpath_store_safe_fetch(gpstore,hkey) (gpath_store_is_alloced(gpstore) ? gpath_store_fetch(gpstore,hkey) : NULL)
+#define gpath_store_use_traverse(gpstore) ((gpstore)->use_traverse)
 GPath* gpath_store_fetch(const GPathStore *gpstore, hkey_t hkey);
 GPath* gpath_store_fetch_traverse(const GPathStore *gpstore, hkey_t hkey);
 
+// Next path in the linked list of a kmer
+#define gpath_store_next(gpstore,gpath) gpath_get_next(&(gpstore)->gpset,gpath)
+
 GPath* gpstore_find(const GPathStore *gpstore, hkey_t hkey, GPathNew find);
 
 // Always adds
@@ -2,6 +2,8 @@
 #include "gpath_subset.h"
 #include "binary_seq.h"
 
+#include "sort_r/sort_r.h"
+
 void gpath_subset_alloc(GPathSubset *subset)
 {
   gpath_ptr_buf_alloc(&subset->list, 16);
@@ -34,7 +36,8 @@ void gpath_subset_add(GPathSubset *subset, GPath *path)
 
 void gpath_subset_sort(GPathSubset *subset)
 {
-  qsort(subset->list.b, subset->list.len, sizeof(GPath*), gpath_cmp_void);
+  sort_r(subset->list.b, subset->list.len, sizeof(GPath*),
+         gpath_cmp_void, subset->gpset);
   subset->is_sorted = true;
 }
 
@@ -49,7 +52,7 @@ void gpath_subset_load_llist(GPathSubset *subset, GPath *first)
        gpath_set_get_nseen(subset->gpset, first)) {
       gpath_ptr_buf_add(&subset->list, first);
     }
-    first = first->next;
+    first = gpath_get_next(subset->gpset, first);
   }
 }
 
@@ -68,10 +71,11 @@ void gpath_subset_load_set(GPathSubset *subset)
 void gpath_subset_update_linkedlist(GPathSubset *subset)
 {
   if(subset->list.len == 0) return;
+  GPath **list = subset->list.b;
   size_t i;
   for(i = 0; i+1 < subset->list.len; i++)
-    subset->list.b[i]->next = subset->list.b[i+1];
-  subset->list.b[subset->list.len-1]->next = NULL;
+    list[i]->next = gpset_get_pkey(subset->gpset, list[i+1]) + 1;
+  list[subset->list.len-1]->next = 0;
 }
 
 /**
@@ -83,13 +87,14 @@ void gpath_subset_rmdup(GPathSubset *subset)
   if(subset->list.len <= 1) return;
   if(!subset->is_sorted) gpath_subset_sort(subset);
 
-  size_t i, j, len = subset->list.len, ncols = subset->gpset->ncols;
+  const GPathSet *gpset = subset->gpset;
+  size_t i, j, len = subset->list.len;
   GPath **list = subset->list.b;
 
   for(i = 0, j = 1; j < len; j++) {
-    if(gpath_cmp(list[i], list[j]) == 0)
+    if(gpath_cmp(gpset, list[i], gpset, list[j]) == 0)
     {
-      gpath_colset_or_mt(list[i], list[j], ncols);
+      gpath_colset_or_mt(gpset, list[i], gpset, list[j]);
       gpath_set_nseen_sum_mt(list[i], subset->gpset,
                              list[j], subset->gpset);
     }
@@ -112,7 +117,8 @@ void gpath_subset_rmsubstr(GPathSubset *subset)
   if(subset->list.len <= 1) return;
   if(!subset->is_sorted) gpath_subset_sort(subset);
 
-  size_t i, j, len = subset->list.len, min_juncs, ncols = subset->gpset->ncols;
+  const GPathSet *gpset = subset->gpset;
+  size_t i, j, len = subset->list.len, min_juncs;
   GPath **list = subset->list.b;
 
   // Work backwards to remove colours from subsumed paths
@@ -129,15 +135,15 @@ void gpath_subset_rmsubstr(GPathSubset *subset)
           // or orientations don't match
           if(list[i]->num_juncs < list[j]->num_juncs ||
              list[i]->orient != list[j]->orient ||
-             binary_seqs_cmp(list[i]->seq, min_juncs,
-                             list[j]->seq, min_juncs) != 0)
+             binary_seqs_cmp(gpath_get_seq(gpset, list[i]), min_juncs,
+                             gpath_get_seq(gpset, list[j]), min_juncs) != 0)
           {
             break;
           }
           else if(list[i]->num_juncs == list[j]->num_juncs)
           {
             // paths match, steal colours from j and remove it
-            gpath_colset_or_mt(list[i], list[j], ncols);
+            gpath_colset_or_mt(gpset, list[i], gpset, list[j]);
             gpath_set_nseen_sum_mt(list[i], subset->gpset,
                                    list[j], subset->gpset);
             list[j] = NULL;
@@ -146,7 +152,7 @@ void gpath_subset_rmsubstr(GPathSubset *subset)
           {
             // path j is substring of i, remove colours from j that are in i
             // then remove path j only if all colours removed
-            if(gpath_colset_rm_intersect(list[i], list[j], ncols) == 0)
+            if(gpath_colset_rm_intersect(gpset, list[i], list[j]) == 0)
               list[j] = NULL;
           }
         }
@@ -173,7 +179,7 @@ void gpath_subset_merge(GPathSubset *dst, GPathSubset *src)
   if(!dst->is_sorted) gpath_subset_sort(dst);
   if(!src->is_sorted) gpath_subset_sort(src);
 
-  size_t i = 0, j = 0, ncols = dst->gpset->ncols;
+  size_t i = 0, j = 0;
   int cmp;
 
   GPath **dstlist = dst->list.b;
@@ -183,13 +189,13 @@ void gpath_subset_merge(GPathSubset *dst, GPathSubset *src)
 
   while(i < dst->list.len && j < src->list.len)
   {
-    cmp = gpath_cmp(dstlist[i], srclist[j]);
+    cmp = gpath_cmp(dst->gpset, dstlist[i], src->gpset, srclist[j]);
 
     if(cmp < 0) i++;
     else if(cmp > 0) j++;
     else {
       // paths match, steal colours and remove it
-      gpath_colset_or_mt(dstlist[i], srclist[j], ncols);
+      gpath_colset_or_mt(dst->gpset, dstlist[i], src->gpset, srclist[j]);
       gpath_set_nseen_sum_mt(dstlist[i], dst->gpset,
                              srclist[j], src->gpset);
       srclist[j] = NULL;
@@ -149,6 +149,43 @@ static void test_bkmer_first_last_nuc()
   }
 }
 
+static void test_bkmer_roll_hash()
+{
+  test_status("Testing roll_hash_shift()");
+
+  char seq[200];
+  size_t k, i, len = sizeof(seq)-1;
+  BinaryKmer bkmer, bkey;
+  RollHasher roller;
+  RollHash rhash, rhash2;
+  Nucleotide nuc;
+
+  for(k = MIN_KMER_SIZE; k <= MAX_KMER_SIZE; k+=2)
+  {
+    dna_rand_str(seq, len);
+    roll_hash_init(&roller, k, NUM_BKMER_WORDS);
+    bkmer = binary_kmer_from_str(seq, k);
+    bkmer = binary_kmer_right_shift_one_base(bkmer);
+    rhash = binary_kmer_roll_hash(bkmer, k);
+
+    for(i = k-1; i < len; i++) {
+      nuc = dna_char_to_nuc(seq[i]);
+      roll_hash_shift(&roller, &rhash, binary_kmer_first_nuc(bkmer, k), nuc);
+      bkmer = binary_kmer_left_shift_add(bkmer, k, nuc);
+
+      // Rolled hash matches hashing from scratch
+      rhash2 = binary_kmer_roll_hash(bkmer, k);
+      TASSERT(rhash.fw == rhash2.fw);
+      TASSERT(rhash.rc == rhash2.rc);
+
+      // Hash of the key is the same from either orientation
+      bkey = binary_kmer_get_key(bkmer, k);
+      TASSERT(binary_kmer_roll_hash_key(bkmer, bkey, rhash) ==
+              roll_hash_words(bkey.b, NUM_BKMER_WORDS));
+    }
+  }
+}
+
 void test_bkmer_functions()
 {
   TASSERT(sizeof(BinaryKmer) == NUM_BKMER_WORDS * 8);
@@ -156,5 +193,6 @@ void test_bkmer_functions()
   test_bkmer_revcmp();
   test_bkmer_shifts();
   test_bkmer_first_last_nuc();
+  test_bkmer_roll_hash();
   // TODO: equal, less than, cmp
 }
@@ -66,7 +66,7 @@ static void test_bubbles(dBGraph *graph, const char **seqs, size_t nseqs,
                          const char *flank5p, const char *flank3p,
                          const char **alleles, size_t nalleles)
 {
-  db_graph_reset(graph);
+  db_graph_reset(graph, 1);
 
   TASSERT(graph->num_of_cols >= nseqs);
 
@@ -3,8 +3,14 @@
 #include "db_graph.h"
 #include "db_node.h"
 #include "build_graph.h"
+#include "build_graph_parts.h"
+#include "graph_image.h"
+#include "graph_writer.h"
+#include "graphs_load.h"
+#include "graph_search.h"
 
 #include <math.h>
+#include <unistd.h> // close(), unlink()
 
 static Covg kmer_get_covg(const char *kmer, const dBGraph *db_graph)
 {
@@ -12,6 +18,663 @@ static Covg kmer_get_covg(const char *kmer, const dBGraph *db_graph)
   return db_node_get_covg(db_graph, node.key, 0);
 }
 
+// Check a kmer from `expect` is in `graph` with the same coverages and edges
+static void _check_same_kmer(hkey_t hkey, const dBGraph *expect,
+                             const dBGraph *graph)
+{
+  size_t col;
+  BinaryKmer bkmer = db_node_get_bkey(expect, hkey);
+  dBNode node = db_graph_find(graph, bkmer);
+  TASSERT(node.key != HASH_NOT_FOUND);
+  if(node.key == HASH_NOT_FOUND) return;
+  for(col = 0; col < expect->num_of_cols; col++) {
+    TASSERT(db_node_get_covg(graph, node.key, col) ==
+            db_node_get_covg(expect, hkey, col));
+    TASSERT(db_node_get_edges(graph, node.key, col) ==
+            db_node_get_edges(expect, hkey, col));
+    if(graph->node_in_cols != NULL) {
+      TASSERT(db_node_has_col(graph, node.key, col) ==
+              (db_node_get_covg(expect, hkey, col) > 0));
+    }
+  }
+}
+
+static void _check_graphs_equal(const dBGraph *expect, const dBGraph *graph)
+{
+  TASSERT(hash_table_nkmers(&graph->ht) == hash_table_nkmers(&expect->ht));
+  HASH_ITERATE(&expect->ht, _check_same_kmer, expect, graph);
+}
+
+// Create an empty temporary file, `path` is a mkstemp() template
+static bool _create_tmp_file(char *path)
+{
+  int fd = mkstemp(path);
+  TASSERT(fd >= 0);
+  if(fd < 0) return false;
+  close(fd);
+  return true;
+}
+
+// Save a sorted graph file (v6 or v7) to a new temporary file
+static bool _save_graph_tmp(const dBGraph *graph, char *path,
+                            uint32_t version, uint32_t block_kmers)
+{
+  if(!_create_tmp_file(path)) return false;
+
+  FileFilter fltr;
+  memset(&fltr, 0, sizeof(fltr));
+  file_filter_create_direct(&fltr, graph->num_of_cols, graph->num_of_cols);
+  GraphFileHeader *hdr = graph_writer_mkhdr(graph, &fltr, graph->num_of_cols);
+  hdr->version = version;
+  hdr->block_kmers = block_kmers;
+  graph_writer_save(path, graph, hdr, true, &fltr);
+  graph_header_free(hdr);
+  file_filter_close(&fltr);
+  return true;
+}
+
+// Load a graph file on top of `graph`
+static void _load_graph_file(const char *path, dBGraph *graph)
+{
+  GraphFileReader gfile;
+  memset(&gfile, 0, sizeof(gfile));
+  graph_file_open(&gfile, path);
+  graph_load(&gfile, graph_loading_prefs(graph), NULL);
+  graph_file_close(&gfile);
+}
+
+// Images keep the hash table, so kmers are at the same position
+static void _check_same_hkey(hkey_t hkey, const dBGraph *graph,
+                             const dBGraph *image)
+{
+  BinaryKmer bkmer = db_node_get_bkey(graph, hkey);
+  TASSERT(db_graph_find(image, bkmer).key == hkey);
+}
+
+static void test_graph_image()
+{
+  test_status("Testing saving and mapping graph images in graph_image.c");
+
+  dBGraph graph, image;
+  size_t kmer_size = 19, ncols = 2;
+
+  db_graph_alloc(&graph, kmer_size, ncols, ncols, 1024,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS);
+
+  _tests_add_to_graph(&graph, "CTACGATGTATGCTTAGCTGTTCCG", 0);
+  _tests_add_to_graph(&graph, "CTACGATGTATGCTTAGCTAATGAT", 1);
+  _tests_add_to_graph(&graph, "TAGAACGTTCCCTACACGTCCTATG", 1);
+  strbuf_set(&graph.ginfo[1].sample_name, "sample1");
+  graph.ginfo[1].total_sequence = 50;
+
+  char path[] = "/tmp/ctx_image_test.XXXXXX";
+  if(!_create_tmp_file(path)) { db_graph_dealloc(&graph); return; }
+
+  graph_image_save(path, &graph, NULL);
+  TASSERT(graph_image_is_image(path));
+  graph_image_load(path, &image);
+
+  TASSERT(image.kmer_size == kmer_size);
+  TASSERT(image.num_of_cols == ncols);
+  TASSERT(image.num_edge_cols == ncols);
+  TASSERT(strcmp(image.ginfo[1].sample_name.b, "sample1") == 0);
+  TASSERT(image.ginfo[1].total_sequence == 50);
+
+  // Every kmer should be found at the same position with the same data
+  _check_graphs_equal(&graph, &image);
+  HASH_ITERATE(&graph.ht, _check_same_hkey, &graph, &image);
+
+  dBNode node = db_graph_find_str(&image, "GCTTAGCTAATGATAAAAA");
+  TASSERT(node.key == HASH_NOT_FOUND);
+
+  db_graph_dealloc(&image);
+  db_graph_dealloc(&graph);
+  unlink(path);
+}
+
+static void _check_search_kmer(hkey_t hkey, const dBGraph *graph,
+                               GraphFileSearch *gs)
+{
+  size_t col;
+  Covg covgs[graph->num_of_cols];
+  Edges edges[graph->num_of_cols];
+  BinaryKmer bkmer = db_node_get_bkey(graph, hkey);
+  TASSERT(graph_search_find(gs, bkmer, covgs, edges));
+  for(col = 0; col < graph->num_of_cols; col++) {
+    TASSERT(covgs[col] == db_node_get_covg(graph, hkey, col));
+    TASSERT(edges[col] == db_node_get_edges(graph, hkey, col));
+  }
+}
+
+static void test_graph_blocked()
+{
+  test_status("Testing compressed graph files (.ctx v7) in graph_block.c");
+
+  dBGraph graph, loaded;
+  size_t kmer_size = 19, ncols = 2;
+
+  db_graph_alloc(&graph, kmer_size, ncols, ncols, 1024,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS);
+  db_graph_alloc(&loaded, kmer_size, ncols, ncols, 1024,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS);
+
+  _tests_add_to_graph(&graph, "CTACGATGTATGCTTAGCTGTTCCG", 0);
+  _tests_add_to_graph(&graph, "CTACGATGTATGCTTAGCTAATGAT", 1);
+  _tests_add_to_graph(&graph, "TAGAACGTTCCCTACACGTCCTATG", 1);
+
+  // Small blocks so we have more than one
+  char path[] = "/tmp/ctx_blocked_test.XXXXXX";
+  if(!_save_graph_tmp(&graph, path, CTX_GRAPH_FILEFORMAT_BLOCKED, 5)) {
+    db_graph_dealloc(&graph);
+    db_graph_dealloc(&loaded);
+    return;
+  }
+
+  GraphFileReader gfile;
+  memset(&gfile, 0, sizeof(gfile));
+  graph_file_open(&gfile, path);
+  TASSERT(gfile.hdr.version == CTX_GRAPH_FILEFORMAT_BLOCKED);
+  TASSERT(gfile.num_of_kmers == (int64_t)hash_table_nkmers(&graph.ht));
+  TASSERT(gfile.blkidx != NULL && gfile.blkidx->nblocks > 1);
+
+  graph_load(&gfile, graph_loading_prefs(&loaded), NULL);
+  _check_graphs_equal(&graph, &loaded);
+
+  GraphFileSearch *gs = graph_search_new(&gfile);
+  HASH_ITERATE(&graph.ht, _check_search_kmer, &graph, gs);
+
+  BinaryKmer bkmer = binary_kmer_from_str("GCTTAGCTAATGATAAAAA", kmer_size);
+  bkmer = binary_kmer_get_key(bkmer, kmer_size);
+  Covg covgs[ncols];
+  Edges edges[ncols];
+  TASSERT(!graph_search_find(gs, bkmer, covgs, edges));
+
+  graph_search_destroy(gs);
+  graph_file_close(&gfile);
+  db_graph_dealloc(&loaded);
+  db_graph_dealloc(&graph);
+  unlink(path);
+}
+
+static void test_graph_merge_sorted()
+{
+  test_status("Testing merging sorted graph files in graph_writer.c");
+
+  dBGraph a, b, expect, merged;
+  size_t i, c, kmer_size = 19, ncols = 2;
+
+  db_graph_alloc(&a, kmer_size, ncols, ncols, 1024,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS);
+  db_graph_alloc(&b, kmer_size, ncols, ncols, 1024,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS);
+  db_graph_alloc(&expect, kmer_size, ncols, ncols, 1024,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS);
+  db_graph_alloc(&merged, kmer_size, ncols, ncols, 1024,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS);
+
+  // Graphs share some kmers
+  _tests_add_to_graph(&a, "CTACGATGTATGCTTAGCTGTTCCG", 0);
+  _tests_add_to_graph(&a, "TAGAACGTTCCCTACACGTCCTATG", 1);
+  _tests_add_to_graph(&b, "CTACGATGTATGCTTAGCTAATGAT", 0);
+  _tests_add_to_graph(&b, "TAGAACGTTCCCTACACGTCCTATG", 1);
+
+  // Second file is compressed (v7)
+  char paths[3][32];
+  strcpy(paths[0], "/tmp/ctx_merge_test.XXXXXX");
+  strcpy(paths[1], "/tmp/ctx_merge_test.XXXXXX");
+  strcpy(paths[2], "/tmp/ctx_merge_test.XXXXXX");
+  _save_graph_tmp(&a, paths[0], CTX_GRAPH_FILEFORMAT, 0);
+  _save_graph_tmp(&b, paths[1], CTX_GRAPH_FILEFORMAT_BLOCKED, 4);
+  _create_tmp_file(paths[2]);
+
+  for(i = 0; i < 2; i++) _load_graph_file(paths[i], &expect);
+
+  GraphFileReader gfiles[2];
+  memset(gfiles, 0, sizeof(gfiles));
+
+  // Write the merged graph uncompressed (v6) then compressed (v7)
+  for(c = 0; c < 2; c++)
+  {
+    for(i = 0; i < 2; i++) graph_file_open(&gfiles[i], paths[i]);
+    uint64_t nkmers = graph_writer_merge_sorted_mkhdr(paths[2], gfiles, 2,
+                                                      c, c ? 4 : 0);
+    for(i = 0; i < 2; i++) graph_file_close(&gfiles[i]);
+
+    TASSERT(nkmers == hash_table_nkmers(&expect.ht));
+
+    graph_file_open(&gfiles[0], paths[2]);
+    TASSERT(gfiles[0].hdr.version == (c ? CTX_GRAPH_FILEFORMAT_BLOCKED
+                                        : CTX_GRAPH_FILEFORMAT));
+    TASSERT(!c || gfiles[0].hdr.block_kmers == 4);
+    graph_file_close(&gfiles[0]);
+
+    db_graph_reset(&merged, 1);
+    _load_graph_file(paths[2], &merged);
+    _check_graphs_equal(&expect, &merged);
+  }
+
+  for(i = 0; i < 3; i++) unlink(paths[i]);
+  db_graph_dealloc(&merged);
+  db_graph_dealloc(&expect);
+  db_graph_dealloc(&b);
+  db_graph_dealloc(&a);
+}
+
+static void test_build_graph_min_count()
+{
+  test_status("Testing --min-count kmer bloom filter in build_graph.c");
+
+  dBGraph graph;
+  KmerBloom bloom;
+  size_t i, kmer_size = 19, ncols = 1;
+  const char seq[] = "CTACGATGTATGCTTAGCTGTTCCG";
+  const char err[] = "CTACGATGTATGCTAAGCTGTTCCG"; // seq with an error
+
+  db_graph_alloc(&graph, kmer_size, ncols, ncols, 1024,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS);
+  kmer_bloom_alloc(&bloom, 1<<12, 3);
+
+  // Kmers are only added on the third time they are seen
+  for(i = 0; i < 2; i++)
+    build_graph_from_str_bloom_mt(&graph, 0, seq, strlen(seq), &bloom);
+  TASSERT(hash_table_nkmers(&graph.ht) == 0);
+
+  build_graph_from_str_bloom_mt(&graph, 0, err, strlen(err), &bloom);
+  build_graph_from_str_bloom_mt(&graph, 0, seq, strlen(seq), &bloom);
+  TASSERT(hash_table_nkmers(&graph.ht) == strlen(seq)+1-kmer_size);
+
+  // Coverage includes the times we saw kmers before adding them
+  TASSERT(kmer_get_covg("CTACGATGTATGCTTAGCT", &graph) == 3);
+  TASSERT(kmer_get_covg("TACGATGTATGCTTAGCTG", &graph) == 3);
+  TASSERT(kmer_get_covg("GATGTATGCTTAGCTGTTC", &graph) == 3);
+
+  // Kmers already in the graph are updated straight away
+  build_graph_from_str_bloom_mt(&graph, 0, seq, strlen(seq), &bloom);
+  TASSERT(kmer_get_covg("CTACGATGTATGCTTAGCT", &graph) == 4);
+  TASSERT(hash_table_nkmers(&graph.ht) == strlen(seq)+1-kmer_size);
+
+  kmer_bloom_dealloc(&bloom);
+  db_graph_dealloc(&graph);
+}
+
+static void test_kmer_hll_estimate()
+{
+  test_status("Testing estimating kmers with HyperLogLog in build_graph.c");
+
+  dBGraph graph;
+  KmerHLL hll;
+  size_t i, kmer_size = 31, ncols = 1, seqlen = 20000;
+  char *seq = ctx_malloc(seqlen+1);
+  char path[32] = "/tmp/ctx_hll_test.XXXXXX";
+
+  db_graph_alloc(&graph, kmer_size, ncols, ncols, 1<<15,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS);
+  kmer_hll_alloc(&hll, KMER_HLL_BITS);
+
+  for(i = 0; i < seqlen; i++) seq[i] = "ACGT"[rand() & 3];
+  seq[seqlen] = '\0';
+  build_graph_from_str_mt(&graph, 0, seq, seqlen, false);
+
+  // Kmers seen twice are only counted once
+  for(i = 0; i+kmer_size <= seqlen; i++) {
+    BinaryKmer bkmer = binary_kmer_from_str(seq+i, kmer_size);
+    kmer_hll_add(&hll, binary_kmer_get_key(bkmer, kmer_size));
+    kmer_hll_add(&hll, binary_kmer_get_key(bkmer, kmer_size));
+  }
+
+  double nkmers = hash_table_nkmers(&graph.ht);
+  TASSERT(fabs(kmer_hll_estimate(&hll) - nkmers) < nkmers * 0.03);
+
+  // Estimate from a sequence file that is read to the end
+  _create_tmp_file(path);
+  FILE *fh = fopen(path, "w");
+  fprintf(fh, ">seq\n%s\n", seq);
+  fclose(fh);
+
+  BuildGraphTask task;
+  memset(&task, 0, sizeof(task));
+  task.prefs = SEQ_LOADING_PREFS_INIT;
+  task.files.file1 = seq_open(path);
+  TASSERT(task.files.file1 != NULL);
+
+  size_t est = build_graph_estimate_nkmers(&task, 1, kmer_size, 1<<20, 1);
+  TASSERT(fabs(est - nkmers) < nkmers * 0.03);
+
+  seq_close(task.files.file1);
+  unlink(path);
+  kmer_hll_dealloc(&hll);
+  db_graph_dealloc(&graph);
+  ctx_free(seq);
+}
+
+typedef struct {
+  dBGraph *graph;
+  const char *seq;
+  size_t len;
+} GrowTestJob;
+
+static void _grow_test_job(void *arg, size_t threadid)
+{
+  (void)threadid;
+  GrowTestJob *job = (GrowTestJob*)arg;
+  build_graph_from_str_mt(job->graph, 0, job->seq, job->len, false);
+}
+
+static void test_build_graph_grow()
+{
+  test_status("Testing growing the hash table in build_graph.c");
+
+  dBGraph graph, expect;
+  size_t i, kmer_size = 31, ncols = 1, seqlen = 6000, nthreads = 4;
+  char *seq = ctx_malloc(seqlen+1);
+  GrowTestJob jobs[4];
+
+  db_graph_alloc(&graph, kmer_size, ncols, ncols, 1024,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS);
+  db_graph_alloc(&expect, kmer_size, ncols, ncols, 1<<15,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS);
+  db_graph_set_growable(&graph, nthreads);
+  uint64_t capacity = graph.ht.capacity;
+
+  for(i = 0; i < seqlen; i++) seq[i] = "ACGT"[rand() & 3];
+  seq[seqlen] = '\0';
+
+  // Load overlapping pieces of the sequence in parallel, then some again
+  for(i = 0; i < nthreads; i++) {
+    jobs[i].graph = &graph;
+    jobs[i].seq = seq + i * seqlen / nthreads;
+    jobs[i].len = seqlen / nthreads + (i+1 < nthreads ? kmer_size : 0);
+    build_graph_from_str_mt(&expect, 0, jobs[i].seq, jobs[i].len, false);
+    if(i < nthreads/2)
+      build_graph_from_str_mt(&expect, 0, jobs[i].seq, jobs[i].len, false);
+  }
+
+  util_run_threads(jobs, nthreads, sizeof(jobs[0]), nthreads, _grow_test_job);
+  util_run_threads(jobs, nthreads/2, sizeof(jobs[0]), nthreads, _grow_test_job);
+
+  TASSERT(graph.ht.capacity > capacity);
+  _check_graphs_equal(&expect, &graph);
+
+  // Growing directly keeps all nodes
+  capacity = graph.ht.capacity;
+  db_graph_grow(&graph, 2);
+  TASSERT(graph.ht.capacity > capacity);
+  _check_graphs_equal(&expect, &graph);
+
+  db_graph_dealloc(&expect);
+  db_graph_dealloc(&graph);
+  ctx_free(seq);
+}
+
+// Kmers after one that does not fit must not be reported as already seen
+static void test_build_graph_grow_counts()
+{
+  test_status("Testing novel kmer counts whilst growing the hash table");
+
+  dBGraph graph, expect;
+  size_t i, l, pos, kmer_size = 31, ncols = 1, seqlen = 3000, readlen = 100;
+  size_t nkmers, nseen, expect_nseen;
+  char *seq = ctx_malloc(seqlen+1);
+
+  for(i = 0; i < seqlen; i++) seq[i] = "ACGT"[rand() & 3];
+  seq[seqlen] = '\0';
+
+  // With and without bucket locks
+  for(l = 0; l < 2; l++)
+  {
+    db_graph_alloc(&graph, kmer_size, ncols, ncols, 1024,
+                   DBG_ALLOC_EDGES | DBG_ALLOC_COVGS |
+                   (l ? DBG_ALLOC_BKTLOCKS : 0));
+    db_graph_alloc(&expect, kmer_size, ncols, ncols, 1<<14,
+                   DBG_ALLOC_EDGES | DBG_ALLOC_COVGS);
+    db_graph_set_growable(&graph, 2);
+    uint64_t capacity = graph.ht.capacity;
+
+    // Overlapping reads, so batches mix new kmers with kmers already seen
+    nkmers = nseen = expect_nseen = 0;
+    for(i = 0; i < 400; i++) {
+      pos = rand() % (seqlen - readlen);
+      nseen += build_graph_from_str_mt(&graph, 0, seq+pos, readlen, false);
+      expect_nseen += build_graph_from_str_mt(&expect, 0, seq+pos, readlen,
+                                              false);
+      nkmers += readlen - kmer_size + 1;
+    }
+
+    TASSERT(graph.ht.capacity > capacity);
+    TASSERT2(nseen == expect_nseen, "%zu vs %zu", nseen, expect_nseen);
+    TASSERT(nkmers - nseen == graph.ht.num_kmers);
+    _check_graphs_equal(&expect, &graph);
+
+    db_graph_dealloc(&expect);
+    db_graph_dealloc(&graph);
+  }
+
+  ctx_free(seq);
+}
+
+static void test_build_graph_grow_min_count()
+{
+  test_status("Testing growing the hash table with --min-count in build_graph.c");
+
+  dBGraph graph, expect;
+  KmerBloom bloom;
+  size_t i, kmer_size = 31, ncols = 1, seqlen = 3000;
+  char *seq = ctx_malloc(seqlen+1);
+
+  db_graph_alloc(&graph, kmer_size, ncols, ncols, 1024,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS);
+  db_graph_alloc(&expect, kmer_size, ncols, ncols, 1<<14,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS);
+  db_graph_set_growable(&graph, 2);
+  // Large enough that a false positive over-counting a kmer is very unlikely
+  kmer_bloom_alloc(&bloom, 1<<24, 2);
+  uint64_t capacity = graph.ht.capacity;
+
+  // Fixed seed so that the same sequence is tested on every run
+  unsigned int seed = 7229;
+  for(i = 0; i < seqlen; i++) seq[i] = "ACGT"[rand_r(&seed) & 3];
+  seq[seqlen] = '\0';
+
+  // Every kmer is added on the second pass, filling the table many times.
+  // Kmers that did not fit must not be counted again when retried
+  for(i = 0; i < 2; i++) {
+    build_graph_from_str_mt(&expect, 0, seq, seqlen, false);
+    build_graph_from_str_bloom_mt(&graph, 0, seq, seqlen, &bloom);
+  }
+
+  TASSERT(graph.ht.capacity > capacity);
+  _check_graphs_equal(&expect, &graph);
+
+  kmer_bloom_dealloc(&bloom);
+  db_graph_dealloc(&expect);
+  db_graph_dealloc(&graph);
+  ctx_free(seq);
+}
+
+static void test_covg_buffer()
+{
+  test_status("Testing buffered coverage updates in covg_buffer.c");
+
+  dBGraph graph, expect;
+  CovgBuffer bufs[2];
+  size_t i, kmer_size = 21, ncols = 1, seqlen = 5000, readlen = 100;
+  char *seq = ctx_malloc(seqlen+1);
+
+  db_graph_alloc(&graph, kmer_size, ncols, ncols, 1<<14,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS | DBG_ALLOC_NODE_IN_COL);
+  db_graph_alloc(&expect, kmer_size, ncols, ncols, 1<<14,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS | DBG_ALLOC_NODE_IN_COL);
+  covg_buffer_alloc(&bufs[0], &graph);
+  covg_buffer_alloc(&bufs[1], &graph);
+
+  // Repeat with some random sequence, so entries are evicted
+  for(i = 0; i < seqlen; i++)
+    seq[i] = (i % 2000 < 1000) ? "ACGTTGCAGC"[i % 10] : "ACGT"[rand() & 3];
+  seq[seqlen] = '\0';
+
+  for(i = 0; i + readlen <= seqlen; i += 10) {
+    build_graph_from_str_mt(&expect, 0, seq+i, readlen, false);
+    build_graph_from_str_buf_mt(&graph, 0, seq+i, readlen, &bufs[i % 20 == 0]);
+  }
+
+  TASSERT(bufs[0].nflushed > 0);
+  covg_buffer_flush(&bufs[0]);
+  covg_buffer_flush(&bufs[1]);
+
+  _check_graphs_equal(&expect, &graph);
+
+  covg_buffer_dealloc(&bufs[0]);
+  covg_buffer_dealloc(&bufs[1]);
+  db_graph_dealloc(&expect);
+  db_graph_dealloc(&graph);
+  ctx_free(seq);
+}
+
+// Grow flush hook: flush both buffers
+static void _flush_test_buffers(void *arg)
+{
+  CovgBuffer *bufs = (CovgBuffer*)arg;
+  covg_buffer_flush(&bufs[0]);
+  covg_buffer_flush(&bufs[1]);
+}
+
+static void test_covg_buffer_grow()
+{
+  test_status("Testing buffered coverage updates whilst growing the table");
+
+  dBGraph graph, expect;
+  CovgBuffer bufs[2];
+  size_t i, kmer_size = 21, ncols = 1, seqlen = 5000, readlen = 100;
+  char *seq = ctx_malloc(seqlen+1);
+
+  db_graph_alloc(&graph, kmer_size, ncols, ncols, 1024,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS | DBG_ALLOC_NODE_IN_COL);
+  db_graph_alloc(&expect, kmer_size, ncols, ncols, 1<<14,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS | DBG_ALLOC_NODE_IN_COL);
+  db_graph_set_growable(&graph, 2);
+  covg_buffer_alloc(&bufs[0], &graph);
+  covg_buffer_alloc(&bufs[1], &graph);
+  db_graph_set_grow_flush(&graph, _flush_test_buffers, bufs);
+  uint64_t capacity = graph.ht.capacity;
+
+  for(i = 0; i < seqlen; i++)
+    seq[i] = (i % 2000 < 1000) ? "ACGTTGCAGC"[i % 10] : "ACGT"[rand() & 3];
+  seq[seqlen] = '\0';
+
+  // Buffers are kept across reads: only flushed when the table grows
+  for(i = 0; i + readlen <= seqlen; i += 10) {
+    build_graph_from_str_mt(&expect, 0, seq+i, readlen, false);
+    build_graph_from_str_buf_mt(&graph, 0, seq+i, readlen, &bufs[i % 20 == 0]);
+  }
+
+  TASSERT(graph.ht.capacity > capacity);
+  db_graph_set_grow_flush(&graph, NULL, NULL);
+  covg_buffer_flush(&bufs[0]);
+  covg_buffer_flush(&bufs[1]);
+
+  _check_graphs_equal(&expect, &graph);
+
+  covg_buffer_dealloc(&bufs[0]);
+  covg_buffer_dealloc(&bufs[1]);
+  db_graph_dealloc(&expect);
+  db_graph_dealloc(&graph);
+  ctx_free(seq);
+}
+
+static void _parts_test_task(BuildGraphTask *task, const char *path)
+{
+  memset(task, 0, sizeof(*task));
+  task->prefs = SEQ_LOADING_PREFS_INIT;
+  task->stats = SEQ_LOADING_STATS_INIT;
+  task->files.file1 = seq_open(path);
+  TASSERT(task->files.file1 != NULL);
+}
+
+static void test_build_graph_parts()
+{
+  test_status("Testing out-of-core build with partitions in build_graph_parts.c");
+
+  dBGraph expect, graph, loaded;
+  BuildGraphParts parts;
+  BuildGraphTask task;
+  size_t i, kmer_size = 31, ncols = 1, seqlen = 5000, readlen = 100;
+  size_t nparts = 4, nthreads = 2;
+  char *seq = ctx_malloc(seqlen+1);
+  char seq_path[] = "/tmp/ctx_parts_test.XXXXXX";
+  char out_path[] = "/tmp/ctx_parts_test.XXXXXX";
+
+  db_graph_alloc(&expect, kmer_size, ncols, ncols, 1<<15,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS);
+  db_graph_alloc(&graph, kmer_size, ncols, ncols, 1<<15,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS);
+  db_graph_alloc(&loaded, kmer_size, ncols, ncols, 1<<15,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS);
+
+  for(i = 0; i < seqlen; i++) seq[i] = "ACGT"[rand() & 3];
+  seq[seqlen] = '\0';
+
+  // Overlapping reads, first half of the sequence is covered twice
+  _create_tmp_file(seq_path);
+  FILE *fh = fopen(seq_path, "w");
+  for(i = 0; i + readlen <= seqlen; i += readlen/2)
+    fprintf(fh, ">r%zu\n%.*s\n", i, (int)readlen, seq+i);
+  for(i = 0; i + readlen <= seqlen/2; i += readlen/4)
+    fprintf(fh, ">s%zu\n%.*s\n", i, (int)readlen, seq+i);
+  fclose(fh);
+  _create_tmp_file(out_path);
+
+  // Build in memory
+  _parts_test_task(&task, seq_path);
+  build_graph(&expect, &task, 1, nthreads);
+  build_graph_task_destroy(&task);
+
+  // Build in partitions, with small chunks so each partition is added to the
+  // graph in several goes
+  build_graph_parts_alloc(&parts, nparts, kmer_size, "/tmp");
+  parts.chunk_size = 256;
+  _parts_test_task(&task, seq_path);
+  build_graph_parts_load(&parts, &graph, &task, 1, nthreads);
+  build_graph_task_destroy(&task);
+
+  FileFilter fltr;
+  memset(&fltr, 0, sizeof(fltr));
+  file_filter_create_direct(&fltr, ncols, ncols);
+  GraphFileHeader *hdr = graph_writer_mkhdr(&graph, &fltr, ncols);
+  uint64_t nkmers = build_graph_parts_save(&parts, &graph, hdr, nthreads,
+                                           out_path);
+  build_graph_parts_dealloc(&parts);
+  graph_header_free(hdr);
+  file_filter_close(&fltr);
+
+  TASSERT(nkmers == hash_table_nkmers(&expect.ht));
+
+  // Output is sorted
+  GraphFileReader gfile;
+  memset(&gfile, 0, sizeof(gfile));
+  graph_file_open(&gfile, out_path);
+  BinaryKmer bkmer, prev = BINARY_KMER_ZERO_MACRO;
+  Covg covgs[ncols];
+  Edges edges[ncols];
+  size_t n = 0;
+  while(graph_file_read_reset(&gfile, &bkmer, covgs, edges)) {
+    if(n++) TASSERT(binary_kmer_less_than(prev, bkmer));
+    prev = bkmer;
+  }
+  TASSERT(n == nkmers);
+  graph_file_close(&gfile);
+
+  // Same kmers, coverages and edges
+  _load_graph_file(out_path, &loaded);
+  _check_graphs_equal(&expect, &loaded);
+
+  unlink(seq_path);
+  unlink(out_path);
+  db_graph_dealloc(&loaded);
+  db_graph_dealloc(&graph);
+  db_graph_dealloc(&expect);
+  ctx_free(seq);
+}
+
 void test_build_graph()
 {
   test_status("Testing remove PCR duplicates in build_graph.c");
@@ -151,4 +814,16 @@ void test_build_graph()
   seq_read_dealloc(&r2);
 
   db_graph_dealloc(&graph);
+
+  test_graph_image();
+  test_graph_blocked();
+  test_graph_merge_sorted();
+  test_build_graph_min_count();
+  test_kmer_hll_estimate();
+  test_build_graph_grow();
+  test_build_graph_grow_counts();
+  test_build_graph_grow_min_count();
+  test_covg_buffer();
+  test_covg_buffer_grow();
+  test_build_graph_parts();
 }
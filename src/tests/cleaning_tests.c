@@ -113,7 +113,7 @@ void _test_graph_cleaning()
   TASSERT(hash_table_nkmers(&graph.ht) == hash_table_count_kmers(&graph.ht));
 
   // clear hash table + graph
-  hash_table_empty(&graph.ht);
+  hash_table_empty(&graph.ht, nthreads);
   memset(graph.col_edges, 0, ncols*graph.ht.capacity*sizeof(Edges));
   memset(graph.col_covgs, 0, ncols*graph.ht.capacity*sizeof(Covg));
 
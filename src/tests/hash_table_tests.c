@@ -71,12 +71,21 @@ static void test_add_remove()
 
 typedef struct {
   HashTable ht;
-  uint8_t *bktlocks;
+  uint8_t *bktlocks; // if NULL use lock-free inserts
   BinaryKmer *bkmers;
   size_t *nadded;
   size_t n;
 } BKmerTestSet;
 
+static inline hkey_t bset_find_or_insert(BKmerTestSet *bset, size_t i,
+                                         bool *found)
+{
+  return bset->bktlocks != NULL
+         ? hash_table_find_or_insert_mt(&bset->ht, bset->bkmers[i], found,
+                                        bset->bktlocks)
+         : hash_table_find_or_insert_cas(&bset->ht, bset->bkmers[i], found);
+}
+
 void load_bset(void *arg, size_t threadid)
 {
   (void)threadid;
@@ -84,32 +93,32 @@ void load_bset(void *arg, size_t threadid)
   size_t i, start = rand() % bset->n;
   bool found = false;
   for(i = start; i < bset->n; i++) {
-    hash_table_find_or_insert_mt(&bset->ht, bset->bkmers[i], &found, bset->bktlocks);
+    bset_find_or_insert(bset, i, &found);
     __sync_fetch_and_add((volatile size_t*)&bset->nadded[i], !found);
   }
   sched_yield(); // release the CPU
   for(i = 0; i < start; i++) {
-    hash_table_find_or_insert_mt(&bset->ht, bset->bkmers[i], &found, bset->bktlocks);
+    bset_find_or_insert(bset, i, &found);
     __sync_fetch_and_add((volatile size_t*)&bset->nadded[i], !found);
   }
 }
 
-static void test_hash_table_mt()
+static void test_hash_table_mt(bool use_locks)
 {
   // Generate 2000 random binary kmers
   // start 20 threads adding them to the hash table
   size_t i, kmer_size = MAX_KMER_SIZE;
   size_t nthreads = (rand() % 50)+1, nkmers = 1000000;
 
-  test_status("Testing hash table multithreading %zu threads, %zu kmers",
-              nthreads, nkmers);
+  test_status("Testing hash table multithreading %zu threads, %zu kmers (%s)",
+              nthreads, nkmers, use_locks ? "bucket locks" : "lock-free");
 
   BKmerTestSet bset;
   bset.n = nkmers;
   hash_table_alloc(&bset.ht, bset.n*1.5);
   bset.bkmers = ctx_calloc(bset.n, sizeof(bset.bkmers[0]));
   bset.nadded = ctx_calloc(bset.n, sizeof(bset.nadded[0]));
-  bset.bktlocks = ctx_calloc((bset.ht.capacity+7)/8, 1);
+  bset.bktlocks = use_locks ? ctx_calloc((bset.ht.capacity+7)/8, 1) : NULL;
 
   for(i = 0; i < bset.n; i++)
     bset.bkmers[i] = binary_kmer_random(kmer_size);
@@ -121,6 +130,15 @@ static void test_hash_table_mt()
     TASSERT2(bset.nadded[i] == 1, "%zu", bset.nadded[i]);
 
   TASSERT(hash_table_nkmers(&bset.ht) == nkmers);
+  TASSERT(hash_table_count_kmers(&bset.ht) == nkmers);
+
+  // Check all kmers can be found
+  hkey_t hkey;
+  for(i = 0; i < bset.n; i++) {
+    hkey = hash_table_find(&bset.ht, bset.bkmers[i]);
+    TASSERT(hkey != HASH_NOT_FOUND);
+    TASSERT(hkey == hash_table_find_cas(&bset.ht, bset.bkmers[i]));
+  }
 
   ctx_free(bset.bktlocks);
   ctx_free(bset.nadded);
@@ -128,8 +146,165 @@ static void test_hash_table_mt()
   hash_table_dealloc(&bset.ht);
 }
 
+// Check each bucket probe the CPU supports gives the same results
+static void test_hash_table_probes()
+{
+  test_status("Testing hash table bucket probes");
+
+  const HashTableProbe probes[] = {HT_PROBE_SCALAR, HT_PROBE_SSE42, HT_PROBE_AVX2};
+  const size_t nprobes = sizeof(probes)/sizeof(probes[0]);
+  HashTableProbe init_probe = hash_table_get_probe();
+  size_t i, p, nkmers = 2000, kmer_size = MAX_KMER_SIZE;
+  BinaryKmer bkmers[2*2000];
+  hkey_t hkeys[2*2000];
+  bool found;
+
+  HashTable ht;
+  hash_table_alloc(&ht, nkmers*1.2);
+
+  // Add the first half, keep the second half to test for misses
+  for(i = 0; i < 2*nkmers; i++) {
+    bkmers[i] = binary_kmer_get_key(binary_kmer_random(kmer_size), kmer_size);
+    hkeys[i] = i < nkmers ? hash_table_find_or_insert(&ht, bkmers[i], &found)
+                          : HASH_NOT_FOUND;
+  }
+
+  // Delete some kmers to leave holes in buckets
+  for(i = 0; i < nkmers; i += 7) {
+    hash_table_delete(&ht, hkeys[i]);
+    hkeys[i] = HASH_NOT_FOUND;
+  }
+
+  for(p = 0; p < nprobes; p++) {
+    if(!hash_table_probe_supported(probes[p])) continue;
+    TASSERT(hash_table_set_probe(probes[p]) == probes[p]);
+    for(i = 0; i < 2*nkmers; i++)
+      TASSERT(hash_table_find(&ht, bkmers[i]) == hkeys[i]);
+  }
+
+  hash_table_set_probe(init_probe);
+  hash_table_dealloc(&ht);
+}
+
+// Check batched lookups give the same results as one at a time
+static void test_hash_table_batch()
+{
+  test_status("Testing hash table batched lookups");
+
+  size_t i, nkmers = 1000, kmer_size = MAX_KMER_SIZE;
+  BinaryKmer bkmers[2*1000];
+  hkey_t hkeys[2*1000], hkeys_cas[2*1000];
+  bool found[2*1000], found_cas[2*1000];
+  uint8_t *bktlocks;
+
+  HashTable ht, ht_cas;
+  hash_table_alloc(&ht, nkmers*1.2);
+  hash_table_alloc(&ht_cas, nkmers*1.2);
+  bktlocks = ctx_calloc((ht.capacity+7)/8, 1);
+
+  // Second half repeats the first half
+  for(i = 0; i < nkmers; i++) {
+    bkmers[i] = binary_kmer_get_key(binary_kmer_random(kmer_size), kmer_size);
+    bkmers[nkmers+i] = bkmers[i];
+  }
+
+  TASSERT(hash_table_find_or_insert_batch_mt(&ht, bkmers, NULL, 2*nkmers,
+                                             hkeys, found, bktlocks)
+          == 2*nkmers);
+  TASSERT(hash_table_find_or_insert_batch_cas(&ht_cas, bkmers, NULL, 2*nkmers,
+                                              hkeys_cas, found_cas)
+          == 2*nkmers);
+
+  TASSERT(hash_table_nkmers(&ht) == nkmers);
+  TASSERT(hash_table_nkmers(&ht_cas) == nkmers);
+
+  for(i = 0; i < nkmers; i++) {
+    TASSERT(!found[i] && found[nkmers+i]);
+    TASSERT(!found_cas[i] && found_cas[nkmers+i]);
+    TASSERT(hkeys[i] == hkeys[nkmers+i]);
+    TASSERT(hkeys_cas[i] == hkeys_cas[nkmers+i]);
+  }
+
+  // Look up present and absent kmers
+  for(i = 0; i < nkmers; i++)
+    bkmers[nkmers+i] = binary_kmer_get_key(binary_kmer_random(kmer_size), kmer_size);
+
+  hash_table_find_batch(&ht, bkmers, NULL, 2*nkmers, hkeys);
+
+  for(i = 0; i < 2*nkmers; i++)
+    TASSERT(hkeys[i] == hash_table_find(&ht, bkmers[i]));
+
+  ctx_free(bktlocks);
+  hash_table_dealloc(&ht);
+  hash_table_dealloc(&ht_cas);
+}
+
+static void sum_range(hkey_t start, hkey_t end, void *arg)
+{
+  __sync_fetch_and_add((volatile size_t*)arg, (size_t)(end - start));
+}
+
+// Emptying should only clear regions that were written to
+static void test_hash_table_empty()
+{
+  test_status("Testing emptying hash table");
+
+  size_t i, nkmers = 100, ndirty, kmer_size = MAX_KMER_SIZE;
+  BinaryKmer bkmers[100];
+  bool found;
+
+  HashTable ht;
+  hash_table_alloc(&ht, 1<<20);
+
+  for(i = 0; i < nkmers; i++) {
+    bkmers[i] = binary_kmer_get_key(binary_kmer_random(kmer_size), kmer_size);
+    if(i & 1) hash_table_find_or_insert(&ht, bkmers[i], &found);
+    else hash_table_find_or_insert_cas(&ht, bkmers[i], &found);
+  }
+
+  // Few kmers in a large table: most of the table is clean
+  ndirty = 0;
+  hash_table_dirty_iterate(&ht, 3, sum_range, &ndirty);
+  TASSERT(ndirty > 0 && ndirty < ht.capacity / 2);
+
+  hash_table_empty(&ht, 3);
+  TASSERT(hash_table_nkmers(&ht) == 0);
+  TASSERT(hash_table_count_kmers(&ht) == 0);
+  for(i = 0; i < nkmers; i++)
+    TASSERT(hash_table_find(&ht, bkmers[i]) == HASH_NOT_FOUND);
+
+  ndirty = 0;
+  hash_table_dirty_iterate(&ht, 3, sum_range, &ndirty);
+  TASSERT(ndirty == 0);
+
+  // Table can be reused
+  for(i = 0; i < nkmers; i++) {
+    hash_table_find_or_insert(&ht, bkmers[i], &found);
+    TASSERT(!found);
+  }
+  for(i = 0; i < nkmers; i++)
+    TASSERT(hash_table_find(&ht, bkmers[i]) != HASH_NOT_FOUND);
+
+  hash_table_dealloc(&ht);
+}
+
 void test_hash_table()
 {
-  test_add_remove();
-  test_hash_table_mt();
+  const HashTableLayout layouts[] = {HT_LAYOUT_SPLIT, HT_LAYOUT_TAGS};
+  HashTableLayout init_layout = hash_table_get_layout();
+  size_t i;
+
+  for(i = 0; i < sizeof(layouts)/sizeof(layouts[0]); i++) {
+    test_status("Testing %s hash table layout",
+                hash_table_layout_str(layouts[i]));
+    hash_table_set_layout(layouts[i]);
+    test_add_remove();
+    test_hash_table_probes();
+    test_hash_table_batch();
+    test_hash_table_empty();
+    test_hash_table_mt(true);
+    test_hash_table_mt(false);
+  }
+
+  hash_table_set_layout(init_layout);
 }
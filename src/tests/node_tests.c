@@ -50,6 +50,181 @@ static void test_db_graph_next_nodes()
   db_graph_dealloc(&graph);
 }
 
+static void records_check(hkey_t hkey, const dBGraph *graph,
+                          const dBGraph *recs)
+{
+  size_t col;
+  dBNode node = db_graph_find(recs, db_node_get_bkey(graph, hkey));
+  TASSERT(node.key != HASH_NOT_FOUND);
+  if(node.key == HASH_NOT_FOUND) return;
+  for(col = 0; col < graph->num_of_cols; col++) {
+    TASSERT(db_node_get_covg(recs, node.key, col) ==
+            db_node_get_covg(graph, hkey, col));
+    TASSERT(db_node_get_edges(recs, node.key, col) ==
+            db_node_get_edges(graph, hkey, col));
+    TASSERT(db_node_has_col(recs, node.key, col) ==
+            db_node_has_col(graph, hkey, col));
+  }
+}
+
+static void test_node_records()
+{
+  test_status("Testing node records layout (DBG_ALLOC_NODE_RECORDS)");
+
+  dBGraph graph, recs;
+  size_t col, kmer_size = 11, ncols = 3;
+  char seq[200];
+  int flags = DBG_ALLOC_EDGES | DBG_ALLOC_COVGS | DBG_ALLOC_NODE_IN_COL;
+
+  db_graph_alloc(&graph, kmer_size, ncols, ncols, 1024, flags);
+  db_graph_alloc(&recs, kmer_size, ncols, ncols, 1024,
+                 flags | DBG_ALLOC_NODE_RECORDS);
+  TASSERT(recs.node_stride == 3*sizeof(Covg) + 4);
+
+  for(col = 0; col < ncols; col++) {
+    dna_rand_str(seq, sizeof(seq)-1);
+    build_graph_from_str_mt(&graph, col, seq, strlen(seq), false);
+    build_graph_from_str_mt(&recs, col, seq, strlen(seq), false);
+    strcpy(seq, "CTTTCTTATCTGGAACCAGCTTTGCGGGGATGGAGTGTAACCTTGACAATGGGTCCTGC");
+    build_graph_from_str_mt(&graph, col, seq, strlen(seq), false);
+    build_graph_from_str_mt(&recs, col, seq, strlen(seq), false);
+  }
+
+  TASSERT(recs.ht.num_kmers == graph.ht.num_kmers);
+  HASH_ITERATE(&graph.ht, records_check, &graph, &recs);
+
+  // Records are moved when the table grows
+  db_graph_grow(&recs, 2);
+  HASH_ITERATE(&graph.ht, records_check, &graph, &recs);
+
+  db_graph_wipe_colour(&graph, 1);
+  db_graph_wipe_colour(&recs, 1);
+  HASH_ITERATE(&graph.ht, records_check, &graph, &recs);
+
+  db_graph_dealloc(&recs);
+  db_graph_dealloc(&graph);
+}
+
+static void test_small_covgs()
+{
+  test_status("Testing 8 bit coverages (DBG_ALLOC_SMALL_COVGS)");
+
+  dBGraph graph, small;
+  size_t i, kmer_size = 11, ncols = 2;
+  char seq[1001];
+  int flags = DBG_ALLOC_EDGES | DBG_ALLOC_COVGS | DBG_ALLOC_NODE_IN_COL;
+
+  db_graph_alloc(&graph, kmer_size, ncols, ncols, 1024, flags);
+  db_graph_alloc(&small, kmer_size, ncols, ncols, 1024,
+                 flags | DBG_ALLOC_SMALL_COVGS);
+  TASSERT(small.col_covgs == NULL && small.col_covgs8 != NULL);
+
+  // Repeats give kmers with coverage over 255 in colour 0
+  for(i = 0; i < 1000; i++) seq[i] = "ACGTTGCATGCAAGT"[i % 15];
+  seq[1000] = '\0';
+  for(i = 0; i < 4; i++) {
+    build_graph_from_str_mt(&graph, 0, seq, strlen(seq), false);
+    build_graph_from_str_mt(&small, 0, seq, strlen(seq), false);
+  }
+  dna_rand_str(seq, 200);
+  build_graph_from_str_mt(&graph, 1, seq, strlen(seq), false);
+  build_graph_from_str_mt(&small, 1, seq, strlen(seq), false);
+
+  TASSERT(covg_ovf_size(&small.covg_ovf) > 0);
+  HASH_ITERATE(&graph.ht, records_check, &graph, &small);
+
+  // Cross the escape value in both directions
+  hkey_t hkey = 0;
+  while(!db_graph_node_assigned(&small, hkey)) hkey++;
+  db_node_set_covg(&small, hkey, 1, 254);
+  db_node_increment_coverage(&small, hkey, 1);
+  TASSERT(db_node_get_covg(&small, hkey, 1) == 255);
+  db_node_add_col_covg(&small, hkey, 1, COVG_MAX - 10);
+  TASSERT(db_node_get_covg(&small, hkey, 1) == COVG_MAX);
+  db_node_set_covg(&small, hkey, 1, 3);
+  TASSERT(db_node_get_covg(&small, hkey, 1) == 3);
+  dBNode node = db_graph_find(&graph, db_node_get_bkey(&small, hkey));
+  db_node_set_covg(&small, hkey, 1, db_node_get_covg(&graph, node.key, 1));
+
+  // Overflow entries are moved when the table grows
+  db_graph_grow(&small, 2);
+  HASH_ITERATE(&graph.ht, records_check, &graph, &small);
+
+  db_graph_wipe_colour(&graph, 0);
+  db_graph_wipe_colour(&small, 0);
+  HASH_ITERATE(&graph.ht, records_check, &graph, &small);
+  TASSERT(covg_ovf_size(&small.covg_ovf) == 0);
+
+  db_graph_reset(&small, 2);
+  TASSERT(hash_table_nkmers(&small.ht) == 0);
+
+  db_graph_dealloc(&small);
+  db_graph_dealloc(&graph);
+}
+
+#define CC_NCOLS 200
+#define CC_NSETS 8
+
+static void test_colour_classes()
+{
+  test_status("Testing colour classes (db_graph_compress_colours())");
+
+  dBGraph graph;
+  size_t i, col, n, kmer_size = 11;
+  hkey_t hkey;
+  char seq[501];
+  uint32_t cols[CC_NCOLS];
+  bool sets[CC_NSETS][CC_NCOLS];
+
+  db_graph_alloc(&graph, kmer_size, CC_NCOLS, 1, 1024,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_NODE_IN_COL);
+
+  dna_rand_str(seq, 500);
+  build_graph_from_str_mt(&graph, 0, seq, strlen(seq), false);
+
+  // Kmers share a few colour sets: sparse ones are Elias-Fano encoded, dense
+  // ones are bitmaps
+  memset(sets, 0, sizeof(sets));
+  for(i = 0; i < CC_NSETS; i++) {
+    for(col = 0; col < CC_NCOLS; col++)
+      sets[i][col] = (i < CC_NSETS/2 ? rand() % 50 == 0 : rand() % 2);
+  }
+
+  const size_t capacity = graph.ht.capacity;
+  bool *expect = ctx_calloc(capacity * CC_NCOLS, sizeof(bool));
+
+  for(hkey = 0; hkey < capacity; hkey++) {
+    if(!db_graph_node_assigned(&graph, hkey)) continue;
+    i = rand() % CC_NSETS;
+    for(col = 0; col < CC_NCOLS; col++)
+      if(sets[i][col]) db_node_set_col(&graph, hkey, col);
+    for(col = 0; col < CC_NCOLS; col++)
+      expect[hkey*CC_NCOLS+col] = db_node_has_col(&graph, hkey, col);
+  }
+
+  TASSERT(db_graph_compress_colours(&graph));
+  TASSERT(graph.node_in_cols == NULL && db_graph_has_col_classes(&graph));
+
+  // Every set with and without colour 0, plus the empty class
+  const ColourClasses *cc = &graph.col_classes;
+  TASSERT(cc->nclasses <= 2 * CC_NSETS + 1);
+
+  for(hkey = 0; hkey < capacity; hkey++) {
+    if(!db_graph_node_assigned(&graph, hkey)) continue;
+    for(col = 0; col < CC_NCOLS; col++) {
+      TASSERT(db_node_has_col(&graph, hkey, col) == expect[hkey*CC_NCOLS+col]);
+      TASSERT(db_node_in_col(&graph, hkey, col) == expect[hkey*CC_NCOLS+col]);
+    }
+    n = colour_classes_get_cols(cc, cc->node_class[hkey], cols);
+    TASSERT(n == colour_classes_size(cc, cc->node_class[hkey]));
+    for(i = 0; i < n; i++) TASSERT(expect[hkey*CC_NCOLS+cols[i]]);
+    for(i = 1; i < n; i++) TASSERT(cols[i-1] < cols[i]);
+  }
+
+  ctx_free(expect);
+  db_graph_dealloc(&graph);
+}
+
 #define MAXLEN 300
 #define NLOOP 300
 
@@ -90,5 +265,8 @@ static void test_left_shift()
 void test_db_node()
 {
   test_db_graph_next_nodes();
+  test_node_records();
+  test_small_covgs();
+  test_colour_classes();
   test_left_shift();
 }
@@ -4,6 +4,13 @@
 #include "build_graph.h"
 #include "generate_paths.h"
 #include "gpath_checks.h"
+#include "gpath_batch.h"
+#include "gpath_save.h"
+#include "gpath_reader.h"
+#include "gpath_subset.h"
+#include "json_hdr.h"
+
+#include <unistd.h> // close(), unlink()
 
 //       junctions:  >     >           <     <     <
 const char seq0[] = "CCTGGGTGCGAATGACACCAAATCGAATGAC"; // a->d
@@ -88,10 +95,10 @@ static void _check_node_paths(const char *kmer,
   #define MAX_SEQ 128
   char seq[MAX_SEQ];
 
-  for(; path != NULL; path = path->next)
+  for(; path != NULL; path = gpath_store_next(gpstore, path))
   {
     if(path->orient == node.orient &&
-       gpath_has_colour(path, gpstore->gpset.ncols, colour))
+       gpath_has_colour(&gpstore->gpset, path, colour))
     {
       TASSERT(num_paths_seen < npaths);
       db_node_buf_reset(&nbuf);
@@ -176,7 +183,581 @@ static void _test_add_paths()
   db_graph_dealloc(&graph);
 }
 
+static void _test_gpath_batch()
+{
+  test_status("Testing coalescing links in gpath_batch.c");
+
+  GPathStore gpstore;
+  GPathHash gphash;
+  GPathBatch batch;
+  size_t i, ncols = 2, nkmers = 16;
+
+  gpath_store_alloc(&gpstore, ncols, nkmers, 0, ONE_MEGABYTE, true, false);
+  gpath_hash_alloc(&gphash, &gpstore, ONE_MEGABYTE);
+  gpath_batch_alloc(&batch, &gphash);
+
+  uint8_t juncs0[] = {0x1b}, juncs1[] = {0x2d};
+  GPathNew link0 = {.seq = juncs0, .colset = NULL, .nseen = NULL,
+                    .num_juncs = 4, .orient = FORWARD};
+  GPathNew link1 = {.seq = juncs1, .colset = NULL, .nseen = NULL,
+                    .num_juncs = 4, .orient = FORWARD};
+
+  // link0 three times in colour 0, once in colour 1; link1 once
+  for(i = 0; i < 3; i++) gpath_batch_add(&batch, 3, link0, 0);
+  gpath_batch_add(&batch, 3, link0, 1);
+  gpath_batch_add(&batch, 3, link1, 0);
+  TASSERT(batch.nlinks == 3);
+  TASSERT(gpstore.num_paths == 0);
+
+  gpath_batch_flush(&batch);
+  TASSERT(batch.nlinks == 0);
+  TASSERT(gpstore.num_paths == 2);
+  TASSERT(gpstore.num_kmers_with_paths == 1);
+
+  GPath *gpath = gpstore_find(&gpstore, 3, link0);
+  TASSERT(gpath != NULL);
+  TASSERT(gpath_has_colour(&gpstore.gpset, gpath, 0));
+  TASSERT(gpath_has_colour(&gpstore.gpset, gpath, 1));
+  uint8_t *nseen = gpath_set_get_nseen(&gpstore.gpset, gpath);
+  TASSERT(nseen[0] == 3 && nseen[1] == 1);
+
+  // Adding again after a flush finds the existing path
+  gpath_batch_add(&batch, 3, link1, 1);
+  gpath_batch_flush(&batch);
+  TASSERT(gpstore.num_paths == 2);
+  gpath = gpstore_find(&gpstore, 3, link1);
+  TASSERT(gpath != NULL);
+  nseen = gpath_set_get_nseen(&gpstore.gpset, gpath);
+  TASSERT(nseen[0] == 1 && nseen[1] == 1);
+
+  gpath_batch_dealloc(&batch);
+  gpath_hash_dealloc(&gphash);
+  gpath_store_dealloc(&gpstore);
+}
+
+// Add `n` links to a kmer, each differing in its first junction byte
+static void _add_store_links(GPathStore *gpstore, hkey_t hkey, size_t n)
+{
+  uint8_t juncs[2] = {0, (uint8_t)hkey};
+  GPathNew newgpath = {.seq = juncs, .colset = NULL, .nseen = NULL,
+                       .num_juncs = 8, .orient = FORWARD};
+  for(; n > 0; n--) {
+    juncs[0] = (uint8_t)n;
+    gpath_store_add_mt(gpstore, hkey, newgpath);
+  }
+}
+
+static size_t _count_store_links(const GPathStore *gpstore, const GPath *gpath)
+{
+  size_t n = 0;
+  for(; gpath != NULL; gpath = gpath_store_next(gpstore, gpath)) n++;
+  return n;
+}
+
+typedef struct {
+  GPathHash *gphash;
+  size_t col, start, nkmers, nlinks, nrounds;
+} GPathHashTestJob;
+
+// Each round adds every link once, starting at a different link in each job
+static void _gpath_hash_test_job(void *arg, size_t threadid)
+{
+  (void)threadid;
+  GPathHashTestJob *job = (GPathHashTestJob*)arg;
+  size_t r, i, j, n = job->nkmers * job->nlinks;
+  uint8_t juncs[2] = {0, 0xe4};
+  GPathNew newgpath = {.seq = juncs, .colset = NULL, .nseen = NULL,
+                       .num_juncs = 8, .orient = FORWARD};
+  GPathBatch batch;
+
+  gpath_batch_alloc(&batch, job->gphash);
+  for(r = 0; r < job->nrounds; r++) {
+    for(i = 0; i < n; i++) {
+      j = (job->start + i) % n;
+      juncs[0] = (uint8_t)(j % job->nlinks);
+      gpath_batch_add(&batch, j / job->nlinks, newgpath, job->col);
+    }
+    gpath_batch_flush(&batch);
+  }
+  gpath_batch_dealloc(&batch);
+}
+
+static void _test_gpath_hash_mt()
+{
+  test_status("Testing adding links from several threads in gpath_hash.c");
+
+  const size_t ncols = 2, nkmers = 16, nlinks = 16, nrounds = 3, nthreads = 8;
+  GPathStore gpstore;
+  GPathHash gphash;
+  GPathHashTestJob jobs[nthreads];
+  size_t i, col;
+  hkey_t hkey;
+
+  // Small table so that threads race on the same buckets
+  gpath_store_alloc(&gpstore, ncols, nkmers, 0, ONE_MEGABYTE, true, false);
+  gpath_hash_alloc(&gphash, &gpstore, 4096);
+
+  for(i = 0; i < nthreads; i++) {
+    jobs[i] = (GPathHashTestJob){.gphash = &gphash, .col = i % ncols,
+                                 .start = i * nkmers * nlinks / nthreads,
+                                 .nkmers = nkmers, .nlinks = nlinks,
+                                 .nrounds = nrounds};
+  }
+
+  util_run_threads(jobs, nthreads, sizeof(jobs[0]), nthreads,
+                   _gpath_hash_test_job);
+
+  // Every link is only stored once
+  TASSERT(gphash.num_entries == nkmers * nlinks);
+  TASSERT(gpstore.num_paths == nkmers * nlinks);
+  TASSERT(gpstore.num_kmers_with_paths == nkmers);
+
+  // Each job added each link once per round, in its own colour
+  for(hkey = 0; hkey < nkmers; hkey++) {
+    GPath *gpath = gpath_store_fetch(&gpstore, hkey);
+    TASSERT(_count_store_links(&gpstore, gpath) == nlinks);
+    for(; gpath != NULL; gpath = gpath_store_next(&gpstore, gpath)) {
+      uint8_t *nseen = gpath_set_get_nseen(&gpstore.gpset, gpath);
+      for(col = 0; col < ncols; col++) {
+        TASSERT(gpath_has_colour(&gpstore.gpset, gpath, col));
+        TASSERT2(nseen[col] == nrounds * nthreads / ncols,
+                 "col: %zu nseen: %u", col, nseen[col]);
+      }
+    }
+  }
+
+  gpath_hash_dealloc(&gphash);
+  gpath_store_dealloc(&gpstore);
+}
+
+static void _test_gpath_store_compact()
+{
+  test_status("Testing gpath_store_compact() and fetching from the index");
+
+  // Spans more than one GPATH_INDEX_BLOCK of the index
+  const size_t nkmers = 1000;
+  GPathStore gpstore;
+  GPath *heads[nkmers];
+  size_t counts[nkmers];
+  hkey_t hkey;
+
+  gpath_store_alloc(&gpstore, 1, nkmers, 0, ONE_MEGABYTE, false, true);
+
+  memset(counts, 0, sizeof(counts));
+  for(hkey = 0; hkey < nkmers; hkey++) {
+    if(hkey % 3 == 0 || hkey == nkmers-1) {
+      counts[hkey] = 1 + hkey % 4;
+      _add_store_links(&gpstore, hkey, counts[hkey]);
+    }
+    heads[hkey] = gpath_store_fetch(&gpstore, hkey);
+  }
+
+  // Paths added after splitting are not traversed
+  gpath_store_split_read_write(&gpstore);
+  TASSERT(gpstore.index.bits != NULL);
+  for(hkey = 1; hkey < nkmers; hkey += 10)
+    _add_store_links(&gpstore, hkey, 1);
+
+  for(hkey = 0; hkey < nkmers; hkey++) {
+    TASSERT(gpath_store_fetch_traverse(&gpstore, hkey) == heads[hkey]);
+    if(hkey % 10 == 1) {
+      counts[hkey]++;
+      heads[hkey] = gpath_store_fetch(&gpstore, hkey);
+    }
+    else TASSERT(gpath_store_fetch(&gpstore, hkey) == heads[hkey]);
+  }
+
+  // Index-only fetches return the same lists
+  gpath_store_compact(&gpstore);
+  TASSERT(gpstore.paths_all == NULL);
+  TASSERT(gpstore.kmer_locks == NULL);
+
+  size_t nkmers_with_paths = 0, npaths = 0;
+  for(hkey = 0; hkey < nkmers; hkey++) {
+    TASSERT2(gpath_store_fetch(&gpstore, hkey) == heads[hkey],
+             "hkey: %zu", (size_t)hkey);
+    TASSERT(gpath_store_fetch_traverse(&gpstore, hkey) == heads[hkey]);
+    TASSERT(_count_store_links(&gpstore, heads[hkey]) == counts[hkey]);
+    nkmers_with_paths += (counts[hkey] > 0);
+    npaths += counts[hkey];
+  }
+
+  TASSERT(gpstore.index.nkmers == nkmers_with_paths);
+  TASSERT(gpstore.num_kmers_with_paths == nkmers_with_paths);
+  TASSERT(gpstore.num_paths == npaths);
+
+  // Compacting twice is a no-op
+  gpath_store_compact(&gpstore);
+  TASSERT(gpath_store_fetch(&gpstore, nkmers-1) == heads[nkmers-1]);
+
+  gpath_store_dealloc(&gpstore);
+}
+
+//
+// Saving and loading link files
+//
+
+#define LINKS_TEST_NCOLS 2
+
+// Two colour graph of `seq`, with a path store that keeps counts
+static void _links_test_graph(dBGraph *graph, size_t kmer_size,
+                              const char *seq, size_t len, size_t mem)
+{
+  db_graph_alloc(graph, kmer_size, LINKS_TEST_NCOLS, LINKS_TEST_NCOLS, 2*len,
+                 DBG_ALLOC_EDGES | DBG_ALLOC_COVGS | DBG_ALLOC_NODE_IN_COL);
+  gpath_store_alloc(&graph->gpstore, graph->num_of_cols, graph->ht.capacity,
+                    0, mem, true, false);
+  gpath_hash_alloc(&graph->gphash, &graph->gpstore, mem);
+  build_graph_from_str_mt(graph, 0, seq, len, false);
+  graph->num_of_cols_used = LINKS_TEST_NCOLS;
+}
+
+// Add up to `nlinks` random links to a kmer (duplicates are skipped).
+// Counts go up to 255 so some need more than one varint byte.
+static void _add_random_kmer_links(dBGraph *graph, hkey_t hkey, size_t nlinks)
+{
+  GPathSet *gpset = &graph->gpstore.gpset;
+  uint8_t juncs[16], *nseen;
+  size_t i, col;
+  GPath *gpath;
+  bool found;
+
+  for(i = 0; i < nlinks; i++) {
+    rand_bytes(juncs, sizeof(juncs));
+    GPathNew newgpath = {.seq = juncs, .colset = NULL, .nseen = NULL,
+                         .num_juncs = 1 + rand() % (4*sizeof(juncs)),
+                         .orient = rand() & 1};
+    gpath = gpath_hash_find_or_insert_mt(&graph->gphash, hkey, newgpath,
+                                         &found);
+    if(found) continue;
+    nseen = gpath_set_get_nseen(gpset, gpath);
+    for(col = 0; col < LINKS_TEST_NCOLS; col++)
+      nseen[col] = (rand() & 3) ? rand() % 256 : 0;
+    if(nseen[0] == 0 && nseen[1] == 0) nseen[rand() & 1] = 1;
+    for(col = 0; col < LINKS_TEST_NCOLS; col++)
+      if(nseen[col]) gpath_set_colour(gpset, gpath, col);
+  }
+}
+
+// Add `nlinks` random links to every `step`th kmer in the hash table
+static void _add_random_links(dBGraph *graph, size_t nlinks, size_t step)
+{
+  hkey_t hkey;
+  for(hkey = 0; hkey < graph->ht.capacity; hkey += step)
+    if(HASH_ENTRY_ASSIGNED(graph->ht.table[hkey]))
+      _add_random_kmer_links(graph, hkey, nlinks);
+}
+
+// Save links to a new temporary file, `path` is a mkstemp() template
+static void _save_links_tmp(dBGraph *graph, char *path, bool binary)
+{
+  ZeroSizeBuffer hists[LINKS_TEST_NCOLS];
+  BgzfWriter out;
+  memset(hists, 0, sizeof(hists));
+
+  // Reserve a name, the writer will not overwrite an existing file
+  int fd = mkstemp(path);
+  TASSERT(fd >= 0);
+  close(fd);
+  unlink(path);
+
+  // One thread so text and binary files list kmers in the same order
+  bgzf_writer_open(&out, path);
+  gpath_save(&out, path, 1, false, binary, NULL, NULL, NULL, 0,
+             hists, LINKS_TEST_NCOLS, graph);
+  bgzf_writer_close(&out);
+}
+
+// Load links from `path`, which may have a colour filter
+static void _load_links(dBGraph *graph, const char *path, size_t nthreads)
+{
+  GPathReader file;
+  memset(&file, 0, sizeof(file));
+  gpath_reader_open(&file, path);
+  gpath_reader_check(&file, graph->kmer_size, graph->num_of_cols);
+  gpath_reader_load(&file, GPATH_DIE_MISSING_KMERS, nthreads, graph);
+  gpath_reader_close(&file);
+}
+
+// Check two graphs of the same kmers have the same links, with the same
+// orientations, junctions, counts and colours
+static void _check_same_links(dBGraph *a, dBGraph *b)
+{
+  GPathSet *aset = &a->gpstore.gpset, *bset = &b->gpstore.gpset;
+  GPathSubset asub, bsub;
+  const GPath *agp, *bgp;
+  size_t i, colbytes = gpath_colset_bytes(LINKS_TEST_NCOLS);
+  hkey_t akey, bkey;
+
+  TASSERT(a->gpstore.num_paths == b->gpstore.num_paths);
+  TASSERT(a->gpstore.num_kmers_with_paths == b->gpstore.num_kmers_with_paths);
+
+  gpath_subset_alloc(&asub);
+  gpath_subset_alloc(&bsub);
+
+  for(akey = 0; akey < a->ht.capacity; akey++) {
+    if(!HASH_ENTRY_ASSIGNED(a->ht.table[akey])) continue;
+    bkey = hash_table_find(&b->ht, db_node_get_bkey(a, akey));
+    TASSERT(bkey != HASH_NOT_FOUND);
+    if(bkey == HASH_NOT_FOUND) continue;
+
+    gpath_subset_init(&asub, aset);
+    gpath_subset_init(&bsub, bset);
+    gpath_subset_load_llist(&asub, gpath_store_fetch(&a->gpstore, akey));
+    gpath_subset_load_llist(&bsub, gpath_store_fetch(&b->gpstore, bkey));
+    gpath_subset_sort(&asub);
+    gpath_subset_sort(&bsub);
+
+    TASSERT(asub.list.len == bsub.list.len);
+    for(i = 0; i < asub.list.len && i < bsub.list.len; i++) {
+      agp = asub.list.b[i];
+      bgp = bsub.list.b[i];
+      TASSERT(gpath_cmp(aset, agp, bset, bgp) == 0);
+      TASSERT(memcmp(gpath_get_colset(aset, agp), gpath_get_colset(bset, bgp),
+                     colbytes) == 0);
+      TASSERT(memcmp(gpath_set_get_nseen(aset, agp),
+                     gpath_set_get_nseen(bset, bgp), LINKS_TEST_NCOLS) == 0);
+    }
+  }
+
+  gpath_subset_dealloc(&asub);
+  gpath_subset_dealloc(&bsub);
+}
+
+// Read a text and a binary link file record by record, without loading them
+static void _check_same_link_records(const char *txtpath, const char *binpath)
+{
+  GPathReader files[2];
+  StrBuf kmers[2], juncs[2];
+  SizeBuffer counts[2];
+  size_t i, nlinks[2], njuncs[2];
+  bool fw[2], more[2];
+
+  memset(files, 0, sizeof(files));
+  gpath_reader_open(&files[0], txtpath);
+  gpath_reader_open(&files[1], binpath);
+  TASSERT(!gpath_reader_is_binary(&files[0]));
+  TASSERT(gpath_reader_is_binary(&files[1]));
+
+  for(i = 0; i < 2; i++) {
+    strbuf_alloc(&kmers[i], 64);
+    strbuf_alloc(&juncs[i], 64);
+    size_buf_alloc(&counts[i], 8);
+  }
+
+  while(1)
+  {
+    for(i = 0; i < 2; i++)
+      more[i] = gpath_reader_read_kmer(&files[i], &kmers[i], &nlinks[i]);
+    TASSERT(more[0] == more[1]);
+    if(!more[0] || !more[1]) break;
+    TASSERT(kmers[0].end == kmers[1].end &&
+            memcmp(kmers[0].b, kmers[1].b, kmers[0].end) == 0);
+    TASSERT(nlinks[0] == nlinks[1]);
+
+    while(1)
+    {
+      for(i = 0; i < 2; i++) {
+        more[i] = gpath_reader_read_link(&files[i], &fw[i], &njuncs[i],
+                                         &counts[i], &juncs[i], NULL, NULL);
+      }
+      TASSERT(more[0] == more[1]);
+      if(!more[0] || !more[1]) break;
+      TASSERT(fw[0] == fw[1]);
+      TASSERT(njuncs[0] == njuncs[1]);
+      TASSERT(juncs[0].end == juncs[1].end &&
+              memcmp(juncs[0].b, juncs[1].b, juncs[0].end) == 0);
+      TASSERT(counts[0].len == counts[1].len &&
+              memcmp(counts[0].b, counts[1].b,
+                     counts[0].len * sizeof(size_t)) == 0);
+    }
+  }
+
+  for(i = 0; i < 2; i++) {
+    gpath_reader_close(&files[i]);
+    strbuf_dealloc(&kmers[i]);
+    strbuf_dealloc(&juncs[i]);
+    size_buf_dealloc(&counts[i]);
+  }
+}
+
+static void _test_gpath_save_binary()
+{
+  test_status("Testing saving and loading binary links in gpath_save.c");
+
+  dBGraph graph, txtgraph, bingraph;
+  size_t kmer_size = 31, seqlen = 2000, mem = 4*ONE_MEGABYTE;
+  char *seq = ctx_malloc(seqlen+1);
+  char txtpath[] = "/tmp/ctx_links_test.XXXXXX";
+  char binpath[] = "/tmp/ctx_links_test.XXXXXX";
+  char txtfltr[64], binfltr[64];
+
+  rand_bases(seq, seqlen);
+  seq[seqlen] = '\0';
+
+  _links_test_graph(&graph, kmer_size, seq, seqlen, mem);
+  _add_random_links(&graph, 3, 7);
+  TASSERT(graph.gpstore.num_paths > 0);
+
+  _save_links_tmp(&graph, txtpath, false);
+  _save_links_tmp(&graph, binpath, true);
+
+  // Both formats give the same links as the graph they were saved from
+  _check_same_link_records(txtpath, binpath);
+  _links_test_graph(&txtgraph, kmer_size, seq, seqlen, mem);
+  _links_test_graph(&bingraph, kmer_size, seq, seqlen, mem);
+  _load_links(&txtgraph, txtpath, 2);
+  _load_links(&bingraph, binpath, 2);
+  _check_same_links(&graph, &txtgraph);
+  _check_same_links(&txtgraph, &bingraph);
+  db_graph_dealloc(&txtgraph);
+  db_graph_dealloc(&bingraph);
+
+  // Load with colours swapped
+  snprintf(txtfltr, sizeof(txtfltr), "%s:1,0", txtpath);
+  snprintf(binfltr, sizeof(binfltr), "%s:1,0", binpath);
+  _check_same_link_records(txtfltr, binfltr);
+  _links_test_graph(&txtgraph, kmer_size, seq, seqlen, mem);
+  _links_test_graph(&bingraph, kmer_size, seq, seqlen, mem);
+  _load_links(&txtgraph, txtfltr, 2);
+  _load_links(&bingraph, binfltr, 2);
+  _check_same_links(&txtgraph, &bingraph);
+  db_graph_dealloc(&txtgraph);
+  db_graph_dealloc(&bingraph);
+
+  db_graph_dealloc(&graph);
+  ctx_free(seq);
+  unlink(txtpath);
+  unlink(binpath);
+}
+
+// Append the links of `hkey` to `sbuf`, counting kmers and links written
+static void _append_kmer_links(const dBGraph *graph, hkey_t hkey, bool binary,
+                               StrBuf *sbuf, GPathSubset *subset,
+                               size_t *nkmers, size_t *nlinks)
+{
+  const GPathStore *gpstore = &graph->gpstore;
+  const GPath *gpath = gpath_store_fetch(gpstore, hkey);
+  if(gpath == NULL) return;
+  for(; gpath != NULL; gpath = gpath_store_next(gpstore, gpath)) (*nlinks)++;
+  (*nkmers)++;
+  if(binary) gpath_save_bin_sbuf(hkey, sbuf, subset, graph);
+  else gpath_save_sbuf(hkey, sbuf, subset, NULL, NULL, graph);
+}
+
+// Save all links of `a` then the links of every `step`th kmer of `b`, which
+// has the same kmers, so those kmers appear twice in the file.
+// `path` is a mkstemp() template. Returns the length of the longest record.
+static size_t _save_links_twice_tmp(dBGraph *a, dBGraph *b, size_t step,
+                                    char *path, bool binary)
+{
+  ZeroSizeBuffer hists[LINKS_TEST_NCOLS];
+  BgzfWriter out;
+  BgzfCompressor cmp;
+  GPathSubset subset;
+  StrBuf hdr, body;
+  size_t nkmers = 0, nlinks = 0, end, maxlen = 0;
+  hkey_t hkey;
+
+  memset(hists, 0, sizeof(hists));
+  gpath_subset_alloc(&subset);
+  gpath_subset_init(&subset, &a->gpstore.gpset);
+  strbuf_alloc(&hdr, 4096);
+  strbuf_alloc(&body, 16 * ONE_MEGABYTE);
+
+  for(hkey = 0; hkey < a->ht.capacity; hkey++) {
+    end = body.end;
+    _append_kmer_links(a, hkey, binary, &body, &subset, &nkmers, &nlinks);
+    maxlen = MAX2(maxlen, body.end - end);
+  }
+
+  gpath_subset_init(&subset, &b->gpstore.gpset);
+  for(hkey = 0; hkey < b->ht.capacity; hkey += step)
+    _append_kmer_links(b, hkey, binary, &body, &subset, &nkmers, &nlinks);
+
+  int fd = mkstemp(path);
+  TASSERT(fd >= 0);
+  close(fd);
+
+  // Header has to give the number of records in the file
+  cJSON *json = gpath_save_mkhdr(path, NULL, NULL, NULL, 0,
+                                 hists, LINKS_TEST_NCOLS, binary, a);
+  cJSON *paths = json_hdr_get_paths(json, path);
+  cJSON_ReplaceItemInObject(paths, "num_kmers_with_paths",
+                            cJSON_CreateNumber(nkmers));
+  cJSON_ReplaceItemInObject(paths, "num_paths", cJSON_CreateNumber(nlinks));
+  json_hdr_sprint(json, &hdr);
+  cJSON_Delete(json);
+
+  // The writer will not overwrite an existing file
+  unlink(path);
+  bgzf_writer_open(&out, path);
+  bgzf_compressor_alloc(&cmp);
+  bgzf_write_strbuf(&out, &cmp, &hdr);
+  bgzf_write_strbuf(&out, &cmp, &body);
+  bgzf_compressor_dealloc(&cmp);
+  bgzf_writer_close(&out);
+
+  strbuf_dealloc(&hdr);
+  strbuf_dealloc(&body);
+  gpath_subset_dealloc(&subset);
+  return maxlen;
+}
+
+static void _test_gpath_load_chunks()
+{
+  test_status("Testing loading links in chunks with threads in gpath_reader.c");
+
+  dBGraph a, b, loaded[4];
+  size_t i, kmer_size = 31, seqlen = 8000, mem = 8*ONE_MEGABYTE, maxlen;
+  char *seq = ctx_malloc(seqlen+1);
+  char paths[2][32] = {"/tmp/ctx_links_test.XXXXXX",
+                       "/tmp/ctx_links_test.XXXXXX"};
+
+  rand_bases(seq, seqlen);
+  seq[seqlen] = '\0';
+
+  // One kmer has a record longer than a whole chunk, so records cross the
+  // chunk boundary and the reader has to read more before passing any on
+  _links_test_graph(&a, kmer_size, seq, seqlen, mem);
+  _links_test_graph(&b, kmer_size, seq, seqlen, mem);
+  _add_random_links(&a, 4, 1);
+  _add_random_kmer_links(&a, db_graph_find_str(&a, seq).key, 120000);
+  _add_random_links(&b, 2, 5);
+
+  // Load each file with one thread and with three threads
+  for(i = 0; i < 2; i++) {
+    maxlen = _save_links_twice_tmp(&a, &b, 5, paths[i], i == 1);
+    TASSERT(maxlen > GPATH_LOAD_CHUNK);
+    _links_test_graph(&loaded[2*i], kmer_size, seq, seqlen, mem);
+    _links_test_graph(&loaded[2*i+1], kmer_size, seq, seqlen, mem);
+    _load_links(&loaded[2*i], paths[i], 1);
+    _load_links(&loaded[2*i+1], paths[i], 3);
+  }
+
+  // Kmers seen twice are merged
+  TASSERT(loaded[0].gpstore.num_kmers_with_paths ==
+          a.gpstore.num_kmers_with_paths);
+  TASSERT(loaded[0].gpstore.num_paths > a.gpstore.num_paths);
+
+  _check_same_links(&loaded[0], &loaded[1]); // text
+  _check_same_links(&loaded[2], &loaded[3]); // binary
+  _check_same_links(&loaded[0], &loaded[2]);
+
+  for(i = 0; i < 4; i++) db_graph_dealloc(&loaded[i]);
+  db_graph_dealloc(&a);
+  db_graph_dealloc(&b);
+  ctx_free(seq);
+  unlink(paths[0]);
+  unlink(paths[1]);
+}
+
 void test_paths()
 {
   _test_add_paths();
+  _test_gpath_batch();
+  _test_gpath_hash_mt();
+  _test_gpath_store_compact();
+  _test_gpath_save_binary();
+  _test_gpath_load_chunks();
 }
@@ -1,8 +1,10 @@
 #include "global.h"
 #include "all_tests.h"
 #include "util.h"
+#include "bgzf_writer.h"
 
 #include <math.h> // NAN, INFINITY
+#include <unistd.h> // close, unlink
 
 static bool test_canary(const char *ptr, size_t start, size_t len, char canary)
 {
@@ -145,6 +147,173 @@ static void test_util_calc_N50()
   TASSERT(calc_N50(arr, 10, 55) == 8);
 }
 
+// Large allocations should be zeroed and counted as allocs/frees whatever the
+// huge page, NUMA and prefault settings (placement may not be available)
+static void test_alloc_large()
+{
+  test_status("Testing ctx_calloc_large()");
+
+  const AllocNuma numas[] = {ALLOC_NUMA_NONE, ALLOC_NUMA_INTERLEAVE};
+  size_t i, j, h, nallocs, nfrees, n = ALLOC_LARGE_MIN / sizeof(uint64_t);
+  uint64_t *arr, sum;
+  AllocNuma numa;
+
+  TASSERT(alloc_numa_parse("interleave", &numa) && numa == ALLOC_NUMA_INTERLEAVE);
+  TASSERT(alloc_numa_parse("none", &numa) && numa == ALLOC_NUMA_NONE);
+  TASSERT(!alloc_numa_parse("local", &numa));
+
+  for(h = 0; h < 4; h++) {
+    for(i = 0; i < sizeof(numas)/sizeof(numas[0]); i++) {
+      alloc_large_config(h & 1, numas[i], h & 2);
+      nallocs = alloc_get_num_allocs();
+      nfrees = alloc_get_num_frees();
+
+      arr = ctx_calloc_large(n, sizeof(uint64_t));
+      for(j = 0, sum = 0; j < n; j += 511) sum |= arr[j];
+      TASSERT(sum == 0);
+      for(j = 0; j < n; j += 511) arr[j] = j;
+      TASSERT(arr[511*3] == 511*3);
+      ctx_free_large(arr);
+
+      // Small allocations use calloc()
+      arr = ctx_calloc_large(16, sizeof(uint64_t));
+      TASSERT(arr[15] == 0);
+      ctx_free_large(arr);
+
+      TASSERT(alloc_get_num_allocs() - nallocs == 2);
+      TASSERT(alloc_get_num_frees() - nfrees == 2);
+    }
+  }
+
+  // Pages do not divide evenly between three threads
+  alloc_large_config(false, ALLOC_NUMA_NONE, true);
+  alloc_large_set_nthreads(3);
+  arr = ctx_calloc_large(n, sizeof(uint64_t));
+  for(j = 0, sum = 0; j < n; j += 511) sum |= arr[j];
+  TASSERT(sum == 0 && arr[n-1] == 0);
+  ctx_free_large(arr);
+  alloc_large_set_nthreads(1);
+  alloc_large_config(false, ALLOC_NUMA_NONE, false);
+}
+
+static void test_util_memset_mt()
+{
+  test_status("Testing util_memset_mt()");
+
+  // Large enough to be split between threads
+  size_t i, n = 3 * (1UL<<20) + 17;
+  uint8_t *arr = ctx_malloc(n+1);
+  arr[n] = 0;
+
+  util_memset_mt(arr, 0xab, n, 4);
+  for(i = 0; i < n && arr[i] == 0xab; i++) {}
+  TASSERT(i == n && arr[n] == 0);
+
+  util_memset_mt(arr+1, 0, 10, 4);
+  TASSERT(arr[0] == 0xab && arr[1] == 0 && arr[10] == 0 && arr[11] == 0xab);
+
+  ctx_free(arr);
+}
+
+// Check the block sizes (BC field) and input sizes of a BGZF file, then check
+// it decompresses to `buf`
+static void _check_bgzf_file(const char *path, const uint8_t *buf, size_t len)
+{
+  const uint8_t eof[28] = {0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0,
+                           'B', 'C', 2, 0, 0x1b, 0, 3, 0, 0, 0, 0, 0,
+                           0, 0, 0, 0};
+  size_t flen, bsize, isize, total = 0, nblocks = 0, i;
+  uint8_t *file, *blk, *out;
+  FILE *fh;
+  gzFile gzfh;
+  int n;
+
+  // Read the compressed file
+  TASSERT((fh = fopen(path, "r")) != NULL);
+  if(fh == NULL) return;
+  fseek(fh, 0, SEEK_END);
+  flen = ftell(fh);
+  fseek(fh, 0, SEEK_SET);
+  file = ctx_malloc(flen);
+  TASSERT(fread(file, 1, flen, fh) == flen);
+  fclose(fh);
+
+  // Last block is the empty EOF block
+  TASSERT(flen >= sizeof(eof));
+  TASSERT(memcmp(file + flen - sizeof(eof), eof, sizeof(eof)) == 0);
+
+  // Walk the blocks using the block size in each header
+  for(i = 0; i + 18 <= flen - sizeof(eof); i += bsize, nblocks++) {
+    blk = file + i;
+    TASSERT(blk[0] == 0x1f && blk[1] == 0x8b && blk[3] == 4);
+    TASSERT(blk[12] == 'B' && blk[13] == 'C');
+    bsize = (blk[16] | (size_t)blk[17] << 8) + 1;
+    TASSERT(bsize <= BGZF_MAX_BLOCK_SIZE && i + bsize <= flen);
+    if(bsize > BGZF_MAX_BLOCK_SIZE || i + bsize > flen) break;
+    isize = blk[bsize-4] | (size_t)blk[bsize-3] << 8 |
+            (size_t)blk[bsize-2] << 16 | (size_t)blk[bsize-1] << 24;
+    TASSERT(isize > 0 && isize <= BGZF_BLOCK_SIZE);
+    total += isize;
+  }
+  TASSERT2(i == flen - sizeof(eof), "%zu vs %zu", i, flen - sizeof(eof));
+  TASSERT2(total == len, "%zu vs %zu", total, len);
+  TASSERT(nblocks >= (len + BGZF_BLOCK_SIZE - 1) / BGZF_BLOCK_SIZE);
+  ctx_free(file);
+
+  // Decompress with zlib
+  out = ctx_malloc(len+1);
+  TASSERT((gzfh = gzopen(path, "r")) != NULL);
+  if(gzfh == NULL) { ctx_free(out); return; }
+  n = gzread(gzfh, out, len+1);
+  gzclose(gzfh);
+  TASSERT2(n >= 0 && (size_t)n == len, "%i vs %zu", n, len);
+  TASSERT(n >= 0 && memcmp(out, buf, MIN2((size_t)n, len)) == 0);
+  ctx_free(out);
+}
+
+static void _test_bgzf_write_buf(const uint8_t *buf, size_t len)
+{
+  BgzfWriter wtr;
+  BgzfCompressor cmp;
+
+  char path[] = "/tmp/ctx_bgzf_test.XXXXXX";
+  int fd = mkstemp(path);
+  TASSERT(fd >= 0);
+  if(fd < 0) return;
+  close(fd);
+  unlink(path); // writer refuses to overwrite a file
+
+  bgzf_writer_open(&wtr, path);
+  bgzf_compressor_alloc(&cmp);
+  bgzf_write(&wtr, &cmp, buf, len);
+  bgzf_compressor_dealloc(&cmp);
+  bgzf_writer_close(&wtr);
+
+  _check_bgzf_file(path, buf, len);
+  unlink(path);
+}
+
+static void test_bgzf_write()
+{
+  test_status("Testing bgzf_write()");
+
+  size_t i, len = 3 * BGZF_BLOCK_SIZE + 1000;
+  uint8_t *buf = ctx_malloc(len);
+
+  // Random bytes don't compress: blocks are closest to the maximum size
+  rand_bytes(buf, len);
+  _test_bgzf_write_buf(buf, len);
+
+  // Text that compresses well
+  for(i = 0; i < len; i++) buf[i] = "ACGT\n"[(i*i/7) % 5];
+  _test_bgzf_write_buf(buf, len);
+
+  // Fits in a single block
+  _test_bgzf_write_buf(buf, 100);
+
+  ctx_free(buf);
+}
+
 void test_util()
 {
   test_util_rev_nibble_lookup();
@@ -154,4 +323,7 @@ void test_util()
   test_util_calc_GCD();
   test_util_calc_N50();
   test_strnstr();
+  test_util_memset_mt();
+  test_alloc_large();
+  test_bgzf_write();
 }
@@ -272,7 +272,7 @@ static void _seed_from_file(AsyncIOData *data, size_t threadid, void *arg)
 static int _assemble_from_paths(hkey_t hkey, Assembler *assem)
 {
   const GPathStore *gpstore = &assem->db_graph->gpstore;
-  const size_t ncols = gpstore->gpset.ncols, colour = assem->colour;
+  const size_t colour = assem->colour;
   GPath *gpath = gpath_store_fetch_traverse(gpstore, hkey);
   size_t i, pathid, *used_paths = assem->used_paths;
   struct ContigStats s;
@@ -282,11 +282,12 @@ static int _assemble_from_paths(hkey_t hkey, Assembler *assem)
 
   gpath_set_reset(gpset);
 
-  for(; gpath != NULL; gpath = gpath->next)
+  for(; gpath != NULL; gpath = gpath_store_next(gpstore, gpath))
   {
     pathid = gpset_get_pkey(&gpstore->gpset, gpath);
 
-    if(gpath_has_colour(gpath, ncols, colour) && !bitset_get(used_paths, pathid))
+    if(gpath_has_colour(&gpstore->gpset, gpath, colour) &&
+       !bitset_get(used_paths, pathid))
     {
       GPathNew gpath_cpy = gpath_set_get(&gpstore->gpset, gpath);
       gpath_set_add_mt(gpset, gpath_cpy);
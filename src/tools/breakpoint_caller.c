@@ -40,11 +40,15 @@ typedef struct
   PathRefRun *allele_refs, *flank5p_refs;
   KOccurRunBuffer allele_run_buf, flank5p_run_buf;
 
+  // Calls are printed to output_buf, which is compressed and written to `out`
+  // once it is large, without holding a lock
+  StrBuf output_buf;
+  BgzfCompressor cmp;
+
   // Passed to all instances
   const KOGraph *kograph;
   const dBGraph *db_graph;
-  gzFile gzout;
-  pthread_mutex_t *const out_lock;
+  BgzfWriter *out;
   size_t *callid;
   const size_t min_ref_nkmers, max_ref_nkmers; // how many kmers of homology req
 } BreakpointCaller;
@@ -57,7 +61,7 @@ typedef struct
 #define MAX_REFRUNS_PER_CALLER(ncols) MAX_REFRUNS_PER_ORIENT(ncols)*2
 
 static BreakpointCaller* brkpt_callers_new(size_t num_callers,
-                                           gzFile gzout,
+                                           BgzfWriter *out,
                                            size_t min_ref_nkmers,
                                            size_t max_ref_nkmers,
                                            const KOGraph *kograph,
@@ -68,9 +72,6 @@ static BreakpointCaller* brkpt_callers_new(size_t num_callers,
   const size_t ncols = db_graph->num_of_cols;
   BreakpointCaller *callers = ctx_malloc(num_callers * sizeof(BreakpointCaller));
 
-  pthread_mutex_t *out_lock = ctx_malloc(sizeof(pthread_mutex_t));
-  if(pthread_mutex_init(out_lock, NULL) != 0) die("mutex init failed");
-
   size_t *callid = ctx_calloc(1, sizeof(size_t));
 
   // Each colour in each caller can have a GraphCache path at once
@@ -83,8 +84,7 @@ static BreakpointCaller* brkpt_callers_new(size_t num_callers,
     BreakpointCaller tmp = {.nthreads = num_callers,
                             .kograph = kograph,
                             .db_graph = db_graph,
-                            .gzout = gzout,
-                            .out_lock = out_lock,
+                            .out = out,
                             .callid = callid,
                             .allele_refs = path_ref_runs,
                             .flank5p_refs = path_ref_runs+MAX_REFRUNS_PER_ORIENT(ncols),
@@ -106,6 +106,8 @@ static BreakpointCaller* brkpt_callers_new(size_t num_callers,
     korun_buf_alloc(&callers[i].flank5p_run_buf, 128);
     graph_crawler_alloc(&callers[i].crawlers[0], db_graph);
     graph_crawler_alloc(&callers[i].crawlers[1], db_graph);
+    strbuf_alloc(&callers[i].output_buf, 2048);
+    bgzf_compressor_alloc(&callers[i].cmp);
   }
 
   return callers;
@@ -126,9 +128,9 @@ static void brkpt_callers_destroy(BreakpointCaller *callers, size_t num_callers)
     korun_buf_dealloc(&callers[i].flank5p_run_buf);
     graph_crawler_dealloc(&callers[i].crawlers[0]);
     graph_crawler_dealloc(&callers[i].crawlers[1]);
+    strbuf_dealloc(&callers[i].output_buf);
+    bgzf_compressor_dealloc(&callers[i].cmp);
   }
-  pthread_mutex_destroy(callers[0].out_lock);
-  ctx_free(callers[0].out_lock);
   ctx_free(callers[0].callid);
   ctx_free(callers[0].allele_refs);
   ctx_free(callers);
@@ -141,7 +143,7 @@ static void process_contig(BreakpointCaller *caller,
                            const KOccurRun *flank5p_runs, size_t nflank5p_runs,
                            const KOccurRun *flank3p_runs, size_t nflank3p_runs)
 {
-  gzFile gzout = caller->gzout;
+  StrBuf *sbuf = &caller->output_buf;
   const KOGraph *kograph = caller->kograph;
   const size_t kmer_size = caller->db_graph->kmer_size;
 
@@ -159,36 +161,37 @@ static void process_contig(BreakpointCaller *caller,
   size_t kmer3poffset = kmer_size-1-extra3pbases;
 
   size_t callid = __sync_fetch_and_add((volatile size_t*)caller->callid, 1);
-  pthread_mutex_lock(caller->out_lock);
 
   // This can be set to anything without a '.' in it
   const char prefix[] = "call";
 
   // 5p flank with list of ref intersections
-  gzprintf(gzout, ">brkpnt.%s%zu.5pflank chr=", prefix, callid);
-  koruns_gzprint(gzout, kmer_size, kograph, flank5p_runs, nflank5p_runs, 0, 0);
-  gzputc(gzout, '\n');
-  db_nodes_gzprint(flank5p->b, flank5p->len, caller->db_graph, gzout);
-  gzputc(gzout, '\n');
+  strbuf_sprintf(sbuf, ">brkpnt.%s%zu.5pflank chr=", prefix, callid);
+  koruns_sprint(sbuf, kmer_size, kograph, flank5p_runs, nflank5p_runs, 0, 0);
+  strbuf_append_char(sbuf, '\n');
+  db_nodes_sprint(flank5p->b, flank5p->len, caller->db_graph, sbuf);
+  strbuf_append_char(sbuf, '\n');
 
   // 3p flank with list of ref intersections
-  gzprintf(gzout, ">brkpnt.%s%zu.3pflank chr=", prefix, callid);
-  koruns_gzprint(gzout, kmer_size, kograph, flank3p_runs, nflank3p_runs,
-                 flank3pidx, kmer3poffset);
-  gzputc(gzout, '\n');
-  db_nodes_gzprint_cont(allelebuf->b+num_path_kmers,
-                        allelebuf->len-num_path_kmers,
-                        caller->db_graph, gzout);
-  gzputc(gzout, '\n');
+  strbuf_sprintf(sbuf, ">brkpnt.%s%zu.3pflank chr=", prefix, callid);
+  koruns_sprint(sbuf, kmer_size, kograph, flank3p_runs, nflank3p_runs,
+                flank3pidx, kmer3poffset);
+  strbuf_append_char(sbuf, '\n');
+  db_nodes_sprint_cont(allelebuf->b+num_path_kmers,
+                       allelebuf->len-num_path_kmers,
+                       caller->db_graph, sbuf);
+  strbuf_append_char(sbuf, '\n');
 
   // Print path with list of colours
-  gzprintf(gzout, ">brkpnt.%s%zu.path cols=%zu", prefix, callid, cols[0]);
-  for(i = 1; i < ncols; i++) gzprintf(gzout, ",%zu", cols[i]);
-  gzputc(gzout, '\n');
-  db_nodes_gzprint_cont(allelebuf->b, num_path_kmers, caller->db_graph, gzout);
-  gzprintf(gzout, "\n\n");
-
-  pthread_mutex_unlock(caller->out_lock);
+  strbuf_sprintf(sbuf, ">brkpnt.%s%zu.path cols=%zu",
+                 prefix, callid, (size_t)cols[0]);
+  for(i = 1; i < ncols; i++) strbuf_sprintf(sbuf, ",%zu", (size_t)cols[i]);
+  strbuf_append_char(sbuf, '\n');
+  db_nodes_sprint_cont(allelebuf->b, num_path_kmers, caller->db_graph, sbuf);
+  strbuf_append_str(sbuf, "\n\n");
+
+  if(sbuf->end > DEFAULT_IO_BUFSIZE)
+    bgzf_write_strbuf(caller->out, &caller->cmp, sbuf);
 }
 
 
@@ -528,10 +531,12 @@ static void breakpoint_caller(void *ptr, size_t threadid)
 
   HASH_ITERATE_PART(&caller->db_graph->ht, threadid, caller->nthreads,
                     breakpoint_caller_node, caller);
+
+  bgzf_write_strbuf(caller->out, &caller->cmp, &caller->output_buf);
 }
 
-// Print JSON header to gzout
-static void breakpoints_print_header(gzFile gzout, const char *out_path,
+// Print JSON header to out
+static void breakpoints_print_header(BgzfWriter *out, const char *out_path,
                                      char **seq_paths, size_t nseq_paths,
                                      const read_t *reads, size_t nreads,
                                      bool load_ref_edges,
@@ -591,28 +596,36 @@ static void breakpoints_print_header(gzFile gzout, const char *out_path,
   }
   json_hdr_augment_cmd(jsonhdr, "breakpoints", "contigs", contigs);
 
+  StrBuf sbuf;
+  BgzfCompressor cmp;
+  strbuf_alloc(&sbuf, 4096);
+  bgzf_compressor_alloc(&cmp);
+
   // Write header to file
-  json_hdr_gzprint(jsonhdr, gzout);
+  json_hdr_sprint(jsonhdr, &sbuf);
 
   // Print comments about the format
-  gzputs(gzout, "\n");
-  gzputs(gzout, "# This file was generated with McCortex\n");
-  gzputs(gzout, "#   written by Isaac Turner <turner.isaac@gmail.com>\n");
-  gzputs(gzout, "#   url: "MCCORTEX_URL"\n");
-  gzputs(gzout, "# \n");
-  gzputs(gzout, "# Comment lines begin with a # and are ignored, but must come after the header\n");
-  gzputs(gzout, "# Format is:\n");
-  gzputs(gzout, "#   chr=seq:start-end:strand:offset\n");
-  gzputs(gzout, "#   all coordinates are 1-based\n");
-  gzputs(gzout, "#   <strand> is + or -. If +, start <= end. If -, start >= end.\n");
-  gzputs(gzout, "#   <offset> is the position in the sequence where ref starts agreeing\n");
-  gzputs(gzout, "\n");
-
+  strbuf_append_str(&sbuf, "\n");
+  strbuf_append_str(&sbuf, "# This file was generated with McCortex\n");
+  strbuf_append_str(&sbuf, "#   written by Isaac Turner <turner.isaac@gmail.com>\n");
+  strbuf_append_str(&sbuf, "#   url: "MCCORTEX_URL"\n");
+  strbuf_append_str(&sbuf, "# \n");
+  strbuf_append_str(&sbuf, "# Comment lines begin with a # and are ignored, but must come after the header\n");
+  strbuf_append_str(&sbuf, "# Format is:\n");
+  strbuf_append_str(&sbuf, "#   chr=seq:start-end:strand:offset\n");
+  strbuf_append_str(&sbuf, "#   all coordinates are 1-based\n");
+  strbuf_append_str(&sbuf, "#   <strand> is + or -. If +, start <= end. If -, start >= end.\n");
+  strbuf_append_str(&sbuf, "#   <offset> is the position in the sequence where ref starts agreeing\n");
+  strbuf_append_str(&sbuf, "\n");
+  bgzf_write_strbuf(out, &cmp, &sbuf);
+
+  bgzf_compressor_dealloc(&cmp);
+  strbuf_dealloc(&sbuf);
   cJSON_Delete(jsonhdr);
 }
 
 void breakpoints_call(size_t nthreads, size_t ref_col,
-                      gzFile gzout, const char *out_path,
+                      BgzfWriter *out, const char *out_path,
                       const read_t *reads, size_t num_reads,
                       char **seq_paths, size_t num_seq_paths,
                       bool load_ref_edges,
@@ -631,7 +644,7 @@ void breakpoints_call(size_t nthreads, size_t ref_col,
   // Restore graph edges
   db_graph->col_edges = tmp_edges;
 
-  BreakpointCaller *callers = brkpt_callers_new(nthreads, gzout,
+  BreakpointCaller *callers = brkpt_callers_new(nthreads, out,
                                                 min_ref_nkmers, max_ref_nkmers,
                                                 &kograph, db_graph);
 
@@ -642,7 +655,7 @@ void breakpoints_call(size_t nthreads, size_t ref_col,
   status("  Finding breakpoints after at least %zu kmers (%zubp) of homology",
          min_ref_nkmers, min_ref_nkmers+db_graph->kmer_size-1);
 
-  breakpoints_print_header(gzout, out_path,
+  breakpoints_print_header(out, out_path,
                            seq_paths, num_seq_paths,
                            reads, num_reads,
                            load_ref_edges,
@@ -2,6 +2,7 @@
 #define BREAKPOINT_CALLER_H_
 
 #include "db_graph.h"
+#include "bgzf_writer.h"
 
 #include "seq_file/seq_file.h"
 #include "cJSON/cJSON.h"
@@ -18,8 +19,8 @@
  *
  * @param nthreads      number of threads to use
  * @param ref_col       colour to load reference sequence into
- * @param gzout         gzFile to print breakpoints to
- * @param out_path      path to output file that gzout points to
+ * @param out           BGZF file to print breakpoints to
+ * @param out_path      path to output file that out points to
  * @param reads         reference sequence to load into the graph
  * @param num_reads     number of reference contigs
  * @param seq_paths     paths to the files which the ref reads where loaded from
@@ -31,7 +32,7 @@
  * @param db_graph      de Bruijn graph to use
  **/
 void breakpoints_call(size_t nthreads, size_t ref_col,
-                      gzFile gzout, const char *out_path,
+                      BgzfWriter *out, const char *out_path,
                       const read_t *reads, size_t num_reads,
                       char **seq_paths, size_t num_seq_paths,
                       bool load_ref_edges,
@@ -15,7 +15,7 @@
 
 BubbleCaller* bubble_callers_new(size_t num_callers,
                                  const BubbleCallingPrefs *prefs,
-                                 gzFile gzout,
+                                 BgzfWriter *out,
                                  const dBGraph *db_graph)
 {
   ctx_assert(num_callers > 0);
@@ -26,9 +26,6 @@ BubbleCaller* bubble_callers_new(size_t num_callers,
 
   BubbleCaller *callers = ctx_malloc(num_callers * sizeof(BubbleCaller));
 
-  pthread_mutex_t *out_lock = ctx_malloc(sizeof(pthread_mutex_t));
-  if(pthread_mutex_init(out_lock, NULL) != 0) die("mutex init failed");
-
   uint64_t *nbubbles_ptr = ctx_calloc(1, sizeof(uint64_t));
 
   for(i = 0; i < num_callers; i++)
@@ -41,8 +38,7 @@ BubbleCaller* bubble_callers_new(size_t num_callers,
                         .num_serial_bubbles = 0,
                         .nbubbles_ptr = nbubbles_ptr,
                         .prefs = prefs,
-                        .db_graph = db_graph, .gzout = gzout,
-                        .out_lock = out_lock};
+                        .db_graph = db_graph, .out = out};
 
     memcpy(&callers[i], &tmp, sizeof(BubbleCaller));
 
@@ -59,6 +55,7 @@ BubbleCaller* bubble_callers_new(size_t num_callers,
     cache_stepptr_buf_alloc(&callers[i].spp_forward, 1024);
     cache_stepptr_buf_alloc(&callers[i].spp_reverse, 1024);
     strbuf_alloc(&callers[i].output_buf, 2048);
+    bgzf_compressor_alloc(&callers[i].cmp);
   }
 
   return callers;
@@ -85,15 +82,14 @@ void bubble_callers_destroy(BubbleCaller *callers, size_t num_callers)
     cache_stepptr_buf_dealloc(&callers[i].spp_forward);
     cache_stepptr_buf_dealloc(&callers[i].spp_reverse);
     strbuf_dealloc(&callers[i].output_buf);
+    bgzf_compressor_dealloc(&callers[i].cmp);
   }
-  pthread_mutex_destroy(callers[0].out_lock);
-  ctx_free(callers[0].out_lock);
   ctx_free(callers[0].nbubbles_ptr);
   ctx_free(callers);
 }
 
-// Print JSON header to gzout
-static void bubble_caller_print_header(gzFile gzout, const char* out_path,
+// Print JSON header to out
+static void bubble_caller_print_header(BgzfWriter *out, const char* out_path,
                                        const BubbleCallingPrefs *prefs,
                                        cJSON **hdrs, size_t nhdrs,
                                        const dBGraph *db_graph)
@@ -118,21 +114,38 @@ static void bubble_caller_print_header(gzFile gzout, const char* out_path,
     cJSON_AddItemToArray(haploids, cJSON_CreateInt(prefs->haploid_cols[i]));
   json_hdr_augment_cmd(jsonhdr, "bubbles", "haploid_colours", haploids);
 
+  StrBuf sbuf;
+  BgzfCompressor cmp;
+  strbuf_alloc(&sbuf, 4096);
+  bgzf_compressor_alloc(&cmp);
+
   // Write header to file
-  json_hdr_gzprint(jsonhdr, gzout);
+  json_hdr_sprint(jsonhdr, &sbuf);
 
   // Print comments about the format
-  gzputs(gzout, "\n");
-  gzputs(gzout, "# This file was generated with McCortex\n");
-  gzputs(gzout, "#   written by Isaac Turner <turner.isaac@gmail.com>\n");
-  gzputs(gzout, "#   url: "MCCORTEX_URL"\n");
-  gzputs(gzout, "# \n");
-  gzputs(gzout, "# Comment lines begin with a # and are ignored, but must come after the header\n");
-  gzputs(gzout, "\n");
-
+  strbuf_append_str(&sbuf, "\n");
+  strbuf_append_str(&sbuf, "# This file was generated with McCortex\n");
+  strbuf_append_str(&sbuf, "#   written by Isaac Turner <turner.isaac@gmail.com>\n");
+  strbuf_append_str(&sbuf, "#   url: "MCCORTEX_URL"\n");
+  strbuf_append_str(&sbuf, "# \n");
+  strbuf_append_str(&sbuf, "# Comment lines begin with a # and are ignored, but must come after the header\n");
+  strbuf_append_str(&sbuf, "\n");
+  bgzf_write_strbuf(out, &cmp, &sbuf);
+
+  bgzf_compressor_dealloc(&cmp);
+  strbuf_dealloc(&sbuf);
   cJSON_Delete(jsonhdr);
 }
 
+// Compress and write buffered bubbles
+static void bubble_caller_flush(BubbleCaller *caller)
+{
+  if(caller->out != NULL)
+    bgzf_write_strbuf(caller->out, &caller->cmp, &caller->output_buf);
+  else
+    strbuf_reset(&caller->output_buf);
+}
+
 static void branch_to_str(const dBNode *nodes, size_t len, bool print_first_kmer,
                           StrBuf *sbuf, const dBGraph *db_graph)
 {
@@ -181,9 +194,9 @@ static void print_bubble(BubbleCaller *caller,
   // Print Bubble
   //
 
-  // write to string buffer then flush to gzFile
+  // write to string buffer, flushed once it is large
   StrBuf *sbuf = &caller->output_buf;
-  strbuf_reset(sbuf);
+  const size_t start = sbuf->end;
 
   // Temporary node buffer to use
   dBNodeBuffer *pathbuf = &caller->pathbuf;
@@ -241,12 +254,11 @@ static void print_bubble(BubbleCaller *caller,
 
   strbuf_append_char(sbuf, '\n');
 
-  ctx_assert(strlen(sbuf->b) == sbuf->end);
+  // Only check this bubble, the rest of the buffer has been checked already
+  ctx_assert(strlen(sbuf->b + start) == sbuf->end - start);
+  (void)start;
 
-  // lock, print, unlock
-  pthread_mutex_lock(caller->out_lock);
-  gzwrite(caller->gzout, sbuf->b, sbuf->end);
-  pthread_mutex_unlock(caller->out_lock);
+  if(sbuf->end > DEFAULT_IO_BUFSIZE) bubble_caller_flush(caller);
 }
 
 // `fork_node` is a node with outdegree > 1
@@ -492,11 +504,13 @@ void bubble_caller(void *args, size_t threadid)
 
   HASH_ITERATE_PART(&caller->db_graph->ht, threadid, caller->nthreads,
                     bubble_caller_node, caller);
+
+  bubble_caller_flush(caller);
 }
 
 void invoke_bubble_caller(size_t num_of_threads,
                           const BubbleCallingPrefs *prefs,
-                          gzFile gzout, const char *out_path,
+                          BgzfWriter *out, const char *out_path,
                           cJSON **hdrs, size_t nhdrs,
                           const dBGraph *db_graph)
 {
@@ -513,10 +527,10 @@ void invoke_bubble_caller(size_t num_of_threads,
   strbuf_dealloc(&tmpstr);
 
   // Print header
-  bubble_caller_print_header(gzout, out_path, prefs, hdrs, nhdrs, db_graph);
+  bubble_caller_print_header(out, out_path, prefs, hdrs, nhdrs, db_graph);
 
   BubbleCaller *callers = bubble_callers_new(num_of_threads, prefs,
-                                             gzout, db_graph);
+                                             out, db_graph);
 
   // Run
   util_run_threads(callers, num_of_threads, sizeof(callers[0]),
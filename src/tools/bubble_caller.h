@@ -6,6 +6,7 @@
 #include "graph_walker.h"
 #include "repeat_walker.h"
 #include "cmd.h"
+#include "bgzf_writer.h"
 
 #include "cJSON/cJSON.h"
 
@@ -44,7 +45,10 @@ typedef struct
   GraphWalker wlk;
   RepeatWalker rptwlk;
 
+  // Bubbles are printed to output_buf, which is compressed and written to
+  // `out` once it is large, without holding a lock
   StrBuf output_buf;
+  BgzfCompressor cmp;
   uint64_t num_haploid_bubbles; // number of dropped bubbles in haploid sample
   uint64_t num_serial_bubbles; // how many bubbles were dropped for 'serial'
 
@@ -52,13 +56,12 @@ typedef struct
   uint64_t *nbubbles_ptr; // statistics - shared pointer
   const BubbleCallingPrefs *prefs;
   const dBGraph *db_graph;
-  gzFile gzout;
-  pthread_mutex_t *const out_lock;
+  BgzfWriter *const out;
 } BubbleCaller;
 
 BubbleCaller* bubble_callers_new(size_t num_callers,
                                  const BubbleCallingPrefs *prefs,
-                                 gzFile gzout,
+                                 BgzfWriter *out,
                                  const dBGraph *db_graph);
 
 void bubble_callers_destroy(BubbleCaller *callers, size_t num_callers);
@@ -70,12 +73,12 @@ void find_bubbles(BubbleCaller *caller, dBNode fork_node);
 // or caller->spp_reverse (if they traverse the unitig in reverse)
 void find_bubbles_ending_with(BubbleCaller *caller, GCacheUnitig *unitig);
 
-// Run bubble caller, write output to gzout
+// Run bubble caller, write output to `out`
 // @param hdrs JSON headers of input files
 // @param nhdrs number of JSON headers of input files
 void invoke_bubble_caller(size_t num_of_threads,
                           const BubbleCallingPrefs *prefs,
-                          gzFile gzout, const char *out_path,
+                          BgzfWriter *out, const char *out_path,
                           cJSON **hdrs, size_t nhdrs,
                           const dBGraph *db_graph);
 
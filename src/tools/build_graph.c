@@ -5,6 +5,7 @@
 #include "seq_reader.h"
 #include "async_read_io.h"
 #include "seq_loading_stats.h"
+#include "covg_buffer.h"
 #include "util.h"
 #include "file_util.h"
 
@@ -19,6 +20,7 @@ typedef struct {
   SeqLoadingStats *stats; // [files]
   size_t nreads;
   volatile size_t *shared_nreads;
+  CovgBuffer covgbuf; // coverage and edge updates from this thread
 } BuildGraphThread;
 
 //
@@ -59,18 +61,22 @@ static bool seq_reads_are_novel(read_t *r1, read_t *r2,
     got_kmer2 = (start2 < r2->seq.end);
   }
 
-  bool found1 = false, found2 = false;
+  bool found1 = false, found2 = false, novel;
+  uint64_t capacity;
 
-  // Look up first kmer
-  if(got_kmer1) {
-    bkmer1 = binary_kmer_from_str(r1->seq.b + start1, kmer_size);
-    node1 = db_graph_find_or_add_node_mt(db_graph, bkmer1, &found1);
-  }
+  if(got_kmer1) bkmer1 = binary_kmer_from_str(r1->seq.b + start1, kmer_size);
+  if(got_kmer2) bkmer2 = binary_kmer_from_str(r2->seq.b + start2, kmer_size);
+
+  db_graph_grow_enter(db_graph);
 
-  // Look up second kmer
-  if(got_kmer2) {
-    bkmer2 = binary_kmer_from_str(r2->seq.b + start2, kmer_size);
-    node2 = db_graph_find_or_add_node_mt(db_graph, bkmer2, &found2);
+  // Look up first and second kmers, growing the hash table if it is full
+  while(1) {
+    capacity = db_graph->ht.capacity;
+    if(got_kmer1) node1 = db_graph_find_or_add_node_mt(db_graph, bkmer1, &found1);
+    if(got_kmer2) node2 = db_graph_find_or_add_node_mt(db_graph, bkmer2, &found2);
+    if((!got_kmer1 || node1.key != HASH_NOT_FOUND) &&
+       (!got_kmer2 || node2.key != HASH_NOT_FOUND)) break;
+    db_graph_grow_mt(db_graph, capacity);
   }
 
   size_t num_kmers_novel = !found1 + !found2;
@@ -78,17 +84,18 @@ static bool seq_reads_are_novel(read_t *r1, read_t *r2,
 
   // Each read gives no kmer or a duplicate kmer
   // used find_or_insert so if we have a kmer we have a graph node
-  if((!got_kmer1 || db_node_has_read_start_mt(db_graph, node1)) &&
-     (!got_kmer2 || db_node_has_read_start_mt(db_graph, node2)))
-  {
-    return false;
-  }
+  novel = !((!got_kmer1 || db_node_has_read_start_mt(db_graph, node1)) &&
+            (!got_kmer2 || db_node_has_read_start_mt(db_graph, node2)));
 
   // Read is novel
-  if(got_kmer1) (void)db_node_set_read_start_mt(db_graph, node1);
-  if(got_kmer2) (void)db_node_set_read_start_mt(db_graph, node2);
+  if(novel) {
+    if(got_kmer1) (void)db_node_set_read_start_mt(db_graph, node1);
+    if(got_kmer2) (void)db_node_set_read_start_mt(db_graph, node2);
+  }
 
-  return true;
+  db_graph_grow_exit(db_graph);
+
+  return novel;
 }
 
 
@@ -96,63 +103,206 @@ static bool seq_reads_are_novel(read_t *r1, read_t *r2,
 // Add to the de bruijn graph
 //
 
-static inline dBNode _find_or_insert(dBGraph *db_graph,
-                                     BinaryKmer bkmer, size_t colour,
-                                     bool must_exist_in_graph, bool *found)
+// Update coverage and colour of a node, via `covgbuf` if it is not NULL
+static inline void _update_node(dBGraph *db_graph, CovgBuffer *covgbuf,
+                                dBNode node, size_t colour)
 {
-  dBNode node;
+  if(covgbuf) covg_buffer_update_node(covgbuf, node, colour);
+  else db_graph_update_node_mt(db_graph, node, colour);
+}
+
+// If `bloom` is not NULL, kmers not in the graph are counted and only added
+// once seen bloom->min_count times. found[i] is true for kmers not added.
+// Returns the number of kmers dealt with, which is less than n if the hash
+// table is full (only if growable). The kmer that did not fit has already
+// been counted in the bloom filter: its count is stored in *retry_nseen, to be
+// passed back in when retrying from that kmer, so it is not counted twice.
+// Otherwise *retry_nseen is SIZE_MAX.
+static inline size_t _find_or_insert_batch(dBGraph *db_graph,
+                                           const BinaryKmer *bkmers,
+                                           const RollHash *rhashes, size_t n,
+                                           size_t colour,
+                                           bool must_exist_in_graph,
+                                           KmerBloom *bloom,
+                                           CovgBuffer *covgbuf,
+                                           dBNode *nodes, bool *found,
+                                           size_t *retry_nseen)
+{
+  size_t i, nseen, prev_nseen = *retry_nseen;
+  BinaryKmer bkey;
+
+  *retry_nseen = SIZE_MAX;
+
   if(must_exist_in_graph)
   {
     // Doesn't have to be threadsafe find_mt, since we are not adding
-    node = db_graph_find_node(db_graph, bkmer);
-    *found = (node.key != HASH_NOT_FOUND);
-    if(*found) db_graph_update_node_mt(db_graph, node, colour);
+    db_graph_find_nodes(db_graph, bkmers, rhashes, n, nodes);
+    for(i = 0; i < n; i++) {
+      found[i] = (nodes[i].key != HASH_NOT_FOUND);
+      if(found[i]) _update_node(db_graph, covgbuf, nodes[i], colour);
+    }
+  }
+  else if(bloom != NULL)
+  {
+    // Only look up kmers in the bloom filter if they are not in the graph.
+    // Other threads are adding kmers, so use the threadsafe find
+    db_graph_find_nodes_mt(db_graph, bkmers, rhashes, n, nodes);
+    for(i = 0; i < n; i++) {
+      found[i] = (nodes[i].key != HASH_NOT_FOUND);
+      if(!found[i]) {
+        if(i == 0 && prev_nseen != SIZE_MAX) nseen = prev_nseen;
+        else {
+          bkey = binary_kmer_get_key(bkmers[i], db_graph->kmer_size);
+          nseen = kmer_bloom_add_mt(bloom, bkey);
+        }
+        if(nseen+1 < bloom->min_count) { found[i] = true; continue; }
+        nodes[i] = db_graph_find_or_add_node_mt(db_graph, bkmers[i], &found[i]);
+        if(nodes[i].key == HASH_NOT_FOUND) {
+          *retry_nseen = nseen;
+          return i; // table full
+        }
+        // Add coverage from the times we saw the kmer before adding it
+        if(!found[i] && db_graph_has_covgs(db_graph))
+          db_node_add_col_covg_mt(db_graph, nodes[i].key, colour, nseen);
+      }
+      _update_node(db_graph, covgbuf, nodes[i], colour);
+    }
   }
   else
   {
-    node = db_graph_find_or_add_node_mt(db_graph, bkmer, found);
-    db_graph_update_node_mt(db_graph, node, colour);
+    // Stops at the first kmer that does not fit, so the found flags of kmers
+    // after it are not lost when they are retried after growing the table
+    n = db_graph_find_or_add_nodes_mt(db_graph, bkmers, rhashes, n,
+                                      nodes, found);
+    for(i = 0; i < n; i++)
+      _update_node(db_graph, covgbuf, nodes[i], colour);
+    return n;
   }
-  return node;
+
+  return n;
 }
 
-// Threadsafe
 // Sequence must be entirely ACGT and len >= kmer_size
-// Returns number of non-novel kmers seen
-size_t build_graph_from_str_mt(dBGraph *db_graph, size_t colour,
-                               const char *seq, size_t len,
-                               bool must_exist_in_graph)
+// If `covgbuf` is not NULL, coverage and edge updates go via the buffer. If
+// the table can grow, the grow flush hook must flush the buffer (see
+// db_graph_set_grow_flush()), since node keys change when the table grows.
+// Returns number of kmers seen that were not added to the graph as new kmers
+static size_t _build_graph_from_str_mt(dBGraph *db_graph, size_t colour,
+                                       const char *seq, size_t len,
+                                       bool must_exist_in_graph,
+                                       KmerBloom *bloom, CovgBuffer *covgbuf)
 {
   ctx_assert(len >= db_graph->kmer_size);
+  ctx_assert(!covgbuf || !db_graph->grow_nthreads || db_graph->grow_flush);
   const size_t kmer_size = db_graph->kmer_size;
-  BinaryKmer bkmer;
+  BinaryKmer bkmer, bkmers[HASH_BATCH_SIZE];
+  RollHasher roller;
+  RollHash rhash = {.fw = 0, .rc = 0}, rhashes[HASH_BATCH_SIZE];
   Nucleotide nuc;
-  dBNode prev, curr;
-  size_t i, num_nonnovel_kmers = 0;
+  dBNode prev = {.key = HASH_NOT_FOUND}, nodes[HASH_BATCH_SIZE];
+  bool found[HASH_BATCH_SIZE];
+  size_t i, j, m, nadded, num_nonnovel_kmers = 0, retry_nseen = SIZE_MAX;
   size_t edge_col = db_graph->num_edge_cols == 1 ? 0 : colour;
-  bool found;
+  BinaryKmer bkmer0;
+  RollHash rhash0;
+  uint64_t capacity;
 
   bkmer = binary_kmer_from_str(seq, kmer_size);
-  prev = _find_or_insert(db_graph, bkmer, colour, must_exist_in_graph, &found);
-  num_nonnovel_kmers += found;
+  bkmer = binary_kmer_right_shift_one_base(bkmer);
 
-  for(i = kmer_size; i < len; i++, prev = curr)
+  if(BINARY_KMER_ROLL_HASH) {
+    roll_hash_init(&roller, kmer_size, NUM_BKMER_WORDS);
+    rhash = binary_kmer_roll_hash(bkmer, kmer_size);
+  }
+
+  db_graph_grow_enter(db_graph);
+
+  // Look up kmers in batches so hash table buckets can be prefetched
+  for(i = kmer_size-1; i < len; )
   {
-    nuc = dna_char_to_nuc(seq[i]);
-    bkmer = binary_kmer_left_shift_add(bkmer, kmer_size, nuc);
-    curr = _find_or_insert(db_graph, bkmer, colour, must_exist_in_graph, &found);
-    if(prev.key != HASH_NOT_FOUND && curr.key != HASH_NOT_FOUND)
-      db_graph_add_edge_mt(db_graph, edge_col, prev, curr);
-    num_nonnovel_kmers += found;
+    bkmer0 = bkmer;
+    rhash0 = rhash;
+    capacity = db_graph->ht.capacity;
+
+    for(m = 0; m < HASH_BATCH_SIZE && i < len; m++, i++) {
+      nuc = dna_char_to_nuc(seq[i]);
+      if(BINARY_KMER_ROLL_HASH) {
+        roll_hash_shift(&roller, &rhash, binary_kmer_first_nuc(bkmer, kmer_size),
+                        nuc);
+        rhashes[m] = rhash;
+      }
+      bkmer = binary_kmer_left_shift_add(bkmer, kmer_size, nuc);
+      bkmers[m] = bkmer;
+    }
+
+    nadded = _find_or_insert_batch(db_graph, bkmers,
+                                   BINARY_KMER_ROLL_HASH ? rhashes : NULL, m,
+                                   colour, must_exist_in_graph, bloom,
+                                   covgbuf, nodes, found, &retry_nseen);
+
+    for(j = 0; j < nadded; j++) {
+      if(prev.key != HASH_NOT_FOUND && nodes[j].key != HASH_NOT_FOUND) {
+        if(covgbuf) covg_buffer_add_edge(covgbuf, colour, prev, nodes[j]);
+        else db_graph_add_edge_mt(db_graph, edge_col, prev, nodes[j]);
+      }
+      num_nonnovel_kmers += found[j];
+      prev = nodes[j];
+    }
+
+    if(nadded < m) {
+      // Hash table full: grow it then resume from the first kmer not added.
+      // Nodes move when the table grows so look up prev again
+      db_graph_grow_mt(db_graph, capacity);
+      i -= m - nadded;
+      bkmer = nadded ? bkmers[nadded-1] : bkmer0;
+      if(BINARY_KMER_ROLL_HASH) rhash = nadded ? rhashes[nadded-1] : rhash0;
+      if(prev.key != HASH_NOT_FOUND)
+        prev = db_graph_find_node(db_graph, bkmer);
+    }
   }
 
+  db_graph_grow_exit(db_graph);
+
   return num_nonnovel_kmers;
 }
 
+// Threadsafe
+// Sequence must be entirely ACGT and len >= kmer_size
+// Returns number of non-novel kmers seen
+size_t build_graph_from_str_mt(dBGraph *db_graph, size_t colour,
+                               const char *seq, size_t len,
+                               bool must_exist_in_graph)
+{
+  return _build_graph_from_str_mt(db_graph, colour, seq, len,
+                                  must_exist_in_graph, NULL, NULL);
+}
+
+// Threadsafe
+// Only add kmers to the graph once seen bloom->min_count times
+// Returns number of kmers seen that were not added to the graph as new kmers
+size_t build_graph_from_str_bloom_mt(dBGraph *db_graph, size_t colour,
+                                     const char *seq, size_t len,
+                                     KmerBloom *bloom)
+{
+  return _build_graph_from_str_mt(db_graph, colour, seq, len, false, bloom,
+                                  NULL);
+}
+
+// Threadsafe
+// Coverage and edge updates go via covgbuf, which must be private to this thread
+size_t build_graph_from_str_buf_mt(dBGraph *db_graph, size_t colour,
+                                   const char *seq, size_t len,
+                                   CovgBuffer *covgbuf)
+{
+  return _build_graph_from_str_mt(db_graph, colour, seq, len, false, NULL,
+                                  covgbuf);
+}
+
 // Already found a start position
 // Stats must be private to this thread
 static void load_read(const read_t *r, uint8_t qual_cutoff, uint8_t hp_cutoff,
-                      bool must_exist_in_graph, Colour colour,
+                      bool must_exist_in_graph, KmerBloom *bloom,
+                      CovgBuffer *covgbuf, Colour colour,
                       SeqLoadingStats *stats, dBGraph *db_graph)
 {
   const size_t kmer_size = db_graph->kmer_size;
@@ -166,9 +316,11 @@ static void load_read(const read_t *r, uint8_t qual_cutoff, uint8_t hp_cutoff,
                                 qual_cutoff, hp_cutoff, &search_start);
 
     contig_len = contig_end - contig_start;
-    num_nonnovel_kmers = build_graph_from_str_mt(db_graph, colour,
-                                                 r->seq.b+contig_start, contig_len,
-                                                 must_exist_in_graph);
+    num_nonnovel_kmers = _build_graph_from_str_mt(db_graph, colour,
+                                                  r->seq.b+contig_start,
+                                                  contig_len,
+                                                  must_exist_in_graph, bloom,
+                                                  covgbuf);
 
     size_t contig_kmers = contig_len + 1 - kmer_size;
     size_t num_novel_kmers = contig_kmers - num_nonnovel_kmers;
@@ -188,14 +340,17 @@ static void load_read(const read_t *r, uint8_t qual_cutoff, uint8_t hp_cutoff,
   stats->num_bad_reads += (num_contigs == 0);
 }
 
-// Stats must be private to this thread
-void build_graph_from_reads_mt(read_t *r1, read_t *r2,
-                               uint8_t fq_offset1, uint8_t fq_offset2,
-                               const SeqLoadingPrefs *prefs,
-                               SeqLoadingStats *stats,
-                               dBGraph *db_graph)
+// Stats and covgbuf must be private to this thread
+static void _build_graph_from_reads_mt(read_t *r1, read_t *r2,
+                                       uint8_t fq_offset1, uint8_t fq_offset2,
+                                       const SeqLoadingPrefs *prefs,
+                                       SeqLoadingStats *stats,
+                                       CovgBuffer *covgbuf,
+                                       dBGraph *db_graph)
 {
   ctx_assert(!prefs->must_exist_in_graph || !prefs->remove_pcr_dups);
+  ctx_assert(!prefs->bloom || !prefs->remove_pcr_dups);
+  KmerBloom *bloom = prefs->must_exist_in_graph ? NULL : prefs->bloom;
   // status("r1: '%s' '%s'", r1->name.b, r1->seq.b);
   // if(r2) status("r2: '%s' '%s'", r2->name.b, r2->seq.b);
 
@@ -224,12 +379,23 @@ void build_graph_from_reads_mt(read_t *r1, read_t *r2,
   }
   else {
     load_read(r1, fq_cutoff1, prefs->hp_cutoff, prefs->must_exist_in_graph,
-              prefs->colour, stats, db_graph);
+              bloom, covgbuf, prefs->colour, stats, db_graph);
     if(r2) load_read(r2, fq_cutoff2, prefs->hp_cutoff, prefs->must_exist_in_graph,
-                     prefs->colour, stats, db_graph);
+                     bloom, covgbuf, prefs->colour, stats, db_graph);
   }
 }
 
+// Stats must be private to this thread
+void build_graph_from_reads_mt(read_t *r1, read_t *r2,
+                               uint8_t fq_offset1, uint8_t fq_offset2,
+                               const SeqLoadingPrefs *prefs,
+                               SeqLoadingStats *stats,
+                               dBGraph *db_graph)
+{
+  _build_graph_from_reads_mt(r1, r2, fq_offset1, fq_offset2, prefs, stats,
+                             NULL, db_graph);
+}
+
 static void add_reads_to_graph(AsyncIOData *data, size_t threadid, void *ptr)
 {
   (void)threadid;
@@ -237,10 +403,10 @@ static void add_reads_to_graph(AsyncIOData *data, size_t threadid, void *ptr)
   const BuildGraphTask *task = (BuildGraphTask*)data->ptr;
   read_t *r2 = data->r2.name.end == 0 && data->r2.seq.end == 0 ? NULL : &data->r2;
 
-  build_graph_from_reads_mt(&data->r1, r2,
-                            data->fq_offset1, data->fq_offset2,
-                            &task->prefs, wrkr->stats,
-                            wrkr->db_graph);
+  _build_graph_from_reads_mt(&data->r1, r2,
+                             data->fq_offset1, data->fq_offset2,
+                             &task->prefs, wrkr->stats, &wrkr->covgbuf,
+                             wrkr->db_graph);
 
   // Print progress
   wrkr->nreads++;
@@ -253,12 +419,24 @@ static void add_reads_to_graph(AsyncIOData *data, size_t threadid, void *ptr)
   }
 }
 
+typedef struct {
+  BuildGraphThread *threads;
+  size_t nthreads;
+} BuildGraphThreads;
+
+// Called before the hash table grows, whilst no worker holds node keys
+static void _flush_covg_buffers(void *arg)
+{
+  const BuildGraphThreads *wrkrs = (const BuildGraphThreads*)arg;
+  size_t i;
+  for(i = 0; i < wrkrs->nthreads; i++)
+    covg_buffer_flush(&wrkrs->threads[i].covgbuf);
+}
+
 // One thread used per input file, nthreads used to add reads to graph
 void build_graph(dBGraph *db_graph, BuildGraphTask *files,
                  size_t nfiles, size_t nthreads)
 {
-  ctx_assert(db_graph->bktlocks != NULL);
-
   // Start async io reading
   AsyncIOInput *async_tasks = ctx_malloc(nfiles * sizeof(AsyncIOInput));
   size_t i, f;
@@ -276,13 +454,22 @@ void build_graph(dBGraph *db_graph, BuildGraphTask *files,
     threads[i].stats = ctx_calloc(nfiles, sizeof(SeqLoadingStats));
     threads[i].db_graph = db_graph;
     threads[i].shared_nreads = &total_nreads;
+    covg_buffer_alloc(&threads[i].covgbuf, db_graph);
   }
 
+  // Buffers are kept across reads, and flushed when the table grows
+  BuildGraphThreads wrkrs = {.threads = threads, .nthreads = nthreads};
+  db_graph_set_grow_flush(db_graph, _flush_covg_buffers, &wrkrs);
+
   asyncio_run_pool(async_tasks, nfiles, add_reads_to_graph,
                    threads, nthreads, sizeof(BuildGraphThread));
 
+  db_graph_set_grow_flush(db_graph, NULL, NULL);
+
   // Merge stats
   for(i = 0; i < nthreads; i++) {
+    covg_buffer_flush(&threads[i].covgbuf);
+    covg_buffer_dealloc(&threads[i].covgbuf);
     for(f = 0; f < nfiles; f++)
       seq_loading_stats_merge(&files[f].stats, &threads[i].stats[f]);
     ctx_free(threads[i].stats);
@@ -384,3 +571,165 @@ void build_graph_task_print_stats(const BuildGraphTask *task)
   status("  num contigs: %s  num kmers: %s novel kmers: %s",
          num_contigs_str, num_kmers_loaded_str, num_kmers_novel_str);
 }
+
+//
+// Estimate number of kmers in input
+//
+
+// Assume this compression ratio for gzipped input when extrapolating
+#define KMER_EST_GZIP_RATIO 4
+
+typedef struct
+{
+  const char *path;
+  size_t kmer_size, max_bases;
+  uint8_t hp_cutoff;
+  KmerHLL hll, half; // sketch of whole sample, and first half of the sample
+  uint64_t nbases, half_nbases, nbytes, est_nbases;
+  bool eof;
+} KmerEstJob;
+
+static bool _file_is_gzip(const char *path)
+{
+  unsigned char magic[2];
+  FILE *fh = fopen(path, "r");
+  if(fh == NULL) return false;
+  size_t n = fread(magic, 1, 2, fh);
+  fclose(fh);
+  return (n == 2 && magic[0] == 0x1f && magic[1] == 0x8b);
+}
+
+static void _estimate_add_contig(KmerHLL *hll, const char *seq, size_t len,
+                                 size_t kmer_size)
+{
+  BinaryKmer bkmer = binary_kmer_from_str(seq, kmer_size);
+  size_t i;
+  kmer_hll_add(hll, binary_kmer_get_key(bkmer, kmer_size));
+  for(i = kmer_size; i < len; i++) {
+    bkmer = binary_kmer_left_shift_add(bkmer, kmer_size, dna_char_to_nuc(seq[i]));
+    kmer_hll_add(hll, binary_kmer_get_key(bkmer, kmer_size));
+  }
+}
+
+static void estimate_nkmers_job(void *arg, size_t threadid)
+{
+  (void)threadid;
+  KmerEstJob *job = (KmerEstJob*)arg;
+  const size_t kmer_size = job->kmer_size;
+  size_t start, end, search_start;
+  bool half_done = false;
+  seq_file_t *sf;
+  read_t r;
+
+  if((sf = seq_open(job->path)) == NULL)
+    die("Cannot open file: %s", job->path);
+  if(seq_read_alloc(&r) == NULL)
+    die("Out of memory");
+
+  while(job->nbases < job->max_bases && seq_read_primary(sf, &r) > 0)
+  {
+    search_start = 0;
+    while((start = seq_contig_start(&r, search_start, kmer_size,
+                                    0, job->hp_cutoff)) < r.seq.end)
+    {
+      end = seq_contig_end(&r, start, kmer_size, 0, job->hp_cutoff,
+                           &search_start);
+      _estimate_add_contig(&job->hll, r.seq.b+start, end-start, kmer_size);
+    }
+
+    // Approximate bytes used by this read in the file
+    job->nbytes += r.name.end + r.seq.end + r.qual.end + (r.qual.end ? 6 : 3);
+    job->nbases += r.seq.end;
+
+    if(!half_done && job->nbases >= job->max_bases / 2) {
+      kmer_hll_copy(&job->half, &job->hll);
+      job->half_nbases = job->nbases;
+      half_done = true;
+    }
+  }
+
+  job->eof = (job->nbases < job->max_bases);
+
+  // Guess total number of bases from the file size
+  job->est_nbases = job->nbases;
+  if(!job->eof && job->nbytes > 0) {
+    double fsize = futil_get_file_size(job->path);
+    if(_file_is_gzip(job->path)) fsize *= KMER_EST_GZIP_RATIO;
+    job->est_nbases = MAX2(job->nbases, (uint64_t)(fsize / job->nbytes * job->nbases));
+  }
+
+  seq_read_dealloc(&r);
+  seq_close(sf);
+}
+
+size_t build_graph_estimate_nkmers(const BuildGraphTask *tasks, size_t ntasks,
+                                   size_t kmer_size, size_t max_bases,
+                                   size_t nthreads)
+{
+  size_t i, f, njobs = 0;
+  KmerEstJob *jobs = ctx_calloc(ntasks*2, sizeof(KmerEstJob));
+
+  for(i = 0; i < ntasks; i++) {
+    for(f = 0; f < 2; f++) {
+      seq_file_t *sf = f ? tasks[i].files.file2 : tasks[i].files.file1;
+      if(sf == NULL) continue;
+      if(strcmp(sf->path, "-") == 0 || futil_get_file_size(sf->path) < 0) {
+        ctx_free(jobs);
+        return SIZE_MAX;
+      }
+      jobs[njobs].path = sf->path;
+      jobs[njobs].hp_cutoff = tasks[i].prefs.hp_cutoff;
+      njobs++;
+    }
+  }
+
+  if(njobs == 0) { ctx_free(jobs); return 0; }
+
+  for(i = 0; i < njobs; i++) {
+    jobs[i].kmer_size = kmer_size;
+    jobs[i].max_bases = MAX2(max_bases / njobs, 1);
+    kmer_hll_alloc(&jobs[i].hll, KMER_HLL_BITS);
+    kmer_hll_alloc(&jobs[i].half, KMER_HLL_BITS);
+  }
+
+  util_run_threads(jobs, njobs, sizeof(KmerEstJob), nthreads,
+                   estimate_nkmers_job);
+
+  // Union of all samples, plus kmers expected in the rest of each file
+  KmerHLL all;
+  kmer_hll_alloc(&all, KMER_HLL_BITS);
+  uint64_t nbases = 0, est_nbases = 0, nsampled, nhalf;
+  double extra = 0;
+
+  for(i = 0; i < njobs; i++) {
+    kmer_hll_merge(&all, &jobs[i].hll);
+    nbases += jobs[i].nbases;
+    est_nbases += jobs[i].est_nbases;
+    if(!jobs[i].eof && jobs[i].nbases > jobs[i].half_nbases) {
+      nsampled = kmer_hll_estimate(&jobs[i].hll);
+      nhalf = kmer_hll_estimate(&jobs[i].half);
+      if(nsampled > nhalf) {
+        extra += (double)(nsampled - nhalf) *
+                 (jobs[i].est_nbases - jobs[i].nbases) /
+                 (jobs[i].nbases - jobs[i].half_nbases);
+      }
+    }
+    kmer_hll_dealloc(&jobs[i].hll);
+    kmer_hll_dealloc(&jobs[i].half);
+  }
+
+  uint64_t nkmers = kmer_hll_estimate(&all) + (uint64_t)extra;
+  nkmers = MIN2(nkmers, est_nbases);
+
+  char nbases_str[50], est_nbases_str[50], nkmers_str[50];
+  ulong_to_str(nbases, nbases_str);
+  ulong_to_str(est_nbases, est_nbases_str);
+  ulong_to_str(nkmers, nkmers_str);
+  status("[estimate] Sampled %s of ~%s bases: ~%s distinct kmers",
+         nbases_str, est_nbases_str, nkmers_str);
+
+  kmer_hll_dealloc(&all);
+  ctx_free(jobs);
+
+  return nkmers;
+}
@@ -14,6 +14,9 @@
 #include "seq_reader.h"
 #include "async_read_io.h"
 #include "seq_loading_stats.h"
+#include "kmer_bloom.h"
+#include "kmer_hll.h"
+#include "covg_buffer.h"
 
 typedef struct
 {
@@ -21,6 +24,8 @@ typedef struct
   ReadMateDir matedir;
   Colour colour;
   bool remove_pcr_dups, must_exist_in_graph;
+  // If not NULL, only add kmers once they have been seen bloom->min_count times
+  KmerBloom *bloom;
 } SeqLoadingPrefs;
 
 typedef struct
@@ -39,7 +44,8 @@ typedef struct
                                                  .hp_cutoff = 0, \
                                                  .matedir = READPAIR_FR, \
                                                  .colour = 0, \
-                                                 .remove_pcr_dups = false}
+                                                 .remove_pcr_dups = false, \
+                                                 .bloom = NULL}
 
 #include "madcrowlib/madcrow_buffer.h"
 madcrow_buffer(build_graph_task_buf, BuildGraphTaskBuffer, BuildGraphTask);
@@ -78,4 +84,34 @@ size_t build_graph_from_str_mt(dBGraph *db_graph, size_t colour,
                                const char *seq, size_t len,
                                bool must_exist_in_graph);
 
+// Threadsafe
+// As build_graph_from_str_mt() but kmers not already in the graph are only
+// added once they have been seen bloom->min_count times. Coverage of new kmers
+// includes the earlier sightings. Edges are only added between kmers in the
+// graph, so edges seen before a kmer is added are lost.
+// Returns number of kmers seen that were not added to the graph as new kmers
+size_t build_graph_from_str_bloom_mt(dBGraph *db_graph, size_t colour,
+                                     const char *seq, size_t len,
+                                     KmerBloom *bloom);
+
+// Threadsafe
+// As build_graph_from_str_mt() but coverage and edge updates are summed in
+// `covgbuf`, which must be private to this thread. Updates are only in the
+// graph once the buffer has been flushed. build_graph() uses one per thread
+// so high copy kmers are not updated by all threads at once. If the graph can
+// grow, buffers must be flushed by a hook set with db_graph_set_grow_flush().
+size_t build_graph_from_str_buf_mt(dBGraph *db_graph, size_t colour,
+                                   const char *seq, size_t len,
+                                   CovgBuffer *covgbuf);
+
+// Estimate the number of distinct kmers in the input of `tasks` by sampling up
+// to `max_bases` bases (split between input files) into HyperLogLog sketches.
+// Kmers in files that are not read to the end are extrapolated from the rate
+// new kmers were seen in the second half of the sample. Ignores quality
+// cutoffs and PCR duplicates so tends to over estimate.
+// Returns SIZE_MAX if an input cannot be read twice (e.g. stdin)
+size_t build_graph_estimate_nkmers(const BuildGraphTask *tasks, size_t ntasks,
+                                   size_t kmer_size, size_t max_bases,
+                                   size_t nthreads);
+
 #endif /* BUILD_GRAPH_H_ */
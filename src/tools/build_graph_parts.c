@@ -0,0 +1,497 @@
+#include "global.h"
+#include "build_graph_parts.h"
+#include "build_graph.h"
+#include "db_graph.h"
+#include "db_node.h"
+#include "seq_reader.h"
+#include "async_read_io.h"
+#include "graph_writer.h"
+#include "graph_file_reader.h"
+#include "util.h"
+#include "file_util.h"
+
+// Flush super-kmers to a partition file once we have this many bytes
+#define BUILD_PARTS_BUF_SIZE (1UL<<16)
+
+// Read super-kmers from a partition file in chunks of this many bytes
+#define BUILD_PARTS_CHUNK_SIZE (16UL<<20)
+
+// Update shared_nreads in steps of 100 to reduce thread interaction
+#define BUILD_PARTS_COUNTER_STEP 100
+
+// Super-kmer record in a partition file:
+//   [uint32_t len][uint32_t colour][char lhs][char rhs][char seq[len]]
+// lhs, rhs are the bases before and after seq, or zero if none
+#define BUILD_PARTS_REC_HDR (2*sizeof(uint32_t)+2)
+
+typedef struct
+{
+  BuildGraphParts *parts;
+  SeqLoadingStats *stats; // [files]
+  StrBuf *bufs; // [nparts] super-kmers waiting to be written
+  uint64_t *mhashes; // hash of each m-mer in a contig
+  size_t *window; // m-mer indices for sliding window minimum
+  uint32_t *kparts; // partition of each kmer in a contig
+  size_t cap, nreads;
+  volatile size_t *shared_nreads;
+} BuildPartsThread;
+
+// A super-kmer read back from a partition file
+typedef struct
+{
+  const char *seq;
+  uint32_t len, colour;
+  char lhs, rhs;
+} BuildPartsRecord;
+
+typedef struct
+{
+  dBGraph *db_graph;
+  const BuildPartsRecord *recs;
+  size_t n;
+} BuildPartsJob;
+
+static void _part_path(const BuildGraphParts *parts, size_t p, const char *ext,
+                       StrBuf *path)
+{
+  strbuf_reset(path);
+  strbuf_sprintf(path, "%s/part%zu.%s", parts->dir, p, ext);
+}
+
+void build_graph_parts_alloc(BuildGraphParts *parts, size_t nparts,
+                             size_t kmer_size, const char *tmp_dir)
+{
+  size_t p;
+  StrBuf path;
+  strbuf_alloc(&path, 256);
+
+  memset(parts, 0, sizeof(*parts));
+  parts->nparts = nparts;
+  parts->kmer_size = kmer_size;
+  parts->mmer_size = MIN2(kmer_size, BUILD_PARTS_MMER_SIZE);
+  parts->chunk_size = BUILD_PARTS_CHUNK_SIZE;
+
+  strbuf_sprintf(&path, "%s/cortex.build.XXXXXX", tmp_dir);
+  if(mkdtemp(path.b) == NULL)
+    die("Cannot create temporary directory in: %s [%s]", tmp_dir, strerror(errno));
+  parts->dir = strdup(path.b);
+
+  parts->fhs = ctx_calloc(nparts, sizeof(FILE*));
+  parts->locks = ctx_calloc(nparts, sizeof(pthread_mutex_t));
+
+  for(p = 0; p < nparts; p++) {
+    _part_path(parts, p, "seq", &path);
+    if((parts->fhs[p] = fopen(path.b, "w+")) == NULL)
+      die("Cannot create temporary file: %s [%s]", path.b, strerror(errno));
+    if(pthread_mutex_init(&parts->locks[p], NULL) != 0)
+      die("Mutex init failed");
+  }
+
+  status("[parts] Writing %zu partitions to: %s", nparts, parts->dir);
+  strbuf_dealloc(&path);
+}
+
+void build_graph_parts_dealloc(BuildGraphParts *parts)
+{
+  size_t p;
+  StrBuf path;
+  strbuf_alloc(&path, 256);
+
+  for(p = 0; p < parts->nparts; p++) {
+    if(parts->fhs[p]) fclose(parts->fhs[p]);
+    pthread_mutex_destroy(&parts->locks[p]);
+    _part_path(parts, p, "seq", &path);
+    unlink(path.b);
+    _part_path(parts, p, "ctx", &path);
+    unlink(path.b);
+  }
+
+  if(rmdir(parts->dir) != 0)
+    warn("Cannot remove temporary directory: %s [%s]", parts->dir, strerror(errno));
+
+  free(parts->dir);
+  ctx_free(parts->fhs);
+  ctx_free(parts->locks);
+  strbuf_dealloc(&path);
+  memset(parts, 0, sizeof(*parts));
+}
+
+//
+// Pass 1: split reads into super-kmers
+//
+
+static inline uint64_t _mmer_hash(uint64_t x)
+{
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdUL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53UL;
+  x ^= x >> 33;
+  return x;
+}
+
+// Minimizer hashes are small, so hash again to pick a partition
+#define _mmer_part(h,nparts) ((uint32_t)(_mmer_hash((h)+1) % (nparts)))
+
+static void parts_flush(BuildPartsThread *wrkr, size_t p)
+{
+  BuildGraphParts *parts = wrkr->parts;
+  StrBuf *buf = &wrkr->bufs[p];
+  if(buf->end == 0) return;
+  pthread_mutex_lock(&parts->locks[p]);
+  if(fwrite(buf->b, 1, buf->end, parts->fhs[p]) != buf->end)
+    die("Cannot write to temporary file: %s [%s]", parts->dir, strerror(errno));
+  pthread_mutex_unlock(&parts->locks[p]);
+  strbuf_reset(buf);
+}
+
+static void parts_write(BuildPartsThread *wrkr, size_t p, Colour colour,
+                        const char *seq, size_t len, char lhs, char rhs)
+{
+  StrBuf *buf = &wrkr->bufs[p];
+  uint32_t hdr[2] = {(uint32_t)len, (uint32_t)colour};
+  strbuf_append_strn(buf, (const char*)hdr, sizeof(hdr));
+  strbuf_append_char(buf, lhs);
+  strbuf_append_char(buf, rhs);
+  strbuf_append_strn(buf, seq, len);
+  if(buf->end >= BUILD_PARTS_BUF_SIZE) parts_flush(wrkr, p);
+}
+
+// Sequence must be entirely ACGT and len >= kmer_size
+static void parts_add_contig(BuildPartsThread *wrkr, const char *seq,
+                             size_t len, Colour colour)
+{
+  const BuildGraphParts *parts = wrkr->parts;
+  const size_t k = parts->kmer_size, m = parts->mmer_size, w = k-m+1;
+  const size_t nmmers = len-m+1, nkmers = len-k+1, mbits = m*2;
+  const uint64_t mask = bitmask64(mbits);
+  size_t i, s, e, head = 0, tail = 0;
+  uint64_t fw = 0, rv = 0;
+  Nucleotide nuc;
+
+  if(len > wrkr->cap) {
+    wrkr->cap = roundup2pow(len);
+    wrkr->mhashes = ctx_reallocarray(wrkr->mhashes, wrkr->cap, sizeof(uint64_t));
+    wrkr->window = ctx_reallocarray(wrkr->window, wrkr->cap, sizeof(size_t));
+    wrkr->kparts = ctx_reallocarray(wrkr->kparts, wrkr->cap, sizeof(uint32_t));
+  }
+
+  // Hash canonical m-mers, so a kmer and its reverse complement get the same
+  // minimizer
+  for(i = 0; i < len; i++) {
+    nuc = dna_char_to_nuc(seq[i]);
+    fw = ((fw << 2) | nuc) & mask;
+    rv = (rv >> 2) | ((uint64_t)dna_nuc_complement(nuc) << (2*(m-1)));
+    if(i+1 >= m) wrkr->mhashes[i+1-m] = _mmer_hash(MIN2(fw, rv));
+  }
+
+  // Sliding window minimum: kmer i contains m-mers i..i+w-1
+  for(i = 0; i < nmmers; i++) {
+    while(tail > head && wrkr->mhashes[wrkr->window[tail-1]] >= wrkr->mhashes[i])
+      tail--;
+    wrkr->window[tail++] = i;
+    if(i+1 >= w) {
+      while(wrkr->window[head] + w <= i) head++;
+      wrkr->kparts[i+1-w] = _mmer_part(wrkr->mhashes[wrkr->window[head]],
+                                       parts->nparts);
+    }
+  }
+
+  // Write runs of kmers in the same partition
+  for(s = 0; s < nkmers; s = e) {
+    for(e = s+1; e < nkmers && wrkr->kparts[e] == wrkr->kparts[s]; e++) {}
+    parts_write(wrkr, wrkr->kparts[s], colour, seq+s, e-s+k-1,
+                s > 0 ? seq[s-1] : 0, e+k-1 < len ? seq[e+k-1] : 0);
+  }
+}
+
+static void parts_add_read(BuildPartsThread *wrkr, const read_t *r,
+                           uint8_t qual_cutoff, uint8_t hp_cutoff,
+                           Colour colour, SeqLoadingStats *stats)
+{
+  const size_t kmer_size = wrkr->parts->kmer_size;
+  size_t contig_start, contig_end, contig_len;
+  size_t num_contigs = 0, search_start = 0;
+
+  while((contig_start = seq_contig_start(r, search_start, kmer_size,
+                                         qual_cutoff, hp_cutoff)) < r->seq.end)
+  {
+    contig_end = seq_contig_end(r, contig_start, kmer_size,
+                                qual_cutoff, hp_cutoff, &search_start);
+    contig_len = contig_end - contig_start;
+    parts_add_contig(wrkr, r->seq.b+contig_start, contig_len, colour);
+
+    stats->total_bases_loaded += contig_len;
+    stats->num_kmers_loaded += contig_len + 1 - kmer_size;
+    num_contigs++;
+  }
+
+  stats->contigs_parsed += num_contigs;
+  stats->num_good_reads += (num_contigs > 0);
+  stats->num_bad_reads += (num_contigs == 0);
+}
+
+static void add_reads_to_parts(AsyncIOData *data, size_t threadid, void *ptr)
+{
+  (void)threadid;
+  BuildPartsThread *wrkr = (BuildPartsThread*)ptr;
+  const BuildGraphTask *task = (BuildGraphTask*)data->ptr;
+  const SeqLoadingPrefs *prefs = &task->prefs;
+  SeqLoadingStats *stats = &wrkr->stats[task->idx];
+  read_t *r1 = &data->r1;
+  read_t *r2 = data->r2.name.end == 0 && data->r2.seq.end == 0 ? NULL : &data->r2;
+
+  uint8_t fq_cutoff1 = prefs->fq_cutoff, fq_cutoff2 = prefs->fq_cutoff;
+
+  if(prefs->fq_cutoff) {
+    fq_cutoff1 += data->fq_offset1;
+    fq_cutoff2 += data->fq_offset2;
+  }
+
+  stats->total_bases_read += r1->seq.end + (r2 ? r2->seq.end : 0);
+  if(r2) stats->num_pe_reads += 2;
+  else   stats->num_se_reads += 1;
+
+  parts_add_read(wrkr, r1, fq_cutoff1, prefs->hp_cutoff, prefs->colour, stats);
+  if(r2) parts_add_read(wrkr, r2, fq_cutoff2, prefs->hp_cutoff, prefs->colour, stats);
+
+  // Print progress
+  wrkr->nreads++;
+  if(wrkr->nreads >= BUILD_PARTS_COUNTER_STEP) {
+    size_t n = __sync_fetch_and_add(wrkr->shared_nreads, wrkr->nreads);
+    ctx_update2("BuildParts", n, n+wrkr->nreads, CTX_UPDATE_REPORT_RATE);
+    wrkr->nreads = 0;
+  }
+}
+
+// One thread used per input file, nthreads used to split reads
+void build_graph_parts_load(BuildGraphParts *parts, dBGraph *db_graph,
+                            BuildGraphTask *files, size_t nfiles,
+                            size_t nthreads)
+{
+  AsyncIOInput *async_tasks = ctx_malloc(nfiles * sizeof(AsyncIOInput));
+  size_t i, f, p;
+
+  for(f = 0; f < nfiles; f++) {
+    ctx_assert(!files[f].prefs.remove_pcr_dups);
+    ctx_assert(!files[f].prefs.must_exist_in_graph);
+    files[f].idx = f;
+    files[f].files.ptr = &files[f];
+    memcpy(&async_tasks[f], &files[f].files, sizeof(AsyncIOInput));
+  }
+
+  BuildPartsThread *threads = ctx_calloc(nthreads, sizeof(BuildPartsThread));
+  size_t total_nreads = 0;
+
+  for(i = 0; i < nthreads; i++) {
+    threads[i].parts = parts;
+    threads[i].stats = ctx_calloc(nfiles, sizeof(SeqLoadingStats));
+    threads[i].bufs = ctx_calloc(parts->nparts, sizeof(StrBuf));
+    for(p = 0; p < parts->nparts; p++)
+      strbuf_alloc(&threads[i].bufs[p], BUILD_PARTS_BUF_SIZE + 1024);
+    threads[i].shared_nreads = &total_nreads;
+  }
+
+  asyncio_run_pool(async_tasks, nfiles, add_reads_to_parts,
+                   threads, nthreads, sizeof(BuildPartsThread));
+
+  // Flush buffers, merge stats
+  for(i = 0; i < nthreads; i++) {
+    for(p = 0; p < parts->nparts; p++) {
+      parts_flush(&threads[i], p);
+      strbuf_dealloc(&threads[i].bufs[p]);
+    }
+    for(f = 0; f < nfiles; f++)
+      seq_loading_stats_merge(&files[f].stats, &threads[i].stats[f]);
+    ctx_free(threads[i].stats);
+    ctx_free(threads[i].bufs);
+    ctx_free(threads[i].mhashes);
+    ctx_free(threads[i].window);
+    ctx_free(threads[i].kparts);
+  }
+  ctx_free(threads);
+  ctx_free(async_tasks);
+
+  // Copy stats into ginfo
+  size_t max_col = 0;
+  for(f = 0; f < nfiles; f++) {
+    max_col = MAX2(max_col, files[f].prefs.colour);
+    graph_info_update_stats(&db_graph->ginfo[files[f].prefs.colour],
+                            &files[f].stats);
+  }
+
+  db_graph->num_of_cols_used = MAX2(db_graph->num_of_cols_used, max_col+1);
+}
+
+//
+// Pass 2: build each partition
+//
+
+// Add super-kmers to the graph, with the edges to the bases either side
+static void parts_build_job(void *arg, size_t threadid)
+{
+  (void)threadid;
+  BuildPartsJob *job = (BuildPartsJob*)arg;
+  dBGraph *db_graph = job->db_graph;
+  const size_t kmer_size = db_graph->kmer_size;
+  size_t i, col;
+  dBNode node;
+
+  for(i = 0; i < job->n; i++)
+  {
+    const BuildPartsRecord *rec = &job->recs[i];
+    build_graph_from_str_mt(db_graph, rec->colour, rec->seq, rec->len, false);
+    col = db_graph->num_edge_cols == 1 ? 0 : rec->colour;
+
+    // Hold node keys only while the hash table cannot grow
+    db_graph_grow_enter(db_graph);
+    if(rec->lhs) {
+      node = db_graph_find_str(db_graph, rec->seq);
+      db_node_set_col_edge_mt(db_graph, node.key, col,
+                              dna_nuc_complement(dna_char_to_nuc(rec->lhs)),
+                              !node.orient);
+    }
+    if(rec->rhs) {
+      node = db_graph_find_str(db_graph, rec->seq + rec->len - kmer_size);
+      db_node_set_col_edge_mt(db_graph, node.key, col,
+                              dna_char_to_nuc(rec->rhs), node.orient);
+    }
+    db_graph_grow_exit(db_graph);
+  }
+}
+
+static void parts_build_records(dBGraph *db_graph, const BuildPartsRecord *recs,
+                                size_t nrecs, size_t nthreads)
+{
+  size_t i, njobs = MIN2(nrecs, nthreads*16), per_job;
+  if(nrecs == 0) return;
+  per_job = (nrecs + njobs - 1) / njobs;
+  njobs = (nrecs + per_job - 1) / per_job;
+
+  BuildPartsJob *jobs = ctx_calloc(njobs, sizeof(BuildPartsJob));
+  for(i = 0; i < njobs; i++) {
+    jobs[i].db_graph = db_graph;
+    jobs[i].recs = recs + i*per_job;
+    jobs[i].n = MIN2(per_job, nrecs - i*per_job);
+  }
+
+  util_run_threads(jobs, njobs, sizeof(BuildPartsJob), nthreads,
+                   parts_build_job);
+
+  ctx_free(jobs);
+}
+
+// Load all super-kmers from a partition file into the graph
+static void parts_build_graph(BuildGraphParts *parts, size_t p,
+                              dBGraph *db_graph, size_t nthreads)
+{
+  FILE *fh = parts->fhs[p];
+  size_t memcap = parts->chunk_size, memlen = 0, i, nrecs = 0, reccap = 1024;
+  char *mem = ctx_malloc(memcap);
+  BuildPartsRecord *recs = ctx_malloc(reccap * sizeof(BuildPartsRecord));
+  char hdr[BUILD_PARTS_REC_HDR];
+  uint32_t len, colour;
+  size_t n;
+
+  if(fseek(fh, 0, SEEK_SET) != 0) die("fseek failed: %s", strerror(errno));
+
+  while(1)
+  {
+    n = fread(hdr, 1, sizeof(hdr), fh);
+    if(n != 0 && n != sizeof(hdr))
+      die("Truncated temporary file: %s", parts->dir);
+
+    if(n) memcpy(&len, hdr, sizeof(uint32_t));
+
+    if(n == 0 || memlen + len > memcap) {
+      // Add records in this chunk to the graph
+      // (record pointers are offsets until then, since mem may move)
+      for(i = 0; i < nrecs; i++) recs[i].seq = mem + (size_t)recs[i].seq;
+      parts_build_records(db_graph, recs, nrecs, nthreads);
+      memlen = nrecs = 0;
+      if(n == 0) break;
+    }
+
+    memcpy(&colour, hdr+sizeof(uint32_t), sizeof(uint32_t));
+
+    // Only grow for a single record larger than the chunk
+    if(len > memcap) {
+      memcap = len;
+      mem = ctx_realloc(mem, memcap);
+    }
+    if(nrecs == reccap) {
+      reccap *= 2;
+      recs = ctx_reallocarray(recs, reccap, sizeof(BuildPartsRecord));
+    }
+    if(fread(mem+memlen, 1, len, fh) != len)
+      die("Truncated temporary file: %s", parts->dir);
+
+    recs[nrecs++] = (BuildPartsRecord){.seq = (const char*)memlen,
+                                       .len = len, .colour = colour,
+                                       .lhs = hdr[2*sizeof(uint32_t)],
+                                       .rhs = hdr[2*sizeof(uint32_t)+1]};
+    memlen += len;
+  }
+
+  ctx_free(recs);
+  ctx_free(mem);
+}
+
+uint64_t build_graph_parts_save(BuildGraphParts *parts, dBGraph *db_graph,
+                                const GraphFileHeader *hdr, size_t nthreads,
+                                const char *out_path)
+{
+  size_t p, nparts = parts->nparts;
+  uint64_t nkmers, max_part_kmers = 0;
+  StrBuf path;
+  strbuf_alloc(&path, 256);
+
+  FileFilter fltr;
+  memset(&fltr, 0, sizeof(fltr));
+  file_filter_create_direct(&fltr, db_graph->num_of_cols, hdr->num_of_cols);
+
+  GraphFileReader *gfiles = ctx_calloc(nparts, sizeof(GraphFileReader));
+
+  for(p = 0; p < nparts; p++)
+  {
+    status("[parts] Building partition %zu of %zu", p+1, nparts);
+    db_graph_reset(db_graph, nthreads);
+    parts_build_graph(parts, p, db_graph, nthreads);
+    max_part_kmers = MAX2(max_part_kmers, hash_table_nkmers(&db_graph->ht));
+
+    // Super-kmers no longer needed
+    fclose(parts->fhs[p]);
+    parts->fhs[p] = NULL;
+    _part_path(parts, p, "seq", &path);
+    unlink(path.b);
+
+    _part_path(parts, p, "ctx", &path);
+    graph_writer_save(path.b, db_graph, hdr, true, &fltr);
+  }
+
+  db_graph_reset(db_graph, nthreads);
+
+  char nkmers_str[50];
+  ulong_to_str(max_part_kmers, nkmers_str);
+  status("[parts] Largest partition: %s kmers", nkmers_str);
+
+  // Merge sorted partitions
+  for(p = 0; p < nparts; p++) {
+    _part_path(parts, p, "ctx", &path);
+    graph_file_open(&gfiles[p], path.b);
+  }
+
+  nkmers = graph_writer_merge_sorted(out_path, gfiles, nparts, hdr);
+
+  for(p = 0; p < nparts; p++) {
+    graph_file_close(&gfiles[p]);
+    _part_path(parts, p, "ctx", &path);
+    unlink(path.b);
+  }
+
+  ctx_free(gfiles);
+  file_filter_close(&fltr);
+  strbuf_dealloc(&path);
+
+  return nkmers;
+}
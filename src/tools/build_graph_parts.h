@@ -0,0 +1,60 @@
+#ifndef BUILD_GRAPH_PARTS_H_
+#define BUILD_GRAPH_PARTS_H_
+
+#include <pthread.h>
+
+#include "db_graph.h"
+#include "build_graph.h"
+#include "graph_format.h"
+
+//
+// Build a graph out-of-core by partitioning kmers on disk
+//
+// Pass 1: reads are split into super-kmers: runs of consecutive kmers that
+// share a minimizer (the smallest canonical m-mer, by hash). Each super-kmer
+// is written to the partition file picked by its minimizer, with the bases
+// either side of it so edges leaving the super-kmer are not lost. A kmer and
+// its reverse complement have the same minimizer so are always in the same
+// partition.
+//
+// Pass 2: each partition is loaded into the (empty) hash table on its own and
+// saved as a sorted graph file. The sorted partitions are then merged into
+// the output graph, which is therefore sorted.
+//
+// The hash table only needs to hold the kmers of the largest partition.
+//
+
+#define BUILD_PARTS_MMER_SIZE 15
+#define BUILD_PARTS_MAX 512 /* one open file per partition */
+
+typedef struct
+{
+  size_t nparts, kmer_size, mmer_size;
+  size_t chunk_size; // bytes of super-kmers added to the graph at once
+  char *dir; // temporary directory holding partition files
+  FILE **fhs; // super-kmer file for each partition
+  pthread_mutex_t *locks; // one lock per partition file
+} BuildGraphParts;
+
+// Creates a new temporary directory in `tmp_dir`
+void build_graph_parts_alloc(BuildGraphParts *parts, size_t nparts,
+                             size_t kmer_size, const char *tmp_dir);
+
+// Removes temporary files and directory
+void build_graph_parts_dealloc(BuildGraphParts *parts);
+
+// Pass 1: write super-kmers from reads to partition files
+// One thread used per input file, nthreads used to split reads
+// Updates stats and ginfo
+void build_graph_parts_load(BuildGraphParts *parts, dBGraph *db_graph,
+                            BuildGraphTask *files, size_t nfiles,
+                            size_t nthreads);
+
+// Pass 2: build each partition in db_graph, save it sorted then merge all
+// partitions into out_path. `hdr` is the header of the output file.
+// db_graph is emptied between partitions. Returns number of kmers written.
+uint64_t build_graph_parts_save(BuildGraphParts *parts, dBGraph *db_graph,
+                                const GraphFileHeader *hdr, size_t nthreads,
+                                const char *out_path);
+
+#endif /* BUILD_GRAPH_PARTS_H_ */
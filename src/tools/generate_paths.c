@@ -14,6 +14,7 @@
 #include "seq_reader.h"
 #include "binary_seq.h"
 #include "gpath_checks.h"
+#include "gpath_batch.h"
 
 //
 // Multithreaded code to add paths to the graph from sequence data
@@ -41,6 +42,9 @@ struct GenPathWorker
 
   CorrectAlnWorker corrector;
 
+  // New links are collected here then added to db_graph->gphash
+  GPathBatch linkbatch;
+
   // Nucleotides and positions of junctions
   // only one array allocated for each type, rev points to half way through
   uint8_t *pck_fw, *pck_rv;
@@ -61,7 +65,8 @@ size_t gen_paths_worker_est_mem(const dBGraph *db_graph)
   junc_mem = 2 * INIT_BUFLEN * (sizeof(Nucleotide)+sizeof(size_t));
   packed_mem = INIT_BUFLEN;
 
-  return job_mem + corrector_mem + junc_mem + packed_mem + sizeof(GenPathWorker);
+  return job_mem + corrector_mem + junc_mem + packed_mem + gpath_batch_mem() +
+         sizeof(GenPathWorker);
 }
 
 // GenPathWorker stores four buffers of size n
@@ -72,6 +77,7 @@ static void _gen_paths_worker_alloc(GenPathWorker *wrkr, dBGraph *db_graph)
   GenPathWorker tmp = {.db_graph = db_graph};
 
   correct_aln_worker_alloc(&tmp.corrector, true, db_graph);
+  gpath_batch_alloc(&tmp.linkbatch, &db_graph->gphash);
 
   // Junction data
   // only fw arrays are malloc'd, rv point to fw
@@ -89,6 +95,7 @@ static void _gen_paths_worker_alloc(GenPathWorker *wrkr, dBGraph *db_graph)
 static void _gen_paths_worker_dealloc(GenPathWorker *wrkr)
 {
   correct_aln_worker_dealloc(&wrkr->corrector);
+  gpath_batch_dealloc(&wrkr->linkbatch);
   ctx_free(wrkr->pck_fw);
   ctx_free(wrkr->pos_fw);
 }
@@ -160,7 +167,6 @@ static inline size_t _juncs_to_paths(const size_t *restrict pos_pl,
 {
   dBGraph *db_graph = wrkr->db_graph;
   const size_t ctpcol = wrkr->task.crt_params.ctpcol;
-  GPathSet *gpset = &db_graph->gphash.gpstore->gpset;
 
   size_t i, num_added = 0;
   dBNode node;
@@ -244,7 +250,6 @@ static inline size_t _juncs_to_paths(const size_t *restrict pos_pl,
     uint8_t top_byte = packed_ptr[top_idx];
     packed_ptr[top_idx] &= 0xff >> (8 - bits_in_top_byte(plen));
 
-    bool found = false;
     GPathNew newgpath = {.seq = packed_ptr,
                          .orient = node.orient, .num_juncs = plen,
                          .colset = NULL, .nseen = NULL};
@@ -260,22 +265,11 @@ static inline size_t _juncs_to_paths(const size_t *restrict pos_pl,
     //          kmerstr, node.orient, start_pl, start_mn, pos_mn[start_mn]);
     // #endif
 
-    GPath *gpath = gpath_hash_find_or_insert_mt(&db_graph->gphash, node.key,
-                                                newgpath, &found);
-
-    // Add colour
-    bitset_set(gpath_get_colset(gpath, gpset->ncols), ctpcol);
-    uint8_t *nseen = gpath_set_get_nseen(gpset, gpath);
-    if(nseen != NULL) safe_add_uint8_mt(&nseen[ctpcol], 1);
+    // Colour and count are set when the batch is added to the hash
+    gpath_batch_add(&wrkr->linkbatch, node.key, newgpath, ctpcol);
 
     packed_ptr[top_idx] = top_byte; // restore top byte
 
-    #ifdef CTXVERBOSE
-      printf("We %s\n", found ? "abandoned" : "added");
-    #endif
-
-    // If the path already exists, all of its subpaths also already exist
-    // if(found && plen < GPATH_MAX_JUNCS) break;
     num_added++;
 
     // Debugging
@@ -457,6 +451,13 @@ static void generate_paths_worker(AsyncIOData *data, size_t threadid, void *ptr)
   }
 }
 
+static void gen_paths_worker_flush(void *ptr, size_t threadid)
+{
+  (void)threadid;
+  GenPathWorker *wrkr = (GenPathWorker*)ptr;
+  gpath_batch_flush(&wrkr->linkbatch);
+}
+
 void gen_paths_worker_seq(GenPathWorker *wrkr, AsyncIOData *data,
                           const CorrectAlnInput *task)
 {
@@ -465,6 +466,7 @@ void gen_paths_worker_seq(GenPathWorker *wrkr, AsyncIOData *data,
   memcpy(&wrkr->task, task, sizeof(CorrectAlnInput));
 
   reads_to_paths(wrkr);
+  gpath_batch_flush(&wrkr->linkbatch);
 }
 
 // Function used in tests
@@ -512,6 +514,10 @@ void generate_paths(CorrectAlnInput *tasks, size_t num_inputs,
 
   ctx_free(asyncio_tasks);
 
+  // Add links still held by workers
+  util_run_threads(workers, num_workers, sizeof(GenPathWorker),
+                   num_workers, gen_paths_worker_flush);
+
   // Merge stats into workers[0]
   for(i = 1; i < num_workers; i++)
     correct_aln_merge_stats(&workers[0].corrector, &workers[i].corrector);